@@ -0,0 +1,154 @@
+// Portable IMA ADPCM decoder
+//
+// Decodes WAV files in the Microsoft IMA ADPCM layout (format tag 0x11, e.g.
+// "sox in.wav -e ima-adpcm out.wav") into an in-memory 16-bit PCM WAV file
+// that can be played directly with PlaySound(SND_MEMORY). Plain PCM WAV
+// input is copied unchanged.
+#ifndef IMA_ADPCM_H
+#define IMA_ADPCM_H
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define WAVE_FORMAT_PCM_TAG 0x0001
+#define WAVE_FORMAT_IMA_ADPCM_TAG 0x0011
+
+static const int ima_index_table[16] = {
+    -1, -1, -1, -1, 2, 4, 6, 8,
+    -1, -1, -1, -1, 2, 4, 6, 8
+};
+
+static const int ima_step_table[89] = {
+    7, 8, 9, 10, 11, 12, 13, 14, 16, 17, 19, 21, 23, 25, 28, 31, 34, 37, 41, 45,
+    50, 55, 60, 66, 73, 80, 88, 97, 107, 118, 130, 143, 157, 173, 190, 209, 230,
+    253, 279, 307, 337, 371, 408, 449, 494, 544, 598, 658, 724, 796, 876, 963,
+    1060, 1166, 1282, 1411, 1552, 1707, 1878, 2066, 2272, 2499, 2749, 3024, 3327,
+    3660, 4026, 4428, 4871, 5358, 5894, 6484, 7132, 7845, 8630, 9493, 10442, 11487,
+    12635, 13899, 15289, 16818, 18500, 20350, 22385, 24623, 27086, 29794, 32767
+};
+
+static inline uint16_t ima_rd16(const uint8_t* p) { return (uint16_t)(p[0] | (p[1] << 8)); }
+static inline uint32_t ima_rd32(const uint8_t* p) { return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24); }
+static inline void ima_wr16(uint8_t* p, uint32_t v) { p[0] = (uint8_t)v; p[1] = (uint8_t)(v >> 8); }
+static inline void ima_wr32(uint8_t* p, uint32_t v) { ima_wr16(p, v); ima_wr16(p + 2, v >> 16); }
+
+// Decode one nibble and update the channel state
+static inline int16_t ima_decode_nibble(int nibble, int* predictor, int* index) {
+    int step = ima_step_table[*index];
+    int diff = step >> 3;
+    if (nibble & 1) diff += step >> 2;
+    if (nibble & 2) diff += step >> 1;
+    if (nibble & 4) diff += step;
+    if (nibble & 8) diff = -diff;
+    *predictor += diff;
+    if (*predictor > 32767) *predictor = 32767;
+    if (*predictor < -32768) *predictor = -32768;
+    *index += ima_index_table[nibble];
+    if (*index < 0) *index = 0;
+    if (*index > 88) *index = 88;
+    return (int16_t)*predictor;
+}
+
+// Find a RIFF chunk; returns its data or NULL
+static inline const uint8_t* ima_find_chunk(const uint8_t* wav, size_t size, const char* id, uint32_t* chunk_size) {
+    if (size < 12 || memcmp(wav, "RIFF", 4) != 0 || memcmp(wav + 8, "WAVE", 4) != 0) return NULL;
+    size_t pos = 12;
+    while (pos + 8 <= size) {
+        uint32_t len = ima_rd32(wav + pos + 4);
+        if (memcmp(wav + pos, id, 4) == 0) {
+            if (len > size - pos - 8) len = (uint32_t)(size - pos - 8);
+            *chunk_size = len;
+            return wav + pos + 8;
+        }
+        pos += 8 + (size_t)len + (len & 1);
+    }
+    return NULL;
+}
+
+// Decode a WAV file into a newly allocated 16-bit PCM WAV file.
+// Returns the size of *out (free with free()), or 0 if the input is not supported.
+static inline size_t ima_adpcm_decode_wav(const void* input, size_t size, uint8_t** out) {
+    const uint8_t* wav = (const uint8_t*)input;
+    uint32_t fmt_size = 0, data_size = 0;
+    const uint8_t* fmt = ima_find_chunk(wav, size, "fmt ", &fmt_size);
+    const uint8_t* data = ima_find_chunk(wav, size, "data", &data_size);
+    *out = NULL;
+    if (!fmt || !data || fmt_size < 16) return 0;
+
+    uint16_t tag = ima_rd16(fmt);
+    int channels = ima_rd16(fmt + 2);
+    uint32_t rate = ima_rd32(fmt + 4);
+    int block_align = ima_rd16(fmt + 12);
+    if (channels < 1 || channels > 2) return 0;
+
+    if (tag == WAVE_FORMAT_PCM_TAG) {
+        *out = (uint8_t*)malloc(size);
+        if (!*out) return 0;
+        memcpy(*out, wav, size);
+        return size;
+    }
+    if (tag != WAVE_FORMAT_IMA_ADPCM_TAG || block_align <= 4 * channels) return 0;
+
+    // Each block: a 4-byte header per channel, then 4-byte groups of 8 nibbles per channel
+    size_t samples_per_block = (size_t)(block_align - 4 * channels) * 2 / channels + 1;
+    size_t blocks = (data_size + block_align - 1) / block_align;
+    size_t max_samples = blocks * samples_per_block;
+    size_t pcm_size = max_samples * channels * 2;
+    uint8_t* result = (uint8_t*)malloc(44 + pcm_size);
+    if (!result) return 0;
+    int16_t* pcm = (int16_t*)(result + 44);
+
+    size_t frames = 0;
+    for (size_t b = 0; b < blocks; b++) {
+        const uint8_t* block = data + b * block_align;
+        size_t len = data_size - b * block_align;
+        if (len > (size_t)block_align) len = block_align;
+        if (len < (size_t)(4 * channels)) break;
+
+        int predictor[2], index[2];
+        for (int c = 0; c < channels; c++) {
+            predictor[c] = (int16_t)ima_rd16(block + 4 * c);
+            index[c] = block[4 * c + 2];
+            if (index[c] > 88) index[c] = 88;
+            pcm[(frames) * channels + c] = (int16_t)predictor[c];
+        }
+        frames++;
+
+        const uint8_t* p = block + 4 * channels;
+        const uint8_t* end = block + len;
+        while (p + 4 * channels <= end) {
+            for (int c = 0; c < channels; c++) {
+                for (int i = 0; i < 8; i++) {
+                    int nibble = (p[i >> 1] >> ((i & 1) * 4)) & 0x0F;
+                    pcm[(frames + i) * channels + c] = ima_decode_nibble(nibble, &predictor[c], &index[c]);
+                }
+                p += 4;
+            }
+            frames += 8;
+        }
+    }
+
+    // The fact chunk holds the exact sample count; the last block is padded
+    uint32_t fact_size = 0;
+    const uint8_t* fact = ima_find_chunk(wav, size, "fact", &fact_size);
+    if (fact && fact_size >= 4 && ima_rd32(fact) < frames) frames = ima_rd32(fact);
+
+    uint32_t bytes = (uint32_t)(frames * channels * 2);
+    memcpy(result, "RIFF", 4);
+    ima_wr32(result + 4, 36 + bytes);
+    memcpy(result + 8, "WAVEfmt ", 8);
+    ima_wr32(result + 16, 16);
+    ima_wr16(result + 20, WAVE_FORMAT_PCM_TAG);
+    ima_wr16(result + 22, (uint32_t)channels);
+    ima_wr32(result + 24, rate);
+    ima_wr32(result + 28, rate * channels * 2);
+    ima_wr16(result + 32, (uint32_t)channels * 2);
+    ima_wr16(result + 34, 16);
+    memcpy(result + 36, "data", 4);
+    ima_wr32(result + 40, bytes);
+    *out = result;
+    return 44 + bytes;
+}
+
+#endif
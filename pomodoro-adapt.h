@@ -0,0 +1,132 @@
+// Pomodoro Timer adaptive durations
+//
+// For each hour of the day the timer keeps a few running statistics about the
+// Pomodoros started in it: how often they are finished (an exponentially
+// weighted average), and when they are stopped early (the weighted mean and
+// variance of the stop time, and a histogram of 5 minute bins). Each finished
+// session updates them in constant time, and the whole model is 24 fixed-size
+// records, about 1 KB on disk.
+//
+// A shorter Pomodoro is suggested for an hour only when there is enough
+// history, most Pomodoros of that hour are stopped, and the stops cluster
+// around the same point (most fall near the mean and vary little around it);
+// the suggestion is a little past that point, rounded to 5 minutes. Otherwise
+// the configured duration stands.
+#ifndef POMODORO_ADAPT_H
+#define POMODORO_ADAPT_H
+
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#endif
+
+#define ADAPT_MAGIC 0x32504441 // "ADP2"
+#define ADAPT_HOURS 24
+#define ADAPT_BIN_MINUTES 5
+#define ADAPT_BINS 24              // up to the 120 minutes the settings allow
+#define ADAPT_ALPHA 0.1f           // weight of the newest session
+#define ADAPT_MIN_SESSIONS 8       // before an hour gets suggestions
+#define ADAPT_MAX_COMPLETION 0.7f  // suggest only when fewer are finished
+#define ADAPT_MIN_CLUSTER 0.67f    // share of the stops within a bin of the mean stop
+#define ADAPT_MAX_SPREAD 0.3f      // standard deviation of the stop time over its mean
+#define ADAPT_MIN_MINUTES 10
+#define ADAPT_MIN_STOP_SECONDS 60  // shorter stops are misclicks, not abort points
+
+typedef struct {
+    uint32_t sessions;           // Pomodoros started in this hour
+    uint32_t stops;              // of which stopped early
+    float completion;            // weighted share of finished Pomodoros
+    float stop_mean, stop_var;   // weighted mean and variance of the stop time, in minutes
+    uint8_t stop_bins[ADAPT_BINS];
+} AdaptHour;
+
+typedef struct {
+    AdaptHour hours[ADAPT_HOURS];
+    uint32_t synced;             // records of the sync journal included (pomodoro-sync.h)
+} AdaptModel;
+
+// Count a finished Pomodoro that started in the given local hour
+static inline void adapt_record(AdaptModel* m, int hour, int actual_seconds, int completed) {
+    if (hour < 0 || hour >= ADAPT_HOURS) return;
+    if (!completed && actual_seconds < ADAPT_MIN_STOP_SECONDS) return;
+    AdaptHour* h = &m->hours[hour];
+    float done = completed ? 1.0f : 0.0f;
+    h->completion = h->sessions ? h->completion + ADAPT_ALPHA * (done - h->completion) : done;
+    h->sessions++;
+    if (completed) return;
+
+    float minutes = actual_seconds / 60.0f;
+    if (h->stops == 0) {
+        h->stop_mean = minutes;
+        h->stop_var = 0;
+    } else {
+        float diff = minutes - h->stop_mean;
+        float step = ADAPT_ALPHA * diff;
+        h->stop_mean += step;
+        h->stop_var = (1.0f - ADAPT_ALPHA) * (h->stop_var + diff * step);
+    }
+    h->stops++;
+
+    int bin = (int)(minutes / ADAPT_BIN_MINUTES);
+    if (bin >= ADAPT_BINS) bin = ADAPT_BINS - 1;
+    // A full bin halves them all, which also lets old stops fade
+    if (h->stop_bins[bin] == UINT8_MAX) {
+        for (int i = 0; i < ADAPT_BINS; i++) h->stop_bins[i] /= 2;
+    }
+    h->stop_bins[bin]++;
+}
+
+// Pomodoro minutes to use in the given local hour; configured_minutes when there is nothing to suggest
+static inline int adapt_suggest(const AdaptModel* m, int hour, int configured_minutes) {
+    if (hour < 0 || hour >= ADAPT_HOURS) return configured_minutes;
+    const AdaptHour* h = &m->hours[hour];
+    if (h->sessions < ADAPT_MIN_SESSIONS || h->completion >= ADAPT_MAX_COMPLETION) return configured_minutes;
+
+    int center = (int)(h->stop_mean / ADAPT_BIN_MINUTES), near = 0, total = 0;
+    for (int i = 0; i < ADAPT_BINS; i++) {
+        total += h->stop_bins[i];
+        if (i >= center - 1 && i <= center + 1) near += h->stop_bins[i];
+    }
+    float spread = sqrtf(h->stop_var);
+    if (total == 0 || near < ADAPT_MIN_CLUSTER * total || spread > ADAPT_MAX_SPREAD * h->stop_mean) {
+        return configured_minutes;
+    }
+
+    float target = h->stop_mean + spread;
+    int minutes = (int)(target / ADAPT_BIN_MINUTES + 0.5f) * ADAPT_BIN_MINUTES;
+    if (minutes < ADAPT_MIN_MINUTES) minutes = ADAPT_MIN_MINUTES;
+    return minutes < configured_minutes ? minutes : configured_minutes;
+}
+
+// Load a saved model; returns 0 if the file is missing or not a model
+static inline int adapt_load(AdaptModel* m, const char* path) {
+    memset(m, 0, sizeof(*m));
+    FILE* fp = fopen(path, "rb");
+    if (!fp) return 0;
+    uint32_t magic = 0;
+    int ok = fread(&magic, sizeof(magic), 1, fp) == 1 && magic == ADAPT_MAGIC && fread(m, sizeof(*m), 1, fp) == 1;
+    fclose(fp);
+    if (!ok) memset(m, 0, sizeof(*m));
+    return ok;
+}
+
+static inline int adapt_save(const AdaptModel* m, const char* path) {
+    char tmp[1024];
+    if (snprintf(tmp, sizeof(tmp), "%s.tmp", path) >= (int)sizeof(tmp)) return 0;
+    FILE* fp = fopen(tmp, "wb");
+    if (!fp) return 0;
+    uint32_t magic = ADAPT_MAGIC;
+    int ok = fwrite(&magic, sizeof(magic), 1, fp) == 1 && fwrite(m, sizeof(*m), 1, fp) == 1;
+    if (fclose(fp) != 0) ok = 0;
+#ifdef _WIN32
+    return ok && MoveFileExA(tmp, path, MOVEFILE_REPLACE_EXISTING);
+#else
+    return ok && rename(tmp, path) == 0;
+#endif
+}
+
+#endif
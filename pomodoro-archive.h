@@ -0,0 +1,549 @@
+// Pomodoro Timer history archive
+//
+// Finished sessions are appended to a row-per-line CSV log. Old rows are
+// moved from the front of the log into a columnar archive, so queries over
+// years of history read a fraction of the bytes and loop over flat arrays.
+//
+// The archive is a header followed by blocks of up to ARCHIVE_BLOCK_ROWS
+// sessions. Each block stores its columns one after the other:
+//   start     32-bit delta from the block's smallest start time
+//   planned   seconds, 2 or 4 bytes per value depending on the block
+//   actual    seconds, same width
+//   codes     kind | outcome << 2, two 4-bit codes per byte
+//   focus     percent, 255 when there is none
+//   labels    the block's distinct label ids, then a 1 or 2 byte index per row
+// The block header keeps the min/max start time and actual length, the set of
+// codes present and the label dictionary, so a scan skips blocks that cannot
+// match without touching their columns. Matching blocks are summed with
+// branch-free loops over the columns that the compiler can vectorize.
+//
+// Compaction is crash safe: the archive records the log prefix it took
+// (length and hash) before the log is rewritten, and a later run finishes
+// the rewrite if the prefix is still there.
+#ifndef POMODORO_ARCHIVE_H
+#define POMODORO_ARCHIVE_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#endif
+
+#define ARCHIVE_MAGIC 0x31414850 // "PHA1"
+#define ARCHIVE_VERSION 1
+#define ARCHIVE_BLOCK_ROWS 4096
+#define ARCHIVE_NO_FOCUS 255
+#define ARCHIVE_ANY_LABEL 0xFFFFFFFFu
+#define ARCHIVE_CODE(kind, outcome) ((kind) | (outcome) << 2)
+#define ARCHIVE_ALL_CODES 0xFFFF
+
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t block_count;
+    uint32_t reserved;
+    uint64_t row_count;
+    uint64_t archived_bytes;  // bytes taken from the front of the log so far
+    uint64_t pending_bytes;   // log prefix archived but maybe not removed yet
+    uint32_t pending_hash;
+    uint32_t reserved2;
+    uint64_t end_offset;      // end of the last complete block
+} ArchiveHeader;
+
+typedef struct {
+    uint32_t size;            // bytes of the block, this header included
+    uint32_t count;
+    int64_t min_start, max_start;
+    uint32_t min_actual, max_actual;
+    uint16_t codes;           // bit ARCHIVE_CODE(kind, outcome) set if present
+    uint16_t dict_count;
+    uint8_t width;            // bytes per planned/actual value
+    uint8_t code_width;       // bytes per label index
+    uint8_t reserved[10];
+} ArchiveBlock;
+
+typedef struct {
+    int64_t start;
+    uint32_t planned, actual;
+    uint32_t label;
+    uint8_t kind, outcome, focus;
+} ArchiveRow;
+
+typedef struct {
+    int64_t from, to;         // start time range, inclusive
+    uint16_t codes;           // accepted ARCHIVE_CODE values
+    uint32_t label;           // ARCHIVE_ANY_LABEL for any
+    uint32_t min_actual, max_actual;
+} ArchiveFilter;
+
+typedef struct {
+    uint64_t rows;
+    uint64_t planned_seconds, actual_seconds;
+    uint64_t focus_rows, focus_sum; // rows with a focus score and their sum
+} ArchiveSum;
+
+typedef struct {
+    uint8_t* data;            // the whole file
+    size_t size;              // bytes up to the end of the last block
+    uint64_t archived_bytes;
+} Archive;
+
+static inline size_t archive_align(size_t n) { return (n + 7) & ~(size_t)7; }
+
+// Column offsets within a block
+typedef struct {
+    size_t start, planned, actual, codes, focus, dict, index, end;
+} ArchiveLayout;
+
+static inline ArchiveLayout archive_layout(const ArchiveBlock* h) {
+    ArchiveLayout l;
+    size_t count = h->count;
+    l.start = archive_align(sizeof(ArchiveBlock));
+    l.planned = archive_align(l.start + 4 * count);
+    l.actual = archive_align(l.planned + h->width * count);
+    l.codes = archive_align(l.actual + h->width * count);
+    l.focus = archive_align(l.codes + (count + 1) / 2);
+    l.dict = archive_align(l.focus + count);
+    l.index = archive_align(l.dict + 4 * (size_t)h->dict_count);
+    l.end = archive_align(l.index + h->code_width * count);
+    return l;
+}
+
+static inline ArchiveFilter archive_filter_all(void) {
+    ArchiveFilter f = {INT64_MIN, INT64_MAX, ARCHIVE_ALL_CODES, ARCHIVE_ANY_LABEL, 0, UINT32_MAX};
+    return f;
+}
+
+static inline uint32_t archive_hash(const char* data, size_t size) {
+    uint32_t h = 2166136261u;
+    for (size_t i = 0; i < size; i++) h = (h ^ (uint8_t)data[i]) * 16777619u;
+    return h;
+}
+
+// Parse a number at *p and step over it; returns 0 if there is none
+static inline int archive_parse_number(const char** p, int64_t* value) {
+    const char* s = *p;
+    int neg = *s == '-';
+    int64_t v = 0;
+    s += neg;
+    if (*s < '0' || *s > '9') return 0;
+    while (*s >= '0' && *s <= '9') v = v * 10 + (*s++ - '0');
+    *value = neg ? -v : v;
+    *p = s;
+    return 1;
+}
+
+// Match one of names followed by a comma or the end of the line; returns its index or -1
+static inline int archive_parse_name(const char** p, const char* const* names, int count) {
+    for (int i = 0; i < count; i++) {
+        size_t len = strlen(names[i]);
+        char next = (*p)[len];
+        if (strncmp(*p, names[i], len) == 0 && (next == ',' || next == '\n' || next == '\r' || next == '\0')) {
+            *p += len;
+            return i;
+        }
+    }
+    return -1;
+}
+
+// Parse one log line: start,kind,planned,actual,outcome[,focus[,label]].
+// The line may be followed by more lines; parsing stops at its end.
+static inline int archive_parse_line(const char* line, ArchiveRow* row) {
+    static const char* const kinds[] = {"pomodoro", "short_break", "long_break"};
+    static const char* const outcomes[] = {"completed", "stopped", "expired"};
+    const char* p = line;
+    int64_t start, planned, actual, value;
+    int kind, outcome;
+    if (!archive_parse_number(&p, &start) || *p++ != ',') return 0;
+    if ((kind = archive_parse_name(&p, kinds, 3)) < 0 || *p++ != ',') return 0;
+    if (!archive_parse_number(&p, &planned) || *p++ != ',') return 0;
+    if (!archive_parse_number(&p, &actual) || *p++ != ',') return 0;
+    if ((outcome = archive_parse_name(&p, outcomes, 3)) < 0) return 0;
+    row->start = start;
+    row->planned = planned > 0 && planned <= UINT32_MAX ? (uint32_t)planned : 0;
+    row->actual = actual > 0 && actual <= UINT32_MAX ? (uint32_t)actual : 0;
+    row->kind = (uint8_t)kind;
+    row->outcome = (uint8_t)outcome;
+    row->focus = ARCHIVE_NO_FOCUS;
+    row->label = 0;
+    if (*p == ',') {
+        p++;
+        if (archive_parse_number(&p, &value) && value >= 0 && value <= 100) row->focus = (uint8_t)value;
+        if (*p == ',') {
+            p++;
+            if (archive_parse_number(&p, &value) && value > 0 && value <= UINT32_MAX) row->label = (uint32_t)value;
+        }
+    }
+    return 1;
+}
+
+static inline int archive_row_matches(const ArchiveRow* r, const ArchiveFilter* f) {
+    return r->start >= f->from && r->start <= f->to && (f->codes >> ARCHIVE_CODE(r->kind, r->outcome) & 1) &&
+           (f->label == ARCHIVE_ANY_LABEL || r->label == f->label) && r->actual >= f->min_actual &&
+           r->actual <= f->max_actual;
+}
+
+static inline void archive_sum_row(const ArchiveRow* r, ArchiveSum* sum) {
+    sum->rows++;
+    sum->planned_seconds += r->planned;
+    sum->actual_seconds += r->actual;
+    if (r->focus != ARCHIVE_NO_FOCUS) {
+        sum->focus_rows++;
+        sum->focus_sum += r->focus;
+    }
+}
+
+// Encode up to ARCHIVE_BLOCK_ROWS rows; returns a malloc'd block or NULL
+static inline ArchiveBlock* archive_encode_block(const ArchiveRow* rows, uint32_t count) {
+    ArchiveBlock h;
+    memset(&h, 0, sizeof(h));
+    h.count = count;
+    h.min_start = INT64_MAX;
+    h.max_start = INT64_MIN;
+    h.min_actual = UINT32_MAX;
+    uint32_t max_value = 0;
+    uint32_t dict[ARCHIVE_BLOCK_ROWS];
+    for (uint32_t i = 0; i < count; i++) {
+        const ArchiveRow* r = &rows[i];
+        if (r->start < h.min_start) h.min_start = r->start;
+        if (r->start > h.max_start) h.max_start = r->start;
+        if (r->actual < h.min_actual) h.min_actual = r->actual;
+        if (r->actual > h.max_actual) h.max_actual = r->actual;
+        if (r->planned > max_value) max_value = r->planned;
+        h.codes |= (uint16_t)(1u << ARCHIVE_CODE(r->kind, r->outcome));
+        uint32_t d = 0;
+        while (d < h.dict_count && dict[d] != r->label) d++;
+        if (d == h.dict_count) dict[h.dict_count++] = r->label;
+    }
+    if (h.max_actual > max_value) max_value = h.max_actual;
+    if ((uint64_t)(h.max_start - h.min_start) > UINT32_MAX) return NULL; // the caller splits such blocks
+    h.width = max_value > 0xFFFF ? 4 : 2;
+    h.code_width = h.dict_count > 256 ? 2 : 1;
+
+    ArchiveLayout l = archive_layout(&h);
+    h.size = (uint32_t)l.end;
+
+    uint8_t* b = (uint8_t*)calloc(1, h.size);
+    if (!b) return NULL;
+    memcpy(b, &h, sizeof(h));
+    uint32_t* start = (uint32_t*)(b + l.start);
+    memcpy(b + l.dict, dict, 4 * (size_t)h.dict_count);
+    for (uint32_t i = 0; i < count; i++) {
+        const ArchiveRow* r = &rows[i];
+        start[i] = (uint32_t)(r->start - h.min_start);
+        if (h.width == 2) {
+            ((uint16_t*)(b + l.planned))[i] = (uint16_t)r->planned;
+            ((uint16_t*)(b + l.actual))[i] = (uint16_t)r->actual;
+        } else {
+            ((uint32_t*)(b + l.planned))[i] = r->planned;
+            ((uint32_t*)(b + l.actual))[i] = r->actual;
+        }
+        b[l.codes + i / 2] |= (uint8_t)(ARCHIVE_CODE(r->kind, r->outcome) << (i & 1) * 4);
+        b[l.focus + i] = r->focus;
+        uint32_t d = 0;
+        while (dict[d] != r->label) d++;
+        if (h.code_width == 1) b[l.index + i] = (uint8_t)d;
+        else ((uint16_t*)(b + l.index))[i] = (uint16_t)d;
+    }
+    return (ArchiveBlock*)b;
+}
+
+// Scratch space for decoding one block
+typedef struct {
+    uint32_t planned[ARCHIVE_BLOCK_ROWS];
+    uint32_t actual[ARCHIVE_BLOCK_ROWS];
+    uint8_t code[ARCHIVE_BLOCK_ROWS];
+    uint16_t label[ARCHIVE_BLOCK_ROWS];
+} ArchiveScratch;
+
+// Add the matching rows of one block to sum
+static inline void archive_scan_block(const ArchiveBlock* h, const ArchiveFilter* f, ArchiveSum* sum, ArchiveScratch* s) {
+    uint32_t count = h->count;
+    if (count == 0 || count > ARCHIVE_BLOCK_ROWS || h->max_start < f->from || h->min_start > f->to) return;
+    if (!(h->codes & f->codes) || h->max_actual < f->min_actual || h->min_actual > f->max_actual) return;
+
+    const uint8_t* b = (const uint8_t*)h;
+    ArchiveLayout l = archive_layout(h);
+    if (l.end > h->size) return;
+
+    // The label filter becomes an index into the block dictionary
+    uint32_t want_label = 0, any_label = f->label == ARCHIVE_ANY_LABEL;
+    if (!any_label) {
+        const uint32_t* dict = (const uint32_t*)(b + l.dict);
+        while (want_label < h->dict_count && dict[want_label] != f->label) want_label++;
+        if (want_label == h->dict_count) return;
+    }
+
+    // Time bounds relative to the block, clamped to the delta range
+    uint32_t lo = f->from <= h->min_start ? 0 : (uint32_t)(f->from - h->min_start);
+    uint32_t hi = f->to >= h->max_start ? UINT32_MAX : (uint32_t)(f->to - h->min_start);
+
+    // Widen the narrow columns once so the loop below has a single shape
+    const uint32_t* planned = (const uint32_t*)(b + l.planned);
+    const uint32_t* actual = (const uint32_t*)(b + l.actual);
+    if (h->width == 2) {
+        const uint16_t* p16 = (const uint16_t*)(b + l.planned);
+        const uint16_t* a16 = (const uint16_t*)(b + l.actual);
+        for (uint32_t i = 0; i < count; i++) {
+            s->planned[i] = p16[i];
+            s->actual[i] = a16[i];
+        }
+        planned = s->planned;
+        actual = s->actual;
+    }
+    for (uint32_t i = 0; i < count; i++) s->code[i] = (uint8_t)(b[l.codes + i / 2] >> (i & 1) * 4 & 0x0F);
+    if (!any_label) {
+        if (h->code_width == 1) {
+            for (uint32_t i = 0; i < count; i++) s->label[i] = b[l.index + i];
+        } else {
+            memcpy(s->label, b + l.index, 2 * (size_t)count);
+        }
+    }
+
+    const uint32_t* start = (const uint32_t*)(b + l.start);
+    const uint8_t* focus = b + l.focus;
+    uint32_t codes = f->codes, min_actual = f->min_actual, max_actual = f->max_actual;
+    uint64_t rows = 0, planned_sum = 0, actual_sum = 0, focus_rows = 0, focus_sum = 0;
+    for (uint32_t i = 0; i < count; i++) {
+        uint32_t m = (start[i] >= lo) & (start[i] <= hi) & (codes >> s->code[i] & 1) &
+                     (actual[i] >= min_actual) & (actual[i] <= max_actual) & (any_label | (s->label[i] == want_label));
+        uint32_t fm = m & (focus[i] != ARCHIVE_NO_FOCUS);
+        rows += m;
+        planned_sum += (uint64_t)(planned[i] & (0u - m));
+        actual_sum += (uint64_t)(actual[i] & (0u - m));
+        focus_rows += fm;
+        focus_sum += focus[i] & (0u - fm);
+    }
+    sum->rows += rows;
+    sum->planned_seconds += planned_sum;
+    sum->actual_seconds += actual_sum;
+    sum->focus_rows += focus_rows;
+    sum->focus_sum += focus_sum;
+}
+
+// Decode every archived row into a malloc'd array; returns the row count
+static inline size_t archive_read_rows(const Archive* a, ArchiveRow** out) {
+    const ArchiveHeader* hdr = (const ArchiveHeader*)a->data;
+    *out = NULL;
+    if (!a->data || !hdr->row_count || !(*out = (ArchiveRow*)malloc((size_t)hdr->row_count * sizeof(ArchiveRow)))) return 0;
+    size_t n = 0, pos = sizeof(ArchiveHeader);
+    while (pos + sizeof(ArchiveBlock) <= a->size) {
+        const ArchiveBlock* h = (const ArchiveBlock*)(a->data + pos);
+        if (h->size < sizeof(ArchiveBlock) || h->size > a->size - pos) break;
+        ArchiveLayout l = archive_layout(h);
+        if (l.end > h->size || h->count > hdr->row_count - n) break;
+        const uint8_t* b = (const uint8_t*)h;
+        const uint32_t* dict = (const uint32_t*)(b + l.dict);
+        for (uint32_t i = 0; i < h->count; i++) {
+            ArchiveRow* r = &(*out)[n++];
+            uint8_t code = (uint8_t)(b[l.codes + i / 2] >> (i & 1) * 4 & 0x0F);
+            uint32_t index = h->code_width == 1 ? b[l.index + i] : ((const uint16_t*)(b + l.index))[i];
+            r->start = h->min_start + ((const uint32_t*)(b + l.start))[i];
+            r->planned = h->width == 2 ? ((const uint16_t*)(b + l.planned))[i] : ((const uint32_t*)(b + l.planned))[i];
+            r->actual = h->width == 2 ? ((const uint16_t*)(b + l.actual))[i] : ((const uint32_t*)(b + l.actual))[i];
+            r->kind = code & 3;
+            r->outcome = code >> 2;
+            r->focus = b[l.focus + i];
+            r->label = index < h->dict_count ? dict[index] : 0;
+        }
+        pos += h->size;
+    }
+    return n;
+}
+
+// Sum the archived rows that match a filter
+static inline void archive_scan(const Archive* a, const ArchiveFilter* f, ArchiveSum* sum) {
+    if (!a->data) return;
+    ArchiveScratch* s = (ArchiveScratch*)malloc(sizeof(ArchiveScratch));
+    if (!s) return;
+    size_t pos = sizeof(ArchiveHeader);
+    while (pos + sizeof(ArchiveBlock) <= a->size) {
+        const ArchiveBlock* h = (const ArchiveBlock*)(a->data + pos);
+        if (h->size < sizeof(ArchiveBlock) || h->size > a->size - pos) break;
+        archive_scan_block(h, f, sum, s);
+        pos += h->size;
+    }
+    free(s);
+}
+
+// Load the archive into memory; a missing archive loads as empty
+static inline int archive_load(Archive* a, const char* path) {
+    memset(a, 0, sizeof(*a));
+    FILE* fp = fopen(path, "rb");
+    if (!fp) return 1;
+    fseek(fp, 0, SEEK_END);
+    long size = ftell(fp);
+    fseek(fp, 0, SEEK_SET);
+    if (size >= (long)sizeof(ArchiveHeader) && (a->data = (uint8_t*)malloc(size))) {
+        a->size = fread(a->data, 1, size, fp);
+    }
+    fclose(fp);
+    const ArchiveHeader* hdr = (const ArchiveHeader*)a->data;
+    if (!a->data || a->size < sizeof(ArchiveHeader) || hdr->magic != ARCHIVE_MAGIC || hdr->version != ARCHIVE_VERSION) {
+        free(a->data);
+        a->data = NULL;
+        a->size = 0;
+        return 0;
+    }
+    a->archived_bytes = hdr->archived_bytes;
+    if (hdr->end_offset < a->size) a->size = (size_t)hdr->end_offset;
+    return 1;
+}
+
+static inline void archive_free(Archive* a) {
+    free(a->data);
+    memset(a, 0, sizeof(*a));
+}
+
+static inline int archive_replace_file(const char* from, const char* to) {
+#ifdef _WIN32
+    return MoveFileExA(from, to, MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH) != 0;
+#else
+    return rename(from, to) == 0;
+#endif
+}
+
+static inline int archive_write_header(FILE* fp, const ArchiveHeader* hdr) {
+    return fseek(fp, 0, SEEK_SET) == 0 && fwrite(hdr, sizeof(*hdr), 1, fp) == 1 && fflush(fp) == 0;
+}
+
+// Write a block at the end of the archive; the header is updated in memory only
+static inline int archive_append_block(FILE* fp, ArchiveHeader* hdr, const ArchiveRow* rows, uint32_t count) {
+    ArchiveBlock* block = archive_encode_block(rows, count);
+    int ok = block && fseek(fp, (long)hdr->end_offset, SEEK_SET) == 0 && fwrite(block, block->size, 1, fp) == 1;
+    if (ok) {
+        hdr->end_offset += block->size;
+        hdr->block_count++;
+        hdr->row_count += count;
+    }
+    free(block);
+    return ok;
+}
+
+// Drop the first prefix bytes of the log if they hash to the given value
+static inline int archive_drop_prefix(const char* log_path, const char* log, size_t size, size_t prefix, uint32_t hash) {
+    if (prefix > size || archive_hash(log, prefix) != hash) return 1; // already dropped
+    char tmp[300];
+    snprintf(tmp, sizeof(tmp), "%s.tmp", log_path);
+    FILE* fp = fopen(tmp, "wb");
+    if (!fp) return 0;
+    int ok = fwrite(log + prefix, 1, size - prefix, fp) == size - prefix;
+    if (fclose(fp) != 0) ok = 0;
+    return ok && archive_replace_file(tmp, log_path);
+}
+
+static inline char* archive_read_file(const char* path, size_t* size) {
+    FILE* fp = fopen(path, "rb");
+    *size = 0;
+    if (!fp) return NULL;
+    fseek(fp, 0, SEEK_END);
+    long n = ftell(fp);
+    fseek(fp, 0, SEEK_SET);
+    char* buf = n >= 0 ? (char*)malloc((size_t)n + 1) : NULL;
+    if (buf) {
+        *size = fread(buf, 1, (size_t)n, fp);
+        buf[*size] = '\0';
+    }
+    fclose(fp);
+    return buf;
+}
+
+// Move the rows at the front of the log that started before cutoff into the
+// archive. Runs only when the oldest row is older than cutoff - slack, so the
+// log is rewritten about once per slack period. Returns the number of rows
+// archived, or -1 on error. The caller must keep writers of the log out.
+static inline long archive_compact(const char* log_path, const char* arc_path, int64_t cutoff, int64_t slack) {
+    FILE* arc = fopen(arc_path, "r+b");
+    if (!arc) arc = fopen(arc_path, "w+b");
+    if (!arc) return -1;
+    ArchiveHeader hdr;
+    if (fread(&hdr, sizeof(hdr), 1, arc) != 1 || hdr.magic != ARCHIVE_MAGIC) {
+        memset(&hdr, 0, sizeof(hdr));
+        hdr.magic = ARCHIVE_MAGIC;
+        hdr.version = ARCHIVE_VERSION;
+        hdr.end_offset = sizeof(hdr);
+        if (!archive_write_header(arc, &hdr)) {
+            fclose(arc);
+            return -1;
+        }
+    } else if (hdr.version != ARCHIVE_VERSION) {
+        fclose(arc);
+        return -1;
+    }
+
+    size_t size;
+    char* log = archive_read_file(log_path, &size);
+    long archived = 0;
+
+    // Finish a compaction that stopped before the log was rewritten
+    if (hdr.pending_bytes) {
+        if (log && !archive_drop_prefix(log_path, log, size, (size_t)hdr.pending_bytes, hdr.pending_hash)) archived = -1;
+        if (archived == 0) {
+            hdr.pending_bytes = 0;
+            hdr.pending_hash = 0;
+            archive_write_header(arc, &hdr);
+            free(log);
+            log = archive_read_file(log_path, &size);
+        }
+    }
+
+    ArchiveRow first;
+    if (archived == 0 && log && archive_parse_line(log, &first) && first.start < cutoff - slack) {
+        // The log is in time order: take the rows up to the first one at or after cutoff
+        ArchiveRow* rows = (ArchiveRow*)malloc(ARCHIVE_BLOCK_ROWS * sizeof(ArchiveRow));
+        size_t prefix = 0;
+        uint32_t count = 0;
+        int64_t lo = 0, hi = 0;
+        if (!rows) archived = -1;
+        if (hdr.end_offset < sizeof(hdr)) hdr.end_offset = sizeof(hdr);
+        while (archived >= 0 && prefix < size) {
+            char* nl = (char*)memchr(log + prefix, '\n', size - prefix);
+            if (!nl) break; // a partial last line stays in the log
+            ArchiveRow row;
+            int ok = archive_parse_line(log + prefix, &row);
+            if (ok && row.start >= cutoff) break;
+            prefix = nl + 1 - log;
+            if (!ok) continue;
+            // A block is full at ARCHIVE_BLOCK_ROWS rows or when its time span would not fit the deltas
+            if (count > 0 && (count == ARCHIVE_BLOCK_ROWS || (row.start > hi ? row.start - lo : hi - row.start) > (int64_t)UINT32_MAX)) {
+                if (!archive_append_block(arc, &hdr, rows, count)) {
+                    archived = -1;
+                    break;
+                }
+                archived += count;
+                count = 0;
+            }
+            if (count == 0 || row.start < lo) lo = row.start;
+            if (count == 0 || row.start > hi) hi = row.start;
+            rows[count++] = row;
+        }
+        if (archived >= 0 && count > 0) {
+            if (archive_append_block(arc, &hdr, rows, count)) archived += count;
+            else archived = -1;
+        }
+        free(rows);
+
+        // Record the prefix before the log loses it, then drop it. After a failed block the header
+        // on disk still ends before the blocks written this time, so they are overwritten next time.
+        if (archived >= 0 && prefix > 0) {
+            hdr.archived_bytes += prefix;
+            hdr.pending_bytes = prefix;
+            hdr.pending_hash = archive_hash(log, prefix);
+            if (!archive_write_header(arc, &hdr)) {
+                archived = -1;
+            } else if (archive_drop_prefix(log_path, log, size, prefix, hdr.pending_hash)) {
+                hdr.pending_bytes = 0;
+                hdr.pending_hash = 0;
+                archive_write_header(arc, &hdr);
+            }
+        }
+    }
+    free(log);
+    if (fclose(arc) != 0) archived = -1;
+    return archived;
+}
+
+#endif
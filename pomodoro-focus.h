@@ -0,0 +1,70 @@
+// Pomodoro Timer focus sampler
+//
+// During a Pomodoro the timer takes one activity sample every
+// FOCUS_SAMPLE_SECONDS on its existing one-second tick: a single bit that is
+// set when there was keyboard or mouse input since the previous sample. A
+// sample counts as focused when any of the last FOCUS_WINDOW_SAMPLES bits is
+// set, so reading or thinking for a minute without touching the mouse is not
+// penalised. The bits live in a ring just long enough for the window, and the
+// counters are updated as each sample comes in, so a sample costs a few
+// instructions and the score is ready the moment the session ends.
+#ifndef POMODORO_FOCUS_H
+#define POMODORO_FOCUS_H
+
+#include <stdint.h>
+#include <string.h>
+
+#define FOCUS_SAMPLE_SECONDS 5
+#define FOCUS_WINDOW_SAMPLES 12   // one minute
+#define FOCUS_RING_BITS 64        // power of two, at least FOCUS_WINDOW_SAMPLES
+
+typedef struct {
+    uint8_t bits[FOCUS_RING_BITS / 8];
+    int samples;          // samples taken this session
+    int focused;          // samples with input inside the window
+    int window_active;    // set bits among the last FOCUS_WINDOW_SAMPLES samples
+    int tick;             // seconds since the previous sample
+    uint32_t last_input;  // input time seen at the previous sample
+} FocusSampler;
+
+// Start a session; last_input is the current input time of the platform
+static inline void focus_sampler_reset(FocusSampler* f, uint32_t last_input) {
+    memset(f, 0, sizeof(*f));
+    f->last_input = last_input;
+}
+
+// Count down elapsed seconds; returns 1 when a sample is due
+static inline int focus_sampler_tick(FocusSampler* f, int elapsed_sec) {
+    f->tick += elapsed_sec;
+    if (f->tick < FOCUS_SAMPLE_SECONDS) return 0;
+    f->tick %= FOCUS_SAMPLE_SECONDS;
+    return 1;
+}
+
+// Take one sample given the current input time and update the score counters
+static inline void focus_sampler_add(FocusSampler* f, uint32_t last_input) {
+    int active = last_input != f->last_input;
+    f->last_input = last_input;
+
+    int pos = f->samples & (FOCUS_RING_BITS - 1);
+    if (f->samples >= FOCUS_WINDOW_SAMPLES) {
+        int old = (f->samples - FOCUS_WINDOW_SAMPLES) & (FOCUS_RING_BITS - 1);
+        f->window_active -= (f->bits[old >> 3] >> (old & 7)) & 1;
+    }
+    if (active) {
+        f->bits[pos >> 3] |= (uint8_t)(1 << (pos & 7));
+    } else {
+        f->bits[pos >> 3] &= (uint8_t)~(1 << (pos & 7));
+    }
+    f->window_active += active;
+    f->samples++;
+    if (f->window_active > 0) f->focused++;
+}
+
+// Focus score in percent, or -1 if nothing was sampled
+static inline int focus_sampler_score(const FocusSampler* f) {
+    if (f->samples == 0) return -1;
+    return f->focused * 100 / f->samples;
+}
+
+#endif
@@ -0,0 +1,204 @@
+// Pomodoro Timer calendar heatmap
+//
+// The number of finished Pomodoros per day is kept as a small array of
+// counters indexed by day number (days since 1601-01-01, a Monday), stored in
+// one file and updated whenever a session ends. A decade is about 7 KB, so
+// the heatmap never reads the history itself.
+//
+// A month is drawn as a tile: one row per week, one column per weekday, with
+// a dot per day on the dark red background of the tray icon. Days without a
+// Pomodoro get a black dot, the others a green one that gets lighter with the
+// count. Tiles are rendered into plain 32-bit pixel buffers (0x00RRGGBB,
+// top-down), so the drawing does not depend on the platform and the output
+// for given counts is always the same.
+#ifndef POMODORO_HEATMAP_H
+#define POMODORO_HEATMAP_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#endif
+
+#define HEATMAP_MAGIC 0x32594450 // "PDY2"
+#define HEATMAP_CELL 16          // pixels per day
+#define HEATMAP_DOT_RADIUS 6     // same dots as the completion toast
+#define HEATMAP_TILE_WIDTH (7 * HEATMAP_CELL)
+#define HEATMAP_TILE_HEIGHT (6 * HEATMAP_CELL)
+#define HEATMAP_FULL_DAY 8       // Pomodoros drawn with the lightest green
+#define HEATMAP_BACKGROUND 0x8B0000
+#define HEATMAP_EMPTY_DOT 0x000000
+#define HEATMAP_LOW_DOT 0x226422
+#define HEATMAP_HIGH_DOT 0x90EE90
+#define HEATMAP_TODAY_RING 0xFFFFFF
+
+typedef struct {
+    int32_t first_day;       // day number of values[0]
+    uint32_t count, cap;
+    uint16_t* values;        // finished Pomodoros per day
+    uint32_t synced;         // records of the sync journal included (pomodoro-sync.h)
+} HeatmapDays;
+
+typedef struct {
+    uint32_t* pixels;
+    int width, height;
+    int stride;              // pixels per row
+} HeatmapImage;
+
+// Day number (days since 1601-01-01) of a civil date
+static inline int32_t heatmap_day_number(int year, int month, int day) {
+    int y = year - (month <= 2);
+    int era = y / 400;
+    int yoe = y - era * 400;
+    int doy = (153 * (month + (month > 2 ? -3 : 9)) + 2) / 5 + day - 1;
+    int doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+    return era * 146097 + doe - 584694; // 0000-03-01 based to 1601-01-01 based
+}
+
+static inline int heatmap_days_in_month(int year, int month) {
+    static const int days[] = {31, 28, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31};
+    int leap = (year % 4 == 0 && year % 100 != 0) || year % 400 == 0;
+    return days[month - 1] + (month == 2 && leap);
+}
+
+static inline uint16_t heatmap_days_get(const HeatmapDays* d, int32_t day) {
+    int64_t i = (int64_t)day - d->first_day;
+    return i >= 0 && i < d->count ? d->values[i] : 0;
+}
+
+// Add to the counter of a day, growing the array in either direction
+static inline int heatmap_days_add(HeatmapDays* d, int32_t day, int delta) {
+    if (day < 0) return 0;
+    if (d->count == 0) d->first_day = day;
+    int32_t shift = day < d->first_day ? d->first_day - day : 0;
+    uint32_t need = (uint32_t)((day >= d->first_day ? day - d->first_day : 0) + 1);
+    if (need < d->count + shift) need = d->count + shift;
+    if (need > d->cap) {
+        uint32_t cap = d->cap ? d->cap : 512;
+        while (cap < need) cap *= 2;
+        uint16_t* values = (uint16_t*)realloc(d->values, cap * sizeof(uint16_t));
+        if (!values) return 0;
+        d->values = values;
+        d->cap = cap;
+    }
+    if (shift) {
+        memmove(d->values + shift, d->values, d->count * sizeof(uint16_t));
+        memset(d->values, 0, shift * sizeof(uint16_t));
+        d->first_day = day;
+    }
+    if (need > d->count) memset(d->values + d->count + shift, 0, (need - d->count - shift) * sizeof(uint16_t));
+    d->count = need;
+    uint16_t* v = &d->values[day - d->first_day];
+    int value = *v + delta;
+    *v = (uint16_t)(value < 0 ? 0 : value > 0xFFFF ? 0xFFFF : value);
+    return 1;
+}
+
+static inline void heatmap_days_free(HeatmapDays* d) {
+    free(d->values);
+    memset(d, 0, sizeof(*d));
+}
+
+// Load the counters; returns 0 if the file is missing or not valid
+static inline int heatmap_days_load(HeatmapDays* d, const char* path) {
+    memset(d, 0, sizeof(*d));
+    FILE* fp = fopen(path, "rb");
+    if (!fp) return 0;
+    uint32_t header[4];
+    int ok = fread(header, sizeof(header), 1, fp) == 1 && header[0] == HEATMAP_MAGIC && header[2] < (1u << 20);
+    if (ok) d->synced = header[3];
+    if (ok && header[2] > 0) {
+        d->values = (uint16_t*)malloc(header[2] * sizeof(uint16_t));
+        ok = d->values && fread(d->values, sizeof(uint16_t), header[2], fp) == header[2];
+        d->first_day = (int32_t)header[1];
+        d->count = d->cap = header[2];
+    }
+    fclose(fp);
+    if (!ok) heatmap_days_free(d);
+    return ok;
+}
+
+static inline int heatmap_days_save(const HeatmapDays* d, const char* path) {
+    char tmp[300];
+    snprintf(tmp, sizeof(tmp), "%s.tmp", path);
+    FILE* fp = fopen(tmp, "wb");
+    if (!fp) return 0;
+    uint32_t header[4] = {HEATMAP_MAGIC, (uint32_t)d->first_day, d->count, d->synced};
+    int ok = fwrite(header, sizeof(header), 1, fp) == 1 && fwrite(d->values, sizeof(uint16_t), d->count, fp) == d->count;
+    if (fclose(fp) != 0) ok = 0;
+#ifdef _WIN32
+    return ok && MoveFileExA(tmp, path, MOVEFILE_REPLACE_EXISTING);
+#else
+    return ok && rename(tmp, path) == 0;
+#endif
+}
+
+// The counters a month tile is drawn from, to tell whether a cached tile is stale
+static inline void heatmap_month_values(const HeatmapDays* d, int year, int month, uint16_t out[31]) {
+    int32_t first = heatmap_day_number(year, month, 1);
+    int days = heatmap_days_in_month(year, month);
+    for (int i = 0; i < 31; i++) out[i] = i < days ? heatmap_days_get(d, first + i) : 0;
+}
+
+static inline uint32_t heatmap_blend(uint32_t a, uint32_t b, int weight, int scale) {
+    uint32_t r = 0;
+    for (int shift = 0; shift <= 16; shift += 8) {
+        int ca = (a >> shift) & 0xFF, cb = (b >> shift) & 0xFF;
+        r |= (uint32_t)(ca + (cb - ca) * weight / scale) << shift;
+    }
+    return r;
+}
+
+static inline uint32_t heatmap_dot_color(uint16_t count) {
+    if (count == 0) return HEATMAP_EMPTY_DOT;
+    int level = count >= HEATMAP_FULL_DAY ? HEATMAP_FULL_DAY - 1 : count - 1;
+    return heatmap_blend(HEATMAP_LOW_DOT, HEATMAP_HIGH_DOT, level, HEATMAP_FULL_DAY - 1);
+}
+
+// Draw a dot with 4x4 supersampled edges; ring > 0 draws only an outline of that width
+static inline void heatmap_draw_dot(HeatmapImage* img, int cx2, int cy2, int radius, int ring, uint32_t color) {
+    // Coordinates are in half pixels so the dot can be centered between pixels
+    int r8 = radius * 8, inner8 = (radius - ring) * 8;
+    for (int y = (cy2 / 2) - radius - 1; y <= (cy2 / 2) + radius + 1; y++) {
+        if (y < 0 || y >= img->height) continue;
+        for (int x = (cx2 / 2) - radius - 1; x <= (cx2 / 2) + radius + 1; x++) {
+            if (x < 0 || x >= img->width) continue;
+            int covered = 0;
+            for (int sy = 0; sy < 4; sy++) {
+                for (int sx = 0; sx < 4; sx++) {
+                    // Sample position relative to the center, in 1/8 pixels
+                    int dx = x * 8 + sx * 2 + 1 - cx2 * 4, dy = y * 8 + sy * 2 + 1 - cy2 * 4;
+                    int dist2 = dx * dx + dy * dy;
+                    covered += dist2 <= r8 * r8 && (ring == 0 || dist2 >= inner8 * inner8);
+                }
+            }
+            if (covered) {
+                uint32_t* p = &img->pixels[y * img->stride + x];
+                *p = heatmap_blend(*p, color, covered, 16);
+            }
+        }
+    }
+}
+
+// Render one month; the image must be at least HEATMAP_TILE_WIDTH x HEATMAP_TILE_HEIGHT.
+// today is the day number to mark with a ring, or -1.
+static inline void heatmap_render_month(const HeatmapDays* d, int year, int month, int32_t today, HeatmapImage* img) {
+    for (int y = 0; y < img->height; y++) {
+        for (int x = 0; x < img->width; x++) img->pixels[y * img->stride + x] = HEATMAP_BACKGROUND;
+    }
+    int32_t first = heatmap_day_number(year, month, 1);
+    int weekday = first % 7; // 0 = Monday
+    int days = heatmap_days_in_month(year, month);
+    for (int i = 0; i < days; i++) {
+        int cell = weekday + i;
+        int cx2 = (cell % 7) * HEATMAP_CELL * 2 + HEATMAP_CELL;
+        int cy2 = (cell / 7) * HEATMAP_CELL * 2 + HEATMAP_CELL;
+        heatmap_draw_dot(img, cx2, cy2, HEATMAP_DOT_RADIUS, 0, heatmap_dot_color(heatmap_days_get(d, first + i)));
+        if (first + i == today) heatmap_draw_dot(img, cx2, cy2, HEATMAP_DOT_RADIUS + 2, 1, HEATMAP_TODAY_RING);
+    }
+}
+
+#endif
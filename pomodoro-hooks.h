@@ -0,0 +1,118 @@
+// Pomodoro Timer hook queue
+//
+// Hook commands run on worker threads, never on the thread that fires the
+// event. Firing copies the job into a fixed ring of HOOK_QUEUE_MAX slots under
+// a lock held for a few instructions and wakes one worker; when every slot is
+// taken the job is dropped and counted instead of waited for. A hook that
+// hangs therefore holds up only its worker and, once the ring is full, costs
+// the timer one dropped job per event.
+#ifndef POMODORO_HOOKS_H
+#define POMODORO_HOOKS_H
+
+#include <stdint.h>
+#include <string.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <pthread.h>
+#endif
+
+#define HOOK_QUEUE_MAX 64
+#define HOOK_PAYLOAD_MAX 512
+
+typedef struct {
+    int event;
+    uint32_t queued_at;  // milliseconds, GetTickCount on Windows
+    int depth;           // queue depth when it was queued, this job included
+    char payload[HOOK_PAYLOAD_MAX];
+} HookJob;
+
+typedef struct {
+    HookJob jobs[HOOK_QUEUE_MAX];
+    int head, count;
+    int64_t dropped;     // jobs dropped because the queue was full
+#ifdef _WIN32
+    CRITICAL_SECTION lock;
+    HANDLE ready;        // semaphore, one count per queued job
+#else
+    pthread_mutex_t lock;
+    pthread_cond_t ready;
+#endif
+} HookQueue;
+
+// Returns 0 if the wakeup could not be created
+static inline int hook_queue_init(HookQueue* q) {
+    q->head = q->count = 0;
+    q->dropped = 0;
+#ifdef _WIN32
+    InitializeCriticalSection(&q->lock);
+    q->ready = CreateSemaphoreW(NULL, 0, HOOK_QUEUE_MAX, NULL);
+    return q->ready != NULL;
+#else
+    return pthread_mutex_init(&q->lock, NULL) == 0 && pthread_cond_init(&q->ready, NULL) == 0;
+#endif
+}
+
+static inline void hook_queue_lock(HookQueue* q) {
+#ifdef _WIN32
+    EnterCriticalSection(&q->lock);
+#else
+    pthread_mutex_lock(&q->lock);
+#endif
+}
+
+static inline void hook_queue_unlock(HookQueue* q) {
+#ifdef _WIN32
+    LeaveCriticalSection(&q->lock);
+#else
+    pthread_mutex_unlock(&q->lock);
+#endif
+}
+
+// Queue a copy of the job and set its depth; never blocks on a worker.
+// Returns 0 if the queue was full and the job was dropped.
+static inline int hook_queue_push(HookQueue* q, HookJob* job) {
+    hook_queue_lock(q);
+    if (q->count == HOOK_QUEUE_MAX) {
+        q->dropped++;
+        hook_queue_unlock(q);
+        return 0;
+    }
+    job->depth = q->count + 1;
+    q->jobs[(q->head + q->count) % HOOK_QUEUE_MAX] = *job;
+    q->count++;
+#ifdef _WIN32
+    hook_queue_unlock(q);
+    ReleaseSemaphore(q->ready, 1, NULL);
+#else
+    pthread_cond_signal(&q->ready);
+    hook_queue_unlock(q);
+#endif
+    return 1;
+}
+
+// Take the oldest job, waiting for one; *dropped gets the drops so far
+static inline void hook_queue_pop(HookQueue* q, HookJob* job, int64_t* dropped) {
+#ifdef _WIN32
+    WaitForSingleObject(q->ready, INFINITE);
+    hook_queue_lock(q);
+#else
+    hook_queue_lock(q);
+    while (q->count == 0) pthread_cond_wait(&q->ready, &q->lock);
+#endif
+    *job = q->jobs[q->head];
+    q->head = (q->head + 1) % HOOK_QUEUE_MAX;
+    q->count--;
+    *dropped = q->dropped;
+    hook_queue_unlock(q);
+}
+
+static inline void hook_queue_stats(HookQueue* q, int* depth, int64_t* dropped) {
+    hook_queue_lock(q);
+    *depth = q->count;
+    *dropped = q->dropped;
+    hook_queue_unlock(q);
+}
+
+#endif
@@ -0,0 +1,521 @@
+// Pomodoro Timer task labels
+//
+// Label names are interned: every name is stored once in an append-only text
+// file (UTF-8, one name per line) and sessions refer to it by its line number,
+// so label ids are small and stable. 0 means "no label". The names are loaded
+// with a single read into one buffer and indexed by an open-addressing hash
+// table, so even years of labels load instantly.
+//
+// Per-label totals live in a second file of fixed-size records indexed by id.
+// Finishing a session updates one record in memory and rewrites just that
+// record on disk, so "time spent on X this week" never needs the history.
+//
+// The optional word index lists every word start of every name, sorted by
+// the text from there on (ASCII case-insensitive), so a typed prefix selects
+// one contiguous range with two binary searches. It is kept in a file that is
+// memory-mapped at load and updated in place as labels are added.
+#ifndef POMODORO_LABELS_H
+#define POMODORO_LABELS_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#define LABEL_MAX_BYTES 128
+#define LABEL_INDEX_MAGIC 0x31494C50 // "PLI1"
+#define LABEL_SCAN_LIMIT 2048        // wider prefix ranges are answered by walking the MRU list
+
+typedef struct {
+    uint32_t magic;
+    uint32_t label_count;    // labels covered; a mismatch means the index is stale
+    uint32_t entry_count;
+    uint32_t reserved;
+} LabelIndexHeader;          // followed by entry_count entries: id << 8 | word offset
+
+typedef struct {
+    uint32_t count;          // finished pomodoros
+    uint32_t week_seconds;   // seconds in the week given by week
+    int64_t total_seconds;
+    int64_t last_used;       // unix seconds
+    int32_t week;            // week number of week_seconds
+    uint32_t synced;         // last record of the sync journal included (pomodoro-sync.h)
+} LabelTotals;
+
+typedef struct {
+    char* names;             // all names, each NUL-terminated
+    size_t names_size, names_cap;
+    uint32_t* offsets;       // offsets[id - 1] into names
+    LabelTotals* totals;     // totals[id - 1]
+    int count, cap;
+    int32_t* slots;          // hash table of ids, 0 = empty
+    uint32_t slot_mask;
+    char names_path[260];
+    char totals_path[260];
+    uint32_t* index;         // word index entries, mapped or on the heap
+    uint32_t index_count, index_cap;
+    void* index_map;         // mapped index file, NULL once the entries live on the heap
+    size_t index_map_size;
+    char index_path[260];    // empty when there is no index
+    uint32_t* mru;           // ids, most recently used first; built with the index
+} LabelTable;
+
+static inline uint32_t label_hash(const char* name) {
+    uint32_t h = 2166136261u;
+    while (*name) h = (h ^ (uint8_t)*name++) * 16777619u;
+    return h;
+}
+
+static inline const char* label_name(const LabelTable* t, int id) {
+    return id > 0 && id <= t->count ? t->names + t->offsets[id - 1] : "";
+}
+
+static inline void label_rehash(LabelTable* t, uint32_t slot_count) {
+    free(t->slots);
+    t->slots = (int32_t*)calloc(slot_count, sizeof(int32_t));
+    t->slot_mask = t->slots ? slot_count - 1 : 0;
+    if (!t->slots) return;
+    for (int id = 1; id <= t->count; id++) {
+        uint32_t i = label_hash(label_name(t, id)) & t->slot_mask;
+        while (t->slots[i]) i = (i + 1) & t->slot_mask;
+        t->slots[i] = id;
+    }
+}
+
+// Look up a name; returns its id or 0
+static inline int label_find(const LabelTable* t, const char* name) {
+    if (!t->slots) return 0;
+    uint32_t i = label_hash(name) & t->slot_mask;
+    while (t->slots[i]) {
+        if (strcmp(label_name(t, t->slots[i]), name) == 0) return t->slots[i];
+        i = (i + 1) & t->slot_mask;
+    }
+    return 0;
+}
+
+// Add a name to the in-memory table without touching the files; returns its id or 0
+static inline int label_add(LabelTable* t, const char* name, size_t len) {
+    if (t->count == t->cap) {
+        int cap = t->cap ? t->cap * 2 : 64;
+        uint32_t* offsets = (uint32_t*)realloc(t->offsets, cap * sizeof(uint32_t));
+        if (!offsets) return 0;
+        t->offsets = offsets;
+        LabelTotals* totals = (LabelTotals*)realloc(t->totals, cap * sizeof(LabelTotals));
+        if (!totals) return 0;
+        memset(totals + t->cap, 0, (cap - t->cap) * sizeof(LabelTotals));
+        t->totals = totals;
+        t->cap = cap;
+    }
+    if (t->names_size + len + 1 > t->names_cap) {
+        size_t cap = t->names_cap ? t->names_cap * 2 : 4096;
+        while (cap < t->names_size + len + 1) cap *= 2;
+        char* names = (char*)realloc(t->names, cap);
+        if (!names) return 0;
+        t->names = names;
+        t->names_cap = cap;
+    }
+    memcpy(t->names + t->names_size, name, len);
+    t->names[t->names_size + len] = '\0';
+    t->offsets[t->count] = (uint32_t)t->names_size;
+    t->names_size += len + 1;
+    t->count++;
+
+    // Keep the hash table at most half full
+    if ((uint32_t)t->count * 2 > t->slot_mask) {
+        label_rehash(t, t->slot_mask ? (t->slot_mask + 1) * 2 : 128);
+    } else {
+        uint32_t i = label_hash(label_name(t, t->count)) & t->slot_mask;
+        while (t->slots[i]) i = (i + 1) & t->slot_mask;
+        t->slots[i] = t->count;
+    }
+    return t->count;
+}
+
+static inline int label_fold(int c) {
+    return c >= 'A' && c <= 'Z' ? c + 32 : c;
+}
+
+static inline const char* label_index_text(const LabelTable* t, uint32_t entry) {
+    return label_name(t, (int)(entry >> 8)) + (entry & 0xFF);
+}
+
+// Compare the text of an entry with a string, looking at no more than n bytes of it
+static inline int label_index_cmp(const LabelTable* t, uint32_t entry, const char* s, size_t n) {
+    const uint8_t* a = (const uint8_t*)label_index_text(t, entry);
+    const uint8_t* b = (const uint8_t*)s;
+    for (size_t i = 0; i < n; i++) {
+        int ca = label_fold(a[i]), cb = label_fold(b[i]);
+        if (ca != cb || ca == 0) return ca - cb;
+    }
+    return 0;
+}
+
+// First entry whose text is not below s; with after_prefix, the first entry past all texts starting with s
+static inline uint32_t label_index_bound(const LabelTable* t, const char* s, int after_prefix) {
+    size_t n = after_prefix ? strlen(s) : (size_t)-1;
+    uint32_t lo = 0, hi = t->index_count;
+    while (lo < hi) {
+        uint32_t mid = lo + (hi - lo) / 2;
+        int c = label_index_cmp(t, t->index[mid], s, n);
+        if (c < 0 || (after_prefix && c == 0)) lo = mid + 1;
+        else hi = mid;
+    }
+    return lo;
+}
+
+static inline int label_is_word_start(const char* name, size_t i) {
+    uint8_t c = (uint8_t)name[i];
+    if (c == ' ' || c == '-' || c == '_' || c == '/' || c == '.' || c == ',' || c == ':' || c == '(' || c == ')' || c == '#') return 0;
+    if ((c & 0xC0) == 0x80) return 0; // inside a UTF-8 sequence
+    if (i == 0) return 1;
+    uint8_t p = (uint8_t)name[i - 1];
+    return p == ' ' || p == '-' || p == '_' || p == '/' || p == '.' || p == ',' || p == ':' || p == '(' || p == ')' || p == '#';
+}
+
+static inline void label_index_unmap(LabelTable* t) {
+    if (!t->index_map) return;
+#ifdef _WIN32
+    UnmapViewOfFile(t->index_map);
+#else
+    munmap(t->index_map, t->index_map_size);
+#endif
+    t->index_map = NULL;
+    t->index_map_size = 0;
+}
+
+// Move the entries to the heap so they can grow and the file can be rewritten
+static inline int label_index_own(LabelTable* t, uint32_t need) {
+    if (!t->index_map && need <= t->index_cap) return 1;
+    uint32_t cap = t->index_cap > need ? t->index_cap : need;
+    if (cap < 256) cap = 256;
+    if (cap < t->index_cap * 2) cap = t->index_cap * 2;
+    uint32_t* entries = (uint32_t*)malloc(cap * sizeof(uint32_t));
+    if (!entries) return 0;
+    if (t->index_count) memcpy(entries, t->index, t->index_count * sizeof(uint32_t));
+    if (t->index_map) label_index_unmap(t);
+    else free(t->index);
+    t->index = entries;
+    t->index_cap = cap;
+    return 1;
+}
+
+static inline void label_index_save(LabelTable* t) {
+    // A mapped file cannot be rewritten on Windows
+    if (t->index_map && !label_index_own(t, t->index_count)) return;
+    LabelIndexHeader h = {LABEL_INDEX_MAGIC, (uint32_t)t->count, t->index_count, 0};
+    FILE* fp = fopen(t->index_path, "wb");
+    if (!fp) return;
+    fwrite(&h, sizeof(h), 1, fp);
+    fwrite(t->index, sizeof(uint32_t), t->index_count, fp);
+    fclose(fp);
+}
+
+// Insert the word starts of one label at their sorted positions
+static inline void label_index_insert(LabelTable* t, int id) {
+    const char* name = label_name(t, id);
+    for (size_t i = 0; name[i]; i++) {
+        if (!label_is_word_start(name, i)) continue;
+        if (!label_index_own(t, t->index_count + 1)) return;
+        uint32_t pos = label_index_bound(t, name + i, 0);
+        memmove(t->index + pos + 1, t->index + pos, (t->index_count - pos) * sizeof(uint32_t));
+        t->index[pos] = (uint32_t)id << 8 | (uint32_t)i;
+        t->index_count++;
+    }
+}
+
+static inline int label_entry_before(const LabelTable* t, uint32_t a, uint32_t b) {
+    return label_index_cmp(t, a, label_index_text(t, b), (size_t)-1) < 0;
+}
+
+static inline int label_used_before(const LabelTable* t, uint32_t a, uint32_t b) {
+    return t->totals[a - 1].last_used > t->totals[b - 1].last_used;
+}
+
+// Stable bottom-up merge sort; tmp must hold n values
+static inline void label_sort(const LabelTable* t, uint32_t* v, uint32_t* tmp, uint32_t n,
+                              int (*before)(const LabelTable*, uint32_t, uint32_t)) {
+    uint32_t* src = v;
+    uint32_t* dst = tmp;
+    for (uint32_t width = 1; width < n; width *= 2) {
+        for (uint32_t lo = 0; lo < n; lo += 2 * width) {
+            uint32_t mid = lo + width < n ? lo + width : n;
+            uint32_t hi = lo + 2 * width < n ? lo + 2 * width : n;
+            uint32_t i = lo, j = mid, k = lo;
+            while (i < mid && j < hi) dst[k++] = before(t, src[j], src[i]) ? src[j++] : src[i++];
+            while (i < mid) dst[k++] = src[i++];
+            while (j < hi) dst[k++] = src[j++];
+        }
+        uint32_t* swap = src;
+        src = dst;
+        dst = swap;
+    }
+    if (src != v) memcpy(v, src, n * sizeof(uint32_t));
+}
+
+// Order all ids by last use for searches with a wide prefix range
+static inline void label_mru_build(LabelTable* t) {
+    free(t->mru);
+    t->mru = (uint32_t*)malloc((t->cap ? t->cap : 1) * sizeof(uint32_t));
+    uint32_t* tmp = (uint32_t*)malloc((t->count ? t->count : 1) * sizeof(uint32_t));
+    if (t->mru && tmp) {
+        for (int id = 1; id <= t->count; id++) t->mru[id - 1] = (uint32_t)id;
+        label_sort(t, t->mru, tmp, (uint32_t)t->count, label_used_before);
+    } else {
+        free(t->mru);
+        t->mru = NULL;
+    }
+    free(tmp);
+}
+
+// Map the index file, or rebuild and save it if it is missing or stale
+static inline void label_index_load(LabelTable* t, const char* index_path) {
+    strncpy(t->index_path, index_path, sizeof(t->index_path) - 1);
+    label_mru_build(t);
+    void* map = NULL;
+    size_t size = 0;
+#ifdef _WIN32
+    HANDLE file = CreateFileA(index_path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (file != INVALID_HANDLE_VALUE) {
+        size = GetFileSize(file, NULL);
+        HANDLE mapping = size >= sizeof(LabelIndexHeader) ? CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL) : NULL;
+        if (mapping) {
+            map = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+            CloseHandle(mapping); // the view keeps the mapping alive
+        }
+        CloseHandle(file);
+    }
+#else
+    int fd = open(index_path, O_RDONLY);
+    if (fd >= 0) {
+        struct stat st;
+        if (fstat(fd, &st) == 0 && (size_t)st.st_size >= sizeof(LabelIndexHeader)) {
+            size = (size_t)st.st_size;
+            map = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (map == MAP_FAILED) map = NULL;
+        }
+        close(fd);
+    }
+#endif
+    if (map) {
+        const LabelIndexHeader* h = (const LabelIndexHeader*)map;
+        if (h->magic == LABEL_INDEX_MAGIC && h->label_count == (uint32_t)t->count &&
+            size == sizeof(LabelIndexHeader) + (size_t)h->entry_count * sizeof(uint32_t)) {
+            t->index_map = map;
+            t->index_map_size = size;
+            t->index = (uint32_t*)(h + 1);
+            t->index_count = h->entry_count;
+            return;
+        }
+        t->index_map = map;
+        t->index_map_size = size;
+        label_index_unmap(t);
+    }
+
+    // Stale or missing: rebuild from the names
+    uint32_t n = 0;
+    for (int id = 1; id <= t->count; id++) {
+        const char* name = label_name(t, id);
+        for (size_t i = 0; name[i]; i++) n += (uint32_t)label_is_word_start(name, i);
+    }
+    t->index_count = 0;
+    uint32_t* tmp = (uint32_t*)malloc((n ? n : 1) * sizeof(uint32_t));
+    if (tmp && label_index_own(t, n)) {
+        for (int id = 1; id <= t->count; id++) {
+            const char* name = label_name(t, id);
+            for (size_t i = 0; name[i]; i++) {
+                if (label_is_word_start(name, i)) t->index[t->index_count++] = (uint32_t)id << 8 | (uint32_t)i;
+            }
+        }
+        label_sort(t, t->index, tmp, t->index_count, label_entry_before);
+        label_index_save(t);
+    }
+    free(tmp);
+}
+
+// Does any word of a label start with prefix (n bytes)?
+static inline int label_matches(const LabelTable* t, int id, const char* prefix, size_t n) {
+    const char* name = label_name(t, id);
+    for (size_t i = 0; name[i]; i++) {
+        if (label_is_word_start(name, i) && label_index_cmp(t, (uint32_t)id << 8 | (uint32_t)i, prefix, n) == 0) return 1;
+    }
+    return 0;
+}
+
+// Labels with a word starting with prefix, most recently used first; returns the number of ids
+static inline int label_search(const LabelTable* t, const char* prefix, int* ids, int max) {
+    size_t n = strlen(prefix);
+    uint32_t lo = n ? label_index_bound(t, prefix, 0) : 0;
+    uint32_t hi = n ? label_index_bound(t, prefix, 1) : t->index_count;
+    int count = 0;
+
+    // Many matches: the first matching labels in MRU order are the answer
+    if (hi - lo > LABEL_SCAN_LIMIT && t->mru) {
+        for (int k = 0; k < t->count && count < max; k++) {
+            if (!n || label_matches(t, (int)t->mru[k], prefix, n)) ids[count++] = (int)t->mru[k];
+        }
+        return count;
+    }
+
+    // Few matches: keep the max most recent of the range
+    for (uint32_t e = lo; e < hi; e++) {
+        int id = (int)(t->index[e] >> 8);
+        int64_t used = t->totals[id - 1].last_used;
+        if (count == max && t->totals[ids[max - 1] - 1].last_used >= used) continue;
+        int dup = 0;
+        for (int k = 0; k < count && !dup; k++) dup = ids[k] == id;
+        if (dup) continue;
+        int pos = count < max ? count : max - 1;
+        while (pos > 0 && t->totals[ids[pos - 1] - 1].last_used < used) pos--;
+        memmove(ids + pos + 1, ids + pos, (size_t)((count < max ? count : max - 1) - pos) * sizeof(int));
+        ids[pos] = id;
+        if (count < max) count++;
+    }
+    return count;
+}
+
+// Load the names and totals files; missing files give an empty table
+static inline void label_table_load(LabelTable* t, const char* names_path, const char* totals_path) {
+    memset(t, 0, sizeof(*t));
+    strncpy(t->names_path, names_path, sizeof(t->names_path) - 1);
+    strncpy(t->totals_path, totals_path, sizeof(t->totals_path) - 1);
+
+    FILE* fp = fopen(names_path, "rb");
+    if (fp) {
+        fseek(fp, 0, SEEK_END);
+        long size = ftell(fp);
+        fseek(fp, 0, SEEK_SET);
+        char* buf = size > 0 ? (char*)malloc((size_t)size) : NULL;
+        if (buf && fread(buf, 1, (size_t)size, fp) == (size_t)size) {
+            char* p = buf;
+            char* end = buf + size;
+            while (p < end) {
+                char* nl = (char*)memchr(p, '\n', (size_t)(end - p));
+                if (!nl) break; // an unfinished last line is a torn append
+                size_t len = (size_t)(nl - p);
+                if (len && p[len - 1] == '\r') len--;
+                label_add(t, p, len);
+                p = nl + 1;
+            }
+        }
+        free(buf);
+        fclose(fp);
+    }
+
+    fp = fopen(totals_path, "rb");
+    if (fp) {
+        size_t n = fread(t->totals, sizeof(LabelTotals), (size_t)t->count, fp);
+        (void)n;
+        fclose(fp);
+    }
+}
+
+static inline void label_table_free(LabelTable* t) {
+    if (t->index_map) label_index_unmap(t);
+    else free(t->index);
+    free(t->mru);
+    free(t->names);
+    free(t->offsets);
+    free(t->totals);
+    free(t->slots);
+    memset(t, 0, sizeof(*t));
+}
+
+// Return the id of a name, adding it to the names file if it is new; 0 on failure.
+// Line breaks are replaced and the name is cut to LABEL_MAX_BYTES - 1 bytes.
+static inline int label_intern(LabelTable* t, const char* name) {
+    char clean[LABEL_MAX_BYTES];
+    size_t len = 0;
+    while (*name == ' ') name++;
+    for (; *name && len < sizeof(clean) - 1; name++) {
+        clean[len++] = (*name == '\r' || *name == '\n') ? ' ' : *name;
+    }
+    // Do not cut a UTF-8 sequence in half
+    if (((uint8_t)*name & 0xC0) == 0x80) {
+        while (len && ((uint8_t)clean[len - 1] & 0xC0) == 0x80) len--;
+        if (len) len--;
+    }
+    while (len && clean[len - 1] == ' ') len--;
+    clean[len] = '\0';
+    if (len == 0) return 0;
+
+    int id = label_find(t, clean);
+    if (id) return id;
+
+    FILE* fp = fopen(t->names_path, "ab");
+    if (!fp) return 0;
+    int ok = fwrite(clean, 1, len, fp) == len && fputc('\n', fp) != EOF;
+    ok = fclose(fp) == 0 && ok;
+    id = ok ? label_add(t, clean, len) : 0;
+    if (id && t->index_path[0]) {
+        label_index_insert(t, id);
+        label_index_save(t);
+        label_mru_build(t);
+    }
+    return id;
+}
+
+// Write back the totals record of a label
+static inline void label_save_totals(const LabelTable* t, int id) {
+    if (id <= 0 || id > t->count) return;
+    FILE* fp = fopen(t->totals_path, "r+b");
+    if (!fp) fp = fopen(t->totals_path, "w+b");
+    if (!fp) return;
+    // Records of labels without sessions yet may be missing at the end of the file
+    fseek(fp, 0, SEEK_END);
+    long have = ftell(fp) / (long)sizeof(LabelTotals);
+    if (have < id - 1) {
+        fwrite(&t->totals[have], sizeof(LabelTotals), (size_t)(id - 1 - have), fp);
+    }
+    fseek(fp, (long)(id - 1) * (long)sizeof(LabelTotals), SEEK_SET);
+    fwrite(&t->totals[id - 1], sizeof(LabelTotals), 1, fp);
+    fclose(fp);
+}
+
+// Add a finished pomodoro to a label's totals and write back its record.
+// The result does not depend on the order in which records are added, so
+// sessions merged from other machines can arrive late.
+static inline void label_record(LabelTable* t, int id, int seconds, int64_t when, int32_t week) {
+    if (id <= 0 || id > t->count) return;
+    LabelTotals* lt = &t->totals[id - 1];
+    lt->count++;
+    lt->total_seconds += seconds;
+    if (week > lt->week) {
+        lt->week = week;
+        lt->week_seconds = 0;
+    }
+    if (week == lt->week) lt->week_seconds += (uint32_t)seconds;
+
+    // Keep the MRU list ordered by last use
+    if (when > lt->last_used) {
+        lt->last_used = when;
+        if (t->mru) {
+            int k = 0;
+            while (k < t->count && t->mru[k] != (uint32_t)id) k++;
+            int pos = 0;
+            while (pos < k && t->totals[t->mru[pos] - 1].last_used > when) pos++;
+            if (k < t->count) {
+                memmove(t->mru + pos + 1, t->mru + pos, (size_t)(k - pos) * sizeof(uint32_t));
+                t->mru[pos] = (uint32_t)id;
+            }
+        }
+    }
+
+    label_save_totals(t, id);
+}
+
+// Seconds spent on a label in the given week
+static inline uint32_t label_week_seconds(const LabelTable* t, int id, int32_t week) {
+    if (id <= 0 || id > t->count || t->totals[id - 1].week != week) return 0;
+    return t->totals[id - 1].week_seconds;
+}
+
+#endif
@@ -0,0 +1,184 @@
+// Pomodoro Timer metrics in the Prometheus text format
+//
+// The timer keeps a few in-memory counters about its use (sessions, focus
+// time) and its own cost (wakeups, icon renders, tray updates, hooks). Adding
+// to a counter is a single atomic add, so the tick path pays nothing more.
+// An exporter thread formats a snapshot now and then and writes it for the
+// node exporter's textfile collector: the text goes to "<path>.tmp" first and
+// is renamed over <path>, so a scrape never sees half a file. The collector
+// only reads *.prom files, so the temporary file is ignored.
+//
+// Counters start at zero with the process; Prometheus handles the reset.
+#ifndef POMODORO_METRICS_H
+#define POMODORO_METRICS_H
+
+#include <stdint.h>
+#include <stdio.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#endif
+
+#define METRICS_KINDS 3    // pomodoro, short break, long break
+#define METRICS_OUTCOMES 3 // completed, stopped, expired
+
+typedef struct {
+    volatile int64_t sessions[METRICS_KINDS][METRICS_OUTCOMES];
+    volatile int64_t focus_seconds;
+    volatile int64_t timer_wakeups;
+    volatile int64_t icon_renders;
+    volatile int64_t notify_icon_calls;
+    volatile int64_t animation_frames;
+    volatile int64_t animation_frames_dropped; // skipped to keep the countdown on time
+    volatile int64_t hook_runs;
+    volatile int64_t hook_timeouts;
+    volatile int64_t hook_milliseconds;
+    volatile int64_t hotkey_presses;
+    volatile int64_t hotkey_microseconds;     // from the key press to the icon change
+    volatile int64_t hotkey_max_microseconds;
+} PomodoroMetrics;
+
+// Values sampled by the exporter when it writes the file
+typedef struct {
+    int running;
+    int hook_queue_depth;
+    int64_t hooks_dropped;
+    int64_t private_bytes;
+    int64_t gdi_objects;
+    int64_t user_objects;
+    int64_t start_time;    // unix seconds the process started
+} PomodoroGauges;
+
+static inline void metrics_add(volatile int64_t* counter, int64_t n) {
+#if defined(_MSC_VER) && !defined(__clang__)
+    InterlockedExchangeAdd64((volatile LONG64*)counter, n);
+#else
+    __atomic_fetch_add(counter, n, __ATOMIC_RELAXED);
+#endif
+}
+
+// Raise a high-water mark
+static inline void metrics_max(volatile int64_t* counter, int64_t value) {
+#if defined(_MSC_VER) && !defined(__clang__)
+    LONG64 seen = InterlockedCompareExchange64((volatile LONG64*)counter, 0, 0);
+    while (value > seen) {
+        LONG64 prev = InterlockedCompareExchange64((volatile LONG64*)counter, value, seen);
+        if (prev == seen) break;
+        seen = prev;
+    }
+#else
+    int64_t seen = __atomic_load_n(counter, __ATOMIC_RELAXED);
+    while (value > seen && !__atomic_compare_exchange_n(counter, &seen, value, 0, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+    }
+#endif
+}
+
+static inline int64_t metrics_get(const volatile int64_t* counter) {
+#if defined(_MSC_VER) && !defined(__clang__)
+    return InterlockedCompareExchange64((volatile LONG64*)counter, 0, 0);
+#else
+    return __atomic_load_n(counter, __ATOMIC_RELAXED);
+#endif
+}
+
+// Append to a buffer, remembering if anything did not fit
+typedef struct {
+    char* out;
+    size_t size, len;
+    int truncated;
+} MetricsText;
+
+static inline void metrics_append(MetricsText* t, const char* text) {
+    for (; *text; text++) {
+        if (t->len + 1 >= t->size) {
+            t->truncated = 1;
+            return;
+        }
+        t->out[t->len++] = *text;
+    }
+    t->out[t->len] = '\0';
+}
+
+static inline void metrics_family(MetricsText* t, const char* name, const char* type, const char* help) {
+    char line[256];
+    snprintf(line, sizeof(line), "# HELP %s %s\n# TYPE %s %s\n", name, help, name, type);
+    metrics_append(t, line);
+}
+
+static inline void metrics_sample(MetricsText* t, const char* name, const char* labels, int64_t value) {
+    char line[256];
+    snprintf(line, sizeof(line), "%s%s%s%s %lld\n", name, labels ? "{" : "", labels ? labels : "", labels ? "}" : "",
+             (long long)value);
+    metrics_append(t, line);
+}
+
+static inline void metrics_single(MetricsText* t, const char* name, const char* type, const char* help, int64_t value) {
+    metrics_family(t, name, type, help);
+    metrics_sample(t, name, NULL, value);
+}
+
+// Format a snapshot; returns the length, or -1 if the buffer is too small
+static inline int metrics_format(const PomodoroMetrics* m, const PomodoroGauges* g, char* out, size_t size) {
+    static const char* kinds[METRICS_KINDS] = {"pomodoro", "short_break", "long_break"};
+    static const char* outcomes[METRICS_OUTCOMES] = {"completed", "stopped", "expired"};
+    MetricsText t = {out, size, 0, 0};
+    if (size == 0) return -1;
+    out[0] = '\0';
+
+    metrics_family(&t, "pomodoro_sessions_total", "counter", "Sessions that ended, by kind and outcome.");
+    for (int k = 0; k < METRICS_KINDS; k++) {
+        for (int o = 0; o < METRICS_OUTCOMES; o++) {
+            char labels[64];
+            snprintf(labels, sizeof(labels), "kind=\"%s\",outcome=\"%s\"", kinds[k], outcomes[o]);
+            metrics_sample(&t, "pomodoro_sessions_total", labels, metrics_get(&m->sessions[k][o]));
+        }
+    }
+    metrics_single(&t, "pomodoro_focus_seconds_total", "counter", "Seconds spent in Pomodoros.",
+                   metrics_get(&m->focus_seconds));
+    metrics_single(&t, "pomodoro_running", "gauge", "1 while a session is counting down.", g->running);
+    metrics_single(&t, "pomodoro_timer_wakeups_total", "counter", "Times the timer thread woke up.",
+                   metrics_get(&m->timer_wakeups));
+    metrics_single(&t, "pomodoro_icon_renders_total", "counter", "Tray icons rendered.",
+                   metrics_get(&m->icon_renders));
+    metrics_single(&t, "pomodoro_notify_icon_calls_total", "counter", "Shell_NotifyIcon calls to update the tray icon.",
+                   metrics_get(&m->notify_icon_calls));
+    metrics_single(&t, "pomodoro_animation_frames_total", "counter", "Countdown and completion frames shown.",
+                   metrics_get(&m->animation_frames));
+    metrics_single(&t, "pomodoro_animation_frames_dropped_total", "counter", "Countdown and completion frames skipped.",
+                   metrics_get(&m->animation_frames_dropped));
+    metrics_single(&t, "pomodoro_hook_runs_total", "counter", "Hook commands run.", metrics_get(&m->hook_runs));
+    metrics_single(&t, "pomodoro_hook_timeouts_total", "counter", "Hook commands killed after the timeout.",
+                   metrics_get(&m->hook_timeouts));
+    metrics_single(&t, "pomodoro_hook_milliseconds_total", "counter", "Time spent running hook commands.",
+                   metrics_get(&m->hook_milliseconds));
+    metrics_single(&t, "pomodoro_hotkeys_total", "counter", "Global hotkeys pressed.", metrics_get(&m->hotkey_presses));
+    metrics_single(&t, "pomodoro_hotkey_latency_microseconds_total", "counter",
+                   "Time from hotkey presses to the tray icon change.", metrics_get(&m->hotkey_microseconds));
+    metrics_single(&t, "pomodoro_hotkey_latency_max_microseconds", "gauge",
+                   "Longest time from a hotkey press to the tray icon change.", metrics_get(&m->hotkey_max_microseconds));
+    metrics_single(&t, "pomodoro_hooks_dropped_total", "counter", "Hook events dropped because the queue was full.",
+                   g->hooks_dropped);
+    metrics_single(&t, "pomodoro_hook_queue_depth", "gauge", "Hook events waiting to run.", g->hook_queue_depth);
+    metrics_single(&t, "pomodoro_private_bytes", "gauge", "Private memory of the process.", g->private_bytes);
+    metrics_single(&t, "pomodoro_gdi_objects", "gauge", "GDI handles held by the process.", g->gdi_objects);
+    metrics_single(&t, "pomodoro_user_objects", "gauge", "USER handles held by the process.", g->user_objects);
+    metrics_single(&t, "pomodoro_start_time_seconds", "gauge", "Unix time the process started.", g->start_time);
+    return t.truncated ? -1 : (int)t.len;
+}
+
+// Write the text next to the target and rename it into place
+static inline int metrics_write_textfile(const char* path, const char* text, size_t len) {
+    char tmp[1024];
+    if (snprintf(tmp, sizeof(tmp), "%s.tmp", path) >= (int)sizeof(tmp)) return 0;
+    FILE* fp = fopen(tmp, "wb");
+    if (!fp) return 0;
+    int ok = fwrite(text, 1, len, fp) == len;
+    if (fclose(fp) != 0) ok = 0;
+#ifdef _WIN32
+    return ok && MoveFileExA(tmp, path, MOVEFILE_REPLACE_EXISTING);
+#else
+    return ok && rename(tmp, path) == 0;
+#endif
+}
+
+#endif
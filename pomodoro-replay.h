@@ -0,0 +1,137 @@
+// Pomodoro Timer input recording
+//
+// A recording is the stream of events that reach the timer: tray clicks, menu
+// commands, toast buttons, commands from other instances, and the seconds the
+// timer thread counted down. Replaying it drives the same handlers with the
+// same events, and the timer advances only by the recorded ticks, so a run
+// reaches the same states at any speed. Latencies are collected per event type
+// for the replay report.
+//
+// Only the file and the latency statistics are portable. The timer's state
+// machine is not separated from the Win32 handlers in pomodoro-timer.c, so a
+// recording can be replayed only there (--replay on Windows); the Linux test
+// covers the file and the statistics, not a replay.
+//
+// File: "PRP1", then 8 byte events with the milliseconds since the recording
+// started, all little-endian.
+#ifndef POMODORO_REPLAY_H
+#define POMODORO_REPLAY_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define REPLAY_MAGIC 0x31505250 // "PRP1"
+
+#define REPLAY_TICK 0   // arg: seconds counted down
+#define REPLAY_TRAY 1   // arg: mouse message of the tray icon
+#define REPLAY_MENU 2   // arg: menu command
+#define REPLAY_TOAST 3  // arg: toast button id, 0 for a click on the background
+#define REPLAY_REMOTE 4 // arg: REMOTE_CMD_* from another instance
+#define REPLAY_TYPES 5
+
+typedef struct {
+    uint32_t ms;   // since the recording started
+    uint8_t type;  // REPLAY_*
+    uint8_t reserved;
+    uint16_t arg;
+} ReplayEvent;
+
+typedef struct {
+    ReplayEvent* events;
+    uint32_t count;
+} ReplayTrace;
+
+// Latencies of one event type, in microseconds
+typedef struct {
+    double* samples;
+    uint32_t count, cap;
+} ReplayLatency;
+
+static inline const char* replay_type_name(int type) {
+    static const char* names[REPLAY_TYPES] = {"tick", "tray click", "menu command", "toast button", "remote command"};
+    return type >= 0 && type < REPLAY_TYPES ? names[type] : "unknown";
+}
+
+// Start a recording; returns NULL if the file cannot be created
+static inline FILE* replay_record_open(const char* path) {
+    FILE* fp = fopen(path, "wb");
+    uint32_t magic = REPLAY_MAGIC;
+    if (fp && fwrite(&magic, sizeof(magic), 1, fp) != 1) {
+        fclose(fp);
+        fp = NULL;
+    }
+    return fp;
+}
+
+static inline void replay_record(FILE* fp, uint32_t ms, int type, int arg) {
+    ReplayEvent e = {ms, (uint8_t)type, 0, (uint16_t)arg};
+    fwrite(&e, sizeof(e), 1, fp);
+}
+
+// Load a recording; returns 0 if the file is missing or not a recording
+static inline int replay_load(ReplayTrace* t, const char* path) {
+    memset(t, 0, sizeof(*t));
+    FILE* fp = fopen(path, "rb");
+    if (!fp) return 0;
+    uint32_t magic = 0;
+    int ok = fread(&magic, sizeof(magic), 1, fp) == 1 && magic == REPLAY_MAGIC;
+    uint32_t cap = 0;
+    ReplayEvent e;
+    while (ok && fread(&e, sizeof(e), 1, fp) == 1) {
+        if (e.type >= REPLAY_TYPES) continue;
+        if (t->count == cap) {
+            cap = cap ? cap * 2 : 1024;
+            ReplayEvent* events = (ReplayEvent*)realloc(t->events, cap * sizeof(ReplayEvent));
+            if (!events) {
+                ok = 0;
+                break;
+            }
+            t->events = events;
+        }
+        t->events[t->count++] = e;
+    }
+    fclose(fp);
+    if (!ok) {
+        free(t->events);
+        memset(t, 0, sizeof(*t));
+    }
+    return ok;
+}
+
+static inline void replay_free(ReplayTrace* t) {
+    free(t->events);
+    memset(t, 0, sizeof(*t));
+}
+
+static inline void replay_latency_add(ReplayLatency* l, double us) {
+    if (l->count == l->cap) {
+        uint32_t cap = l->cap ? l->cap * 2 : 256;
+        double* samples = (double*)realloc(l->samples, cap * sizeof(double));
+        if (!samples) return;
+        l->samples = samples;
+        l->cap = cap;
+    }
+    l->samples[l->count++] = us;
+}
+
+static inline int replay_compare_double(const void* a, const void* b) {
+    double x = *(const double*)a, y = *(const double*)b;
+    return x < y ? -1 : x > y;
+}
+
+// Sort the samples and take a percentile (0-100)
+static inline double replay_percentile(ReplayLatency* l, double pct) {
+    if (l->count == 0) return 0;
+    qsort(l->samples, l->count, sizeof(double), replay_compare_double);
+    uint32_t i = (uint32_t)(pct / 100.0 * (l->count - 1) + 0.5);
+    return l->samples[i];
+}
+
+static inline void replay_latency_free(ReplayLatency* l) {
+    free(l->samples);
+    memset(l, 0, sizeof(*l));
+}
+
+#endif
@@ -0,0 +1,569 @@
+// Pomodoro Timer team report
+//
+// Aggregates a folder of per-user session logs, the <user>.pomodoro.log
+// segments written by history sync, into per-day, per-user and per-label
+// totals with percentiles of the Pomodoro length.
+//
+// The logs are cut into fixed-size byte ranges. A segment is appended in time
+// order, so every range is also a time range of one user. Worker threads, one
+// per core, take the next range from a shared atomic cursor until none is
+// left; a thread that finishes early simply takes more, so one user with a
+// large history does not hold up the rest. Each thread aggregates into its own
+// partial result without locks, and the partials are added up at the end.
+// Histograms are merged bin by bin, so the percentiles are exact and the
+// report is the same for any number of threads.
+#ifndef POMODORO_REPORT_H
+#define POMODORO_REPORT_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <dirent.h>
+#include <pthread.h>
+#include <unistd.h>
+#endif
+
+#define TEAM_REPORT_SUFFIX ".pomodoro.log"
+#define TEAM_REPORT_CHUNK (4 * 1024 * 1024) // bytes per work item
+#define TEAM_REPORT_LINE_MAX 4096           // longest line read past the end of a range
+#define TEAM_REPORT_MAX_THREADS 64
+#define TEAM_REPORT_MAX_DAY 200000          // unix day numbers beyond this are ignored
+#define TEAM_LENGTH_BINS 14401              // Pomodoro length in seconds, 0-4 hours
+#define TEAM_USER_BINS 241                  // per-user Pomodoro length in minutes, 0-4 hours
+
+typedef struct {
+    uint32_t sessions;       // all sessions, breaks included
+    uint32_t pomodoros;      // Pomodoros that were not stopped
+    uint64_t focus_seconds;  // seconds spent in Pomodoros
+} TeamTotals;
+
+typedef struct {
+    char* name;
+    uint32_t hash;
+    TeamTotals totals;
+} TeamLabel;
+
+typedef struct {
+    TeamTotals* days;        // indexed by unix day number
+    int32_t day_cap;
+    TeamTotals* users;       // indexed like TeamReport.users
+    uint32_t** user_hist;    // per user, allocated on first use
+    TeamLabel* labels;       // open-addressing hash table by name
+    uint32_t label_count, label_mask;
+    uint32_t length_hist[TEAM_LENGTH_BINS];
+    uint32_t focus_hist[101];
+    uint64_t bad_lines;
+} TeamPartial;
+
+typedef struct {
+    int file;
+    int64_t begin, end;
+} TeamWorkItem;
+
+typedef struct {
+    char** users;            // user names, sorted
+    char** paths;            // log file of each user
+    int user_count;
+    TeamWorkItem* items;
+    int item_count;
+    volatile long next_item; // shared cursor into items
+    TeamPartial* partials;   // one per thread; partials[0] holds the merged result
+    int thread_count;
+} TeamReport;
+
+static inline uint32_t team_hash(const char* s, size_t len) {
+    uint32_t h = 2166136261u;
+    for (size_t i = 0; i < len; i++) h = (h ^ (uint8_t)s[i]) * 16777619u;
+    return h;
+}
+
+static inline FILE* team_fopen(const char* utf8_path) {
+#ifdef _WIN32
+    wchar_t path[MAX_PATH];
+    if (!MultiByteToWideChar(CP_UTF8, 0, utf8_path, -1, path, MAX_PATH)) return NULL;
+    return _wfopen(path, L"rb");
+#else
+    return fopen(utf8_path, "rb");
+#endif
+}
+
+static inline int64_t team_file_size(FILE* fp) {
+#ifdef _WIN32
+    if (_fseeki64(fp, 0, SEEK_END) != 0) return -1;
+    return _ftelli64(fp);
+#else
+    if (fseeko(fp, 0, SEEK_END) != 0) return -1;
+    return (int64_t)ftello(fp);
+#endif
+}
+
+static inline int team_seek(FILE* fp, int64_t offset) {
+#ifdef _WIN32
+    return _fseeki64(fp, offset, SEEK_SET) == 0;
+#else
+    return fseeko(fp, (off_t)offset, SEEK_SET) == 0;
+#endif
+}
+
+static inline int team_name_cmp(const void* a, const void* b) {
+    return strcmp(*(char* const*)a, *(char* const*)b);
+}
+
+// Add a user log; the name is the file name without the suffix
+static inline int team_add_user(TeamReport* r, int* cap, const char* dir, const char* file_name) {
+    size_t len = strlen(file_name), suffix = strlen(TEAM_REPORT_SUFFIX);
+    if (len <= suffix || strcmp(file_name + len - suffix, TEAM_REPORT_SUFFIX) != 0) return 1;
+    if (r->user_count == *cap) {
+        int new_cap = *cap ? *cap * 2 : 64;
+        char** users = (char**)realloc(r->users, new_cap * sizeof(char*));
+        if (!users) return 0;
+        r->users = users;
+        *cap = new_cap;
+    }
+    // "name\0dir/file\0" in one allocation, so sorting the names keeps the paths
+    size_t dir_len = strlen(dir);
+    char* entry = (char*)malloc(len - suffix + 1 + dir_len + 1 + len + 1);
+    if (!entry) return 0;
+    memcpy(entry, file_name, len - suffix);
+    entry[len - suffix] = '\0';
+    char* path = entry + len - suffix + 1;
+    memcpy(path, dir, dir_len);
+    path[dir_len] = '/';
+    memcpy(path + dir_len + 1, file_name, len + 1);
+    r->users[r->user_count++] = entry;
+    return 1;
+}
+
+// Collect the user logs of a folder, sorted by user name
+static inline int team_list_users(TeamReport* r, const char* dir) {
+    int cap = 0;
+#ifdef _WIN32
+    wchar_t pattern[MAX_PATH];
+    int n = MultiByteToWideChar(CP_UTF8, 0, dir, -1, pattern, MAX_PATH - 24);
+    if (!n) return 0;
+    wcscat(pattern, L"\\*.pomodoro.log");
+    WIN32_FIND_DATAW fd;
+    HANDLE find = FindFirstFileW(pattern, &fd);
+    if (find == INVALID_HANDLE_VALUE) return 1;
+    do {
+        char name[MAX_PATH * 3];
+        if (fd.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) continue;
+        if (!WideCharToMultiByte(CP_UTF8, 0, fd.cFileName, -1, name, sizeof(name), NULL, NULL)) continue;
+        if (!team_add_user(r, &cap, dir, name)) {
+            FindClose(find);
+            return 0;
+        }
+    } while (FindNextFileW(find, &fd));
+    FindClose(find);
+#else
+    DIR* d = opendir(dir);
+    if (!d) return 0;
+    struct dirent* e;
+    while ((e = readdir(d)) != NULL) {
+        if (!team_add_user(r, &cap, dir, e->d_name)) {
+            closedir(d);
+            return 0;
+        }
+    }
+    closedir(d);
+#endif
+    if (r->user_count > 1) qsort(r->users, r->user_count, sizeof(char*), team_name_cmp);
+    r->paths = (char**)malloc((r->user_count + 1) * sizeof(char*));
+    if (!r->paths) return 0;
+    for (int i = 0; i < r->user_count; i++) r->paths[i] = r->users[i] + strlen(r->users[i]) + 1;
+    return 1;
+}
+
+// Cut every log into ranges of TEAM_REPORT_CHUNK bytes
+static inline int team_split_work(TeamReport* r) {
+    int cap = r->user_count + 16;
+    r->items = (TeamWorkItem*)malloc(cap * sizeof(TeamWorkItem));
+    if (!r->items) return 0;
+    for (int f = 0; f < r->user_count; f++) {
+        FILE* fp = team_fopen(r->paths[f]);
+        if (!fp) continue;
+        int64_t size = team_file_size(fp);
+        fclose(fp);
+        for (int64_t begin = 0; begin < size; begin += TEAM_REPORT_CHUNK) {
+            if (r->item_count == cap) {
+                cap *= 2;
+                TeamWorkItem* items = (TeamWorkItem*)realloc(r->items, cap * sizeof(TeamWorkItem));
+                if (!items) return 0;
+                r->items = items;
+            }
+            TeamWorkItem* item = &r->items[r->item_count++];
+            item->file = f;
+            item->begin = begin;
+            item->end = begin + TEAM_REPORT_CHUNK < size ? begin + TEAM_REPORT_CHUNK : size;
+        }
+    }
+    return 1;
+}
+
+static inline TeamTotals* team_label_slot(TeamPartial* p, const char* name, size_t len) {
+    if ((p->label_count + 1) * 2 > p->label_mask + 1) {
+        uint32_t mask = p->label_mask ? p->label_mask * 2 + 1 : 255;
+        TeamLabel* table = (TeamLabel*)calloc(mask + 1, sizeof(TeamLabel));
+        if (!table) return NULL;
+        for (uint32_t i = 0; p->labels && i <= p->label_mask; i++) {
+            if (!p->labels[i].name) continue;
+            uint32_t s = p->labels[i].hash & mask;
+            while (table[s].name) s = (s + 1) & mask;
+            table[s] = p->labels[i];
+        }
+        free(p->labels);
+        p->labels = table;
+        p->label_mask = mask;
+    }
+    uint32_t h = team_hash(name, len);
+    uint32_t s = h & p->label_mask;
+    while (p->labels[s].name) {
+        if (p->labels[s].hash == h && strncmp(p->labels[s].name, name, len) == 0 && p->labels[s].name[len] == '\0') {
+            return &p->labels[s].totals;
+        }
+        s = (s + 1) & p->label_mask;
+    }
+    char* copy = (char*)malloc(len + 1);
+    if (!copy) return NULL;
+    memcpy(copy, name, len);
+    copy[len] = '\0';
+    p->labels[s].name = copy;
+    p->labels[s].hash = h;
+    p->label_count++;
+    return &p->labels[s].totals;
+}
+
+static inline int team_day_slot(TeamPartial* p, int64_t day) {
+    if (day >= p->day_cap) {
+        int32_t cap = p->day_cap ? p->day_cap : 1024;
+        while (cap <= day) cap *= 2;
+        TeamTotals* days = (TeamTotals*)realloc(p->days, cap * sizeof(TeamTotals));
+        if (!days) return 0;
+        memset(days + p->day_cap, 0, (cap - p->day_cap) * sizeof(TeamTotals));
+        p->days = days;
+        p->day_cap = cap;
+    }
+    return 1;
+}
+
+// Parse a decimal field ending at a comma; returns the position after the comma or NULL
+static inline const char* team_field_int(const char* s, const char* end, int64_t* value) {
+    int64_t v = 0;
+    int neg = 0, digits = 0;
+    if (s < end && *s == '-') {
+        neg = 1;
+        s++;
+    }
+    while (s < end && *s >= '0' && *s <= '9') {
+        v = v * 10 + (*s++ - '0');
+        digits++;
+    }
+    if (s >= end || *s != ',' || digits == 0) return NULL;
+    *value = neg ? -v : v;
+    return s + 1;
+}
+
+// Aggregate one line: seq,start,kind,planned,actual,outcome,focus,label
+static inline void team_add_line(TeamPartial* p, int user, const char* s, const char* end) {
+    int64_t seq, start, planned, actual, focus = -1;
+    if (end > s && end[-1] == '\r') end--;
+    if (!(s = team_field_int(s, end, &seq)) || !(s = team_field_int(s, end, &start))) goto bad;
+    const char* kind = s;
+    while (s < end && *s != ',') s++;
+    if (s >= end) goto bad;
+    int is_pomodoro = s - kind == 8 && memcmp(kind, "pomodoro", 8) == 0;
+    if (!(s = team_field_int(s + 1, end, &planned)) || !(s = team_field_int(s, end, &actual))) goto bad;
+    const char* outcome = s;
+    while (s < end && *s != ',') s++;
+    if (s >= end) goto bad;
+    int stopped = s - outcome == 7 && memcmp(outcome, "stopped", 7) == 0;
+    s++;
+    if (s < end && *s == ',') {
+        s++;
+    } else if (!(s = team_field_int(s, end, &focus))) {
+        goto bad;
+    }
+    if (actual < 0) actual = 0;
+
+    TeamTotals* u = &p->users[user];
+    u->sessions++;
+    int64_t day = start / 86400;
+    TeamTotals* d = day >= 0 && day <= TEAM_REPORT_MAX_DAY && team_day_slot(p, day) ? &p->days[day] : NULL;
+    if (d) d->sessions++;
+    if (!is_pomodoro) return;
+
+    int counted = !stopped;
+    u->pomodoros += counted;
+    u->focus_seconds += actual;
+    if (d) {
+        d->pomodoros += counted;
+        d->focus_seconds += actual;
+    }
+    if (s < end) {
+        TeamTotals* l = team_label_slot(p, s, end - s);
+        if (l) {
+            l->sessions++;
+            l->pomodoros += counted;
+            l->focus_seconds += actual;
+        }
+    }
+    if (counted) {
+        p->length_hist[actual < TEAM_LENGTH_BINS ? actual : TEAM_LENGTH_BINS - 1]++;
+        if (!p->user_hist[user]) p->user_hist[user] = (uint32_t*)calloc(TEAM_USER_BINS, sizeof(uint32_t));
+        if (p->user_hist[user]) p->user_hist[user][actual / 60 < TEAM_USER_BINS ? actual / 60 : TEAM_USER_BINS - 1]++;
+        if (focus >= 0 && focus <= 100) p->focus_hist[focus]++;
+    }
+    return;
+bad:
+    p->bad_lines++;
+}
+
+// Aggregate the lines that start inside one range. The line that crosses the
+// end of the range is finished here; the next range skips it.
+static inline void team_run_item(TeamReport* r, TeamPartial* p, const TeamWorkItem* item, char* buf) {
+    FILE* fp = team_fopen(r->paths[item->file]);
+    if (!fp) return;
+    int64_t from = item->begin > 0 ? item->begin - 1 : 0;
+    size_t want = (size_t)(item->end - from) + TEAM_REPORT_LINE_MAX;
+    size_t got = team_seek(fp, from) ? fread(buf, 1, want, fp) : 0;
+    fclose(fp);
+
+    const char* s = buf;
+    const char* stop = buf + (item->end - from); // lines must start before this
+    const char* end = buf + got;
+    if (item->begin > 0) {
+        // Start after the first line break at or after begin - 1
+        while (s < end && *s != '\n') s++;
+        s++;
+    }
+    while (s < stop && s < end) {
+        const char* nl = (const char*)memchr(s, '\n', end - s);
+        if (!nl) {
+            if (got < want) team_add_line(p, item->file, s, end); // last line without a line break
+            else p->bad_lines++;
+            break;
+        }
+        if (nl > s) team_add_line(p, item->file, s, nl);
+        s = nl + 1;
+    }
+}
+
+typedef struct {
+    TeamReport* report;
+    TeamPartial* partial;
+} TeamWorker;
+
+static inline long team_next_item(TeamReport* r) {
+#ifdef _WIN32
+    return InterlockedIncrement(&r->next_item) - 1;
+#else
+    return __atomic_fetch_add(&r->next_item, 1, __ATOMIC_RELAXED);
+#endif
+}
+
+#ifdef _WIN32
+static DWORD WINAPI team_worker(LPVOID arg) {
+#else
+static void* team_worker(void* arg) {
+#endif
+    TeamWorker* w = (TeamWorker*)arg;
+    char* buf = (char*)malloc(TEAM_REPORT_CHUNK + TEAM_REPORT_LINE_MAX + 1);
+    if (buf) {
+        long i;
+        while ((i = team_next_item(w->report)) < w->report->item_count) {
+            team_run_item(w->report, w->partial, &w->report->items[i], buf);
+        }
+        free(buf);
+    }
+    return 0;
+}
+
+static inline void team_add_totals(TeamTotals* to, const TeamTotals* from) {
+    to->sessions += from->sessions;
+    to->pomodoros += from->pomodoros;
+    to->focus_seconds += from->focus_seconds;
+}
+
+// Add partial b into partial a
+static inline void team_merge(TeamPartial* a, TeamPartial* b, int user_count) {
+    if (b->day_cap > 0 && team_day_slot(a, b->day_cap - 1)) {
+        for (int32_t d = 0; d < b->day_cap; d++) team_add_totals(&a->days[d], &b->days[d]);
+    }
+    for (int u = 0; u < user_count; u++) {
+        team_add_totals(&a->users[u], &b->users[u]);
+        if (!b->user_hist[u]) continue;
+        if (!a->user_hist[u]) {
+            a->user_hist[u] = b->user_hist[u];
+            b->user_hist[u] = NULL;
+            continue;
+        }
+        for (int i = 0; i < TEAM_USER_BINS; i++) a->user_hist[u][i] += b->user_hist[u][i];
+    }
+    for (uint32_t i = 0; b->labels && i <= b->label_mask; i++) {
+        if (!b->labels[i].name) continue;
+        TeamTotals* l = team_label_slot(a, b->labels[i].name, strlen(b->labels[i].name));
+        if (l) team_add_totals(l, &b->labels[i].totals);
+    }
+    for (int i = 0; i < TEAM_LENGTH_BINS; i++) a->length_hist[i] += b->length_hist[i];
+    for (int i = 0; i <= 100; i++) a->focus_hist[i] += b->focus_hist[i];
+    a->bad_lines += b->bad_lines;
+}
+
+static inline void team_partial_free(TeamPartial* p, int user_count) {
+    free(p->days);
+    free(p->users);
+    for (int u = 0; p->user_hist && u < user_count; u++) free(p->user_hist[u]);
+    free(p->user_hist);
+    for (uint32_t i = 0; p->labels && i <= p->label_mask; i++) free(p->labels[i].name);
+    free(p->labels);
+}
+
+static inline void team_report_free(TeamReport* r) {
+    for (int t = 0; r->partials && t < r->thread_count; t++) team_partial_free(&r->partials[t], r->user_count);
+    free(r->partials);
+    for (int u = 0; u < r->user_count; u++) free(r->users[u]);
+    free(r->users);
+    free(r->paths);
+    free(r->items);
+    memset(r, 0, sizeof(*r));
+}
+
+static inline int team_cpu_count(void) {
+#ifdef _WIN32
+    SYSTEM_INFO si;
+    GetSystemInfo(&si);
+    return (int)si.dwNumberOfProcessors;
+#else
+    long n = sysconf(_SC_NPROCESSORS_ONLN);
+    return n > 0 ? (int)n : 1;
+#endif
+}
+
+// Aggregate all logs of a folder; threads <= 0 uses one thread per core.
+// Returns 1 on success; free the report with team_report_free either way.
+static inline int team_report_run(TeamReport* r, const char* dir, int threads) {
+    memset(r, 0, sizeof(*r));
+    if (!team_list_users(r, dir) || !team_split_work(r)) return 0;
+    if (threads <= 0) threads = team_cpu_count();
+    if (threads > r->item_count) threads = r->item_count;
+    if (threads > TEAM_REPORT_MAX_THREADS) threads = TEAM_REPORT_MAX_THREADS;
+    if (threads < 1) threads = 1;
+
+    r->partials = (TeamPartial*)calloc(threads, sizeof(TeamPartial));
+    if (!r->partials) return 0;
+    r->thread_count = threads;
+    for (int t = 0; t < threads; t++) {
+        r->partials[t].users = (TeamTotals*)calloc(r->user_count + 1, sizeof(TeamTotals));
+        r->partials[t].user_hist = (uint32_t**)calloc(r->user_count + 1, sizeof(uint32_t*));
+        if (!r->partials[t].users || !r->partials[t].user_hist) return 0;
+    }
+
+    TeamWorker workers[TEAM_REPORT_MAX_THREADS];
+#ifdef _WIN32
+    HANDLE handles[TEAM_REPORT_MAX_THREADS];
+#else
+    pthread_t handles[TEAM_REPORT_MAX_THREADS];
+#endif
+    int started = 0;
+    for (int t = 0; t < threads; t++) {
+        workers[t].report = r;
+        workers[t].partial = &r->partials[t];
+        // The calling thread takes the first share itself
+        if (t == 0) continue;
+#ifdef _WIN32
+        handles[started] = CreateThread(NULL, 0, team_worker, &workers[t], 0, NULL);
+        if (handles[started]) started++;
+#else
+        if (pthread_create(&handles[started], NULL, team_worker, &workers[t]) == 0) started++;
+#endif
+    }
+    team_worker(&workers[0]);
+#ifdef _WIN32
+    if (started > 0) WaitForMultipleObjects(started, handles, TRUE, INFINITE);
+    for (int t = 0; t < started; t++) CloseHandle(handles[t]);
+#else
+    for (int t = 0; t < started; t++) pthread_join(handles[t], NULL);
+#endif
+
+    for (int t = 1; t < threads; t++) team_merge(&r->partials[0], &r->partials[t], r->user_count);
+    return 1;
+}
+
+// Smallest bin holding the given fraction of a histogram (0 if empty)
+static inline int team_percentile(const uint32_t* hist, int bins, double fraction) {
+    uint64_t total = 0, seen = 0;
+    for (int i = 0; i < bins; i++) total += hist[i];
+    if (total == 0) return 0;
+    uint64_t rank = (uint64_t)(fraction * (double)total);
+    if (rank >= total) rank = total - 1;
+    for (int i = 0; i < bins; i++) {
+        seen += hist[i];
+        if (seen > rank) return i;
+    }
+    return bins - 1;
+}
+
+static inline int team_label_order(const void* a, const void* b) {
+    const TeamLabel* x = *(const TeamLabel* const*)a;
+    const TeamLabel* y = *(const TeamLabel* const*)b;
+    if (x->totals.focus_seconds != y->totals.focus_seconds) return x->totals.focus_seconds > y->totals.focus_seconds ? -1 : 1;
+    return strcmp(x->name, y->name);
+}
+
+// Write the merged report as CSV sections; returns 1 on success
+static inline int team_report_write(const TeamReport* r, FILE* out) {
+    const TeamPartial* p = &r->partials[0];
+    TeamTotals all = {0, 0, 0};
+    for (int u = 0; u < r->user_count; u++) team_add_totals(&all, &p->users[u]);
+
+    fprintf(out, "users,sessions,pomodoros,focus_seconds,length_p50,length_p90,length_p99,focus_p50,bad_lines\n");
+    fprintf(out, "%d,%u,%u,%llu,%d,%d,%d,%d,%llu\n\n", r->user_count, all.sessions, all.pomodoros,
+            (unsigned long long)all.focus_seconds, team_percentile(p->length_hist, TEAM_LENGTH_BINS, 0.5),
+            team_percentile(p->length_hist, TEAM_LENGTH_BINS, 0.9), team_percentile(p->length_hist, TEAM_LENGTH_BINS, 0.99),
+            team_percentile(p->focus_hist, 101, 0.5), (unsigned long long)p->bad_lines);
+
+    fprintf(out, "date,sessions,pomodoros,focus_seconds\n");
+    for (int32_t d = 0; d < p->day_cap; d++) {
+        if (!p->days[d].sessions) continue;
+        // Civil date from a day number (days since 1970-01-01)
+        int64_t z = d + 719468, era = z / 146097, doe = z - era * 146097;
+        int64_t yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+        int64_t doy = doe - (365 * yoe + yoe / 4 - yoe / 100), mp = (5 * doy + 2) / 153;
+        int day = (int)(doy - (153 * mp + 2) / 5 + 1), month = (int)(mp < 10 ? mp + 3 : mp - 9);
+        int year = (int)(yoe + era * 400 + (month <= 2));
+        fprintf(out, "%04d-%02d-%02d,%u,%u,%llu\n", year, month, day, p->days[d].sessions, p->days[d].pomodoros,
+                (unsigned long long)p->days[d].focus_seconds);
+    }
+
+    fprintf(out, "\nuser,sessions,pomodoros,focus_seconds,length_p50_minutes,length_p90_minutes\n");
+    for (int u = 0; u < r->user_count; u++) {
+        static const uint32_t empty[TEAM_USER_BINS];
+        const uint32_t* hist = p->user_hist[u] ? p->user_hist[u] : empty;
+        fprintf(out, "%s,%u,%u,%llu,%d,%d\n", r->users[u], p->users[u].sessions, p->users[u].pomodoros,
+                (unsigned long long)p->users[u].focus_seconds, team_percentile(hist, TEAM_USER_BINS, 0.5),
+                team_percentile(hist, TEAM_USER_BINS, 0.9));
+    }
+
+    // Labels by time spent; the label is last since it may contain commas
+    fprintf(out, "\nsessions,pomodoros,focus_seconds,label\n");
+    const TeamLabel** order = (const TeamLabel**)malloc((p->label_count + 1) * sizeof(TeamLabel*));
+    if (!order) return 0;
+    uint32_t n = 0;
+    for (uint32_t i = 0; p->labels && i <= p->label_mask; i++) {
+        if (p->labels[i].name) order[n++] = &p->labels[i];
+    }
+    qsort(order, n, sizeof(TeamLabel*), team_label_order);
+    for (uint32_t i = 0; i < n; i++) {
+        fprintf(out, "%u,%u,%llu,%s\n", order[i]->totals.sessions, order[i]->totals.pomodoros,
+                (unsigned long long)order[i]->totals.focus_seconds, order[i]->name);
+    }
+    free(order);
+    return ferror(out) == 0;
+}
+
+#endif
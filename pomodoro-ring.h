@@ -0,0 +1,134 @@
+// Pomodoro Timer progress ring
+//
+// The ring around the tray icon text shows the elapsed part of the session in
+// RING_STEPS angle steps, clockwise from 12 o'clock. Which step every ring
+// pixel belongs to, and how much of it the ring covers, is computed once into
+// a table sorted by step, so a frame only blends the pixels of the steps that
+// changed since the previous frame. Pixels are 0x00RRGGBB, top-down, as in a
+// 32-bit DIB section.
+//
+// The icon mask has a 1 bit where the icon is transparent: the plain
+// background around the face, but never a pixel of the ring, which is drawn
+// over the background.
+#ifndef POMODORO_RING_H
+#define POMODORO_RING_H
+
+#include <math.h>
+#include <stdint.h>
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
+#define RING_STEPS 120
+#define RING_ICON_SIZE 32
+#define RING_MASK_STRIDE (RING_ICON_SIZE / 8) // bytes per monochrome row, WORD aligned
+
+typedef struct {
+    int size;
+    int count;                          // pixels covered by the ring
+    int16_t step_start[RING_STEPS + 1]; // pixels of step i are [step_start[i], step_start[i + 1])
+    int16_t pixel[RING_ICON_SIZE * RING_ICON_SIZE];
+    uint8_t coverage[RING_ICON_SIZE * RING_ICON_SIZE];
+} RingTable;
+
+// Precompute which angle step each ring pixel belongs to and how much of it the ring covers
+static inline void ring_build_table(RingTable* t, int size) {
+    int16_t step_of[RING_ICON_SIZE * RING_ICON_SIZE];
+    uint8_t cov_of[RING_ICON_SIZE * RING_ICON_SIZE];
+    int per_step[RING_STEPS] = {0};
+    double c = size / 2.0;
+    double outer = c - 0.5, inner = outer - 2.5;
+
+    t->size = size;
+    for (int y = 0; y < size; y++) {
+        for (int x = 0; x < size; x++) {
+            // 4x4 supersampling for the radial edges
+            int hits = 0;
+            for (int sy = 0; sy < 4; sy++) {
+                for (int sx = 0; sx < 4; sx++) {
+                    double dx = x + (sx + 0.5) / 4.0 - c, dy = y + (sy + 0.5) / 4.0 - c;
+                    double r = sqrt(dx * dx + dy * dy);
+                    if (r >= inner && r <= outer) hits++;
+                }
+            }
+            int p = y * size + x;
+            cov_of[p] = (uint8_t)(hits * 255 / 16);
+            step_of[p] = -1;
+            if (hits == 0) continue;
+
+            // Clockwise angle from 12 o'clock
+            double a = atan2(x + 0.5 - c, c - (y + 0.5));
+            if (a < 0) a += 2.0 * M_PI;
+            int step = (int)(a / (2.0 * M_PI) * RING_STEPS);
+            if (step >= RING_STEPS) step = RING_STEPS - 1;
+            step_of[p] = (int16_t)step;
+            per_step[step]++;
+        }
+    }
+
+    t->step_start[0] = 0;
+    for (int i = 0; i < RING_STEPS; i++) {
+        t->step_start[i + 1] = (int16_t)(t->step_start[i] + per_step[i]);
+    }
+    int fill[RING_STEPS];
+    for (int i = 0; i < RING_STEPS; i++) fill[i] = t->step_start[i];
+    for (int p = 0; p < size * size; p++) {
+        if (step_of[p] < 0) continue;
+        int at = fill[step_of[p]]++;
+        t->pixel[at] = (int16_t)p;
+        t->coverage[at] = cov_of[p];
+    }
+    t->count = t->step_start[RING_STEPS];
+}
+
+// Blend a 0xRRGGBB color over a pixel with the given coverage (0-255)
+static inline uint32_t ring_blend_pixel(uint32_t base, uint32_t color, int coverage) {
+    uint32_t result = 0;
+    for (int shift = 0; shift <= 16; shift += 8) {
+        int b = (base >> shift) & 0xFF, c = (color >> shift) & 0xFF;
+        result |= (uint32_t)(b + (c - b) * coverage / 255) << shift;
+    }
+    return result;
+}
+
+// Set a mask bit for every pixel that is the plain background, like the mask of a GDI icon
+static inline void ring_background_mask(const uint32_t* pixels, int size, uint32_t background, uint8_t* mask,
+                                        int mask_stride) {
+    for (int y = 0; y < size; y++) {
+        uint8_t* row = mask + y * mask_stride;
+        for (int i = 0; i < mask_stride; i++) row[i] = 0;
+        for (int x = 0; x < size; x++) {
+            if (pixels[y * size + x] == background) row[x / 8] |= (uint8_t)(0x80 >> (x % 8));
+        }
+    }
+}
+
+// Draw the track of the whole ring over a face and make its pixels opaque in the face's mask
+static inline void ring_draw_track(const RingTable* t, uint32_t* pixels, uint32_t color, uint8_t* mask,
+                                   int mask_stride) {
+    for (int i = 0; i < t->count; i++) {
+        int p = t->pixel[i];
+        pixels[p] = ring_blend_pixel(pixels[p], color, t->coverage[i]);
+        mask[(p / t->size) * mask_stride + p % t->size / 8] &= (uint8_t)~(0x80 >> (p % t->size % 8));
+    }
+}
+
+// Move the filled part of the ring from one step count to another; base is the face with the
+// track, and only the pixels of the steps in between are written
+static inline void ring_set_steps(const RingTable* t, uint32_t* pixels, const uint32_t* base, int from, int to,
+                                  uint32_t color) {
+    if (to > from) {
+        for (int i = t->step_start[from]; i < t->step_start[to]; i++) {
+            int p = t->pixel[i];
+            pixels[p] = ring_blend_pixel(base[p], color, t->coverage[i]);
+        }
+    } else {
+        for (int i = t->step_start[to]; i < t->step_start[from]; i++) {
+            int p = t->pixel[i];
+            pixels[p] = base[p];
+        }
+    }
+}
+
+#endif
@@ -0,0 +1,102 @@
+// Pomodoro Timer session state file
+//
+// The running session is kept in one fixed-layout record that is rewritten on
+// every state transition (start, stop, completion, a label or a count change)
+// and never in between, since the deadline is stored rather than the time
+// left. It is written to "<path>.tmp", flushed to disk and renamed over the
+// file, so a kill or a power cut at any point leaves either the old record or
+// the new one; a checksum over the fields rejects anything else.
+//
+// At start a running record is resumed with the time left to its deadline, or
+// counted as expired if the deadline passed while the timer was not running.
+#ifndef POMODORO_SESSION_H
+#define POMODORO_SESSION_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#define SESSION_STATE_MAGIC 0x34534D50 // "PMS4"
+#define SESSION_STATE_KINDS 3          // pomodoro, short break, long break
+#define SESSION_STATE_IDLE 0           // nothing was running
+#define SESSION_STATE_RESUME 1         // still running
+#define SESSION_STATE_EXPIRED 2        // ran out while the timer was not running
+
+typedef struct {
+    uint32_t magic;
+    uint32_t running;
+    uint32_t kind;
+    uint32_t is_in_pomodoro;
+    uint32_t pomodoro_count;
+    uint32_t planned_seconds;
+    int64_t start_time;      // unix seconds
+    int64_t deadline;        // unix seconds
+    uint32_t today_pomodoros;
+    uint32_t today_focus_seconds;
+    int32_t today;           // local day number of the today_* counters
+    uint32_t label;          // id of the current task label, 0 for none
+    uint32_t today_synced;   // records of the sync journal in the today_* counters
+    uint32_t checksum;
+} SessionState;
+
+// FNV-1a over the fields before the checksum
+static inline uint32_t session_state_checksum(const SessionState* st) {
+    const uint8_t* p = (const uint8_t*)st;
+    uint32_t h = 2166136261u;
+    for (size_t i = 0; i < offsetof(SessionState, checksum); i++) {
+        h = (h ^ p[i]) * 16777619u;
+    }
+    return h;
+}
+
+// Write the record in place of the file; sets the magic and the checksum
+static inline int session_state_save(SessionState* st, const char* path) {
+    char tmp[300];
+    if (snprintf(tmp, sizeof(tmp), "%s.tmp", path) >= (int)sizeof(tmp)) return 0;
+    st->magic = SESSION_STATE_MAGIC;
+    st->checksum = session_state_checksum(st);
+#ifdef _WIN32
+    HANDLE file = CreateFileA(tmp, GENERIC_WRITE, 0, NULL, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (file == INVALID_HANDLE_VALUE) return 0;
+    DWORD written = 0;
+    BOOL ok = WriteFile(file, st, sizeof(*st), &written, NULL) && written == sizeof(*st) && FlushFileBuffers(file);
+    CloseHandle(file);
+    return ok && MoveFileExA(tmp, path, MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH);
+#else
+    int fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) return 0;
+    int ok = write(fd, st, sizeof(*st)) == (ssize_t)sizeof(*st) && fsync(fd) == 0;
+    ok = close(fd) == 0 && ok;
+    return ok && rename(tmp, path) == 0;
+#endif
+}
+
+// Read a record; returns 0 if the file is missing, short, foreign or damaged
+static inline int session_state_load(SessionState* st, const char* path) {
+    FILE* fp = fopen(path, "rb");
+    if (!fp) return 0;
+    int ok = fread(st, sizeof(*st), 1, fp) == 1;
+    fclose(fp);
+    return ok && st->magic == SESSION_STATE_MAGIC && st->checksum == session_state_checksum(st) &&
+           st->kind < SESSION_STATE_KINDS && st->pomodoro_count <= 4;
+}
+
+// What a start does with a loaded record; *left gets the seconds to go of a resumed one
+static inline int session_state_resume(const SessionState* st, int64_t now, int* left) {
+    *left = 0;
+    if (!st->running) return SESSION_STATE_IDLE;
+    int64_t to_go = st->deadline - now;
+    // More than planned means the clock went back; the session cannot be placed any more
+    if (to_go <= 0 || to_go > st->planned_seconds) return SESSION_STATE_EXPIRED;
+    *left = (int)to_go;
+    return SESSION_STATE_RESUME;
+}
+
+#endif
@@ -0,0 +1,139 @@
+// Pomodoro Timer settings file
+//
+// pomodoro_settings.json is one flat JSON object of integer fields. It is
+// reread whenever it changes on disk, possibly while an editor or a
+// configuration tool is still writing it, so a text that is not a whole
+// object (no closing brace yet) is refused rather than read in part: a
+// duration of "2" cut from "25" would otherwise be applied. The next change
+// notification brings the finished file. Fields that are missing or outside
+// the settings dialog's limits keep their current values.
+//
+// A reload is applied as a difference: settings_diff tells which parts of the
+// timer are affected, and only those react. The timer's own saves go to
+// "<path>.tmp" first and are renamed over the file, so they are never read
+// half written either.
+#ifndef POMODORO_SETTINGS_H
+#define POMODORO_SETTINGS_H
+
+#include <stdio.h>
+#include <string.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#endif
+
+#define SETTINGS_TEXT_MAX 1024
+#define SETTINGS_COUNTDOWN_MAX_SECONDS 10
+
+// Parts of the timer a change affects
+#define SETTINGS_DIFF_DURATIONS 1    // the next session
+#define SETTINGS_DIFF_CLOCK_SOUND 2  // the ticking sound, right away while a session runs
+#define SETTINGS_DIFF_DIALOG 4       // the completion toast
+#define SETTINGS_DIFF_RING 8         // the tray icon, redrawn right away
+#define SETTINGS_DIFF_COUNTDOWN 16   // the final countdown animation, from the next tick
+#define SETTINGS_DIFF_MENU (SETTINGS_DIFF_CLOCK_SOUND | SETTINGS_DIFF_DIALOG | SETTINGS_DIFF_RING) // checked menu items
+
+typedef struct {
+    int pomodoro_duration;
+    int short_break_duration;
+    int long_break_duration;
+    int enable_clock_sound;
+    int show_completion_dialog;
+    int progress_ring;
+    int countdown_animation;
+    int countdown_seconds;
+} TimerSettings;
+
+// Read an integer field; the value is left unchanged if the key is missing
+static inline void settings_read_int(const char* json, const char* key, int* value) {
+    char pattern[64];
+    snprintf(pattern, sizeof(pattern), "\"%s\":", key);
+    const char* p = strstr(json, pattern);
+    if (p) sscanf(p + strlen(pattern), "%d", value);
+}
+
+// Parse the settings JSON into out; returns 0, leaving out alone, if the text is not a whole object
+static inline int settings_parse(const char* json, TimerSettings* out) {
+    const char* begin = json;
+    const char* end = json + strlen(json);
+    while (*begin == ' ' || *begin == '\t' || *begin == '\r' || *begin == '\n') begin++;
+    while (end > begin && (end[-1] == ' ' || end[-1] == '\t' || end[-1] == '\r' || end[-1] == '\n')) end--;
+    if (*begin != '{' || end == begin || end[-1] != '}') return 0;
+
+    TimerSettings t = *out;
+    settings_read_int(json, "pomodoro_duration", &t.pomodoro_duration);
+    settings_read_int(json, "short_break_duration", &t.short_break_duration);
+    settings_read_int(json, "long_break_duration", &t.long_break_duration);
+    settings_read_int(json, "enable_clock_sound", &t.enable_clock_sound);
+    settings_read_int(json, "show_completion_dialog", &t.show_completion_dialog);
+    settings_read_int(json, "progress_ring", &t.progress_ring);
+    settings_read_int(json, "countdown_animation", &t.countdown_animation);
+    settings_read_int(json, "countdown_seconds", &t.countdown_seconds);
+
+    // Same limits as the settings dialog
+    if (t.pomodoro_duration > 0 && t.pomodoro_duration <= 120) out->pomodoro_duration = t.pomodoro_duration;
+    if (t.short_break_duration > 0 && t.short_break_duration <= 60) out->short_break_duration = t.short_break_duration;
+    if (t.long_break_duration > 0 && t.long_break_duration <= 120) out->long_break_duration = t.long_break_duration;
+    out->enable_clock_sound = t.enable_clock_sound != 0;
+    out->show_completion_dialog = t.show_completion_dialog != 0;
+    out->progress_ring = t.progress_ring != 0;
+    out->countdown_animation = t.countdown_animation != 0;
+    if (t.countdown_seconds >= 1 && t.countdown_seconds <= SETTINGS_COUNTDOWN_MAX_SECONDS) {
+        out->countdown_seconds = t.countdown_seconds;
+    }
+    return 1;
+}
+
+// Read the settings file into out; returns 0 if it cannot be read or is not whole yet
+static inline int settings_read_file(const char* path, TimerSettings* out) {
+    FILE* fp = fopen(path, "rb");
+    if (!fp) return 0;
+    char buf[SETTINGS_TEXT_MAX];
+    size_t len = fread(buf, 1, sizeof(buf) - 1, fp);
+    fclose(fp);
+    buf[len] = '\0';
+    return len > 0 && settings_parse(buf, out);
+}
+
+static inline int settings_format(const TimerSettings* s, char* buf, size_t size) {
+    return snprintf(buf, size,
+                    "{\"pomodoro_duration\":%d,\"short_break_duration\":%d,\"long_break_duration\":%d,"
+                    "\"enable_clock_sound\":%d,\"show_completion_dialog\":%d,\"progress_ring\":%d,"
+                    "\"countdown_animation\":%d,\"countdown_seconds\":%d}",
+                    s->pomodoro_duration, s->short_break_duration, s->long_break_duration, s->enable_clock_sound,
+                    s->show_completion_dialog, s->progress_ring, s->countdown_animation, s->countdown_seconds);
+}
+
+// Write the settings in place of the file
+static inline int settings_save(const TimerSettings* s, const char* path) {
+    char text[SETTINGS_TEXT_MAX], tmp[300];
+    int len = settings_format(s, text, sizeof(text));
+    if (snprintf(tmp, sizeof(tmp), "%s.tmp", path) >= (int)sizeof(tmp)) return 0;
+    FILE* fp = fopen(tmp, "wb");
+    if (!fp) return 0;
+    int ok = fwrite(text, 1, (size_t)len, fp) == (size_t)len;
+    ok = fclose(fp) == 0 && ok;
+#ifdef _WIN32
+    return ok && MoveFileExA(tmp, path, MOVEFILE_REPLACE_EXISTING);
+#else
+    return ok && rename(tmp, path) == 0;
+#endif
+}
+
+// The parts of the timer affected by going from old to updated (SETTINGS_DIFF_*)
+static inline int settings_diff(const TimerSettings* old, const TimerSettings* updated) {
+    int diff = 0;
+    if (old->pomodoro_duration != updated->pomodoro_duration || old->short_break_duration != updated->short_break_duration ||
+        old->long_break_duration != updated->long_break_duration) {
+        diff |= SETTINGS_DIFF_DURATIONS;
+    }
+    if (old->enable_clock_sound != updated->enable_clock_sound) diff |= SETTINGS_DIFF_CLOCK_SOUND;
+    if (old->show_completion_dialog != updated->show_completion_dialog) diff |= SETTINGS_DIFF_DIALOG;
+    if (old->progress_ring != updated->progress_ring) diff |= SETTINGS_DIFF_RING;
+    if (old->countdown_animation != updated->countdown_animation || old->countdown_seconds != updated->countdown_seconds) {
+        diff |= SETTINGS_DIFF_COUNTDOWN;
+    }
+    return diff;
+}
+
+#endif
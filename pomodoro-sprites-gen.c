@@ -0,0 +1,278 @@
+// Generates pomodoro-sprites.bin, the pre-rendered tray icons (see pomodoro-sprites.h)
+//
+// Runs on Linux with FreeType:
+//   gcc -O2 -o pomodoro-sprites-gen pomodoro-sprites-gen.c $(pkg-config --cflags --libs freetype2)
+//   ./pomodoro-sprites-gen LiberationSans-Bold.ttf DejaVuSans-Bold.ttf pomodoro-sprites.bin
+//
+// The layout follows draw_icon_face in pomodoro-timer.c, scaled from 32 pixels to each size:
+// the text in Arial Bold with a 27 pixel cell, centered and 2 pixels up, the play symbol 2
+// pixels right, and the dots as 6 pixel circles with a 1 pixel black outline at x = 4, 12, 20,
+// 28 and y = 30. The font is sized and placed with the metrics of Arial Bold whatever font is
+// given, so any font with Arial's widths lands where GDI draws: Liberation Sans Bold, or a
+// Helvetica Bold such as FreeSans Bold. Characters the first font lacks (FreeSans has no play
+// symbol) come from the optional second font.
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ft2build.h>
+#include FT_FREETYPE_H
+#include "pomodoro-sprites.h"
+
+static const int icon_sizes[] = {16, 20, 24, 32}; // small icons at 100%, 125%, 150% and 200% scaling
+#define ICON_SIZE_COUNT (int)(sizeof(icon_sizes) / sizeof(icon_sizes[0]))
+#define SUPERSAMPLE 8
+
+// Arial Bold, in font units: GDI's 27 pixel cell is the ascent plus the descent
+#define ARIAL_UNITS_PER_EM 2048
+#define ARIAL_WIN_ASCENT 1854
+#define ARIAL_WIN_DESCENT 434
+
+// Distinct items of one kind (half rows, tiles), each stored once
+typedef struct {
+    uint8_t* data;
+    int count, cap;
+    size_t item;  // bytes per item
+} ItemTable;
+
+// Number of an item in the table, adding it if it is new
+static int intern(ItemTable* t, const void* item) {
+    for (int i = 0; i < t->count; i++) {
+        if (memcmp(t->data + i * t->item, item, t->item) == 0) return i;
+    }
+    if (t->count == t->cap) {
+        t->cap = t->cap ? t->cap * 2 : 256;
+        t->data = (uint8_t*)realloc(t->data, t->cap * t->item);
+        if (!t->data) {
+            fprintf(stderr, "Out of memory\n");
+            exit(1);
+        }
+    }
+    memcpy(t->data + t->count * t->item, item, t->item);
+    return t->count++;
+}
+
+static int level(float coverage) {
+    int v = (int)(coverage * SPRITE_LEVELS + 0.5f);
+    return v < 0 ? 0 : v > SPRITE_LEVELS ? SPRITE_LEVELS : v;
+}
+
+// The font of the two that has a character, loaded with the given flags; NULL if neither has it
+static FT_Face load_char(FT_Face fonts[2], unsigned long c, FT_Int32 flags) {
+    for (int i = 0; i < 2; i++) {
+        if (fonts[i] && FT_Get_Char_Index(fonts[i], c) && FT_Load_Char(fonts[i], c, flags) == 0) return fonts[i];
+    }
+    return NULL;
+}
+
+// Render a face's text as white coverage (0-1) into size * size floats
+static void render_text(FT_Face fonts[2], int size, int face, float* cover) {
+    unsigned long text[4];
+    int len = 0;
+    if (face == 0) {
+        text[len++] = 0x25BA;
+    } else {
+        char digits[12];
+        snprintf(digits, sizeof(digits), "%d", face - 1);
+        for (char* d = digits; *d && len < 4; d++) text[len++] = (unsigned long)*d;
+    }
+
+    // Same placement as GetTextExtentPoint32W and the centering in draw_icon_face
+    int width = 0;
+    for (int i = 0; i < len; i++) {
+        FT_Face ft = load_char(fonts, text[i], FT_LOAD_DEFAULT);
+        if (ft) width += (int)((ft->glyph->advance.x + 32) >> 6);
+    }
+    int height = 27 * size / 32;
+    int ascender = (height * ARIAL_WIN_ASCENT + (ARIAL_WIN_ASCENT + ARIAL_WIN_DESCENT) / 2) / (ARIAL_WIN_ASCENT + ARIAL_WIN_DESCENT);
+    int x = (size - width) / 2;
+    int y = (size - height) / 2 - 2 * size / 32;
+    if (face == 0) x += 2 * size / 32;
+
+    memset(cover, 0, sizeof(float) * size * size);
+    for (int i = 0; i < len; i++) {
+        FT_Face ft = load_char(fonts, text[i], FT_LOAD_RENDER);
+        if (!ft) continue;
+        FT_GlyphSlot g = ft->glyph;
+        for (unsigned row = 0; row < g->bitmap.rows; row++) {
+            int py = y + ascender - g->bitmap_top + (int)row;
+            if (py < 0 || py >= size) continue;
+            for (unsigned col = 0; col < g->bitmap.width; col++) {
+                int px = x + g->bitmap_left + (int)col;
+                if (px < 0 || px >= size) continue;
+                float a = g->bitmap.buffer[row * g->bitmap.pitch + col] / 255.0f;
+                float* c = &cover[py * size + px];
+                *c = a + *c * (1.0f - a);
+            }
+        }
+        x += (int)((g->advance.x + 32) >> 6);
+    }
+}
+
+// Render the dots as white and black coverage (0-1) into size * size floats each
+static void render_dots(int size, int dots, float* white, float* black) {
+    float scale = size / 32.0f;
+    float outer = 3.0f * scale, inner = outer - 1.0f;
+    memset(white, 0, sizeof(float) * size * size);
+    memset(black, 0, sizeof(float) * size * size);
+    for (int i = 0; i < dots; i++) {
+        float cx = (4 + i * 8) * scale, cy = 30 * scale;
+        for (int y = 0; y < size; y++) {
+            for (int x = 0; x < size; x++) {
+                int w = 0, k = 0;
+                for (int sy = 0; sy < SUPERSAMPLE; sy++) {
+                    for (int sx = 0; sx < SUPERSAMPLE; sx++) {
+                        float dx = x + (sx + 0.5f) / SUPERSAMPLE - cx, dy = y + (sy + 0.5f) / SUPERSAMPLE - cy;
+                        float r = sqrtf(dx * dx + dy * dy);
+                        if (r <= inner) w++;
+                        else if (r <= outer) k++;
+                    }
+                }
+                if (w || k) {
+                    white[y * size + x] = (float)w / (SUPERSAMPLE * SUPERSAMPLE);
+                    black[y * size + x] = (float)k / (SUPERSAMPLE * SUPERSAMPLE);
+                }
+            }
+        }
+    }
+}
+
+typedef struct {
+    SpriteSize header;
+    ItemTable halves, tiles;
+    uint16_t face_tiles[SPRITE_FACES * 2];
+    uint8_t* dot_rows;
+} SizeTables;
+
+int main(int argc, char** argv) {
+    if (argc != 3 && argc != 4) {
+        fprintf(stderr, "Usage: pomodoro-sprites-gen <bold font.ttf> [<fallback bold font.ttf>] <output.bin>\n");
+        return 2;
+    }
+    FT_Library lib;
+    FT_Face fonts[2] = {NULL, NULL};
+    const char* output = argv[argc - 1];
+    if (FT_Init_FreeType(&lib)) {
+        fprintf(stderr, "Cannot initialize FreeType\n");
+        return 1;
+    }
+    for (int i = 0; i < argc - 2; i++) {
+        if (FT_New_Face(lib, argv[1 + i], 0, &fonts[i])) {
+            fprintf(stderr, "Cannot load font %s\n", argv[1 + i]);
+            return 1;
+        }
+    }
+    if (!FT_Get_Char_Index(fonts[0], 0x25BA) && !(fonts[1] && FT_Get_Char_Index(fonts[1], 0x25BA))) {
+        fprintf(stderr, "Warning: no font has the play symbol (U+25BA)\n");
+    }
+
+    static SizeTables tables[ICON_SIZE_COUNT];
+    float cover[SPRITE_MAX_SIZE * SPRITE_MAX_SIZE], white[SPRITE_MAX_SIZE * SPRITE_MAX_SIZE],
+        black[SPRITE_MAX_SIZE * SPRITE_MAX_SIZE];
+    uint32_t offset = sizeof(SpriteFileHeader) + ICON_SIZE_COUNT * sizeof(SpriteSize);
+
+    for (int s = 0; s < ICON_SIZE_COUNT; s++) {
+        int size = icon_sizes[s], half = size / 2;
+        // The em size GDI picks for Arial Bold with a 27 pixel cell, in 26.6 fixed point
+        long em = 27L * size * 64 / 32 * ARIAL_UNITS_PER_EM / (ARIAL_WIN_ASCENT + ARIAL_WIN_DESCENT);
+        for (int i = 0; i < 2; i++) {
+            if (fonts[i] && FT_Set_Char_Size(fonts[i], 0, em, 72, 72)) {
+                fprintf(stderr, "Cannot size the font for %d pixels\n", size);
+                return 1;
+            }
+        }
+
+        // The dots start where the most of them reach up to; the text must stay above that
+        render_dots(size, SPRITE_MAX_DOTS, white, black);
+        int band = size;
+        for (int i = 0; i < size * size && band == size; i++) {
+            if (level(white[i]) || level(black[i])) band = i / size;
+        }
+
+        SizeTables* t = &tables[s];
+        t->halves.item = size / 4;
+        t->tiles.item = sizeof(uint16_t) * band;
+        for (int f = 0; f < SPRITE_FACES; f++) {
+            render_text(fonts, size, f, cover);
+            for (int y = band; y < size; y++) {
+                for (int x = 0; x < size; x++) {
+                    if (level(cover[y * size + x])) {
+                        fprintf(stderr, "Text %d reaches into the dots at %d pixels\n", f - 1, size);
+                        return 1;
+                    }
+                }
+            }
+            for (int side = 0; side < 2; side++) {
+                uint16_t tile[SPRITE_MAX_SIZE];
+                for (int y = 0; y < band; y++) {
+                    uint8_t packed[SPRITE_MAX_SIZE / 4];
+                    for (int x = 0; x < half; x += 2) {
+                        const float* c = &cover[y * size + side * half + x];
+                        packed[x / 2] = (uint8_t)(level(c[0]) << 4 | level(c[1]));
+                    }
+                    tile[y] = (uint16_t)intern(&t->halves, packed);
+                }
+                t->face_tiles[f * 2 + side] = (uint16_t)intern(&t->tiles, tile);
+            }
+        }
+
+        t->dot_rows = (uint8_t*)malloc((size_t)(SPRITE_MAX_DOTS + 1) * (size - band) * size);
+        for (int d = 0; d <= SPRITE_MAX_DOTS; d++) {
+            render_dots(size, d, white, black);
+            for (int y = band; y < size; y++) {
+                uint8_t* row = t->dot_rows + ((size_t)d * (size - band) + y - band) * size;
+                for (int x = 0; x < size; x++) {
+                    int w = level(white[y * size + x]), k = level(black[y * size + x]);
+                    if (w + k > SPRITE_LEVELS) k = SPRITE_LEVELS - w;
+                    row[x] = (uint8_t)(w << 4 | k);
+                }
+            }
+        }
+
+        SpriteSize* z = &t->header;
+        uint32_t begin = offset;
+        z->size = (uint16_t)size;
+        z->band = (uint16_t)band;
+        z->tiles = (uint16_t)t->tiles.count;
+        z->halves = (uint16_t)t->halves.count;
+        z->face_tiles = offset;
+        offset += sizeof(t->face_tiles);
+        z->tile_rows = offset;
+        offset += (uint32_t)(t->tiles.count * t->tiles.item);
+        z->half_rows = offset;
+        offset += (uint32_t)(t->halves.count * t->halves.item + 1) & ~1u;
+        z->dot_rows = offset;
+        offset += (uint32_t)((SPRITE_MAX_DOTS + 1) * (size - band) * size + 1) & ~1u;
+        printf("%2d px: %d icons from %d tiles of %d half rows, %u bytes\n", size, SPRITE_FACES * (SPRITE_MAX_DOTS + 1),
+               t->tiles.count, t->halves.count, offset - begin);
+    }
+
+    FILE* fp = fopen(output, "wb");
+    if (!fp) {
+        fprintf(stderr, "Cannot create %s\n", output);
+        return 1;
+    }
+    SpriteFileHeader header = {SPRITE_MAGIC, ICON_SIZE_COUNT};
+    fwrite(&header, sizeof(header), 1, fp);
+    for (int s = 0; s < ICON_SIZE_COUNT; s++) fwrite(&tables[s].header, sizeof(SpriteSize), 1, fp);
+    for (int s = 0; s < ICON_SIZE_COUNT; s++) {
+        SizeTables* t = &tables[s];
+        size_t dots = (size_t)(SPRITE_MAX_DOTS + 1) * (t->header.size - t->header.band) * t->header.size;
+        fwrite(t->face_tiles, sizeof(t->face_tiles), 1, fp);
+        fwrite(t->tiles.data, t->tiles.item, t->tiles.count, fp);
+        fwrite(t->halves.data, t->halves.item, t->halves.count, fp);
+        if (t->halves.count * t->halves.item % 2) fputc(0, fp);
+        fwrite(t->dot_rows, 1, dots, fp);
+        if (dots % 2) fputc(0, fp);
+    }
+    if (fclose(fp) != 0) {
+        fprintf(stderr, "Cannot write %s\n", output);
+        return 1;
+    }
+    printf("%s: %u bytes\n", output, offset);
+    for (int i = 0; i < 2; i++) {
+        if (fonts[i]) FT_Done_Face(fonts[i]);
+    }
+    FT_Done_FreeType(lib);
+    return 0;
+}
@@ -0,0 +1,161 @@
+// Pre-rendered tray icon sprites
+//
+// The tray icon only ever shows the play symbol or a number from 0 to 120,
+// with 0-4 progress dots below it, so every icon is rendered ahead of time by
+// pomodoro-sprites-gen.c (run on Linux with FreeType) and linked in as the
+// TRAY_SPRITES resource. Building an icon is then a table lookup per pixel.
+//
+// A pixel is stored as one byte: the high nibble is how much of it is white
+// (text and the dot centres), the low nibble how much is black (the dot
+// outlines), both in 15ths; the rest is the background, so the same sprites
+// work on any background color. Each size is split into the text rows above
+// the dots and the dot rows below them. The text part of an icon is a left
+// and a right tile, half the icon wide. Digits have the same width in the
+// font, so the tiles of two-digit numbers repeat (the left one shows the tens,
+// the right one the units), and so do the half rows within the tiles; each
+// distinct tile and half row is stored once, with only the white nibble. The
+// 2440 icons of four sizes take about 29 KB this way.
+//
+// File, all little-endian: SpriteFileHeader, one SpriteSize per size, then
+// the tables the offsets point to.
+#ifndef POMODORO_SPRITES_H
+#define POMODORO_SPRITES_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <wchar.h>
+
+#define SPRITE_MAGIC 0x31505350 // "PSP1"
+#define SPRITE_MAX_SIZES 8
+#define SPRITE_MAX_SIZE 64
+#define SPRITE_MAX_NUMBER 120   // longest Pomodoro or break the settings allow
+#define SPRITE_FACES (SPRITE_MAX_NUMBER + 2) // play symbol, then 0-120
+#define SPRITE_MAX_DOTS 4
+#define SPRITE_LEVELS 15
+
+typedef struct {
+    uint32_t magic;
+    uint32_t sizes;
+} SpriteFileHeader;
+
+typedef struct {
+    uint16_t size;        // pixels per side, a multiple of 4
+    uint16_t band;        // first row of the dots
+    uint16_t tiles;       // distinct text tiles
+    uint16_t halves;      // distinct half rows in the tiles
+    uint32_t face_tiles;  // offset of SPRITE_FACES * 2 tile numbers, left and right
+    uint32_t tile_rows;   // offset of tiles * band half row numbers
+    uint32_t half_rows;   // offset of halves * size / 4 bytes, two white nibbles each, left one high
+    uint32_t dot_rows;    // offset of (SPRITE_MAX_DOTS + 1) * (size - band) rows of size pixels
+} SpriteSize;
+
+typedef struct {
+    const uint8_t* data;
+    const SpriteSize* sizes;
+    uint32_t count;
+} SpriteSet;
+
+// Check a sprite file and point the set at it; returns 0 if it is not valid
+static inline int sprites_open(SpriteSet* s, const void* data, size_t len) {
+    const SpriteFileHeader* h = (const SpriteFileHeader*)data;
+    s->data = NULL;
+    s->sizes = NULL;
+    s->count = 0;
+    if (!data || len < sizeof(*h) || h->magic != SPRITE_MAGIC || h->sizes == 0 || h->sizes > SPRITE_MAX_SIZES) return 0;
+    if (len < sizeof(*h) + h->sizes * sizeof(SpriteSize)) return 0;
+    const SpriteSize* sizes = (const SpriteSize*)(h + 1);
+    for (uint32_t i = 0; i < h->sizes; i++) {
+        const SpriteSize* z = &sizes[i];
+        if (z->size == 0 || z->size % 4 || z->size > SPRITE_MAX_SIZE || z->band > z->size) return 0;
+        if (z->face_tiles % 2 || z->tile_rows % 2) return 0;
+        if ((size_t)z->face_tiles + (size_t)SPRITE_FACES * 2 * 2 > len) return 0;
+        if ((size_t)z->tile_rows + (size_t)z->tiles * z->band * 2 > len) return 0;
+        if ((size_t)z->half_rows + (size_t)z->halves * z->size / 4 > len) return 0;
+        if ((size_t)z->dot_rows + (size_t)(SPRITE_MAX_DOTS + 1) * (z->size - z->band) * z->size > len) return 0;
+        const uint16_t* face_tiles = (const uint16_t*)((const uint8_t*)data + z->face_tiles);
+        const uint16_t* tile_rows = (const uint16_t*)((const uint8_t*)data + z->tile_rows);
+        for (int t = 0; t < SPRITE_FACES * 2; t++) {
+            if (face_tiles[t] >= z->tiles) return 0;
+        }
+        for (int r = 0; r < z->tiles * z->band; r++) {
+            if (tile_rows[r] >= z->halves) return 0;
+        }
+    }
+    s->data = (const uint8_t*)data;
+    s->sizes = sizes;
+    s->count = h->sizes;
+    return 1;
+}
+
+// Face of a tray text: 0 for the play symbol, 1 + n for the number n; -1 if there is no sprite for it
+static inline int sprite_face(const wchar_t* text) {
+    if (text[0] == 0x25BA && text[1] == 0) return 0;
+    int n = 0, digits = 0;
+    for (; *text; text++, digits++) {
+        if (*text < L'0' || *text > L'9' || digits == 3) return -1;
+        n = n * 10 + (*text - L'0');
+    }
+    return digits && n <= SPRITE_MAX_NUMBER ? 1 + n : -1;
+}
+
+// The sprites of the given size, or NULL
+static inline const SpriteSize* sprite_size(const SpriteSet* s, int size) {
+    for (uint32_t i = 0; i < s->count; i++) {
+        if (s->sizes[i].size == size) return &s->sizes[i];
+    }
+    return NULL;
+}
+
+// Colors of the 256 pixel values on a background, all 0x00RRGGBB
+static inline void sprite_palette(uint32_t palette[256], uint32_t background) {
+    for (int v = 0; v < 256; v++) {
+        int white = v >> 4, black = v & 15;
+        if (white + black > SPRITE_LEVELS) black = SPRITE_LEVELS - white;
+        uint32_t color = 0;
+        for (int shift = 0; shift <= 16; shift += 8) {
+            int bg = (background >> shift) & 0xFF;
+            int c = (bg * (SPRITE_LEVELS - white - black) + 255 * white + SPRITE_LEVELS / 2) / SPRITE_LEVELS;
+            color |= (uint32_t)c << shift;
+        }
+        palette[v] = color;
+    }
+}
+
+// Draw an icon into size * size top-down pixels; mask, if given, gets a 1 bit for each pixel
+// that is pure background, in rows of mask_stride bytes. Returns 0 if there is no such sprite.
+static inline int sprite_draw(const SpriteSet* s, const SpriteSize* z, int face, int dots, const uint32_t palette[256],
+                              uint32_t* pixels, uint8_t* mask, int mask_stride) {
+    if (!z || face < 0 || face >= SPRITE_FACES || dots < 0 || dots > SPRITE_MAX_DOTS) return 0;
+    int size = z->size, half = size / 2;
+    const uint16_t* face_tiles = (const uint16_t*)(s->data + z->face_tiles) + face * 2;
+    const uint16_t* tile_rows = (const uint16_t*)(s->data + z->tile_rows);
+    const uint8_t* half_rows = s->data + z->half_rows;
+    const uint8_t* dot_rows = s->data + z->dot_rows + (size_t)dots * (size - z->band) * size;
+    if (mask) {
+        for (int i = 0; i < mask_stride * size; i++) mask[i] = 0;
+    }
+    for (int y = 0; y < size; y++) {
+        uint32_t* out = pixels + (size_t)y * size;
+        uint8_t* mask_row = mask ? mask + y * mask_stride : NULL;
+        if (y < z->band) {
+            for (int t = 0; t < 2; t++) {
+                const uint8_t* packed = half_rows + (size_t)tile_rows[face_tiles[t] * z->band + y] * (size / 4);
+                for (int x = 0; x < half; x++) {
+                    int value = x % 2 ? (packed[x / 2] & 0x0F) << 4 : packed[x / 2] & 0xF0;
+                    int px = t * half + x;
+                    out[px] = palette[value];
+                    if (mask_row && !value) mask_row[px / 8] |= (uint8_t)(0x80 >> (px % 8));
+                }
+            }
+        } else {
+            const uint8_t* row = dot_rows + (size_t)(y - z->band) * size;
+            for (int x = 0; x < size; x++) {
+                out[x] = palette[row[x]];
+                if (mask_row && !row[x]) mask_row[x / 8] |= (uint8_t)(0x80 >> (x % 8));
+            }
+        }
+    }
+    return 1;
+}
+
+#endif
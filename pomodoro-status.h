@@ -0,0 +1,166 @@
+// Pomodoro Timer status segment
+//
+// The timer publishes its state in a small named shared-memory segment. Any
+// number of readers can take consistent snapshots without locks or system
+// calls: the writer makes the sequence counter odd while it updates the fields
+// and even again when it is done, and a reader retries until it sees the same
+// even value before and after copying.
+//
+// Windows: named file mapping "Local\PomodoroTimerStatus"
+// POSIX:   shm_open("/pomodoro-timer-status"), for tests and a Linux build
+#ifndef POMODORO_STATUS_H
+#define POMODORO_STATUS_H
+
+#include <stdint.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#define POMODORO_STATUS_NAME_WIN L"Local\\PomodoroTimerStatus"
+#ifndef POMODORO_STATUS_NAME_POSIX
+#define POMODORO_STATUS_NAME_POSIX "/pomodoro-timer-status"
+#endif
+#define POMODORO_STATUS_MAGIC 0x31545350 // "PST1"
+#define POMODORO_STATUS_VERSION 1
+
+#define POMODORO_STATUS_POMODORO 0
+#define POMODORO_STATUS_SHORT_BREAK 1
+#define POMODORO_STATUS_LONG_BREAK 2
+
+#if defined(_MSC_VER) && !defined(__clang__)
+#define POMODORO_STATUS_FENCE() MemoryBarrier()
+#else
+#define POMODORO_STATUS_FENCE() __atomic_thread_fence(__ATOMIC_SEQ_CST)
+#endif
+
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t seq;                 // odd while the writer is updating
+    uint32_t kind;                // POMODORO_STATUS_*
+    uint32_t running;
+    uint32_t pomodoro_count;      // completed pomodoros in the current cycle (0-4)
+    int64_t deadline;             // unix seconds, valid while running
+    int64_t start_time;           // unix seconds
+    uint32_t planned_seconds;
+    uint32_t today_pomodoros;     // completed pomodoros today
+    uint32_t today_focus_seconds; // seconds spent in pomodoros today
+    int32_t today;                // local day number of the today_* counters
+} PomodoroStatus;
+
+// Take a consistent snapshot; returns 1 on success, 0 if the segment is not valid
+static inline int pomodoro_status_read(const volatile PomodoroStatus* seg, PomodoroStatus* out) {
+    for (int tries = 0; tries < 10000; tries++) {
+        uint32_t seq = seg->seq;
+        POMODORO_STATUS_FENCE();
+        if (seq & 1) continue;
+        out->magic = seg->magic;
+        out->version = seg->version;
+        out->kind = seg->kind;
+        out->running = seg->running;
+        out->pomodoro_count = seg->pomodoro_count;
+        out->deadline = seg->deadline;
+        out->start_time = seg->start_time;
+        out->planned_seconds = seg->planned_seconds;
+        out->today_pomodoros = seg->today_pomodoros;
+        out->today_focus_seconds = seg->today_focus_seconds;
+        out->today = seg->today;
+        POMODORO_STATUS_FENCE();
+        if (seg->seq == seq) {
+            out->seq = seq;
+            return out->magic == POMODORO_STATUS_MAGIC && out->version == POMODORO_STATUS_VERSION;
+        }
+    }
+    return 0;
+}
+
+// Writer side: bracket every update with begin/end
+static inline void pomodoro_status_write_begin(volatile PomodoroStatus* seg) {
+    seg->seq = seg->seq + 1;
+    POMODORO_STATUS_FENCE();
+}
+
+static inline void pomodoro_status_write_end(volatile PomodoroStatus* seg) {
+    POMODORO_STATUS_FENCE();
+    seg->seq = seg->seq + 1;
+}
+
+// Publish a new state; magic and version are filled in, seq is left to the writer
+static inline void pomodoro_status_publish(volatile PomodoroStatus* seg, const PomodoroStatus* s) {
+    pomodoro_status_write_begin(seg);
+    seg->magic = POMODORO_STATUS_MAGIC;
+    seg->version = POMODORO_STATUS_VERSION;
+    seg->kind = s->kind;
+    seg->running = s->running;
+    seg->pomodoro_count = s->pomodoro_count;
+    seg->deadline = s->deadline;
+    seg->start_time = s->start_time;
+    seg->planned_seconds = s->planned_seconds;
+    seg->today_pomodoros = s->today_pomodoros;
+    seg->today_focus_seconds = s->today_focus_seconds;
+    seg->today = s->today;
+    pomodoro_status_write_end(seg);
+}
+
+// Create the segment for the writer, or open the one that is there; returns NULL on failure.
+// On Windows the mapping handle stays open for the lifetime of the process, which keeps the name.
+static inline volatile PomodoroStatus* pomodoro_status_create(void) {
+#ifdef _WIN32
+    HANDLE mapping = CreateFileMappingW(INVALID_HANDLE_VALUE, NULL, PAGE_READWRITE, 0, sizeof(PomodoroStatus), POMODORO_STATUS_NAME_WIN);
+    if (!mapping) return NULL;
+    return (volatile PomodoroStatus*)MapViewOfFile(mapping, FILE_MAP_WRITE, 0, 0, sizeof(PomodoroStatus));
+#else
+    int fd = shm_open(POMODORO_STATUS_NAME_POSIX, O_RDWR | O_CREAT, 0644);
+    if (fd < 0) return NULL;
+    struct stat st;
+    void* p = MAP_FAILED;
+    // Some systems refuse to truncate a segment that already has a size
+    if (fstat(fd, &st) == 0 && (st.st_size >= (off_t)sizeof(PomodoroStatus) || ftruncate(fd, sizeof(PomodoroStatus)) == 0)) {
+        p = mmap(NULL, sizeof(PomodoroStatus), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    }
+    close(fd);
+    return p == MAP_FAILED ? NULL : (volatile PomodoroStatus*)p;
+#endif
+}
+
+// Map the segment read-only; returns NULL if the timer is not running
+static inline const volatile PomodoroStatus* pomodoro_status_open(void) {
+#ifdef _WIN32
+    HANDLE mapping = OpenFileMappingW(FILE_MAP_READ, FALSE, POMODORO_STATUS_NAME_WIN);
+    if (!mapping) return NULL;
+    const volatile PomodoroStatus* seg = (const volatile PomodoroStatus*)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, sizeof(PomodoroStatus));
+    CloseHandle(mapping); // the view keeps the mapping alive
+    return seg;
+#else
+    int fd = shm_open(POMODORO_STATUS_NAME_POSIX, O_RDONLY, 0);
+    if (fd < 0) return NULL;
+    void* p = mmap(NULL, sizeof(PomodoroStatus), PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    return p == MAP_FAILED ? NULL : (const volatile PomodoroStatus*)p;
+#endif
+}
+
+static inline void pomodoro_status_close(const volatile PomodoroStatus* seg) {
+    if (!seg) return;
+#ifdef _WIN32
+    UnmapViewOfFile((LPCVOID)seg);
+#else
+    munmap((void*)seg, sizeof(PomodoroStatus));
+#endif
+}
+
+// Writer side on exit: remove the POSIX name, which would outlive the process; mapped views stay
+// valid. Windows removes the name with the last handle.
+static inline void pomodoro_status_remove(void) {
+#ifndef _WIN32
+    shm_unlink(POMODORO_STATUS_NAME_POSIX);
+#endif
+}
+
+#endif
@@ -0,0 +1,253 @@
+// Pomodoro Timer history sync
+//
+// Every machine appends its finished sessions to its own segment in a shared
+// folder, one line "seq,start,kind,planned,actual,outcome,focus,label" each
+// (the label name last, since label ids are local). seq grows along a segment,
+// so the last seq taken from a machine tells which of its lines are new, in
+// whatever order the segments are read.
+//
+// The records taken from other machines are appended to a local journal as
+// "machine,seq,start,..." before they are added to anything else, and the
+// journal is the merge cursor: the last seq of each machine is read back from
+// it at start, so a record gets into it once. Every total a record is added to
+// (the day counts, the per-hour model, the label totals, today's counters) is
+// saved with the number of journal records it includes, and at start the
+// records past that number are added again. A crash between the journal and
+// a total therefore neither loses a record nor counts it twice.
+//
+// The totals only add up records, except the per-hour model, whose averages
+// weigh the newest session most; every total gets the records in journal
+// order, live or replayed, so the same journal always gives the same totals.
+#ifndef POMODORO_SYNC_H
+#define POMODORO_SYNC_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "pomodoro-adapt.h"
+#include "pomodoro-archive.h"
+#include "pomodoro-heatmap.h"
+#include "pomodoro-labels.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <unistd.h>
+#endif
+
+#define SYNC_MAX_PEERS 32
+#define SYNC_NAME_BYTES 64
+#define SYNC_POMODORO 0 // kind and outcome codes of archive_parse_line
+#define SYNC_STOPPED 1
+
+typedef struct {
+    const char* machine;     // NULL for a segment line
+    int64_t seq;
+    ArchiveRow row;          // row.label is 0, the name is in label
+    const char* label;       // "" for none
+} SyncRecord;
+
+typedef struct {
+    char name[SYNC_NAME_BYTES];
+    int64_t offset;          // bytes of its segment read so far
+    int64_t last_seq;        // highest seq in the journal
+} SyncPeer;
+
+typedef struct {
+    char path[260];
+    SyncPeer peers[SYNC_MAX_PEERS];
+    int peer_count;
+    uint32_t count;          // records in the journal
+} SyncJournal;
+
+// The totals records are added to; NULL members are left out
+typedef struct {
+    LabelTable* labels;
+    HeatmapDays* days;
+    AdaptModel* model;
+    int* today_pomodoros;
+    int* today_focus_seconds;
+    uint32_t* today_synced;  // journal records included in the two above
+} SyncTotals;
+
+static inline int sync_name_equal(const char* a, const char* b) {
+    while (*a && label_fold((uint8_t)*a) == label_fold((uint8_t)*b)) a++, b++;
+    return *a == *b;
+}
+
+// Find a machine, or add it; NULL if there is no room or the name cannot be a journal field
+static inline SyncPeer* sync_peer(SyncJournal* j, const char* name) {
+    for (int i = 0; i < j->peer_count; i++) {
+        if (sync_name_equal(j->peers[i].name, name)) return &j->peers[i];
+    }
+    size_t len = strlen(name);
+    if (j->peer_count == SYNC_MAX_PEERS || len == 0 || len >= SYNC_NAME_BYTES || strpbrk(name, ",\r\n")) return NULL;
+    SyncPeer* peer = &j->peers[j->peer_count++];
+    memcpy(peer->name, name, len + 1);
+    peer->offset = 0;
+    peer->last_seq = 0;
+    return peer;
+}
+
+// Parse "seq,start,kind,planned,actual,outcome,focus,label" in place
+static inline int sync_parse_segment_line(char* line, SyncRecord* r) {
+    size_t len = strlen(line);
+    if (len && line[len - 1] == '\r') line[len - 1] = '\0';
+    const char* p = line;
+    int64_t seq;
+    if (!archive_parse_number(&p, &seq) || seq <= 0 || *p++ != ',' || !archive_parse_line(p, &r->row)) return 0;
+    r->machine = NULL;
+    r->seq = seq;
+    r->row.label = 0;
+    // The label is the last field and may contain commas
+    const char* label = line;
+    for (int commas = 0; *label && commas < 7; label++) {
+        if (*label == ',') commas++;
+    }
+    r->label = label;
+    return 1;
+}
+
+// Parse a journal line, "machine," and a segment line, in place
+static inline int sync_parse_journal_line(char* line, SyncRecord* r) {
+    char* comma = strchr(line, ',');
+    if (!comma || comma == line) return 0;
+    *comma = '\0';
+    if (!sync_parse_segment_line(comma + 1, r)) return 0;
+    r->machine = line;
+    return 1;
+}
+
+static inline void sync_truncate(const char* path, size_t size) {
+#ifdef _WIN32
+    HANDLE file = CreateFileA(path, GENERIC_WRITE, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (file == INVALID_HANDLE_VALUE) return;
+    LARGE_INTEGER pos;
+    pos.QuadPart = (LONGLONG)size;
+    if (SetFilePointerEx(file, pos, NULL, FILE_BEGIN)) SetEndOfFile(file);
+    CloseHandle(file);
+#else
+    if (truncate(path, (off_t)size) != 0) return;
+#endif
+}
+
+// Read the journal: count its records, raise the last seq of every machine in
+// it, and call visit (if not NULL) for each record with its number, from 1.
+// Machines already in j keep their segment offsets. A line cut short by a
+// crash is removed, so the next append starts a line of its own.
+static inline uint32_t sync_journal_load(SyncJournal* j, const char* path,
+                                         void (*visit)(const SyncRecord* r, uint32_t number, void* context), void* context) {
+    snprintf(j->path, sizeof(j->path), "%s", path);
+    j->count = 0;
+    size_t size, end = 0;
+    char* buf = archive_read_file(path, &size);
+    if (!buf) return 0;
+    while (end < size) {
+        char* line = buf + end;
+        char* nl = (char*)memchr(line, '\n', size - end);
+        if (!nl) break;
+        *nl = '\0';
+        end = (size_t)(nl - buf) + 1;
+        SyncRecord r;
+        if (!sync_parse_journal_line(line, &r)) continue;
+        j->count++;
+        SyncPeer* peer = sync_peer(j, r.machine);
+        if (peer && r.seq > peer->last_seq) peer->last_seq = r.seq;
+        if (visit) visit(&r, j->count, context);
+    }
+    free(buf);
+    if (end < size) sync_truncate(path, end);
+    return j->count;
+}
+
+// Take the records of a segment tail (whole lines) that are past the last seq
+// of its machine: append them to the journal, then call visit for each with
+// its journal number. Returns how many, or -1 if the journal could not be
+// written, in which case nothing is visited and the machine's cursor stays.
+static inline int sync_merge_tail(SyncJournal* j, SyncPeer* peer, char* buf,
+                                  void (*visit)(const SyncRecord* r, uint32_t number, void* context), void* context) {
+    size_t lines = 0, bytes = 0;
+    for (const char* p = buf; (p = strchr(p, '\n')); p++) lines++;
+    if (lines == 0) return 0;
+    SyncRecord* records = (SyncRecord*)malloc(lines * sizeof(SyncRecord));
+    char** texts = (char**)malloc(lines * sizeof(char*));
+    if (!records || !texts) {
+        free(records);
+        free(texts);
+        return -1;
+    }
+    size_t name_len = strlen(peer->name), n = 0;
+    int64_t last = peer->last_seq;
+    for (char* line = buf; n < lines;) {
+        char* nl = strchr(line, '\n');
+        if (!nl) break;
+        *nl = '\0';
+        char* text = line;
+        line = nl + 1;
+        if (!sync_parse_segment_line(text, &records[n]) || records[n].seq <= last) continue;
+        last = records[n].seq;
+        records[n].machine = peer->name;
+        texts[n] = text;
+        bytes += name_len + strlen(text) + 2;
+        n++;
+    }
+
+    int ok = 1;
+    if (n > 0) {
+        char* out = (char*)malloc(bytes + 1);
+        FILE* fp = out ? fopen(j->path, "ab") : NULL;
+        ok = fp != NULL;
+        if (ok) {
+            size_t used = 0;
+            for (size_t i = 0; i < n; i++) {
+                used += (size_t)sprintf(out + used, "%s,%s\n", peer->name, texts[i]);
+            }
+            ok = fwrite(out, 1, used, fp) == used;
+            ok = fclose(fp) == 0 && ok;
+        }
+        free(out);
+    }
+    if (ok) {
+        for (size_t i = 0; i < n; i++) {
+            j->count++;
+            if (visit) visit(&records[i], j->count, context);
+        }
+        peer->last_seq = last;
+    }
+    free(records);
+    free(texts);
+    return ok ? (int)n : -1;
+}
+
+// Add journal record number to every total that does not include it yet.
+// day and hour are the local day number and hour of the record's start, and
+// today the day of the today counters.
+static inline void sync_totals_add(SyncTotals* t, const SyncRecord* r, uint32_t number, int32_t day, int hour, int32_t today) {
+    int pomodoro = r->row.kind == SYNC_POMODORO, finished = r->row.outcome != SYNC_STOPPED;
+    if (t->days && number > t->days->synced) {
+        if (pomodoro && finished) heatmap_days_add(t->days, day, 1);
+        t->days->synced = number;
+    }
+    if (t->model && number > t->model->synced) {
+        if (pomodoro) adapt_record(t->model, hour, (int)r->row.actual, finished);
+        t->model->synced = number;
+    }
+    if (t->today_synced && number > *t->today_synced) {
+        if (pomodoro && day == today) {
+            if (finished) (*t->today_pomodoros)++;
+            *t->today_focus_seconds += (int)r->row.actual;
+        }
+        *t->today_synced = number;
+    }
+    if (t->labels && pomodoro && r->label[0] && r->row.actual > 0) {
+        int id = label_intern(t->labels, r->label);
+        if (id && number > t->labels->totals[id - 1].synced) {
+            t->labels->totals[id - 1].synced = number;
+            label_record(t->labels, id, (int)r->row.actual, r->row.start + r->row.actual, day / 7);
+        }
+    }
+}
+
+#endif
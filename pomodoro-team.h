@@ -0,0 +1,860 @@
+// Pomodoro Timer team channel
+//
+// A headless daemon owns the shared schedule of a team and pushes every change
+// (start, pause, resume, stop) to its subscribers at once. The schedule is
+// small, a start time and the durations, and a subscriber derives the current
+// phase from it with its own clock, so a change is the only thing to send.
+//
+// Every message is the whole current state, so a subscriber never needs the
+// ones it missed. The daemon keeps one message in flight per subscriber and
+// writes without blocking: a subscriber that reads slowly fills its socket or
+// pipe buffer, the daemon stops writing to it, and once it drains it gets the
+// latest state only, with everything in between coalesced away. A slow
+// subscriber costs its fixed slot and nothing more, and never holds up the
+// rest. Any connection can send a command; a command that changes the state
+// is published to everyone before the daemon reads the next one.
+//
+// Windows: named pipe \\.\pipe\pomodoro-team-<name>, overlapped I/O on a completion port
+// Linux:   unix domain socket, non-blocking, with an edge-triggered epoll loop
+//
+// Either way the daemon sleeps until a client connects, a command arrives or
+// a blocked write drains, and team_server_stop (or a TEAM_CMD_SHUTDOWN from
+// any connection) ends its loop.
+//
+// Messages are the structs below in the byte order of the machine.
+#ifndef POMODORO_TEAM_H
+#define POMODORO_TEAM_H
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+#define TEAM_STATE_MAGIC 0x31545450   // "PTT1"
+#define TEAM_COMMAND_MAGIC 0x31435450 // "PTC1"
+#define TEAM_PIPE_PREFIX L"\\\\.\\pipe\\pomodoro-team-"
+#define TEAM_MAX_MINUTES 120          // longest Pomodoro or break the settings allow
+#define TEAM_PIPE_BUFFER 4096
+#define TEAM_EVENTS 256               // epoll events taken per wait
+
+// Phases, the same values as the session kinds of the timer
+#define TEAM_POMODORO 0
+#define TEAM_SHORT_BREAK 1
+#define TEAM_LONG_BREAK 2
+
+#define TEAM_CMD_START 1  // start the schedule now with the durations of the command
+#define TEAM_CMD_PAUSE 2
+#define TEAM_CMD_RESUME 3 // shifts the schedule by the time it was paused
+#define TEAM_CMD_STOP 4
+#define TEAM_CMD_SHUTDOWN 5 // end the daemon; subscribers keep the last schedule
+
+typedef struct {
+    uint32_t magic;
+    uint32_t seq;               // bumped by every change
+    int64_t start;              // unix seconds of the first phase; 0 while stopped
+    int64_t paused_at;          // unix seconds; 0 while running
+    int64_t sent_us;            // unix microseconds when the daemon published it
+    uint16_t pomodoro_duration; // minutes
+    uint16_t short_break_duration;
+    uint16_t long_break_duration;
+    uint16_t long_break_every;  // Pomodoros per cycle, 1-4
+} TeamState;
+
+typedef struct {
+    uint32_t magic;
+    uint32_t command;           // TEAM_CMD_*
+    uint16_t pomodoro_duration; // durations for TEAM_CMD_START
+    uint16_t short_break_duration;
+    uint16_t long_break_duration;
+    uint16_t long_break_every;
+} TeamCommand;
+
+#ifdef _WIN32
+typedef HANDLE TeamHandle;
+#define TEAM_NO_HANDLE INVALID_HANDLE_VALUE
+#define TEAM_STOP_KEY 1             // completion key of team_server_stop
+
+// An overlapped operation of the daemon; the OVERLAPPED of a completion is its TeamIo
+typedef struct {
+    OVERLAPPED ov;
+    void* owner;                // the TeamSubscriber, or NULL for the listening instance
+    uint8_t pending;            // started and not completed yet
+} TeamIo;
+#else
+typedef int TeamHandle;
+#define TEAM_NO_HANDLE (-1)
+#endif
+
+typedef struct {
+    TeamHandle handle;
+    uint32_t seq;               // seq of the message in out
+    uint16_t out_done;          // bytes of out written; sizeof(TeamState) when idle
+    uint8_t in_len;             // bytes of a command read so far
+    uint8_t blocked;            // the last write would have blocked
+    uint8_t dead;               // hung up; freed at the end of the poll
+    uint8_t out[sizeof(TeamState)];
+    uint8_t in[sizeof(TeamCommand)];
+#ifdef _WIN32
+    TeamIo read_io, write_io;   // kept until both are done, even once it hung up
+#endif
+} TeamSubscriber;
+
+typedef struct {
+    TeamState state;
+    TeamSubscriber** subs;
+    uint32_t count, capacity;
+    uint64_t published;         // states published
+    uint64_t sent;              // messages written in full
+    uint64_t coalesced;         // states a slow subscriber skipped
+    uint64_t blocked;           // writes that would have blocked
+    uint8_t shutdown;           // a connection sent TEAM_CMD_SHUTDOWN
+} TeamHub;
+
+typedef struct {
+    TeamHub hub;
+    TeamHandle listener;        // Windows: the pipe instance waiting for the next client
+#ifdef _WIN32
+    HANDLE port;
+    TeamIo connect_io;
+    wchar_t name[MAX_PATH];
+#else
+    int epoll;
+    int stop;                   // eventfd, readable once team_server_stop was called
+    char path[sizeof(((struct sockaddr_un*)0)->sun_path)];
+#endif
+} TeamServer;
+
+// Current time in unix microseconds
+static inline int64_t team_now_us(void) {
+#ifdef _WIN32
+    FILETIME ft;
+    GetSystemTimeAsFileTime(&ft);
+    ULARGE_INTEGER t;
+    t.u.LowPart = ft.dwLowDateTime;
+    t.u.HighPart = ft.dwHighDateTime;
+    return (int64_t)(t.QuadPart / 10) - 11644473600000000LL;
+#else
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return (int64_t)tv.tv_sec * 1000000 + tv.tv_usec;
+#endif
+}
+
+static inline int team_durations_valid(int pomodoro, int short_break, int long_break, int every) {
+    return pomodoro >= 1 && pomodoro <= TEAM_MAX_MINUTES && short_break >= 1 && short_break <= TEAM_MAX_MINUTES &&
+           long_break >= 1 && long_break <= TEAM_MAX_MINUTES && every >= 1 && every <= 4;
+}
+
+// A received state is used only if it passes this
+static inline int team_state_valid(const TeamState* s) {
+    return s->magic == TEAM_STATE_MAGIC && s->start >= 0 && s->paused_at >= 0 &&
+           team_durations_valid(s->pomodoro_duration, s->short_break_duration, s->long_break_duration, s->long_break_every);
+}
+
+// Apply a command to the state at the given time; returns 1 if the state changed
+static inline int team_state_apply(TeamState* s, const TeamCommand* c, int64_t now) {
+    if (c->magic != TEAM_COMMAND_MAGIC) return 0;
+    switch (c->command) {
+    case TEAM_CMD_START:
+        if (!team_durations_valid(c->pomodoro_duration, c->short_break_duration, c->long_break_duration, c->long_break_every)) return 0;
+        s->start = now;
+        s->paused_at = 0;
+        s->pomodoro_duration = c->pomodoro_duration;
+        s->short_break_duration = c->short_break_duration;
+        s->long_break_duration = c->long_break_duration;
+        s->long_break_every = c->long_break_every;
+        return 1;
+    case TEAM_CMD_PAUSE:
+        if (s->start <= 0 || s->paused_at > 0) return 0;
+        s->paused_at = now;
+        return 1;
+    case TEAM_CMD_RESUME:
+        if (s->start <= 0 || s->paused_at <= 0) return 0;
+        s->start += now - s->paused_at;
+        s->paused_at = 0;
+        return 1;
+    case TEAM_CMD_STOP:
+        if (s->start <= 0) return 0;
+        s->start = 0;
+        s->paused_at = 0;
+        return 1;
+    }
+    return 0;
+}
+
+// Find the phase of the schedule at the given time; returns 0 while it is stopped or paused, or before it starts
+static inline int team_phase_at(const TeamState* s, int64_t now, int* kind, int64_t* phase_start, int* phase_seconds, int* completed) {
+    if (s->start <= 0 || s->paused_at > 0 || now < s->start) return 0;
+    int64_t cycle = (int64_t)s->long_break_every * s->pomodoro_duration * 60 +
+                    (int64_t)(s->long_break_every - 1) * s->short_break_duration * 60 +
+                    (int64_t)s->long_break_duration * 60;
+    int64_t t = s->start + (now - s->start) / cycle * cycle;
+    for (int i = 0; i < s->long_break_every; i++) {
+        int len = s->pomodoro_duration * 60;
+        if (now < t + len) {
+            *kind = TEAM_POMODORO;
+            *phase_start = t;
+            *phase_seconds = len;
+            *completed = i;
+            return 1;
+        }
+        t += len;
+        int last = i == s->long_break_every - 1;
+        len = (last ? s->long_break_duration : s->short_break_duration) * 60;
+        if (now < t + len) {
+            *kind = last ? TEAM_LONG_BREAK : TEAM_SHORT_BREAK;
+            *phase_start = t;
+            *phase_seconds = len;
+            *completed = i + 1;
+            return 1;
+        }
+        t += len;
+    }
+    return 0;
+}
+
+// Unix seconds of the next change of phase after now: the end of the current phase, or the start of a
+// schedule that has not begun; 0 while it is stopped or paused
+static inline int64_t team_next_change(const TeamState* s, int64_t now) {
+    int kind, phase_seconds, completed;
+    int64_t phase_start;
+    if (s->start <= 0 || s->paused_at > 0) return 0;
+    if (now < s->start) return s->start;
+    if (!team_phase_at(s, now, &kind, &phase_start, &phase_seconds, &completed)) return 0;
+    return phase_start + phase_seconds;
+}
+
+// Write without blocking; returns the bytes written, 0 if the buffer is full, -1 if the peer is gone
+static inline long team_write(TeamHandle h, const void* buf, size_t len) {
+#ifdef _WIN32
+    DWORD n = 0;
+    if (!WriteFile(h, buf, (DWORD)len, &n, NULL)) return -1;
+    return (long)n;
+#else
+    ssize_t n = send(h, buf, len, MSG_DONTWAIT | MSG_NOSIGNAL);
+    if (n < 0) return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR ? 0 : -1;
+    return (long)n;
+#endif
+}
+
+// Read what is there; returns the bytes read, 0 if there is nothing (non-blocking handles only), -1 if the peer is gone
+static inline long team_read(TeamHandle h, void* buf, size_t len) {
+#ifdef _WIN32
+    DWORD n = 0;
+    if (!ReadFile(h, buf, (DWORD)len, &n, NULL)) return GetLastError() == ERROR_NO_DATA ? 0 : -1;
+    return (long)n;
+#else
+    ssize_t n = recv(h, buf, len, 0);
+    if (n < 0) return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR ? 0 : -1;
+    return n == 0 ? -1 : (long)n;
+#endif
+}
+
+static inline void team_close(TeamHandle h) {
+#ifdef _WIN32
+    DisconnectNamedPipe(h);
+    CloseHandle(h);
+#else
+    close(h);
+#endif
+}
+
+// The daemon's side of team_write and team_read. On Windows a write that cannot complete at once stays
+// pending and counts as would-block until the completion port returns it, and a read that finds nothing
+// stays pending until a command arrives; the buffers must stay put meanwhile.
+static inline long team_sub_write(TeamSubscriber* s, const void* buf, size_t len) {
+#ifdef _WIN32
+    DWORD n = 0;
+    if (s->write_io.pending) return 0;
+    memset(&s->write_io.ov, 0, sizeof(s->write_io.ov));
+    if (WriteFile(s->handle, buf, (DWORD)len, NULL, &s->write_io.ov)) {
+        return GetOverlappedResult(s->handle, &s->write_io.ov, &n, FALSE) ? (long)n : -1;
+    }
+    if (GetLastError() != ERROR_IO_PENDING) return -1;
+    s->write_io.pending = 1;
+    return 0;
+#else
+    return team_write(s->handle, buf, len);
+#endif
+}
+
+static inline long team_sub_read(TeamSubscriber* s, void* buf, size_t len) {
+#ifdef _WIN32
+    DWORD n = 0;
+    if (s->read_io.pending) return 0;
+    memset(&s->read_io.ov, 0, sizeof(s->read_io.ov));
+    if (ReadFile(s->handle, buf, (DWORD)len, NULL, &s->read_io.ov)) {
+        return GetOverlappedResult(s->handle, &s->read_io.ov, &n, FALSE) && n ? (long)n : -1;
+    }
+    if (GetLastError() != ERROR_IO_PENDING) return -1;
+    s->read_io.pending = 1;
+    return 0;
+#else
+    return team_read(s->handle, buf, len);
+#endif
+}
+
+// The subscriber's memory is still in use by an operation in flight
+static inline int team_sub_busy(const TeamSubscriber* s) {
+#ifdef _WIN32
+    return s->read_io.pending || s->write_io.pending;
+#else
+    (void)s;
+    return 0;
+#endif
+}
+
+static inline void team_hub_init(TeamHub* hub) {
+    memset(hub, 0, sizeof(*hub));
+    hub->state.magic = TEAM_STATE_MAGIC;
+    hub->state.seq = 1;
+    hub->state.pomodoro_duration = 25;
+    hub->state.short_break_duration = 5;
+    hub->state.long_break_duration = 15;
+    hub->state.long_break_every = 4;
+}
+
+// Count bytes of the state written to a subscriber
+static inline void team_hub_wrote(TeamHub* hub, TeamSubscriber* s, long n) {
+    s->blocked = 0;
+    s->out_done += (uint16_t)n;
+    if (s->out_done == sizeof(TeamState)) hub->sent++;
+}
+
+// Write as much of the latest state as the subscriber takes; returns -1 if it hung up
+static inline int team_hub_pump(TeamHub* hub, TeamSubscriber* s) {
+    for (;;) {
+        if (s->out_done == sizeof(TeamState)) {
+            if (s->seq == hub->state.seq) return 0;
+            if (s->seq) hub->coalesced += hub->state.seq - s->seq - 1;
+            memcpy(s->out, &hub->state, sizeof(TeamState));
+            s->seq = hub->state.seq;
+            s->out_done = 0;
+        }
+        long n = team_sub_write(s, s->out + s->out_done, sizeof(TeamState) - s->out_done);
+        if (n < 0) return -1;
+        if (n == 0) {
+            s->blocked = 1;
+            hub->blocked++;
+            return 0;
+        }
+        team_hub_wrote(hub, s, n);
+    }
+}
+
+// Mark a subscriber as gone; it is freed by team_hub_sweep
+static inline void team_hub_drop(TeamSubscriber* s) {
+    if (s->dead) return;
+    team_close(s->handle);
+    s->handle = TEAM_NO_HANDLE;
+    s->dead = 1;
+}
+
+// Add a connection; it is sent the current state right away. Returns NULL and closes it if out of memory.
+static inline TeamSubscriber* team_hub_add(TeamHub* hub, TeamHandle h) {
+    if (hub->count == hub->capacity) {
+        uint32_t capacity = hub->capacity ? hub->capacity * 2 : 64;
+        TeamSubscriber** subs = (TeamSubscriber**)realloc(hub->subs, capacity * sizeof(*subs));
+        if (!subs) {
+            team_close(h);
+            return NULL;
+        }
+        hub->subs = subs;
+        hub->capacity = capacity;
+    }
+    TeamSubscriber* s = (TeamSubscriber*)calloc(1, sizeof(*s));
+    if (!s) {
+        team_close(h);
+        return NULL;
+    }
+    s->handle = h;
+    s->out_done = sizeof(TeamState);
+#ifdef _WIN32
+    s->read_io.owner = s->write_io.owner = s;
+#endif
+    hub->subs[hub->count++] = s;
+    if (team_hub_pump(hub, s) < 0) team_hub_drop(s);
+    return s;
+}
+
+// Free the subscribers that hung up, once nothing is in flight on them
+static inline void team_hub_sweep(TeamHub* hub) {
+    uint32_t kept = 0;
+    for (uint32_t i = 0; i < hub->count; i++) {
+        if (hub->subs[i]->dead && !team_sub_busy(hub->subs[i])) {
+            free(hub->subs[i]);
+        } else {
+            hub->subs[kept++] = hub->subs[i];
+        }
+    }
+    hub->count = kept;
+}
+
+// Send the state to every subscriber that can take it now; the blocked ones get it when they drain
+static inline void team_hub_publish(TeamHub* hub) {
+    hub->state.seq++;
+    hub->state.sent_us = team_now_us();
+    hub->published++;
+    for (uint32_t i = 0; i < hub->count; i++) {
+        TeamSubscriber* s = hub->subs[i];
+        if (!s->dead && !s->blocked && team_hub_pump(hub, s) < 0) team_hub_drop(s);
+    }
+}
+
+// Count bytes of a command read into s->in and act on the command once it is whole; returns -1 for
+// something that is not a command
+static inline int team_hub_took(TeamHub* hub, TeamSubscriber* s, long n) {
+    s->in_len += (uint8_t)n;
+    if (s->in_len < sizeof(TeamCommand)) return 0;
+    s->in_len = 0;
+    TeamCommand c;
+    memcpy(&c, s->in, sizeof(c));
+    if (c.magic != TEAM_COMMAND_MAGIC) return -1;
+    if (c.command == TEAM_CMD_SHUTDOWN) {
+        hub->shutdown = 1;
+    } else if (team_state_apply(&hub->state, &c, team_now_us() / 1000000)) {
+        team_hub_publish(hub);
+    }
+    return 0;
+}
+
+// Read the commands a subscriber sent and publish each change; returns -1 if it hung up
+static inline int team_hub_read(TeamHub* hub, TeamSubscriber* s) {
+    for (;;) {
+        long n = team_sub_read(s, s->in + s->in_len, sizeof(TeamCommand) - s->in_len);
+        if (n <= 0) return (int)n;
+        if (team_hub_took(hub, s, n) < 0) return -1;
+    }
+}
+
+static inline void team_hub_free(TeamHub* hub) {
+    for (uint32_t i = 0; i < hub->count; i++) {
+        team_hub_drop(hub->subs[i]);
+        free(hub->subs[i]);
+    }
+    free(hub->subs);
+    hub->subs = NULL;
+    hub->count = hub->capacity = 0;
+}
+
+#ifdef _WIN32
+
+// Create a pipe instance and wait for a client on it through the completion port; returns 0 on failure.
+// Operations that complete at once skip the port, so the daemon's writes behave as non-blocking ones.
+static inline int team_server_listen(TeamServer* srv, int first) {
+    HANDLE h = CreateNamedPipeW(srv->name, PIPE_ACCESS_DUPLEX | FILE_FLAG_OVERLAPPED | (first ? FILE_FLAG_FIRST_PIPE_INSTANCE : 0),
+                                PIPE_TYPE_BYTE | PIPE_READMODE_BYTE | PIPE_WAIT, PIPE_UNLIMITED_INSTANCES,
+                                TEAM_PIPE_BUFFER, TEAM_PIPE_BUFFER, 0, NULL);
+    srv->listener = h;
+    if (h == INVALID_HANDLE_VALUE) return 0;
+    int ok = CreateIoCompletionPort(h, srv->port, 0, 0) != NULL &&
+             SetFileCompletionNotificationModes(h, FILE_SKIP_COMPLETION_PORT_ON_SUCCESS | FILE_SKIP_SET_EVENT_ON_HANDLE);
+    for (int tries = 0; ok && tries < 4; tries++) {
+        memset(&srv->connect_io, 0, sizeof(srv->connect_io));
+        DWORD err = ConnectNamedPipe(h, &srv->connect_io.ov) ? ERROR_PIPE_CONNECTED : GetLastError();
+        if (err == ERROR_NO_DATA) {
+            DisconnectNamedPipe(h); // the client came and went; listen again
+            continue;
+        }
+        srv->connect_io.pending = 1;
+        if (err == ERROR_IO_PENDING) return 1;
+        // Connected before we listened: nothing is queued for that, so queue it ourselves
+        if (err == ERROR_PIPE_CONNECTED && PostQueuedCompletionStatus(srv->port, 0, 0, &srv->connect_io.ov)) return 1;
+        srv->connect_io.pending = 0;
+        break;
+    }
+    CloseHandle(h);
+    srv->listener = INVALID_HANDLE_VALUE;
+    return 0;
+}
+
+// Start serving on a pipe name; returns 0 if it is in use or cannot be created
+static inline int team_server_open(TeamServer* srv, const wchar_t* name) {
+    team_hub_init(&srv->hub);
+    wcsncpy(srv->name, name, MAX_PATH - 1);
+    srv->name[MAX_PATH - 1] = 0;
+    srv->listener = INVALID_HANDLE_VALUE;
+    srv->port = CreateIoCompletionPort(INVALID_HANDLE_VALUE, NULL, 0, 1);
+    if (srv->port && team_server_listen(srv, 1)) return 1;
+    if (srv->port) CloseHandle(srv->port);
+    srv->port = NULL;
+    return 0;
+}
+
+// Handle an operation the completion port returned
+static inline void team_server_complete(TeamServer* srv, OVERLAPPED* ov, DWORD n) {
+    TeamIo* io = (TeamIo*)ov;
+    TeamSubscriber* s = (TeamSubscriber*)io->owner;
+    int ok = ov->Internal == 0; // the NTSTATUS of the operation
+    io->pending = 0;
+    if (!s) {
+        // A client on the listening instance: it becomes a subscriber, and a new instance listens
+        if (ok) {
+            s = team_hub_add(&srv->hub, srv->listener);
+            if (s && !s->dead && team_hub_read(&srv->hub, s) < 0) team_hub_drop(s);
+        } else {
+            CloseHandle(srv->listener);
+        }
+        srv->listener = INVALID_HANDLE_VALUE;
+        team_server_listen(srv, 0);
+        return;
+    }
+    if (s->dead) return;
+    if (io == &s->read_io) {
+        if (!ok || n == 0 || team_hub_took(&srv->hub, s, (long)n) < 0 || team_hub_read(&srv->hub, s) < 0) {
+            team_hub_drop(s);
+        }
+    } else if (!ok) {
+        team_hub_drop(s);
+    } else {
+        team_hub_wrote(&srv->hub, s, (long)n);
+        if (team_hub_pump(&srv->hub, s) < 0) team_hub_drop(s);
+    }
+}
+
+// Wait up to timeout_ms (-1: as long as it takes) for clients, commands and blocked writes that completed,
+// and handle them; returns the number of events handled, or -1 once the daemon is to stop
+static inline int team_server_poll(TeamServer* srv, int timeout_ms) {
+    OVERLAPPED_ENTRY entries[TEAM_EVENTS];
+    ULONG n = 0;
+    DWORD wait = timeout_ms < 0 ? INFINITE : (DWORD)timeout_ms;
+    if (srv->listener == INVALID_HANDLE_VALUE && wait > 1000) wait = 1000; // out of pipe instances; retry
+    int stop = 0;
+    if (!GetQueuedCompletionStatusEx(srv->port, entries, TEAM_EVENTS, &n, wait, FALSE)) n = 0;
+    for (ULONG i = 0; i < n; i++) {
+        if (entries[i].lpOverlapped) {
+            team_server_complete(srv, entries[i].lpOverlapped, entries[i].dwNumberOfBytesTransferred);
+        } else {
+            stop |= entries[i].lpCompletionKey == TEAM_STOP_KEY;
+        }
+    }
+    if (srv->listener == INVALID_HANDLE_VALUE) team_server_listen(srv, 0);
+    team_hub_sweep(&srv->hub);
+    return stop || srv->hub.shutdown ? -1 : (int)n;
+}
+
+// End the wait of team_server_poll; callable from any thread, a console control handler included
+static inline void team_server_stop(TeamServer* srv) {
+    PostQueuedCompletionStatus(srv->port, 0, TEAM_STOP_KEY, NULL);
+}
+
+static inline int team_server_busy(const TeamServer* srv) {
+    if (srv->connect_io.pending) return 1;
+    for (uint32_t i = 0; i < srv->hub.count; i++) {
+        if (team_sub_busy(srv->hub.subs[i])) return 1;
+    }
+    return 0;
+}
+
+static inline void team_server_close(TeamServer* srv) {
+    for (uint32_t i = 0; i < srv->hub.count; i++) team_hub_drop(srv->hub.subs[i]);
+    if (srv->listener != INVALID_HANDLE_VALUE) CloseHandle(srv->listener);
+    srv->listener = INVALID_HANDLE_VALUE;
+    // Closing the pipes cancels what is in flight; the port returns each operation before its memory goes
+    for (int waits = 0; waits < 50 && team_server_busy(srv); waits++) {
+        OVERLAPPED_ENTRY entries[TEAM_EVENTS];
+        ULONG n = 0;
+        if (!GetQueuedCompletionStatusEx(srv->port, entries, TEAM_EVENTS, &n, 100, FALSE)) continue;
+        for (ULONG i = 0; i < n; i++) {
+            if (entries[i].lpOverlapped) ((TeamIo*)entries[i].lpOverlapped)->pending = 0;
+        }
+    }
+    team_hub_free(&srv->hub);
+    if (srv->port) CloseHandle(srv->port);
+    srv->port = NULL;
+}
+
+static inline HANDLE team_open_pipe(const wchar_t* name, DWORD flags) {
+    for (int tries = 0; tries < 5; tries++) {
+        HANDLE h = CreateFileW(name, GENERIC_READ | GENERIC_WRITE, 0, NULL, OPEN_EXISTING, flags, NULL);
+        if (h != INVALID_HANDLE_VALUE || GetLastError() != ERROR_PIPE_BUSY) return h;
+        WaitNamedPipeW(name, 1000);
+    }
+    return INVALID_HANDLE_VALUE;
+}
+
+// Connect to the daemon, e.g. to send a command; returns TEAM_NO_HANDLE if it is not running
+static inline HANDLE team_connect(const wchar_t* name) {
+    return team_open_pipe(name, 0);
+}
+
+// Wait until there is something to read; returns 0 on timeout or if the daemon is gone
+static inline int team_wait_readable(HANDLE h, int timeout_ms) {
+    for (int waited = 0;; waited += 10) {
+        DWORD avail = 0;
+        if (!PeekNamedPipe(h, NULL, 0, NULL, &avail, NULL)) return 0;
+        if (avail) return 1;
+        if (waited >= timeout_ms) return 0;
+        Sleep(10);
+    }
+}
+
+// Subscriber side: a connection read with overlapped I/O, so that a thread can wait for the next state
+// and for other events at once
+typedef struct {
+    HANDLE handle;
+    OVERLAPPED ov;              // ov.hEvent is set when the pending read completes
+    DWORD got;                  // bytes of the next state read so far
+    int pending;
+    uint8_t buf[sizeof(TeamState)];
+} TeamReader;
+
+// Connect a reader to the daemon; returns 0 if it is not running
+static inline int team_reader_open(TeamReader* r, const wchar_t* name) {
+    memset(r, 0, sizeof(*r));
+    r->ov.hEvent = CreateEventW(NULL, TRUE, FALSE, NULL);
+    r->handle = r->ov.hEvent ? team_open_pipe(name, FILE_FLAG_OVERLAPPED) : INVALID_HANDLE_VALUE;
+    if (r->handle != INVALID_HANDLE_VALUE) return 1;
+    if (r->ov.hEvent) CloseHandle(r->ov.hEvent);
+    return 0;
+}
+
+// Wait up to timeout_ms for the next whole state, or until stop is set. Returns 1 with a state in out,
+// 0 on timeout with the read left pending, and -1 if stop was set, the daemon is gone, or it sent
+// something that is not a state.
+static inline int team_reader_wait(TeamReader* r, HANDLE stop, DWORD timeout_ms, TeamState* out) {
+    for (;;) {
+        if (!r->pending) {
+            HANDLE event = r->ov.hEvent;
+            memset(&r->ov, 0, sizeof(r->ov));
+            r->ov.hEvent = event;
+            if (!ReadFile(r->handle, r->buf + r->got, (DWORD)(sizeof(r->buf) - r->got), NULL, &r->ov) &&
+                GetLastError() != ERROR_IO_PENDING) {
+                return -1;
+            }
+            r->pending = 1;
+        }
+        HANDLE events[2] = {r->ov.hEvent, stop};
+        DWORD w = WaitForMultipleObjects(stop ? 2 : 1, events, FALSE, timeout_ms);
+        if (w == WAIT_TIMEOUT) return 0;
+        if (w != WAIT_OBJECT_0) return -1;
+        DWORD n = 0;
+        r->pending = 0;
+        if (!GetOverlappedResult(r->handle, &r->ov, &n, FALSE) || n == 0) return -1;
+        r->got += n;
+        if (r->got < sizeof(r->buf)) continue;
+        r->got = 0;
+        memcpy(out, r->buf, sizeof(*out));
+        return team_state_valid(out) ? 1 : -1;
+    }
+}
+
+static inline void team_reader_close(TeamReader* r) {
+    if (r->pending) {
+        DWORD n;
+        CancelIoEx(r->handle, &r->ov);
+        GetOverlappedResult(r->handle, &r->ov, &n, TRUE);
+    }
+    CloseHandle(r->handle);
+    CloseHandle(r->ov.hEvent);
+}
+
+#else
+
+// Start serving on a socket path; a socket left behind by a daemon that is gone is replaced.
+// Returns 0 if another daemon serves the path or the socket cannot be created.
+static inline int team_server_open(TeamServer* srv, const char* path) {
+    team_hub_init(&srv->hub);
+    srv->listener = -1;
+    srv->epoll = -1;
+    srv->stop = -1;
+    struct sockaddr_un addr = {0};
+    addr.sun_family = AF_UNIX;
+    if (strlen(path) >= sizeof(addr.sun_path)) return 0;
+    strcpy(addr.sun_path, path);
+    strcpy(srv->path, path);
+
+    srv->listener = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (srv->listener < 0) return 0;
+    int ok = bind(srv->listener, (struct sockaddr*)&addr, sizeof(addr)) == 0;
+    if (!ok && errno == EADDRINUSE) {
+        int probe = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        int alive = probe >= 0 && connect(probe, (struct sockaddr*)&addr, sizeof(addr)) == 0;
+        if (probe >= 0) close(probe);
+        ok = !alive && unlink(path) == 0 && bind(srv->listener, (struct sockaddr*)&addr, sizeof(addr)) == 0;
+    }
+    srv->epoll = epoll_create1(EPOLL_CLOEXEC);
+    srv->stop = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    struct epoll_event ev = {0}, stop = {0};
+    ev.events = EPOLLIN;
+    ev.data.ptr = NULL;
+    stop.events = EPOLLIN;
+    stop.data.ptr = &srv->stop;
+    ok = ok && listen(srv->listener, SOMAXCONN) == 0 && srv->epoll >= 0 && srv->stop >= 0 &&
+         epoll_ctl(srv->epoll, EPOLL_CTL_ADD, srv->listener, &ev) == 0 &&
+         epoll_ctl(srv->epoll, EPOLL_CTL_ADD, srv->stop, &stop) == 0;
+    if (!ok) {
+        close(srv->listener);
+        if (srv->epoll >= 0) close(srv->epoll);
+        if (srv->stop >= 0) close(srv->stop);
+        srv->listener = srv->epoll = srv->stop = -1;
+    }
+    return ok;
+}
+
+// Wait up to timeout_ms (-1: as long as it takes) for clients, commands and subscribers that drained,
+// and handle them; returns the number of events handled, or -1 once the daemon is to stop
+static inline int team_server_poll(TeamServer* srv, int timeout_ms) {
+    struct epoll_event events[TEAM_EVENTS];
+    int n = epoll_wait(srv->epoll, events, TEAM_EVENTS, timeout_ms), stop = 0;
+    for (int i = 0; i < n; i++) {
+        TeamSubscriber* s = (TeamSubscriber*)events[i].data.ptr;
+        if (events[i].data.ptr == &srv->stop) {
+            stop = 1; // left readable, so every later poll returns at once too
+            continue;
+        }
+        if (!s) {
+            int fd;
+            while ((fd = accept(srv->listener, NULL, NULL)) >= 0) {
+                fcntl(fd, F_SETFL, O_NONBLOCK);
+                fcntl(fd, F_SETFD, FD_CLOEXEC);
+                s = team_hub_add(&srv->hub, fd);
+                if (!s || s->dead) continue;
+                struct epoll_event ev = {0};
+                ev.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET;
+                ev.data.ptr = s;
+                if (epoll_ctl(srv->epoll, EPOLL_CTL_ADD, fd, &ev) != 0) team_hub_drop(s);
+            }
+            continue;
+        }
+        if (s->dead) continue;
+        uint32_t e = events[i].events;
+        if (e & (EPOLLIN | EPOLLRDHUP | EPOLLHUP | EPOLLERR)) {
+            if (team_hub_read(&srv->hub, s) < 0 || (e & (EPOLLHUP | EPOLLERR))) {
+                team_hub_drop(s);
+                continue;
+            }
+        }
+        if ((e & EPOLLOUT) && s->blocked && team_hub_pump(&srv->hub, s) < 0) team_hub_drop(s);
+    }
+    team_hub_sweep(&srv->hub);
+    if (stop || srv->hub.shutdown) return -1;
+    return n < 0 ? 0 : n;
+}
+
+// End the wait of team_server_poll; callable from any thread or a signal handler
+static inline void team_server_stop(TeamServer* srv) {
+    uint64_t one = 1;
+    ssize_t written = write(srv->stop, &one, sizeof(one));
+    (void)written;
+}
+
+static inline void team_server_close(TeamServer* srv) {
+    team_hub_free(&srv->hub);
+    if (srv->listener >= 0) {
+        close(srv->listener);
+        unlink(srv->path);
+    }
+    if (srv->epoll >= 0) close(srv->epoll);
+    if (srv->stop >= 0) close(srv->stop);
+    srv->listener = srv->epoll = srv->stop = -1;
+}
+
+// Connect a subscriber to the daemon; returns TEAM_NO_HANDLE if it is not running
+static inline int team_connect(const char* path) {
+    struct sockaddr_un addr = {0};
+    addr.sun_family = AF_UNIX;
+    if (strlen(path) >= sizeof(addr.sun_path)) return -1;
+    strcpy(addr.sun_path, path);
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd >= 0 && connect(fd, (struct sockaddr*)&addr, sizeof(addr)) != 0) {
+        close(fd);
+        fd = -1;
+    }
+    return fd;
+}
+
+// Wait until there is something to read; returns 0 on timeout
+static inline int team_wait_readable(int fd, int timeout_ms) {
+    struct pollfd p = {fd, POLLIN, 0};
+    return poll(&p, 1, timeout_ms) > 0;
+}
+
+// Subscriber side: a connection a thread waits on for the next state and for a stop at once
+typedef struct {
+    int handle;
+    size_t got;                 // bytes of the next state read so far
+    uint8_t buf[sizeof(TeamState)];
+} TeamReader;
+
+// Connect a reader to the daemon; returns 0 if it is not running
+static inline int team_reader_open(TeamReader* r, const char* path) {
+    memset(r, 0, sizeof(*r));
+    r->handle = team_connect(path);
+    return r->handle >= 0;
+}
+
+// Wait up to timeout_ms (-1: as long as it takes) for the next whole state, or until the stop
+// descriptor (e.g. an eventfd; -1 for none) is readable. Returns 1 with a state in out, 0 on timeout,
+// and -1 if stopped, the daemon is gone, or it sent something that is not a state.
+static inline int team_reader_wait(TeamReader* r, int stop, int timeout_ms, TeamState* out) {
+    for (;;) {
+        struct pollfd p[2] = {{r->handle, POLLIN, 0}, {stop, POLLIN, 0}};
+        int n = poll(p, stop >= 0 ? 2 : 1, timeout_ms);
+        if (n == 0) return 0;
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0 || (stop >= 0 && p[1].revents)) return -1;
+        ssize_t got = recv(r->handle, r->buf + r->got, sizeof(r->buf) - r->got, 0);
+        if (got <= 0) return -1;
+        r->got += (size_t)got;
+        if (r->got < sizeof(r->buf)) continue;
+        r->got = 0;
+        memcpy(out, r->buf, sizeof(*out));
+        return team_state_valid(out) ? 1 : -1;
+    }
+}
+
+static inline void team_reader_close(TeamReader* r) {
+    close(r->handle);
+}
+
+#endif
+
+// Subscriber side: read the next whole state from a blocking connection; returns 0 if the daemon is gone
+// or sent something that is not a state
+static inline int team_receive(TeamHandle h, TeamState* out) {
+    uint8_t buf[sizeof(TeamState)];
+    size_t got = 0;
+    while (got < sizeof(buf)) {
+        long n = team_read(h, buf + got, sizeof(buf) - got);
+        if (n < 0) return 0;
+        if (n == 0) team_wait_readable(h, 1000);
+        got += (size_t)n;
+    }
+    memcpy(out, buf, sizeof(*out));
+    return team_state_valid(out);
+}
+
+// Subscriber side: send a command over a blocking connection; returns 0 if the daemon is gone
+static inline int team_send(TeamHandle h, const TeamCommand* c) {
+    const uint8_t* p = (const uint8_t*)c;
+    size_t done = 0;
+    while (done < sizeof(*c)) {
+        long n = team_write(h, p + done, sizeof(*c) - done);
+        if (n < 0) return 0;
+        if (n == 0) {
+#ifdef _WIN32
+            Sleep(1);
+#else
+            usleep(1000);
+#endif
+        }
+        done += (size_t)n;
+    }
+    return 1;
+}
+
+#endif
@@ -3,11 +3,32 @@
 #define _WIN32_WINNT 0x0501
 #include <windows.h>
 #include <shellapi.h>
+#include <stddef.h>
 #include <stdio.h>
 #include <string.h>
 #include <wchar.h>
 #include <mmsystem.h>
 #include <tchar.h>
+#include <math.h>
+#include <psapi.h>
+#include "pomodoro-status.h"
+#include "ima-adpcm.h"
+#include "pomodoro-adapt.h"
+#include "pomodoro-archive.h"
+#include "pomodoro-focus.h"
+#include "pomodoro-heatmap.h"
+#include "pomodoro-hooks.h"
+#include "pomodoro-labels.h"
+#include "pomodoro-metrics.h"
+#include "pomodoro-replay.h"
+#include "pomodoro-report.h"
+#include "pomodoro-ring.h"
+#include "pomodoro-session.h"
+#include "pomodoro-settings.h"
+#include "pomodoro-sprites.h"
+#include "pomodoro-sync.h"
+#include "pomodoro-team.h"
+#include "pomodoro-trace.h"
 
 #define ID_MENU_LANGUAGE 301
 #define ID_MENU_LANG_EN 302
@@ -18,12 +39,93 @@
 #define ID_MENU_LANG_FR 307
 #define ID_MENU_LANG_RU 308
 #define ID_MENU_RESET_COUNT 309
+#define ID_MENU_LABEL_PICK 310
+#define ID_MENU_STATISTICS 311
+#define PICKER_WINDOW_CLASS L"PomodoroPickerClass"
+#define HEATMAP_WINDOW_CLASS L"PomodoroHeatmapClass"
+#define ID_PICKER_EDIT 2101
+#define ID_PICKER_LIST 2102
+#define ID_MENU_PROGRESS_RING 10
 #define TOAST_WINDOW_CLASS L"PomodoroToastClass"
 #define WM_TOAST_NOTIFY (WM_APP + 100)
+#define WM_DEFERRED_INIT (WM_APP + 101)
+#define WM_SETTINGS_CHANGED (WM_APP + 102)
+#define WM_REPLAY_MENU (WM_APP + 103)
+#define WM_TEAM_STATE (WM_APP + 104)
+#define SETTINGS_FILE "pomodoro_settings.json"
+#define SETTINGS_FILE_W L"pomodoro_settings.json"
+#define SETTINGS_DEBOUNCE_MS 250
 #define ID_TOAST_ACTION 2001
 #define ID_TOAST_CLOSE 2002
 #define ID_TOAST_RESET 2003
 
+// Commands forwarded from a second instance via WM_COPYDATA
+#define REMOTE_COMMAND_MAGIC 0x504D
+#define REMOTE_CMD_START_POMODORO 1
+#define REMOTE_CMD_START_BREAK 2
+#define REMOTE_CMD_START_LONG_BREAK 3
+#define REMOTE_CMD_STOP 4
+#define REMOTE_CMD_TOGGLE 5
+#define REMOTE_CMD_RESET_COUNT 6
+#define REMOTE_CMD_STATUS 7
+#define REMOTE_CMD_SET_LABEL 8 // the label travels in the WM_COPYDATA payload
+#define REMOTE_CMD_TRACE_DUMP 9
+
+// Session kinds and outcomes
+#define SESSION_POMODORO 0
+#define SESSION_SHORT_BREAK 1
+#define SESSION_LONG_BREAK 2
+#define OUTCOME_COMPLETED 0
+#define OUTCOME_STOPPED 1
+#define OUTCOME_EXPIRED 2
+
+// Running session persisted across restarts (pomodoro-session.h)
+#define SESSION_STATE_FILE "pomodoro_state.dat"
+#define HISTORY_FILE "pomodoro_history.csv"
+#define HISTORY_ARCHIVE_FILE "pomodoro_history.arc"
+#define HISTORY_ARCHIVE_AGE_DAYS 90   // sessions older than this move to the archive
+#define HISTORY_ARCHIVE_SLACK_DAYS 30 // and only once this much more has piled up
+#define DAY_COUNTS_FILE "pomodoro_days.dat"
+#define HISTORY_PENDING_MAX 64 // Pomodoros kept while the history loads, far more than can end meanwhile
+#define HEATMAP_CACHE_TILES 48 // rendered month tiles kept while the heatmap is open
+
+// Task labels
+#define LABELS_FILE "pomodoro_labels.txt"
+#define LABEL_TOTALS_FILE "pomodoro_label_totals.dat"
+#define PICKER_MAX_ROWS 50
+
+// Event hooks, configured in the [hooks] section of pomodoro.ini
+#define CONFIG_INI_FILE L"pomodoro.ini"
+#define HOOKS_LOG_FILE "pomodoro_hooks.log"
+#define HOOK_COMMAND_MAX 1024
+
+// Adaptive Pomodoro durations, configured in the [adaptive] section of pomodoro.ini
+#define ADAPT_FILE "pomodoro_adapt.dat"
+#define ADAPT_MODE_OFF 0
+#define ADAPT_MODE_SUGGEST 1 // shown in the toast after a break
+#define ADAPT_MODE_AUTO 2    // used for the next Pomodoro
+
+// Global hotkeys, configured in the [hotkeys] section of pomodoro.ini
+#define HOTKEY_COUNT 4
+#define HOTKEY_ID_BASE 1
+#ifndef MOD_NOREPEAT
+#define MOD_NOREPEAT 0x4000 // Windows 7 and later; older versions ignore it
+#endif
+
+// History sync through a shared folder, configured in the [sync] section of pomodoro.ini
+#define SYNC_STATE_FILE "pomodoro_sync.dat"
+#define SYNC_PEERS_HISTORY_FILE "pomodoro_history_peers.csv"
+#define SYNC_SEGMENT_SUFFIX L".pomodoro.log"
+#define SYNC_INTERVAL_MS 60000
+#define TEAM_REPORT_FILE "pomodoro_team_report.csv"
+#define LABELS_INDEX_FILE "pomodoro_labels.idx"
+
+// Prometheus textfile exporter, configured in the [metrics] section of pomodoro.ini
+#define METRICS_INTERVAL_SECONDS 15
+#define METRICS_TEXT_MAX 8192
+#define TRACE_FILE "pomodoro_trace.json"
+#define REPLAY_TOAST_WAIT_MS 1000 // for the toast a completion posts to appear
+
 // Structure for localized strings
 typedef struct {
     WCHAR menu_start_pomodoro[64];
@@ -49,10 +151,18 @@ typedef struct {
     WCHAR notify_pomodoro_complete[128];
     WCHAR notify_break_complete[128];
     WCHAR notify_long_break_complete[128];
+    WCHAR menu_progress_ring[64];
+    WCHAR menu_task[64];
+    WCHAR menu_no_task[64];
+    WCHAR menu_choose_task[64];
+    WCHAR task_prompt[64];
+    WCHAR menu_statistics[64];
+    WCHAR toast_suggested[128];
+    WCHAR toast_adapted[128];
 } LANG;
 
 // Language definitions
-static LANG lang_en = {
+static const LANG lang_en = {
     L"Start Pomodoro",
     L"Start Break",
     L"Start Long Break",
@@ -75,10 +185,18 @@ static LANG lang_en = {
     L"Invalid time values! Must be positive and reasonable.",
     L"Pomodoro Complete!",
     L"Break Complete!",
-    L"Long Break Complete!"
+    L"Long Break Complete!",
+    L"Progress Ring",
+    L"Task",
+    L"No Task",
+    L"Choose Task...",
+    L"Task name:",
+    L"Statistics...",
+    L"Suggested for this hour: %d min",
+    L"Next Pomodoro: %d min (adapted)"
 };
 
-static LANG lang_hu = {
+static const LANG lang_hu = {
     L"Pomodoro indítása",
     L"Szünet indítása",
     L"Hosszú szünet indítása",
@@ -101,10 +219,18 @@ static LANG lang_hu = {
     L"Érvénytelen időértékek! Pozitívnak és ésszerűnek kell lenniük.",
     L"Pomodoro kész!",
     L"Szünet kész!",
-    L"Hosszú szünet kész!"
+    L"Hosszú szünet kész!",
+    L"Haladásjelző gyűrű",
+    L"Feladat",
+    L"Nincs feladat",
+    L"Feladat választása...",
+    L"Feladat neve:",
+    L"Statisztika...",
+    L"Javasolt ebben az órában: %d perc",
+    L"Következő pomodoro: %d perc (igazítva)"
 };
 
-static LANG lang_de = {
+static const LANG lang_de = {
     L"Pomodoro starten",
     L"Pause starten",
     L"Lange Pause starten",
@@ -127,10 +253,18 @@ static LANG lang_de = {
     L"Ungültige Zeitwerte! Müssen positiv und angemessen sein.",
     L"Pomodoro abgeschlossen!",
     L"Pause abgeschlossen!",
-    L"Lange Pause abgeschlossen!"
+    L"Lange Pause abgeschlossen!",
+    L"Fortschrittsring",
+    L"Aufgabe",
+    L"Keine Aufgabe",
+    L"Aufgabe wählen...",
+    L"Name der Aufgabe:",
+    L"Statistik...",
+    L"Vorschlag für diese Stunde: %d Min.",
+    L"Nächster Pomodoro: %d Min. (angepasst)"
 };
 
-static LANG lang_it = {
+static const LANG lang_it = {
     L"Avvia Pomodoro",
     L"Avvia Pausa",
     L"Avvia Pausa Lunga",
@@ -153,10 +287,18 @@ static LANG lang_it = {
     L"Valori temporali non validi! Devono essere positivi e ragionevoli.",
     L"Pomodoro Completato!",
     L"Pausa Completata!",
-    L"Pausa Lunga Completata!"
+    L"Pausa Lunga Completata!",
+    L"Anello di avanzamento",
+    L"Attività",
+    L"Nessuna attività",
+    L"Scegli attività...",
+    L"Nome dell'attività:",
+    L"Statistiche...",
+    L"Consigliato per quest'ora: %d min",
+    L"Prossimo pomodoro: %d min (adattato)"
 };
 
-static LANG lang_es = {
+static const LANG lang_es = {
     L"Iniciar Pomodoro",
     L"Iniciar Descanso",
     L"Iniciar Descanso Largo",
@@ -179,10 +321,18 @@ static LANG lang_es = {
     L"¡Valores de tiempo inválidos! Deben ser positivos y razonables.",
     L"¡Pomodoro completado!",
     L"¡Descanso completado!",
-    L"¡Descanso largo completado!"
+    L"¡Descanso largo completado!",
+    L"Anillo de progreso",
+    L"Tarea",
+    L"Sin tarea",
+    L"Elegir tarea...",
+    L"Nombre de la tarea:",
+    L"Estadísticas...",
+    L"Sugerido para esta hora: %d min",
+    L"Próximo pomodoro: %d min (ajustado)"
 };
 
-static LANG lang_fr = {
+static const LANG lang_fr = {
     L"Démarrer Pomodoro",
     L"Démarrer Pause",
     L"Démarrer Pause Longue",
@@ -205,10 +355,18 @@ static LANG lang_fr = {
     L"Valeurs de temps invalides! Doivent être positives et raisonnables.",
     L"Pomodoro Terminé!",
     L"Pause Terminée!",
-    L"Pause Longue Terminée!"
+    L"Pause Longue Terminée!",
+    L"Anneau de progression",
+    L"Tâche",
+    L"Aucune tâche",
+    L"Choisir une tâche...",
+    L"Nom de la tâche :",
+    L"Statistiques...",
+    L"Suggéré pour cette heure : %d min",
+    L"Prochain pomodoro : %d min (ajusté)"
 };
 
-static LANG lang_ru = {
+static const LANG lang_ru = {
     L"Запустить Помодоро",
     L"Запустить Перерыв",
     L"Запустить Длинный Перерыв",
@@ -231,34 +389,55 @@ static LANG lang_ru = {
     L"Недопустимые значения времени! Должны быть положительными и разумными.",
     L"Помодоро завершено!",
     L"Перерыв завершен!",
-    L"Длинный перерыв завершен!"
+    L"Длинный перерыв завершен!",
+    L"Кольцо прогресса",
+    L"Задача",
+    L"Без задачи",
+    L"Выбрать задачу...",
+    L"Название задачи:",
+    L"Статистика...",
+    L"Рекомендуется в этот час: %d мин",
+    L"Следующий помодоро: %d мин (подобрано)"
 };
 
-static LANG *g_lang = &lang_en;
+static const LANG *g_lang = &lang_en;
 static HMENU g_hLangMenu = NULL;
 static HMENU g_hMenu = NULL;
 
-// Timer settings structure
-typedef struct {
-    int pomodoro_duration;
-    int short_break_duration;
-    int long_break_duration;
-    int enable_clock_sound;
-    int show_completion_dialog;
-} TimerSettings;
-
 // Global variables
-TimerSettings settings = {25, 5, 15, 1, 1};
+TimerSettings settings = {25, 5, 15, 1, 1, 0, 0, 10};
 int pomodoro_count = 0;
 int is_running = 0;
 int is_in_pomodoro = 0;
 int remaining_seconds = 0;
+int session_kind = SESSION_POMODORO;
+int session_planned_seconds = 0;
+LONGLONG session_start_time = 0;
+CRITICAL_SECTION state_lock;
+int today_pomodoros = 0;
+int today_focus_seconds = 0;
+LONG today_day = 0;
+uint32_t today_synced = 0;         // see pomodoro-sync.h
+static LabelTable labels;          // guarded by state_lock
+static HANDLE sync_wake = NULL;    // set when there is a new local session to publish
+static LONGLONG history_archived_bytes = 0; // bytes moved from the front of the history to the archive
+static HeatmapDays day_counts;     // finished Pomodoros per local day, guarded by state_lock
+static AdaptModel adapt_model;     // Pomodoro statistics per local hour, guarded by state_lock
+static int history_loaded = 0;     // day_counts and adapt_model are loaded, guarded by state_lock
+static ArchiveRow history_pending[HISTORY_PENDING_MAX]; // Pomodoros logged before that, guarded by state_lock
+static int history_pending_count = 0;
+static int adapt_mode = ADAPT_MODE_SUGGEST;
+static PomodoroMetrics metrics;    // in-memory counters for the metrics exporter
+static HWND g_hHeatmap = NULL;
+static int current_label = 0;      // task label of pomodoros, 0 for none
+static volatile PomodoroStatus* status_segment = NULL;
 NOTIFYICONDATA nid = {0};
 HANDLE timer_thread_handle = NULL;
 int autostart_enabled = 0;
 static HICON last_icon = NULL;
 static wchar_t last_text[16] = {0};
 static int last_dots = -1;
+static HICON ring_icon = NULL;
 static int screenWidth = 0, screenHeight = 0;
 static HWND g_hToastWnd = NULL;
 static HWND g_main_hwnd = NULL; // main invisible window handle
@@ -266,6 +445,28 @@ static int toast_is_pomodoro = 0;
 static int toast_is_long_break = 0;
 static HWND g_hToastButton = NULL;
 static HWND g_hToastCloseButton = NULL;
+static HFONT g_hToastBtnFont = NULL;
+static int g_startup_cmd = 0; // command given on the command line of the first instance
+static wchar_t g_startup_label[LABEL_MAX_BYTES] = L""; // --label <name>
+static int g_startup_timing = 0; // --startup-timing: report the cost of each startup phase
+static int g_memory_report = 0;  // --memory-report: report the memory cost of each subsystem
+static int g_tick_benchmark = 0; // --tick-benchmark: report the cost of the once-per-second tray update
+static int g_launch_benchmark = 0; // --launch-benchmark: time second launches until their command took effect
+static volatile LONGLONG last_remote_command_time = 0; // QueryPerformanceCounter after a forwarded command ran
+static int g_trace = 0;          // --trace: record a timeline of the hot paths
+static char g_record_path[MAX_PATH * 3] = ""; // --record: opened once this is the running instance
+static FILE* record_out = NULL;  // --record: events reaching the timer are appended here
+static DWORD record_start = 0;
+static CRITICAL_SECTION record_lock;
+static char g_replay_path[MAX_PATH * 3] = ""; // --replay: recording to replay
+static double g_replay_speed = 1.0;           // --replay-speed
+static volatile int replay_active = 0;        // the timer advances only by replayed ticks
+static volatile LONG replay_pending_seconds = 0;
+static HANDLE replay_tick_event = NULL, replay_tick_done = NULL;
+static int g_initialized = 0; // deferred initialization done
+static LARGE_INTEGER g_startup_begin, g_startup_last;
+static wchar_t g_team_path[MAX_PATH] = {0}; // --team: pipe of the team daemon to follow
+static HANDLE team_stop = NULL;                // set on exit to end the team thread
 
 // Resource IDs
 #define IDD_SETTINGS 100
@@ -292,7 +493,20 @@ INT_PTR CALLBACK SettingsDlgProc(HWND hwndDlg, UINT uMsg, WPARAM wParam, LPARAM
 INT_PTR CALLBACK AboutDlgProc(HWND hwndDlg, UINT uMsg, WPARAM wParam, LPARAM lParam);
 void ShowSettingsDialog(HWND hwndParent);
 void ShowAboutDialog(HWND hwndParent);
+void ShowLabelPicker(HWND hwnd);
+void ShowHeatmap(HWND hwnd);
 void ShowCompletionNotification(HWND hwnd, int is_pomodoro_complete, int is_long_break);
+void start_timer(HWND hwnd, int duration_minutes);
+void refresh_tray_icon(HWND hwnd);
+void set_current_label(HWND hwnd, const wchar_t* name);
+void deferred_init(HWND hwnd);
+void apply_settings(HWND hwnd, const TimerSettings* updated);
+void start_clock_sound(void);
+void stop_clock_sound(void);
+void team_follow(HWND hwnd);
+void team_update(HWND hwnd, const TeamState* pushed);
+void console_print(const char* text);
+void team_pause_current_phase(void);
 
 // Initialize system metrics for dialog positioning
 void init_system_metrics() {
@@ -301,7 +515,7 @@ void init_system_metrics() {
 }
 
 // Sets the application language and refreshes the UI
-void SetLanguage(LANG *newLang) {
+void SetLanguage(const LANG *newLang) {
     g_lang = newLang;
     RefreshMenuText();
 }
@@ -355,9 +569,11 @@ void RefreshMenuText(void) {
     ModifyMenu(g_hMenu, 4, MF_BYCOMMAND | MF_STRING | (settings.enable_clock_sound ? MF_CHECKED : 0), 4, g_lang->menu_clock_sound);
     ModifyMenu(g_hMenu, 5, MF_BYCOMMAND | MF_STRING | (autostart_enabled ? MF_CHECKED : 0), 5, g_lang->menu_autostart);
     ModifyMenu(g_hMenu, 9, MF_BYCOMMAND | MF_STRING | (settings.show_completion_dialog ? MF_CHECKED : 0), 9, g_lang->menu_show_dialog);
+    ModifyMenu(g_hMenu, ID_MENU_PROGRESS_RING, MF_BYCOMMAND | MF_STRING | (settings.progress_ring ? MF_CHECKED : 0), ID_MENU_PROGRESS_RING, g_lang->menu_progress_ring);
     ModifyMenu(g_hMenu, 6, MF_BYCOMMAND | MF_STRING, 6, g_lang->menu_settings);
     ModifyMenu(g_hMenu, 7, MF_BYCOMMAND | MF_STRING, 7, g_lang->menu_about);
     ModifyMenu(g_hMenu, ID_MENU_RESET_COUNT, MF_BYCOMMAND | MF_STRING, ID_MENU_RESET_COUNT, g_lang->menu_reset_count);
+    ModifyMenu(g_hMenu, ID_MENU_STATISTICS, MF_BYCOMMAND | MF_STRING, ID_MENU_STATISTICS, g_lang->menu_statistics);
     ModifyMenu(g_hMenu, 8, MF_BYCOMMAND | MF_STRING, 8, g_lang->menu_exit);
 
     if (g_hLangMenu) {
@@ -371,35 +587,10 @@ void RefreshMenuText(void) {
     }
 }
 
-// Create dynamic tray icon with text and dots
-HICON create_tray_icon(const wchar_t* text, int dots) {
-    // Return cached icon if nothing has changed
-    if (last_icon && wcscmp(text, last_text) == 0 && dots == last_dots) {
-        return last_icon;
-    }
-
-    // Clean up previous icon
-    if (last_icon) {
-        DestroyIcon(last_icon);
-        last_icon = NULL;
-    }
-
-    // Create device context and bitmap
-    HDC hdc = CreateCompatibleDC(NULL);
-    BITMAPINFO bmi = {0};
-    bmi.bmiHeader.biSize = sizeof(BITMAPINFOHEADER);
-    bmi.bmiHeader.biWidth = 32;
-    bmi.bmiHeader.biHeight = -32;
-    bmi.bmiHeader.biPlanes = 1;
-    bmi.bmiHeader.biBitCount = 32;
-    bmi.bmiHeader.biCompression = BI_RGB;
-
-    void* bits;
-    HBITMAP hBitmap = CreateDIBSection(hdc, &bmi, DIB_RGB_COLORS, &bits, NULL, 0);
-    SelectObject(hdc, hBitmap);
-
-    // Draw background (dark red)
-    HBRUSH bgBrush = CreateSolidBrush(RGB(139, 0, 0));
+// Draw the icon background, text and progress dots into a 32x32 DC
+void draw_icon_face(HDC hdc, const wchar_t* text, int dots, COLORREF background) {
+    // Draw background (dark red by default)
+    HBRUSH bgBrush = CreateSolidBrush(background);
     RECT rect = {0, 0, 32, 32};
     FillRect(hdc, &rect, bgBrush);
     DeleteObject(bgBrush);
@@ -436,12 +627,117 @@ HICON create_tray_icon(const wchar_t* text, int dots) {
     }
     DeleteObject(dotBrush);
     DeleteObject(hFont);
+}
+
+// Pre-rendered tray icons linked in from pomodoro-sprites.bin; GDI draws the ones it lacks
+#define TRAY_BACKGROUND RGB(139, 0, 0)
+static SpriteSet tray_sprites;
+static const SpriteSize* tray_sprite_size = NULL; // NULL: draw every icon with GDI
+static uint32_t tray_palette[256];                // sprite pixel values on TRAY_BACKGROUND
+
+// A COLORREF as a DIB pixel (0x00RRGGBB)
+uint32_t dib_color(COLORREF c) {
+    return (uint32_t)GetRValue(c) << 16 | (uint32_t)GetGValue(c) << 8 | GetBValue(c);
+}
+
+// Pixels per side of the tray icon: 32, which the shell scales to the small icon size,
+// unless the process is DPI aware and gets the real small icon size
+int tray_icon_size(void) {
+    typedef BOOL (WINAPI *IsProcessDPIAwareFunc)(void);
+    IsProcessDPIAwareFunc is_aware =
+        (IsProcessDPIAwareFunc)GetProcAddress(GetModuleHandleW(L"user32.dll"), "IsProcessDPIAware");
+    return is_aware && is_aware() ? GetSystemMetrics(SM_CXSMICON) : 32;
+}
+
+// Find the sprite resource and pick the smallest size at least as large as the tray icon
+void load_tray_sprites(void) {
+    HRSRC hRes = FindResourceA(NULL, "TRAY_SPRITES", MAKEINTRESOURCEA(10)); // RT_RCDATA
+    HGLOBAL hData = hRes ? LoadResource(NULL, hRes) : NULL;
+    if (!hData || !sprites_open(&tray_sprites, LockResource(hData), SizeofResource(NULL, hRes))) return;
+    int want = tray_icon_size();
+    for (uint32_t i = 0; i < tray_sprites.count; i++) {
+        const SpriteSize* z = &tray_sprites.sizes[i];
+        const SpriteSize* best = tray_sprite_size;
+        if (!best || (best->size < want ? z->size > best->size : z->size >= want && z->size < best->size)) {
+            tray_sprite_size = z;
+        }
+    }
+    sprite_palette(tray_palette, dib_color(TRAY_BACKGROUND));
+}
+
+// Build an icon from the pre-rendered sprites; NULL if there is none for the text
+HICON sprite_icon(const wchar_t* text, int dots, COLORREF background) {
+    const SpriteSize* z = tray_sprite_size;
+    int face = sprite_face(text);
+    if (!z || face < 0 || dots < 0 || dots > SPRITE_MAX_DOTS) return NULL;
+    uint32_t palette[256];
+    const uint32_t* colors = tray_palette;
+    if (background != TRAY_BACKGROUND) {
+        sprite_palette(palette, dib_color(background));
+        colors = palette;
+    }
+
+    BITMAPINFO bmi = {0};
+    bmi.bmiHeader.biSize = sizeof(BITMAPINFOHEADER);
+    bmi.bmiHeader.biWidth = z->size;
+    bmi.bmiHeader.biHeight = -z->size;
+    bmi.bmiHeader.biPlanes = 1;
+    bmi.bmiHeader.biBitCount = 32;
+    bmi.bmiHeader.biCompression = BI_RGB;
+    void* bits;
+    HBITMAP hBitmap = CreateDIBSection(NULL, &bmi, DIB_RGB_COLORS, &bits, NULL, 0);
+    if (!hBitmap) return NULL;
+
+    // Same mask as render_icon: set where the pixel is the plain background
+    BYTE mask[SPRITE_MAX_SIZE * SPRITE_MAX_SIZE / 8];
+    int stride = (z->size + 15) / 16 * 2; // monochrome rows are WORD aligned
+    sprite_draw(&tray_sprites, z, face, dots, colors, (uint32_t*)bits, mask, stride);
+    HBITMAP hMask = CreateBitmap(z->size, z->size, 1, 1, mask);
+
+    HICON hIcon = NULL;
+    if (hMask) {
+        ICONINFO iconInfo = {0};
+        iconInfo.fIcon = TRUE;
+        iconInfo.hbmColor = hBitmap;
+        iconInfo.hbmMask = hMask;
+        hIcon = CreateIconIndirect(&iconInfo);
+        DeleteObject(hMask);
+    }
+    DeleteObject(hBitmap);
+    return hIcon;
+}
+
+// Render a new icon with text, dots and the given background color
+HICON render_icon(const wchar_t* text, int dots, COLORREF background) {
+    TRACE_BEGIN("render icon");
+    HICON sprite = sprite_icon(text, dots, background);
+    if (sprite) {
+        metrics_add(&metrics.icon_renders, 1);
+        TRACE_END("render icon");
+        return sprite;
+    }
+
+    // Create device context and bitmap
+    HDC hdc = CreateCompatibleDC(NULL);
+    BITMAPINFO bmi = {0};
+    bmi.bmiHeader.biSize = sizeof(BITMAPINFOHEADER);
+    bmi.bmiHeader.biWidth = 32;
+    bmi.bmiHeader.biHeight = -32;
+    bmi.bmiHeader.biPlanes = 1;
+    bmi.bmiHeader.biBitCount = 32;
+    bmi.bmiHeader.biCompression = BI_RGB;
+
+    void* bits;
+    HBITMAP hBitmap = CreateDIBSection(hdc, &bmi, DIB_RGB_COLORS, &bits, NULL, 0);
+    SelectObject(hdc, hBitmap);
+
+    draw_icon_face(hdc, text, dots, background);
 
     // Create icon mask
     HBITMAP hMask = CreateCompatibleBitmap(hdc, 32, 32);
     HDC hdcMask = CreateCompatibleDC(hdc);
     SelectObject(hdcMask, hMask);
-    SetBkColor(hdc, RGB(139, 0, 0));
+    SetBkColor(hdc, background);
     BitBlt(hdcMask, 0, 0, 32, 32, hdc, 0, 0, SRCCOPY);
 
     // Create icon
@@ -450,6 +746,7 @@ HICON create_tray_icon(const wchar_t* text, int dots) {
     iconInfo.hbmColor = hBitmap;
     iconInfo.hbmMask = hMask;
     HICON hIcon = CreateIconIndirect(&iconInfo);
+    metrics_add(&metrics.icon_renders, 1);
 
     // Clean up
     DeleteDC(hdcMask);
@@ -457,6 +754,25 @@ HICON create_tray_icon(const wchar_t* text, int dots) {
     DeleteObject(hBitmap);
     DeleteObject(hMask);
 
+    TRACE_END("render icon");
+    return hIcon;
+}
+
+// Create dynamic tray icon with text and dots
+HICON create_tray_icon(const wchar_t* text, int dots) {
+    // Return cached icon if nothing has changed
+    if (last_icon && wcscmp(text, last_text) == 0 && dots == last_dots) {
+        return last_icon;
+    }
+
+    // Clean up previous icon
+    if (last_icon) {
+        DestroyIcon(last_icon);
+        last_icon = NULL;
+    }
+
+    HICON hIcon = render_icon(text, dots, TRAY_BACKGROUND);
+
     // Cache for later
     last_icon = hIcon;
     wcscpy(last_text, text);
@@ -465,8 +781,99 @@ HICON create_tray_icon(const wchar_t* text, int dots) {
     return hIcon;
 }
 
-// Update system tray icon and tooltip
-void update_tray_icon(HWND hwnd, const wchar_t* text, int dots, int seconds) {
+// Progress ring (pomodoro-ring.h) around the icon text
+#define RING_TRACK_COLOR 0x00640000 // dark red (0xRRGGBB as stored in the DIB)
+#define RING_FILL_COLOR 0x0090EE90  // light green, same as the dots
+
+static RingTable ring_table;
+static HBITMAP ring_bitmap = NULL;
+static HBITMAP ring_mask = NULL;
+static DWORD* ring_bits = NULL;
+static DWORD ring_base[RING_ICON_SIZE * RING_ICON_SIZE];
+static BYTE ring_mask_bits[RING_ICON_SIZE * RING_MASK_STRIDE];
+static wchar_t ring_text[16] = {0};
+static int ring_dots = -1;
+static int ring_steps = 0;
+
+// Create the tray icon with a progress ring of the given number of elapsed steps
+HICON create_ring_icon(const wchar_t* text, int dots, int steps) {
+    if (steps < 0) steps = 0;
+    if (steps > RING_STEPS) steps = RING_STEPS;
+    if (ring_icon && steps == ring_steps && dots == ring_dots && wcscmp(text, ring_text) == 0) {
+        return ring_icon;
+    }
+
+    if (!ring_bitmap) {
+        ring_build_table(&ring_table, RING_ICON_SIZE);
+        BITMAPINFO bmi = {0};
+        bmi.bmiHeader.biSize = sizeof(BITMAPINFOHEADER);
+        bmi.bmiHeader.biWidth = RING_ICON_SIZE;
+        bmi.bmiHeader.biHeight = -RING_ICON_SIZE;
+        bmi.bmiHeader.biPlanes = 1;
+        bmi.bmiHeader.biBitCount = 32;
+        bmi.bmiHeader.biCompression = BI_RGB;
+        ring_bitmap = CreateDIBSection(NULL, &bmi, DIB_RGB_COLORS, (void**)&ring_bits, NULL, 0);
+        // Filled in with the face below
+        ring_mask = CreateBitmap(RING_ICON_SIZE, RING_ICON_SIZE, 1, 1, ring_mask_bits);
+        if (!ring_bitmap || !ring_mask) {
+            if (ring_bitmap) DeleteObject(ring_bitmap);
+            if (ring_mask) DeleteObject(ring_mask);
+            ring_bitmap = ring_mask = NULL;
+            ring_bits = NULL;
+            return create_tray_icon(text, dots);
+        }
+    }
+
+    TRACE_BEGIN("render ring");
+    // Text or dots changed: copy the face from a sprite or render it with GDI, then draw the ring track
+    if (!ring_icon || dots != ring_dots || wcscmp(text, ring_text) != 0) {
+        const SpriteSize* z = tray_sprite_size ? sprite_size(&tray_sprites, RING_ICON_SIZE) : NULL;
+        if (!sprite_draw(&tray_sprites, z, sprite_face(text), dots, tray_palette, (uint32_t*)ring_bits, ring_mask_bits,
+                         RING_MASK_STRIDE)) {
+            HDC hdc = CreateCompatibleDC(NULL);
+            HGDIOBJ old = SelectObject(hdc, ring_bitmap);
+            draw_icon_face(hdc, text, dots, TRAY_BACKGROUND);
+            GdiFlush();
+            SelectObject(hdc, old);
+            DeleteDC(hdc);
+            ring_background_mask((uint32_t*)ring_bits, RING_ICON_SIZE, dib_color(TRAY_BACKGROUND), ring_mask_bits,
+                                 RING_MASK_STRIDE);
+        }
+
+        // The background around the face is transparent, the ring is not
+        ring_draw_track(&ring_table, (uint32_t*)ring_bits, RING_TRACK_COLOR, ring_mask_bits, RING_MASK_STRIDE);
+        SetBitmapBits(ring_mask, sizeof(ring_mask_bits), ring_mask_bits);
+        memcpy(ring_base, ring_bits, sizeof(ring_base));
+        wcsncpy(ring_text, text, sizeof(ring_text)/sizeof(ring_text[0]) - 1);
+        ring_dots = dots;
+        ring_steps = 0;
+    }
+
+    // Only touch the pixels of the steps between the previous and the new progress
+    ring_set_steps(&ring_table, (uint32_t*)ring_bits, (const uint32_t*)ring_base, ring_steps, steps, RING_FILL_COLOR);
+    ring_steps = steps;
+
+    ICONINFO iconInfo = {0};
+    iconInfo.fIcon = TRUE;
+    iconInfo.hbmColor = ring_bitmap;
+    iconInfo.hbmMask = ring_mask;
+    HICON hIcon = CreateIconIndirect(&iconInfo);
+    metrics_add(&metrics.icon_renders, 1);
+    if (ring_icon) DestroyIcon(ring_icon);
+    ring_icon = hIcon;
+    TRACE_END("render ring");
+    return hIcon;
+}
+
+// Wide copy of a label name for the UI
+void label_display_name(int id, wchar_t* out, int out_len) {
+    EnterCriticalSection(&state_lock);
+    if (!MultiByteToWideChar(CP_UTF8, 0, label_name(&labels, id), -1, out, out_len)) out[0] = L'\0';
+    LeaveCriticalSection(&state_lock);
+}
+
+// Set the tray tooltip to the remaining time, or the next action when stopped
+void set_tray_tooltip(int seconds) {
     wchar_t tooltip[128];
     if (seconds > 0) {
         int min = seconds / 60, sec = seconds % 60;
@@ -480,177 +887,1057 @@ void update_tray_icon(HWND hwnd, const wchar_t* text, int dots, int seconds) {
             tooltip[sizeof(tooltip)/sizeof(tooltip[0]) - 1] = L'\0';
         }
     }
+    if (current_label) {
+        wchar_t name[LABEL_MAX_BYTES];
+        label_display_name(current_label, name, LABEL_MAX_BYTES);
+        size_t cap = sizeof(tooltip)/sizeof(tooltip[0]);
+        wcsncat(tooltip, L" - ", cap - wcslen(tooltip) - 1);
+        wcsncat(tooltip, name, cap - wcslen(tooltip) - 1);
+    }
     wcsncpy(nid.szTip, tooltip, sizeof(nid.szTip)/sizeof(nid.szTip[0]) - 1);
     nid.szTip[sizeof(nid.szTip)/sizeof(nid.szTip[0]) - 1] = L'\0';
+}
+
+// Update system tray icon and tooltip
+void update_tray_icon(HWND hwnd, const wchar_t* text, int dots, int seconds) {
+    set_tray_tooltip(seconds);
 
-    nid.hIcon = create_tray_icon(text, dots);
+    if (settings.progress_ring && seconds > 0 && session_planned_seconds > 0) {
+        int steps = (session_planned_seconds - seconds) * RING_STEPS / session_planned_seconds;
+        nid.hIcon = create_ring_icon(text, dots, steps);
+    } else {
+        nid.hIcon = create_tray_icon(text, dots);
+    }
     nid.uFlags = NIF_ICON | NIF_MESSAGE | NIF_TIP;
+    TRACE_BEGIN("Shell_NotifyIcon");
     Shell_NotifyIcon(NIM_MODIFY, &nid);
+    TRACE_END("Shell_NotifyIcon");
+    metrics_add(&metrics.notify_icon_calls, 1);
 }
 
-// Play sound from resource
-void play_resource_sound(const char* resourceName) {
-    HRSRC hRes = FindResourceA(NULL, resourceName, "WAV");
-    if (hRes) {
-        HGLOBAL hData = LoadResource(NULL, hRes);
-        if (hData) {
-            LPVOID pData = LockResource(hData);
-            PlaySoundA((LPCSTR)pData, NULL, SND_MEMORY | SND_ASYNC);
-            UnlockResource(hData);
-        }
-    }
-}
+// Final countdown animation: every frame is pre-rendered once per dots value,
+// so showing a frame is a single Shell_NotifyIcon call, capped at COUNTDOWN_FPS
+#define COUNTDOWN_MAX_SECONDS SETTINGS_COUNTDOWN_MAX_SECONDS
+#define COUNTDOWN_FRAMES 4
+#define COUNTDOWN_FPS 4
+#define COUNTDOWN_FRAME_MS (1000 / COUNTDOWN_FPS)
+#define COMPLETION_FLASH_MS 1500
 
-// Timer thread function
-DWORD WINAPI timer_thread(LPVOID lpParam) {
-    static int is_sound_playing = 0;
+static HICON countdown_cache[COUNTDOWN_MAX_SECONDS + 1][COUNTDOWN_FRAMES]; // row 0 is the completion play symbol
+static int countdown_cache_dots = -1;
+static int anim_last_key = -1;
+static int anim_last_seq = -1;
+static DWORD anim_last_shown = 0;
+volatile LONG anim_cancel = 0;
 
-    if (settings.enable_clock_sound && !is_sound_playing) {
-        HRSRC hRes = FindResourceA(NULL, "CLOCK_WAV", "WAV");
-        if (hRes) {
-            HGLOBAL hData = LoadResource(NULL, hRes);
-            if (hData) {
-                LPVOID pData = LockResource(hData);
-                PlaySoundA((LPCSTR)pData, NULL, SND_MEMORY | SND_ASYNC | SND_LOOP);
-                is_sound_playing = 1;
-                UnlockResource(hData);
+// Pulse from the normal dark red to a brighter red and back
+static const COLORREF countdown_colors[COUNTDOWN_FRAMES] = {
+    RGB(139, 0, 0), RGB(190, 20, 20), RGB(240, 40, 40), RGB(190, 20, 20)
+};
+
+// Free the pre-rendered countdown frames
+void free_countdown_cache(void) {
+    for (int i = 0; i <= COUNTDOWN_MAX_SECONDS; i++) {
+        for (int f = 0; f < COUNTDOWN_FRAMES; f++) {
+            if (countdown_cache[i][f]) {
+                DestroyIcon(countdown_cache[i][f]);
+                countdown_cache[i][f] = NULL;
             }
         }
     }
+    countdown_cache_dots = -1;
+}
 
-    ULONGLONG last_tick = GetTickCount();
-    int last_shown_seconds = -1;
-    HWND hwnd = (HWND)lpParam;
+// Pre-render all countdown frames for the given number of dots
+void build_countdown_cache(int dots) {
+    if (countdown_cache_dots == dots) return;
+    free_countdown_cache();
+    for (int i = 0; i <= COUNTDOWN_MAX_SECONDS; i++) {
+        wchar_t text[16];
+        if (i == 0) {
+            wcscpy(text, L"\u25BA");
+        } else {
+            _itow(i, text, 10);
+        }
+        for (int f = 0; f < COUNTDOWN_FRAMES; f++) {
+            countdown_cache[i][f] = render_icon(text, dots, countdown_colors[f]);
+        }
+    }
+    countdown_cache_dots = dots;
+}
 
-    while (is_running) {
-        ULONGLONG now = GetTickCount();
-        ULONGLONG elapsed_ms = now - last_tick;
+// Start a new countdown or completion animation sequence
+void reset_animation(void) {
+    anim_last_key = -1;
+    anim_last_seq = -1;
+}
 
-        if (elapsed_ms >= 1000) {
-            int elapsed_sec = (int)(elapsed_ms / 1000);
-            remaining_seconds -= elapsed_sec;
-            last_tick += (ULONGLONG)elapsed_sec * 1000;
+// Show the animation frame for the given row and time; seq is the frame's position in the sequence
+void show_animation_frame(int row, int frame, int seq, int seconds) {
+    int key = row * COUNTDOWN_FRAMES + frame;
+    if (key == anim_last_key) return;
 
-            if (remaining_seconds < 0) remaining_seconds = 0;
+    // Hard cap on the frame rate and the number of Shell_NotifyIcon calls
+    DWORD now = GetTickCount();
+    if (anim_last_key >= 0 && now - anim_last_shown < COUNTDOWN_FRAME_MS) return;
 
-            if (remaining_seconds > 0 && remaining_seconds <= 10 && settings.enable_clock_sound) {
-                Beep(440, 100);
-            }
+    build_countdown_cache(pomodoro_count);
+    if (anim_last_seq >= 0 && seq > anim_last_seq + 1) {
+        metrics_add(&metrics.animation_frames_dropped, seq - anim_last_seq - 1);
+    }
+    anim_last_seq = seq;
+    anim_last_key = key;
+    anim_last_shown = now;
+    metrics_add(&metrics.animation_frames, 1);
 
-            if (remaining_seconds != last_shown_seconds) {
-                wchar_t display_text[16];
-                if (remaining_seconds < 60) {
-                    _itow(remaining_seconds, display_text, 10);
-                } else {
-                    _itow(remaining_seconds / 60, display_text, 10);
-                }
-                update_tray_icon(hwnd, display_text, pomodoro_count, remaining_seconds);
-                last_shown_seconds = remaining_seconds;
-            }
-        }
+    set_tray_tooltip(seconds);
+    nid.hIcon = countdown_cache[row][frame];
+    nid.uFlags = NIF_ICON | NIF_MESSAGE | NIF_TIP;
+    TRACE_BEGIN("Shell_NotifyIcon");
+    Shell_NotifyIcon(NIM_MODIFY, &nid);
+    TRACE_END("Shell_NotifyIcon");
+    metrics_add(&metrics.notify_icon_calls, 1);
+}
 
-        if (remaining_seconds <= 0) {
-            is_running = 0;
+// Show the countdown frame for the remaining seconds; phase_ms is the time since the last second boundary
+void show_countdown_frame(int seconds, int phase_ms) {
+    int frame = (phase_ms / COUNTDOWN_FRAME_MS) % COUNTDOWN_FRAMES;
+    int seq = (settings.countdown_seconds - seconds) * COUNTDOWN_FRAMES + frame;
+    show_animation_frame(seconds, frame, seq, seconds);
+}
 
-            if (is_sound_playing) {
-                PlaySoundA(NULL, NULL, 0);
-                is_sound_playing = 0;
-            }
+// Flash the play symbol after completion; stops early when a new timer starts
+void play_completion_flash(void) {
+    DWORD start = GetTickCount();
+    reset_animation();
+    while (!anim_cancel) {
+        DWORD elapsed = GetTickCount() - start;
+        if (elapsed >= COMPLETION_FLASH_MS) break;
+        int seq = (int)(elapsed / COUNTDOWN_FRAME_MS);
+        show_animation_frame(0, seq % COUNTDOWN_FRAMES, seq, 0);
+        Sleep(COUNTDOWN_FRAME_MS / 5);
+    }
+}
 
-            int was_pomodoro = is_in_pomodoro;
-            int is_long_break = 0;
+// Sounds are stored as IMA ADPCM resources and decoded to PCM on first use;
+// the PCM stays cached until the sound is evicted
+#define SOUND_IDLE_EVICT_MS 30000
 
-            if (is_in_pomodoro) {
-                // increment completed pomodoro count up to 4
-                if (pomodoro_count < 4) pomodoro_count++;
-                if (pomodoro_count == 4) {
-                    is_long_break = 1; // schedule a long break
-                }
-            }
+typedef struct {
+    const char* name;
+    BYTE* pcm;          // decoded PCM WAV, NULL until first use
+    size_t size;
+    DWORD last_used;
+} SoundCacheEntry;
 
-            update_tray_icon(hwnd, L"\u25BA", pomodoro_count, 0);
-            play_resource_sound("DING_WAV");
+static SoundCacheEntry sound_cache[] = {
+    {"CLOCK_WAV", NULL, 0, 0},
+    {"DING_WAV", NULL, 0, 0},
+};
+static int clock_sound_playing = 0;         // guarded by sound_lock
+static const BYTE* sound_last_played = NULL; // the PCM PlaySound was given last, guarded by sound_lock
+CRITICAL_SECTION sound_lock;
 
-            // Post a message to the main thread to show completion notification (create toast on GUI thread)
-            if (settings.show_completion_dialog) {
-                PostMessage(hwnd, WM_TOAST_NOTIFY, (WPARAM)was_pomodoro, (LPARAM)is_long_break);
+// Return the decoded PCM WAV of a sound resource, decoding it on first use
+const BYTE* get_sound(const char* name) {
+    const BYTE* pcm = NULL;
+    EnterCriticalSection(&sound_lock);
+    for (size_t i = 0; i < sizeof(sound_cache)/sizeof(sound_cache[0]); i++) {
+        SoundCacheEntry* e = &sound_cache[i];
+        if (strcmp(e->name, name) != 0) continue;
+        if (!e->pcm) {
+            HRSRC hRes = FindResourceA(NULL, name, "WAV");
+            HGLOBAL hData = hRes ? LoadResource(NULL, hRes) : NULL;
+            if (hData) {
+                e->size = ima_adpcm_decode_wav(LockResource(hData), SizeofResource(NULL, hRes), &e->pcm);
             }
-
-            return 0;
         }
-
-        ULONGLONG next_boundary = last_tick + 1000;
-        now = GetTickCount();
-        long sleep_ms = (long)(next_boundary - now);
-
-        if (sleep_ms < 1) sleep_ms = 1;
-        if (sleep_ms > 50) sleep_ms = 50;
-
-        Sleep(sleep_ms);
+        e->last_used = GetTickCount();
+        pcm = e->pcm;
+        break;
     }
+    LeaveCriticalSection(&sound_lock);
+    return pcm;
+}
 
-    if (is_sound_playing) {
+// Free the decoded PCM of a cache entry; called with sound_lock held. PlaySound reads
+// SND_MEMORY sounds from our buffer while they play, so it is stopped first if it may
+// still have this one.
+void free_sound_entry(SoundCacheEntry* e) {
+    if (!e->pcm) return;
+    if (e->pcm == sound_last_played) {
         PlaySoundA(NULL, NULL, 0);
-        is_sound_playing = 0;
+        sound_last_played = NULL;
+        clock_sound_playing = 0;
     }
+    free(e->pcm);
+    e->pcm = NULL;
+    e->size = 0;
+}
 
-    return 0;
+// Free the decoded PCM of a sound, stopping it if it is playing
+void evict_sound(const char* name) {
+    EnterCriticalSection(&sound_lock);
+    for (size_t i = 0; i < sizeof(sound_cache)/sizeof(sound_cache[0]); i++) {
+        if (strcmp(sound_cache[i].name, name) == 0) free_sound_entry(&sound_cache[i]);
+    }
+    LeaveCriticalSection(&sound_lock);
 }
 
-// Start timer with specified duration
-void start_timer(HWND hwnd, int duration_minutes) {
-    // Stop existing timer if running
-    if (is_running) {
-        is_running = 0;
-        if (timer_thread_handle != NULL) {
-            WaitForSingleObject(timer_thread_handle, INFINITE);
-            CloseHandle(timer_thread_handle);
-            timer_thread_handle = NULL;
-        }
+// Free the sounds that have not been played for a while, except a playing clock loop
+void evict_idle_sounds(void) {
+    EnterCriticalSection(&sound_lock);
+    DWORD now = GetTickCount();
+    for (size_t i = 0; i < sizeof(sound_cache)/sizeof(sound_cache[0]); i++) {
+        SoundCacheEntry* e = &sound_cache[i];
+        if (!e->pcm || now - e->last_used < SOUND_IDLE_EVICT_MS) continue;
+        if (clock_sound_playing && strcmp(e->name, "CLOCK_WAV") == 0) continue;
+        free_sound_entry(e);
     }
+    LeaveCriticalSection(&sound_lock);
+}
 
-    remaining_seconds = duration_minutes * 60;
-    is_running = 1;
-    timer_thread_handle = CreateThread(NULL, 0, timer_thread, hwnd, 0, NULL);
+// Release idle sounds and hand the rest of the working set back to the system;
+// pages that are needed again are faulted back in on demand
+void trim_memory(void) {
+    evict_idle_sounds();
+    SetProcessWorkingSetSize(GetCurrentProcess(), (SIZE_T)-1, (SIZE_T)-1);
 }
 
-// Check if autostart is enabled in registry
-int is_autostart_enabled() {
-    HKEY hKey;
-    if (RegOpenKeyExA(HKEY_CURRENT_USER, "Software\\Microsoft\\Windows\\CurrentVersion\\Run", 0, KEY_READ, &hKey) == ERROR_SUCCESS) {
-        DWORD type;
-        if (RegQueryValueExA(hKey, "PomodoroTimer", NULL, &type, NULL, NULL) == ERROR_SUCCESS) {
-            RegCloseKey(hKey);
-            return 1;
-        }
-        RegCloseKey(hKey);
+// Play sound from resource
+void play_resource_sound(const char* resourceName) {
+    EnterCriticalSection(&sound_lock);
+    const BYTE* pcm = get_sound(resourceName);
+    if (pcm) {
+        TRACE_BEGIN("PlaySound");
+        PlaySoundA((LPCSTR)pcm, NULL, SND_MEMORY | SND_ASYNC);
+        TRACE_END("PlaySound");
+        sound_last_played = pcm;
     }
-    return 0;
+    LeaveCriticalSection(&sound_lock);
 }
 
-// Enable or disable autostart in registry
-void set_autostart(int enable) {
-    HKEY hKey;
-    if (RegOpenKeyExA(HKEY_CURRENT_USER, "Software\\Microsoft\\Windows\\CurrentVersion\\Run", 0, KEY_WRITE, &hKey) == ERROR_SUCCESS) {
-        if (enable) {
-            char path[MAX_PATH];
-            GetModuleFileNameA(NULL, path, MAX_PATH);
-            RegSetValueExA(hKey, "PomodoroTimer", 0, REG_SZ, (BYTE*)path, strlen(path) + 1);
-        } else {
-            RegDeleteValueA(hKey, "PomodoroTimer");
-        }
-        RegCloseKey(hKey);
+// Current time in unix seconds
+LONGLONG unix_time_now(void) {
+    FILETIME ft;
+    GetSystemTimeAsFileTime(&ft);
+    ULARGE_INTEGER t;
+    t.u.LowPart = ft.dwLowDateTime;
+    t.u.HighPart = ft.dwHighDateTime;
+    return (LONGLONG)(t.QuadPart / 10000000ULL) - 11644473600LL;
+}
+
+// Local calendar day number (days since 1601-01-01)
+LONG local_day_number(void) {
+    SYSTEMTIME st;
+    FILETIME ft;
+    GetLocalTime(&st);
+    SystemTimeToFileTime(&st, &ft);
+    ULARGE_INTEGER t;
+    t.u.LowPart = ft.dwLowDateTime;
+    t.u.HighPart = ft.dwHighDateTime;
+    return (LONG)(t.QuadPart / 864000000000ULL);
+}
+
+// Local time of a unix time, in 100 ns units since 1601-01-01
+ULONGLONG local_filetime_of(LONGLONG unix_seconds) {
+    ULARGE_INTEGER t;
+    t.QuadPart = (ULONGLONG)(unix_seconds + 11644473600LL) * 10000000ULL;
+    FILETIME utc, local;
+    utc.dwLowDateTime = t.u.LowPart;
+    utc.dwHighDateTime = t.u.HighPart;
+    FileTimeToLocalFileTime(&utc, &local);
+    t.u.LowPart = local.dwLowDateTime;
+    t.u.HighPart = local.dwHighDateTime;
+    return t.QuadPart;
+}
+
+// Local calendar day number of a unix time
+LONG local_day_of(LONGLONG unix_seconds) {
+    return (LONG)(local_filetime_of(unix_seconds) / 864000000000ULL);
+}
+
+// Local hour of the day (0-23) of a unix time
+int local_hour_of(LONGLONG unix_seconds) {
+    return (int)(local_filetime_of(unix_seconds) / 36000000000ULL % 24);
+}
+
+// Start today's totals from zero when the day changes
+void roll_today_totals(void) {
+    LONG day = local_day_number();
+    if (day != today_day) {
+        today_day = day;
+        today_pomodoros = 0;
+        today_focus_seconds = 0;
     }
 }
 
-// Show settings dialog
-void ShowSettingsDialog(HWND hwndParent) {
-    DialogBox(GetModuleHandle(NULL), MAKEINTRESOURCE(IDD_SETTINGS), hwndParent, SettingsDlgProc);
+// Create the named shared-memory status segment read by other tools
+void create_status_segment(void) {
+    status_segment = pomodoro_status_create();
 }
 
-// Settings dialog procedure
-INT_PTR CALLBACK SettingsDlgProc(HWND hwndDlg, UINT uMsg, WPARAM wParam, LPARAM lParam) {
-    switch (uMsg) {
+// Publish the current state to the status segment; called on state transitions only
+void publish_status(void) {
+    if (!status_segment) return;
+    PomodoroStatus status = {0};
+    status.kind = session_kind;
+    status.running = is_running ? 1 : 0;
+    status.pomodoro_count = pomodoro_count;
+    status.start_time = session_start_time;
+    status.deadline = session_start_time + session_planned_seconds;
+    status.planned_seconds = session_planned_seconds;
+    status.today_pomodoros = today_pomodoros;
+    status.today_focus_seconds = today_focus_seconds;
+    status.today = today_day;
+    pomodoro_status_publish(status_segment, &status);
+}
+
+// Persist the session state; written to a temp file and atomically moved into place
+void save_session_state(void) {
+    SessionState st = {0};
+    st.running = is_running ? 1 : 0;
+    st.kind = session_kind;
+    st.is_in_pomodoro = is_in_pomodoro;
+    st.pomodoro_count = pomodoro_count;
+    st.planned_seconds = session_planned_seconds;
+    st.start_time = session_start_time;
+    st.deadline = session_start_time + session_planned_seconds;
+
+    EnterCriticalSection(&state_lock);
+    roll_today_totals();
+    st.today_pomodoros = today_pomodoros;
+    st.today_focus_seconds = today_focus_seconds;
+    st.today = today_day;
+    st.label = current_label;
+    st.today_synced = today_synced;
+    publish_status();
+    TRACE_BEGIN("save state");
+    session_state_save(&st, SESSION_STATE_FILE);
+    TRACE_END("save state");
+    LeaveCriticalSection(&state_lock);
+}
+
+// Activity sampling for the focus score (pomodoro-focus.h), driven by the timer thread's tick
+static FocusSampler focus;
+
+void focus_reset(void) {
+    LASTINPUTINFO lii = {sizeof(lii), 0};
+    GetLastInputInfo(&lii);
+    focus_sampler_reset(&focus, lii.dwTime);
+}
+
+// Advance the sampler by the seconds the timer thread just counted down
+void focus_advance(int elapsed_sec) {
+    if (session_kind != SESSION_POMODORO) return;
+    if (focus_sampler_tick(&focus, elapsed_sec)) {
+        LASTINPUTINFO lii = {sizeof(lii), 0};
+        // Without the input time the sample counts as idle
+        focus_sampler_add(&focus, GetLastInputInfo(&lii) ? lii.dwTime : focus.last_input);
+    }
+}
+
+// Focus score of the current session in percent, or -1 if nothing was sampled
+int focus_score(void) {
+    return focus_sampler_score(&focus);
+}
+
+// Hooks: user commands run on session events. The timer only appends a job to a
+// bounded queue (pomodoro-hooks.h); a few worker threads start the commands, feed
+// them the event as JSON on stdin and kill them after the timeout. A full queue
+// drops the job.
+#define HOOK_START 0
+#define HOOK_STOP 1
+#define HOOK_COMPLETE 2
+#define HOOK_LONG_BREAK_DUE 3
+#define HOOK_EVENTS 4
+
+static const char* hook_event_names[HOOK_EVENTS] = {"start", "stop", "complete", "long_break_due"};
+static wchar_t hook_commands[HOOK_EVENTS][HOOK_COMMAND_MAX];
+static int hook_timeout_ms = 30000;
+static int hook_workers = 2;
+static HookQueue hook_queue;
+static int hooks_enabled = 0;           // the queue and the workers are set up
+static CRITICAL_SECTION hook_log_lock;  // log file, shared by the workers
+static const wchar_t* hotkey_keys[HOTKEY_COUNT] = {L"start_pomodoro", L"start_break", L"stop", L"reset_count"};
+static const int hotkey_commands[HOTKEY_COUNT] = {REMOTE_CMD_START_POMODORO, REMOTE_CMD_START_BREAK, REMOTE_CMD_STOP,
+                                                  REMOTE_CMD_RESET_COUNT};
+
+// Full path of pomodoro.ini next to the other data files
+const wchar_t* config_ini_path(void) {
+    static wchar_t path[MAX_PATH] = L"";
+    if (!path[0] && !GetFullPathNameW(CONFIG_INI_FILE, MAX_PATH, path, NULL)) {
+        wcscpy(path, CONFIG_INI_FILE);
+    }
+    return path;
+}
+
+// Run queued hooks one at a time; several workers run them concurrently
+DWORD WINAPI hook_worker_thread(LPVOID lpParam) {
+    for (;;) {
+        HookJob job;
+        int64_t dropped;
+        hook_queue_pop(&hook_queue, &job, &dropped);
+
+        // The event goes to the command's stdin; the write end stays with us
+        wchar_t cmdline[HOOK_COMMAND_MAX + 16];
+        swprintf(cmdline, sizeof(cmdline)/sizeof(cmdline[0]), L"cmd.exe /c %ls", hook_commands[job.event]);
+        SECURITY_ATTRIBUTES sa = {sizeof(sa), NULL, TRUE};
+        HANDLE in_read = NULL, in_write = NULL;
+        DWORD started = GetTickCount();
+        DWORD exit_code = (DWORD)-1;
+        int timed_out = 0;
+        if (CreatePipe(&in_read, &in_write, &sa, 0)) {
+            SetHandleInformation(in_write, HANDLE_FLAG_INHERIT, 0);
+            STARTUPINFOW si = {0};
+            PROCESS_INFORMATION pi = {0};
+            si.cb = sizeof(si);
+            si.dwFlags = STARTF_USESTDHANDLES;
+            si.hStdInput = in_read;
+            si.hStdOutput = GetStdHandle(STD_OUTPUT_HANDLE);
+            si.hStdError = GetStdHandle(STD_ERROR_HANDLE);
+            // cmd.exe runs in a job of its own, so a timeout ends the programs it started too; it is
+            // created suspended to be in the job before it can start any. The job has no limits:
+            // closing it after a normal finish leaves whatever the hook started in the background.
+            HANDLE process_job = CreateJobObjectW(NULL, NULL);
+            if (CreateProcessW(NULL, cmdline, NULL, NULL, TRUE, CREATE_NO_WINDOW | CREATE_SUSPENDED, NULL, NULL, &si, &pi)) {
+                // Before Windows 8 this fails when we are in a job ourselves; then only cmd.exe can be ended
+                if (process_job && !AssignProcessToJobObject(process_job, pi.hProcess)) {
+                    CloseHandle(process_job);
+                    process_job = NULL;
+                }
+                ResumeThread(pi.hThread);
+                CloseHandle(in_read);
+                in_read = NULL;
+                DWORD written;
+                WriteFile(in_write, job.payload, (DWORD)strlen(job.payload), &written, NULL);
+                CloseHandle(in_write);
+                in_write = NULL;
+                if (WaitForSingleObject(pi.hProcess, hook_timeout_ms) == WAIT_TIMEOUT) {
+                    if (!process_job || !TerminateJobObject(process_job, 1)) TerminateProcess(pi.hProcess, 1);
+                    WaitForSingleObject(pi.hProcess, 1000);
+                    timed_out = 1;
+                }
+                GetExitCodeProcess(pi.hProcess, &exit_code);
+                CloseHandle(pi.hThread);
+                CloseHandle(pi.hProcess);
+            }
+            if (process_job) CloseHandle(process_job);
+            if (in_read) CloseHandle(in_read);
+            if (in_write) CloseHandle(in_write);
+        }
+        DWORD finished = GetTickCount();
+        metrics_add(&metrics.hook_runs, 1);
+        metrics_add(&metrics.hook_milliseconds, finished - started);
+        if (timed_out) metrics_add(&metrics.hook_timeouts, 1);
+
+        // Log: unix time, event, exit code, ms queued, ms running, queue depth, dropped so far, timeout flag
+        EnterCriticalSection(&hook_log_lock);
+        FILE* fp = fopen(HOOKS_LOG_FILE, "a");
+        if (fp) {
+            fprintf(fp, "%lld,%s,%ld,%lu,%lu,%d,%lld,%s\n", unix_time_now(), hook_event_names[job.event], (long)exit_code,
+                    (unsigned long)(started - job.queued_at), (unsigned long)(finished - started), job.depth,
+                    (long long)dropped, timed_out ? "timeout" : "");
+            fclose(fp);
+        }
+        LeaveCriticalSection(&hook_log_lock);
+    }
+    return 0;
+}
+
+// Read the [hooks] section and start the workers if any hook is set
+void load_hooks(void) {
+    static const wchar_t* keys[HOOK_EVENTS] = {L"on_start", L"on_stop", L"on_complete", L"on_long_break_due"};
+    const wchar_t* ini = config_ini_path();
+    int any = 0;
+    for (int i = 0; i < HOOK_EVENTS; i++) {
+        GetPrivateProfileStringW(L"hooks", keys[i], L"", hook_commands[i], HOOK_COMMAND_MAX, ini);
+        if (hook_commands[i][0]) any = 1;
+    }
+    hook_timeout_ms = GetPrivateProfileIntW(L"hooks", L"timeout_seconds", 30, ini) * 1000;
+    if (hook_timeout_ms <= 0) hook_timeout_ms = 30000;
+    hook_workers = GetPrivateProfileIntW(L"hooks", L"max_concurrent", 2, ini);
+    if (hook_workers < 1) hook_workers = 1;
+    if (hook_workers > 8) hook_workers = 8;
+    if (!any) return;
+
+    if (!hook_queue_init(&hook_queue)) return;
+    InitializeCriticalSection(&hook_log_lock);
+    hooks_enabled = 1;
+    for (int i = 0; i < hook_workers; i++) {
+        HANDLE worker = CreateThread(NULL, 0, hook_worker_thread, NULL, 0, NULL);
+        if (worker) {
+            SetThreadPriority(worker, THREAD_PRIORITY_BELOW_NORMAL);
+            CloseHandle(worker);
+        }
+    }
+}
+
+// Parse a hotkey such as "Ctrl+Alt+P" or "Win+F9"; returns 0 if it is not valid
+int parse_hotkey(const wchar_t* text, UINT* mods, UINT* vk) {
+    static const wchar_t* key_names[] = {L"Space", L"Home", L"End", L"PageUp", L"PageDown", L"Insert", L"Delete", L"Pause"};
+    static const UINT key_codes[] = {VK_SPACE, VK_HOME, VK_END, VK_PRIOR, VK_NEXT, VK_INSERT, VK_DELETE, VK_PAUSE};
+    *mods = MOD_NOREPEAT;
+    *vk = 0;
+    while (*text) {
+        wchar_t part[32];
+        int n = 0;
+        for (; *text && *text != L'+'; text++) {
+            if (*text != L' ' && n < 31) part[n++] = *text;
+        }
+        part[n] = L'\0';
+        if (*text == L'+') text++;
+        if (_wcsicmp(part, L"Ctrl") == 0 || _wcsicmp(part, L"Control") == 0) {
+            *mods |= MOD_CONTROL;
+        } else if (_wcsicmp(part, L"Alt") == 0) {
+            *mods |= MOD_ALT;
+        } else if (_wcsicmp(part, L"Shift") == 0) {
+            *mods |= MOD_SHIFT;
+        } else if (_wcsicmp(part, L"Win") == 0) {
+            *mods |= MOD_WIN;
+        } else if (*vk) {
+            return 0; // one key only
+        } else if (n == 1 && ((part[0] >= L'0' && part[0] <= L'9') || (towupper(part[0]) >= L'A' && towupper(part[0]) <= L'Z'))) {
+            *vk = towupper(part[0]);
+        } else if ((part[0] == L'F' || part[0] == L'f') && n >= 2 && n <= 3 && _wtoi(part + 1) >= 1 && _wtoi(part + 1) <= 24) {
+            *vk = VK_F1 + _wtoi(part + 1) - 1;
+        } else {
+            for (size_t i = 0; i < sizeof(key_names)/sizeof(key_names[0]) && !*vk; i++) {
+                if (_wcsicmp(part, key_names[i]) == 0) *vk = key_codes[i];
+            }
+            if (!*vk) return 0;
+        }
+    }
+    return *vk != 0;
+}
+
+// Read the [hotkeys] section and register the global hotkeys that are set
+void load_hotkeys(HWND hwnd) {
+    const wchar_t* ini = config_ini_path();
+    for (int i = 0; i < HOTKEY_COUNT; i++) {
+        wchar_t text[64];
+        GetPrivateProfileStringW(L"hotkeys", hotkey_keys[i], L"", text, 64, ini);
+        if (!text[0]) continue;
+        UINT mods, vk;
+        char buf[160];
+        if (!parse_hotkey(text, &mods, &vk)) {
+            snprintf(buf, sizeof(buf), "Hotkey %ls is not valid: %ls\n", hotkey_keys[i], text);
+            console_print(buf);
+        } else if (!RegisterHotKey(hwnd, HOTKEY_ID_BASE + i, mods, vk)) {
+            snprintf(buf, sizeof(buf), "Hotkey %ls is in use by another program: %ls\n", hotkey_keys[i], text);
+            console_print(buf);
+        }
+    }
+}
+
+// Append a JSON string value, escaped
+void json_append_string(char* out, size_t size, const char* text) {
+    size_t len = strlen(out);
+    if (len + 2 >= size) return;
+    out[len++] = '"';
+    for (; *text && len + 7 < size; text++) {
+        unsigned char c = (unsigned char)*text;
+        if (c == '"' || c == '\\') {
+            out[len++] = '\\';
+            out[len++] = (char)c;
+        } else if (c < 0x20) {
+            len += snprintf(out + len, size - len, "\\u%04x", c);
+        } else {
+            out[len++] = (char)c;
+        }
+    }
+    out[len++] = '"';
+    out[len] = '\0';
+}
+
+// Queue a hook for an event of the current session; never blocks
+void fire_hook(int event, int actual_seconds, int focus_pct) {
+    if (!hooks_enabled || !hook_commands[event][0]) return;
+    static const char* kinds[] = {"pomodoro", "short_break", "long_break"};
+    HookJob job;
+    job.event = event;
+    job.queued_at = GetTickCount();
+    int len = snprintf(job.payload, sizeof(job.payload),
+                       "{\"event\":\"%s\",\"kind\":\"%s\",\"start\":%lld,\"planned\":%d,\"actual\":%d,\"count\":%d",
+                       hook_event_names[event], kinds[session_kind], session_start_time, session_planned_seconds,
+                       actual_seconds, pomodoro_count);
+    if (focus_pct >= 0) len += snprintf(job.payload + len, sizeof(job.payload) - len, ",\"focus\":%d", focus_pct);
+    if (current_label) {
+        strcpy(job.payload + len, ",\"label\":");
+        EnterCriticalSection(&state_lock);
+        json_append_string(job.payload, sizeof(job.payload) - 2, label_name(&labels, current_label));
+        LeaveCriticalSection(&state_lock);
+        len = (int)strlen(job.payload);
+    }
+    strcpy(job.payload + len, "}\n");
+    hook_queue_push(&hook_queue, &job);
+}
+
+// Append a finished session to the history log; focus is -1 when there is no score
+void append_history(int kind, LONGLONG start_time, int planned_seconds, int actual_seconds, int outcome, int focus_pct, int label) {
+    static const char* kinds[] = {"pomodoro", "short_break", "long_break"};
+    static const char* outcomes[] = {"completed", "stopped", "expired"};
+    char focus_text[8] = "", label_text[16] = "";
+    if (focus_pct >= 0) snprintf(focus_text, sizeof(focus_text), "%d", focus_pct);
+    if (label > 0) snprintf(label_text, sizeof(label_text), "%d", label);
+    EnterCriticalSection(&state_lock);
+    FILE* fp = fopen(HISTORY_FILE, "a");
+    if (fp) {
+        fprintf(fp, "%lld,%s,%d,%d,%s,%s,%s\n", start_time, kinds[kind], planned_seconds, actual_seconds, outcomes[outcome], focus_text, label_text);
+        fclose(fp);
+    }
+    // Counted by the history load; past HISTORY_PENDING_MAX only the count goes on, so it still sees the log grow
+    if (!history_loaded && kind == SESSION_POMODORO) {
+        if (history_pending_count < HISTORY_PENDING_MAX) {
+            ArchiveRow* row = &history_pending[history_pending_count];
+            memset(row, 0, sizeof(*row));
+            row->start = start_time;
+            row->planned = planned_seconds;
+            row->actual = actual_seconds;
+            row->kind = (uint8_t)kind;
+            row->outcome = (uint8_t)outcome;
+        }
+        history_pending_count++;
+    }
+    LeaveCriticalSection(&state_lock);
+}
+
+// Count a finished Pomodoro in the heatmap; called with state_lock held
+void count_day(LONGLONG start_time) {
+    if (!history_loaded) return; // counted by the history load
+    heatmap_days_add(&day_counts, local_day_of(start_time), 1);
+    heatmap_days_save(&day_counts, DAY_COUNTS_FILE);
+    if (g_hHeatmap) InvalidateRect(g_hHeatmap, NULL, FALSE);
+}
+
+// Record the end of the current session
+void end_session(int outcome) {
+    int actual = session_planned_seconds - remaining_seconds;
+    if (outcome != OUTCOME_STOPPED) actual = session_planned_seconds;
+    if (actual < 0) actual = 0;
+    int focus_pct = session_kind == SESSION_POMODORO ? focus_score() : -1;
+    // One lock for the counts and the log line, so the history load finds the session in exactly one of them
+    EnterCriticalSection(&state_lock);
+    if (session_kind == SESSION_POMODORO) {
+        roll_today_totals();
+        if (outcome != OUTCOME_STOPPED) today_pomodoros++;
+        today_focus_seconds += actual;
+        // Day 0 of local_day_number is a Monday, so this gives Monday-based weeks
+        if (actual > 0) label_record(&labels, current_label, actual, unix_time_now(), today_day / 7);
+        if (outcome != OUTCOME_STOPPED) count_day(session_start_time);
+        if (history_loaded) {
+            adapt_record(&adapt_model, local_hour_of(session_start_time), actual, outcome != OUTCOME_STOPPED);
+            adapt_save(&adapt_model, ADAPT_FILE);
+        }
+    }
+    append_history(session_kind, session_start_time, session_planned_seconds, actual, outcome, focus_pct,
+                   session_kind == SESSION_POMODORO ? current_label : 0);
+    LeaveCriticalSection(&state_lock);
+    metrics_add(&metrics.sessions[session_kind][outcome], 1);
+    if (session_kind == SESSION_POMODORO) metrics_add(&metrics.focus_seconds, actual);
+    if (outcome == OUTCOME_COMPLETED) fire_hook(HOOK_COMPLETE, actual, focus_pct);
+    if (outcome == OUTCOME_STOPPED) fire_hook(HOOK_STOP, actual, focus_pct);
+    if (sync_wake) SetEvent(sync_wake);
+}
+
+// The final countdown animation is shown for the last countdown_seconds of a running timer
+int is_countdown_animating(void) {
+    return settings.countdown_animation && is_running &&
+           remaining_seconds > 0 && remaining_seconds <= settings.countdown_seconds;
+}
+
+// Start the looping clock sound
+void start_clock_sound(void) {
+    EnterCriticalSection(&sound_lock);
+    const BYTE* pcm = clock_sound_playing ? NULL : get_sound("CLOCK_WAV");
+    if (pcm) {
+        TRACE_BEGIN("PlaySound");
+        PlaySoundA((LPCSTR)pcm, NULL, SND_MEMORY | SND_ASYNC | SND_LOOP);
+        TRACE_END("PlaySound");
+        sound_last_played = pcm;
+        clock_sound_playing = 1;
+    }
+    LeaveCriticalSection(&sound_lock);
+}
+
+// Stop the looping clock sound
+void stop_clock_sound(void) {
+    EnterCriticalSection(&sound_lock);
+    if (clock_sound_playing) {
+        TRACE_BEGIN("PlaySound stop");
+        PlaySoundA(NULL, NULL, 0);
+        TRACE_END("PlaySound stop");
+        sound_last_played = NULL;
+        clock_sound_playing = 0;
+    }
+    LeaveCriticalSection(&sound_lock);
+}
+
+// --record: append an event to the recording
+void record_event(int type, int arg) {
+    if (!record_out) return;
+    EnterCriticalSection(&record_lock);
+    replay_record(record_out, GetTickCount() - record_start, type, arg);
+    LeaveCriticalSection(&record_lock);
+}
+
+// Timer thread function
+DWORD WINAPI timer_thread(LPVOID lpParam) {
+    TRACE_THREAD_NAME("timer");
+    if (settings.enable_clock_sound) {
+        start_clock_sound();
+    }
+
+    ULONGLONG last_tick = GetTickCount();
+    int last_shown_seconds = -1;
+    int trimmed = 0;
+    HWND hwnd = (HWND)lpParam;
+
+    while (is_running) {
+        ULONGLONG now = GetTickCount();
+        ULONGLONG elapsed_ms = now - last_tick;
+        metrics_add(&metrics.timer_wakeups, 1);
+        if (replay_active) {
+            // Replays advance the clock only by the recorded ticks
+            elapsed_ms = (ULONGLONG)InterlockedExchange(&replay_pending_seconds, 0) * 1000;
+            last_tick = now - elapsed_ms;
+        }
+
+        if (elapsed_ms >= 1000) {
+            TRACE_BEGIN("tick");
+            int elapsed_sec = (int)(elapsed_ms / 1000);
+            record_event(REPLAY_TICK, elapsed_sec);
+            remaining_seconds -= elapsed_sec;
+            last_tick += (ULONGLONG)elapsed_sec * 1000;
+
+            if (remaining_seconds < 0) remaining_seconds = 0;
+            focus_advance(elapsed_sec);
+
+            if (remaining_seconds > 0 && remaining_seconds <= 10 && settings.enable_clock_sound) {
+                TRACE_BEGIN("Beep");
+                Beep(440, 100);
+                TRACE_END("Beep");
+            }
+
+            if (remaining_seconds != last_shown_seconds && !is_countdown_animating()) {
+                wchar_t display_text[16];
+                if (remaining_seconds < 60) {
+                    _itow(remaining_seconds, display_text, 10);
+                } else {
+                    _itow(remaining_seconds / 60, display_text, 10);
+                }
+                update_tray_icon(hwnd, display_text, pomodoro_count, remaining_seconds);
+                last_shown_seconds = remaining_seconds;
+            }
+
+            // Only the minutes change for a while: drop the last countdown's frames and trim
+            // once the first minute has ticked over
+            if (!trimmed && remaining_seconds > 60 && remaining_seconds % 60 == 59) {
+                free_countdown_cache();
+                trim_memory();
+                trimmed = 1;
+            }
+            if (replay_active) SetEvent(replay_tick_done);
+            TRACE_END("tick");
+        }
+
+        if (is_countdown_animating()) {
+            if (remaining_seconds != last_shown_seconds) {
+                if (last_shown_seconds > settings.countdown_seconds || last_shown_seconds < 0) reset_animation();
+                last_shown_seconds = remaining_seconds;
+            }
+            show_countdown_frame(remaining_seconds, (int)(GetTickCount() - last_tick));
+        }
+
+        if (remaining_seconds <= 0) {
+            is_running = 0;
+            stop_clock_sound();
+
+            int was_pomodoro = is_in_pomodoro;
+            int is_long_break = 0;
+
+            if (is_in_pomodoro) {
+                // increment completed pomodoro count up to 4
+                if (pomodoro_count < 4) pomodoro_count++;
+                if (pomodoro_count == 4) {
+                    is_long_break = 1; // schedule a long break
+                }
+            }
+
+            end_session(OUTCOME_COMPLETED);
+            save_session_state();
+            if (is_long_break) fire_hook(HOOK_LONG_BREAK_DUE, 0, -1);
+
+            // The toast first: the flash below takes COMPLETION_FLASH_MS
+            if (settings.show_completion_dialog) {
+                PostMessage(hwnd, WM_TOAST_NOTIFY, (WPARAM)was_pomodoro, (LPARAM)is_long_break);
+            }
+            play_resource_sound("DING_WAV");
+            if (settings.countdown_animation) play_completion_flash();
+            // Also after a cancelled flash: a new timer joins this thread before it draws its own icon
+            update_tray_icon(hwnd, L"\u25BA", pomodoro_count, 0);
+
+            TRACE_THREAD_EXIT();
+            return 1; // see join_timer_thread
+        }
+
+        ULONGLONG next_boundary = last_tick + 1000;
+        now = GetTickCount();
+        long sleep_ms = (long)(next_boundary - now);
+
+        if (sleep_ms < 1) sleep_ms = 1;
+        if (sleep_ms > 50) sleep_ms = 50;
+        if (is_countdown_animating() && sleep_ms > COUNTDOWN_FRAME_MS / 5) sleep_ms = COUNTDOWN_FRAME_MS / 5;
+
+        if (replay_active) {
+            WaitForSingleObject(replay_tick_event, sleep_ms);
+        } else {
+            Sleep(sleep_ms);
+        }
+    }
+
+    stop_clock_sound();
+
+    TRACE_THREAD_EXIT();
+    return 0;
+}
+
+// Stop the timer thread and wait for it to exit; also ends a completion flash. Returns 1 if the
+// thread completed the session before it saw the stop, so the caller must not end it again.
+int join_timer_thread(void) {
+    is_running = 0;
+    anim_cancel = 1;
+    if (timer_thread_handle == NULL) return 0;
+    TRACE_BEGIN("join timer thread");
+    WaitForSingleObject(timer_thread_handle, INFINITE);
+    TRACE_END("join timer thread");
+    DWORD code = 0;
+    GetExitCodeThread(timer_thread_handle, &code);
+    CloseHandle(timer_thread_handle);
+    timer_thread_handle = NULL;
+    return code == 1;
+}
+
+// Run the timer thread for a session started at start_time, with seconds of it to go
+void run_timer(HWND hwnd, LONGLONG start_time, int planned_seconds, int seconds) {
+    join_timer_thread();
+    evict_idle_sounds();
+    focus_reset();
+
+    // The thread reads these from its first tick on
+    session_start_time = start_time;
+    session_planned_seconds = planned_seconds;
+    remaining_seconds = seconds;
+    is_running = 1;
+    anim_cancel = 0;
+    timer_thread_handle = CreateThread(NULL, 0, timer_thread, hwnd, 0, NULL);
+    if (timer_thread_handle == NULL) is_running = 0;
+}
+
+// Start timer with specified duration
+void start_timer(HWND hwnd, int duration_minutes) {
+    run_timer(hwnd, unix_time_now(), duration_minutes * 60, duration_minutes * 60);
+    save_session_state();
+    fire_hook(HOOK_START, 0, -1);
+}
+
+// Record a running session as stopped before another one replaces it. The timer thread is gone
+// afterwards, so a completion racing the stop ends the session once, as completed.
+void interrupt_session(void) {
+    int running = is_running;
+    if (!join_timer_thread() && running) end_session(OUTCOME_STOPPED);
+}
+
+// Pomodoro minutes the history suggests for the current hour, or the configured ones
+int suggested_pomodoro_minutes(void) {
+    EnterCriticalSection(&state_lock);
+    int minutes = adapt_suggest(&adapt_model, local_hour_of(unix_time_now()), settings.pomodoro_duration);
+    LeaveCriticalSection(&state_lock);
+    return minutes;
+}
+
+// Start a new pomodoro session
+void start_pomodoro(HWND hwnd) {
+    team_pause_current_phase();
+    interrupt_session();
+    is_in_pomodoro = 1;
+    session_kind = SESSION_POMODORO;
+    // starting a new pomodoro -> reset completed counter only if cycle complete
+    if (pomodoro_count >= 4) pomodoro_count = 0;
+    start_timer(hwnd, adapt_mode == ADAPT_MODE_AUTO ? suggested_pomodoro_minutes() : settings.pomodoro_duration);
+}
+
+// Start a short or long break session
+void start_break(HWND hwnd, int long_break) {
+    team_pause_current_phase();
+    interrupt_session();
+    is_in_pomodoro = 0;
+    session_kind = long_break ? SESSION_LONG_BREAK : SESSION_SHORT_BREAK;
+    // do not reset here; keep the completed count until a new pomodoro starts
+    start_timer(hwnd, long_break ? settings.long_break_duration : settings.short_break_duration);
+}
+
+// Stop the running timer and show the play symbol
+void stop_timer(HWND hwnd) {
+    team_pause_current_phase();
+    interrupt_session();
+    save_session_state();
+    update_tray_icon(hwnd, L"\u25BA", pomodoro_count, 0);
+}
+
+// Stop the running timer or continue with the next logical session
+void toggle_timer(HWND hwnd) {
+    if (is_running) {
+        stop_timer(hwnd);
+    } else if (is_in_pomodoro) {
+        start_break(hwnd, pomodoro_count == 4);
+    } else {
+        start_pomodoro(hwnd);
+    }
+}
+
+// Clear the completed pomodoro dots
+void reset_pomodoro_count(HWND hwnd) {
+    pomodoro_count = 0;
+    anim_cancel = 1;
+    save_session_state();
+    refresh_tray_icon(hwnd);
+}
+
+// Show the remaining time, or the play symbol when stopped
+void refresh_tray_icon(HWND hwnd) {
+    if (is_running) {
+        wchar_t display_text[16];
+        if (remaining_seconds < 60) {
+            _itow(remaining_seconds, display_text, 10);
+        } else {
+            _itow(remaining_seconds / 60, display_text, 10);
+        }
+        update_tray_icon(hwnd, display_text, pomodoro_count, remaining_seconds);
+    } else {
+        update_tray_icon(hwnd, L"\u25BA", pomodoro_count, 0);
+    }
+}
+
+// Make a label current for this and the following pomodoros; 0 clears it
+void set_current_label_id(HWND hwnd, int id) {
+    current_label = id;
+    save_session_state();
+    refresh_tray_icon(hwnd);
+}
+
+// Intern a label name and make it current; NULL or "" clears the label
+void set_current_label(HWND hwnd, const wchar_t* name) {
+    char utf8[LABEL_MAX_BYTES * 3];
+    int id = 0;
+    int len = name ? (int)wcslen(name) : 0;
+    if (len > LABEL_MAX_BYTES - 1) len = LABEL_MAX_BYTES - 1;
+    if (len > 0) {
+        int n = WideCharToMultiByte(CP_UTF8, 0, name, len, utf8, sizeof(utf8) - 1, NULL, NULL);
+        utf8[n] = '\0';
+        EnterCriticalSection(&state_lock);
+        id = label_intern(&labels, utf8);
+        LeaveCriticalSection(&state_lock);
+    }
+    set_current_label_id(hwnd, id);
+}
+
+// Restore the session saved by a previous run; returns 1 if a timer was resumed
+int restore_session_state(HWND hwnd) {
+    SessionState st;
+    if (!session_state_load(&st, SESSION_STATE_FILE)) return 0;
+
+    pomodoro_count = st.pomodoro_count;
+    is_in_pomodoro = st.is_in_pomodoro ? 1 : 0;
+    session_kind = st.kind;
+    session_start_time = st.start_time;
+    session_planned_seconds = st.planned_seconds;
+    today_pomodoros = st.today_pomodoros;
+    today_focus_seconds = st.today_focus_seconds;
+    today_day = st.today;
+    today_synced = st.today_synced;
+    current_label = (int)st.label <= labels.count ? (int)st.label : 0;
+    roll_today_totals();
+    int left;
+    int resume = session_state_resume(&st, unix_time_now(), &left);
+    if (resume == SESSION_STATE_IDLE) {
+        publish_status();
+        return 0;
+    }
+    if (resume == SESSION_STATE_RESUME) {
+        run_timer(hwnd, st.start_time, st.planned_seconds, left);
+        publish_status();
+        refresh_tray_icon(hwnd);
+        return 1;
+    }
+
+    // The session ran out while the app was not running
+    if (session_kind == SESSION_POMODORO && pomodoro_count < 4) pomodoro_count++;
+    end_session(OUTCOME_EXPIRED);
+    save_session_state();
+    return 0;
+}
+
+// Pack the timer state into a single value for --status replies
+LRESULT pack_status(void) {
+    return (LRESULT)((is_running ? 1 : 0) | (is_in_pomodoro ? 2 : 0) |
+                     ((pomodoro_count & 7) << 2) | ((remaining_seconds & 0xFFFF) << 8));
+}
+
+// Execute a command forwarded from a second instance
+LRESULT execute_remote_command(HWND hwnd, int cmd) {
+    switch (cmd) {
+        case REMOTE_CMD_START_POMODORO: start_pomodoro(hwnd); break;
+        case REMOTE_CMD_START_BREAK: start_break(hwnd, 0); break;
+        case REMOTE_CMD_START_LONG_BREAK: start_break(hwnd, 1); break;
+        case REMOTE_CMD_STOP: if (is_running) stop_timer(hwnd); break;
+        case REMOTE_CMD_TOGGLE: toggle_timer(hwnd); break;
+        case REMOTE_CMD_RESET_COUNT: reset_pomodoro_count(hwnd); break;
+        case REMOTE_CMD_STATUS: break;
+        case REMOTE_CMD_SET_LABEL: break;
+        case REMOTE_CMD_TRACE_DUMP: return trace_dump(TRACE_FILE);
+        default: return 0;
+    }
+    return pack_status();
+}
+
+// Check if autostart is enabled in registry
+int is_autostart_enabled() {
+    HKEY hKey;
+    if (RegOpenKeyExA(HKEY_CURRENT_USER, "Software\\Microsoft\\Windows\\CurrentVersion\\Run", 0, KEY_READ, &hKey) == ERROR_SUCCESS) {
+        DWORD type;
+        if (RegQueryValueExA(hKey, "PomodoroTimer", NULL, &type, NULL, NULL) == ERROR_SUCCESS) {
+            RegCloseKey(hKey);
+            return 1;
+        }
+        RegCloseKey(hKey);
+    }
+    return 0;
+}
+
+// Enable or disable autostart in registry
+void set_autostart(int enable) {
+    HKEY hKey;
+    if (RegOpenKeyExA(HKEY_CURRENT_USER, "Software\\Microsoft\\Windows\\CurrentVersion\\Run", 0, KEY_WRITE, &hKey) == ERROR_SUCCESS) {
+        if (enable) {
+            char path[MAX_PATH];
+            GetModuleFileNameA(NULL, path, MAX_PATH);
+            RegSetValueExA(hKey, "PomodoroTimer", 0, REG_SZ, (BYTE*)path, strlen(path) + 1);
+        } else {
+            RegDeleteValueA(hKey, "PomodoroTimer");
+        }
+        RegCloseKey(hKey);
+    }
+}
+
+// Show settings dialog
+void ShowSettingsDialog(HWND hwndParent) {
+    DialogBox(GetModuleHandle(NULL), MAKEINTRESOURCE(IDD_SETTINGS), hwndParent, SettingsDlgProc);
+}
+
+// Settings dialog procedure
+INT_PTR CALLBACK SettingsDlgProc(HWND hwndDlg, UINT uMsg, WPARAM wParam, LPARAM lParam) {
+    switch (uMsg) {
         case WM_INITDIALOG: {
             // Set dialog title localized
             SetWindowTextW(hwndDlg, g_lang->settings_title);
@@ -700,10 +1987,12 @@ INT_PTR CALLBACK SettingsDlgProc(HWND hwndDlg, UINT uMsg, WPARAM wParam, LPARAM
                         short_break > 0 && short_break <= 60 && 
                         long_break > 0 && long_break <= 120) {
                         
-                        settings.pomodoro_duration = pomodoro;
-                        settings.short_break_duration = short_break;
-                        settings.long_break_duration = long_break;
-                        settings.enable_clock_sound = SendDlgItemMessageA(hwndDlg, IDC_CLOCK_SOUND, BM_GETCHECK, 0, 0) == BST_CHECKED;
+                        TimerSettings updated = settings;
+                        updated.pomodoro_duration = pomodoro;
+                        updated.short_break_duration = short_break;
+                        updated.long_break_duration = long_break;
+                        updated.enable_clock_sound = SendDlgItemMessageA(hwndDlg, IDC_CLOCK_SOUND, BM_GETCHECK, 0, 0) == BST_CHECKED;
+                        apply_settings(g_main_hwnd, &updated);
                         autostart_enabled = SendDlgItemMessageA(hwndDlg, IDC_AUTOSTART, BM_GETCHECK, 0, 0) == BST_CHECKED;
                         set_autostart(autostart_enabled);
                         save_settings();
@@ -821,44 +2110,39 @@ LRESULT CALLBACK ToastWndProc(HWND hwnd, UINT msg, WPARAM wParam, LPARAM lParam)
             return 0;
         }
         case WM_COMMAND:
+            if (HIWORD(wParam) == BN_CLICKED) record_event(REPLAY_TOAST, LOWORD(wParam));
             if (LOWORD(wParam) == ID_TOAST_ACTION && HIWORD(wParam) == BN_CLICKED) {
                 // Button clicked: start the appropriate timer on the main window
                 if (toast_is_pomodoro) {
-                    // start break
-                    is_in_pomodoro = 0; // now we're in break
-                    // treat as long break if either the toast indicated it or the counter reached 4
-                    if (toast_is_long_break || pomodoro_count >= 4) {
-                        // do not reset here; keep the completed count until a new pomodoro starts
-                        start_timer(g_main_hwnd, settings.long_break_duration);
-                     } else {
-                         start_timer(g_main_hwnd, settings.short_break_duration);
-                     }
+                    // start break: treat as long break if either the toast indicated it or the counter reached 4
+                    start_break(g_main_hwnd, toast_is_long_break || pomodoro_count >= 4);
                  } else {
-                     // start pomodoro
-                     is_in_pomodoro = 1; // now we're in pomodoro
-                     // starting a new pomodoro -> reset completed counter only if cycle complete
-                     if (pomodoro_count >= 4) pomodoro_count = 0;
-                     start_timer(g_main_hwnd, settings.pomodoro_duration);
+                     start_pomodoro(g_main_hwnd);
                  }
                  DestroyWindow(hwnd);
              } else if (LOWORD(wParam) == ID_TOAST_CLOSE && HIWORD(wParam) == BN_CLICKED) {
                  // Close button clicked
                  DestroyWindow(hwnd);
              } else if (LOWORD(wParam) == ID_TOAST_RESET && HIWORD(wParam) == BN_CLICKED) {
-                 pomodoro_count = 0;
+                 reset_pomodoro_count(g_main_hwnd);
                  InvalidateRect(hwnd, NULL, TRUE);
-                 update_tray_icon(g_main_hwnd, L"\u25BA", pomodoro_count, 0);
              }
              return 0;
         case WM_DESTROY:
             g_hToastWnd = NULL;
             g_hToastButton = NULL;
             g_hToastCloseButton = NULL;
+            if (g_hToastBtnFont) {
+                DeleteObject(g_hToastBtnFont);
+                g_hToastBtnFont = NULL;
+            }
             return 0;
         case WM_LBUTTONDOWN:
+            record_event(REPLAY_TOAST, 0);
             DestroyWindow(hwnd);
             return 0;
         case WM_PAINT: {
+            TRACE_BEGIN("toast paint");
             PAINTSTRUCT ps;
             HDC hdc = BeginPaint(hwnd, &ps);
 
@@ -924,6 +2208,7 @@ LRESULT CALLBACK ToastWndProc(HWND hwnd, UINT msg, WPARAM wParam, LPARAM lParam)
             DeleteObject(hFont);
 
             EndPaint(hwnd, &ps);
+            TRACE_END("toast paint");
             return 0;
         }
         default:
@@ -976,9 +2261,16 @@ void ShowCompletionNotification(HWND hwnd, int is_pomodoro_complete, int is_long
         GetWindowRect(taskbarWnd, &taskbarRect);
     }
 
+    // A break is over: mention the shorter Pomodoro the history suggests for this hour
+    int suggested = 0;
+    if (!is_pomodoro_complete && adapt_mode != ADAPT_MODE_OFF) {
+        suggested = suggested_pomodoro_minutes();
+        if (suggested == settings.pomodoro_duration) suggested = 0;
+    }
+
     // Calculate toast position (above taskbar, right side)
     int toastWidth = 300; // smaller width
-    int toastHeight = 150; // smaller height to match button
+    int toastHeight = suggested ? 175 : 150; // smaller height to match button
     int screenWidth = GetSystemMetrics(SM_CXSCREEN);
     int screenHeight = GetSystemMetrics(SM_CYSCREEN);
 
@@ -997,6 +2289,12 @@ void ShowCompletionNotification(HWND hwnd, int is_pomodoro_complete, int is_long
     if (msgLen > 255) msgLen = 255;
     wcsncpy(toastMessage, message, msgLen);
     toastMessage[msgLen] = L'\0';
+    if (suggested) {
+        wchar_t line[128];
+        swprintf(line, sizeof(line)/sizeof(line[0]), adapt_mode == ADAPT_MODE_AUTO ? g_lang->toast_adapted : g_lang->toast_suggested, suggested);
+        wcsncat(toastMessage, L"\n", 255 - wcslen(toastMessage));
+        wcsncat(toastMessage, line, 255 - wcslen(toastMessage));
+    }
 
     g_hToastWnd = CreateWindowExW(
         WS_EX_TOPMOST | WS_EX_NOACTIVATE | WS_EX_TOOLWINDOW,
@@ -1025,14 +2323,13 @@ void ShowCompletionNotification(HWND hwnd, int is_pomodoro_complete, int is_long
             btnX, btnY, btnW, btnH,
             g_hToastWnd, (HMENU)ID_TOAST_ACTION, GetModuleHandle(NULL), NULL);
 
-        // Set button font
-        static HFONT hBtnFont = NULL;
-        if (!hBtnFont) {
-            hBtnFont = CreateFontW(17, 0, 0, 0, FW_BOLD, FALSE, FALSE, FALSE,
+        // Set button font; released again when the toast is destroyed
+        if (!g_hToastBtnFont) {
+            g_hToastBtnFont = CreateFontW(17, 0, 0, 0, FW_BOLD, FALSE, FALSE, FALSE,
                                      DEFAULT_CHARSET, OUT_DEFAULT_PRECIS, CLIP_DEFAULT_PRECIS,
                                      DEFAULT_QUALITY, DEFAULT_PITCH, L"Segoe UI");
         }
-        SendMessage(g_hToastButton, WM_SETFONT, (WPARAM)hBtnFont, TRUE);
+        SendMessage(g_hToastButton, WM_SETFONT, (WPARAM)g_hToastBtnFont, TRUE);
 
         // Explicitly set button text (force correct label)
         SetWindowTextW(g_hToastButton, btnText);
@@ -1083,31 +2380,467 @@ void ShowCompletionNotification(HWND hwnd, int is_pomodoro_complete, int is_long
     }
 }
 
-// Main window procedure
-LRESULT CALLBACK WndProc(HWND hwnd, UINT msg, WPARAM wParam, LPARAM lParam) {
-    switch (msg) {
+// Task quick-pick: an edit box over a list of labels. The list shows the most
+// recently used labels; typing filters them through the word index. Enter picks
+// the selected row, or creates a label from the typed text.
+static HWND g_hPicker = NULL;
+static HWND g_hPickerEdit = NULL;
+static HWND g_hPickerList = NULL;
+static WNDPROC picker_edit_proc = NULL;
+
+#define PICKER_ROW_NO_TASK 0
+#define PICKER_ROW_CREATE (-1)
+
+// Refill the list for the typed text
+void picker_refresh(void) {
+    wchar_t typed[LABEL_MAX_BYTES];
+    char prefix[LABEL_MAX_BYTES * 3];
+    int ids[PICKER_MAX_ROWS];
+    GetWindowTextW(g_hPickerEdit, typed, LABEL_MAX_BYTES);
+    wchar_t* start = typed;
+    while (*start == L' ') start++;
+    int n = WideCharToMultiByte(CP_UTF8, 0, start, -1, prefix, sizeof(prefix), NULL, NULL);
+    if (n == 0) prefix[0] = '\0';
+
+    EnterCriticalSection(&state_lock);
+    int count = label_search(&labels, prefix, ids, PICKER_MAX_ROWS);
+    int exact = prefix[0] ? label_find(&labels, prefix) : 0;
+    LeaveCriticalSection(&state_lock);
+
+    SendMessageW(g_hPickerList, WM_SETREDRAW, FALSE, 0);
+    SendMessageW(g_hPickerList, LB_RESETCONTENT, 0, 0);
+    if (!prefix[0]) {
+        int row = (int)SendMessageW(g_hPickerList, LB_ADDSTRING, 0, (LPARAM)g_lang->menu_no_task);
+        SendMessageW(g_hPickerList, LB_SETITEMDATA, row, PICKER_ROW_NO_TASK);
+    }
+    int week = local_day_number() / 7;
+    for (int i = 0; i < count; i++) {
+        wchar_t name[LABEL_MAX_BYTES], text[LABEL_MAX_BYTES + 32];
+        label_display_name(ids[i], name, LABEL_MAX_BYTES);
+        EnterCriticalSection(&state_lock);
+        int minutes = (int)(label_week_seconds(&labels, ids[i], week) / 60);
+        LeaveCriticalSection(&state_lock);
+        swprintf(text, sizeof(text)/sizeof(text[0]), L"%ls\t%d:%02d", name, minutes / 60, minutes % 60);
+        int row = (int)SendMessageW(g_hPickerList, LB_ADDSTRING, 0, (LPARAM)text);
+        SendMessageW(g_hPickerList, LB_SETITEMDATA, row, ids[i]);
+    }
+    if (prefix[0] && !exact) {
+        wchar_t text[LABEL_MAX_BYTES + 4];
+        swprintf(text, sizeof(text)/sizeof(text[0]), L"+ %ls", start);
+        int row = (int)SendMessageW(g_hPickerList, LB_ADDSTRING, 0, (LPARAM)text);
+        SendMessageW(g_hPickerList, LB_SETITEMDATA, row, PICKER_ROW_CREATE);
+    }
+    SendMessageW(g_hPickerList, LB_SETCURSEL, 0, 0);
+    SendMessageW(g_hPickerList, WM_SETREDRAW, TRUE, 0);
+    InvalidateRect(g_hPickerList, NULL, TRUE);
+}
+
+// Apply the selected row and close the picker
+void picker_choose(void) {
+    int row = (int)SendMessageW(g_hPickerList, LB_GETCURSEL, 0, 0);
+    if (row != LB_ERR) {
+        int id = (int)SendMessageW(g_hPickerList, LB_GETITEMDATA, row, 0);
+        if (id == PICKER_ROW_CREATE) {
+            wchar_t typed[LABEL_MAX_BYTES];
+            GetWindowTextW(g_hPickerEdit, typed, LABEL_MAX_BYTES);
+            set_current_label(g_main_hwnd, typed);
+        } else {
+            set_current_label_id(g_main_hwnd, id);
+        }
+    }
+    DestroyWindow(g_hPicker);
+}
+
+// Edit box subclass: arrows move through the list, Enter picks, Escape closes
+LRESULT CALLBACK PickerEditProc(HWND hwnd, UINT msg, WPARAM wParam, LPARAM lParam) {
+    if (msg == WM_KEYDOWN && (wParam == VK_DOWN || wParam == VK_UP)) {
+        int row = (int)SendMessageW(g_hPickerList, LB_GETCURSEL, 0, 0);
+        int rows = (int)SendMessageW(g_hPickerList, LB_GETCOUNT, 0, 0);
+        row += wParam == VK_DOWN ? 1 : -1;
+        if (row >= 0 && row < rows) SendMessageW(g_hPickerList, LB_SETCURSEL, row, 0);
+        return 0;
+    }
+    if (msg == WM_CHAR && (wParam == VK_RETURN || wParam == VK_ESCAPE)) {
+        if (wParam == VK_RETURN) picker_choose();
+        else DestroyWindow(g_hPicker);
+        return 0;
+    }
+    return CallWindowProcW(picker_edit_proc, hwnd, msg, wParam, lParam);
+}
+
+// Picker window procedure
+LRESULT CALLBACK PickerWndProc(HWND hwnd, UINT msg, WPARAM wParam, LPARAM lParam) {
+    switch (msg) {
+        case WM_COMMAND:
+            if (LOWORD(wParam) == ID_PICKER_EDIT && HIWORD(wParam) == EN_CHANGE) {
+                picker_refresh();
+            } else if (LOWORD(wParam) == ID_PICKER_LIST && HIWORD(wParam) == LBN_DBLCLK) {
+                picker_choose();
+            }
+            return 0;
+        case WM_ACTIVATE:
+            // Close when the user clicks elsewhere, like a menu
+            if (LOWORD(wParam) == WA_INACTIVE) PostMessageW(hwnd, WM_CLOSE, 0, 0);
+            return 0;
+        case WM_DESTROY:
+            g_hPicker = NULL;
+            g_hPickerEdit = NULL;
+            g_hPickerList = NULL;
+            return 0;
+        default:
+            return DefWindowProcW(hwnd, msg, wParam, lParam);
+    }
+}
+
+// Show the task quick-pick near the cursor
+void ShowLabelPicker(HWND hwnd) {
+    if (g_hPicker) {
+        SetForegroundWindow(g_hPicker);
+        return;
+    }
+    static BOOL registered = FALSE;
+    if (!registered) {
+        WNDCLASSW wc = {0};
+        wc.lpfnWndProc = PickerWndProc;
+        wc.hInstance = GetModuleHandle(NULL);
+        wc.lpszClassName = PICKER_WINDOW_CLASS;
+        wc.hbrBackground = (HBRUSH)(COLOR_WINDOW + 1);
+        wc.hCursor = LoadCursorW(NULL, IDC_ARROW);
+        RegisterClassW(&wc);
+        registered = TRUE;
+    }
+
+    // Place the picker above the cursor, inside the work area
+    int width = 320, height = 280;
+    POINT pt;
+    RECT work;
+    GetCursorPos(&pt);
+    SystemParametersInfoW(SPI_GETWORKAREA, 0, &work, 0);
+    int x = pt.x - width / 2, y = pt.y - height;
+    if (x + width > work.right) x = work.right - width;
+    if (x < work.left) x = work.left;
+    if (y < work.top) y = work.top;
+    if (y + height > work.bottom) y = work.bottom - height;
+
+    g_hPicker = CreateWindowExW(WS_EX_TOPMOST | WS_EX_TOOLWINDOW, PICKER_WINDOW_CLASS, g_lang->menu_task,
+                                WS_POPUP | WS_BORDER, x, y, width, height, hwnd, NULL, GetModuleHandle(NULL), NULL);
+    if (!g_hPicker) return;
+    HFONT font = (HFONT)GetStockObject(DEFAULT_GUI_FONT);
+    HWND prompt = CreateWindowW(L"STATIC", g_lang->task_prompt, WS_CHILD | WS_VISIBLE,
+                                8, 8, width - 16, 16, g_hPicker, NULL, GetModuleHandle(NULL), NULL);
+    g_hPickerEdit = CreateWindowExW(WS_EX_CLIENTEDGE, L"EDIT", L"", WS_CHILD | WS_VISIBLE | ES_AUTOHSCROLL,
+                                    8, 26, width - 18, 22, g_hPicker, (HMENU)ID_PICKER_EDIT, GetModuleHandle(NULL), NULL);
+    g_hPickerList = CreateWindowExW(WS_EX_CLIENTEDGE, L"LISTBOX", L"",
+                                    WS_CHILD | WS_VISIBLE | WS_VSCROLL | LBS_NOTIFY | LBS_USETABSTOPS | LBS_NOINTEGRALHEIGHT,
+                                    8, 54, width - 18, height - 64, g_hPicker, (HMENU)ID_PICKER_LIST, GetModuleHandle(NULL), NULL);
+    SendMessageW(prompt, WM_SETFONT, (WPARAM)font, TRUE);
+    SendMessageW(g_hPickerEdit, WM_SETFONT, (WPARAM)font, TRUE);
+    SendMessageW(g_hPickerList, WM_SETFONT, (WPARAM)font, TRUE);
+    SendMessageW(g_hPickerEdit, EM_LIMITTEXT, LABEL_MAX_BYTES - 1, 0);
+    int tab = 150; // dialog units: this week's time in a right-hand column
+    SendMessageW(g_hPickerList, LB_SETTABSTOPS, 1, (LPARAM)&tab);
+    picker_edit_proc = (WNDPROC)SetWindowLongPtrW(g_hPickerEdit, GWLP_WNDPROC, (LONG_PTR)PickerEditProc);
+
+    picker_refresh();
+    ShowWindow(g_hPicker, SW_SHOW);
+    SetForegroundWindow(g_hPicker);
+    SetFocus(g_hPickerEdit);
+}
+
+// Statistics window: a year of month tiles from the heatmap. Tiles are
+// rendered into cached bitmaps and redrawn only when their counts change,
+// so paging through years reads nothing but the day counts.
+#define HEATMAP_MARGIN 16
+#define HEATMAP_TITLE_HEIGHT 40
+#define HEATMAP_LABEL_HEIGHT 20
+#define HEATMAP_GAP 12
+#define HEATMAP_CLIENT_WIDTH (2 * HEATMAP_MARGIN + 4 * HEATMAP_TILE_WIDTH + 3 * HEATMAP_GAP)
+#define HEATMAP_CLIENT_HEIGHT (2 * HEATMAP_MARGIN + HEATMAP_TITLE_HEIGHT + 3 * (HEATMAP_LABEL_HEIGHT + HEATMAP_TILE_HEIGHT) + 2 * HEATMAP_GAP)
+
+typedef struct {
+    int year, month;          // 0 when unused
+    int32_t today;            // the ring for today is part of the tile
+    uint16_t values[31];      // counts the tile was rendered from
+    HBITMAP bitmap;
+    uint32_t* bits;
+    DWORD used;
+} HeatmapTile;
+
+static HeatmapTile heatmap_tiles[HEATMAP_CACHE_TILES];
+static DWORD heatmap_tick = 0;
+static int heatmap_year = 0;
+static HFONT g_hHeatmapFont = NULL;
+
+// Get the tile of a month, rendering it only if it is new or its counts changed
+HBITMAP heatmap_tile(int year, int month) {
+    uint16_t values[31];
+    int32_t today = local_day_number();
+    HeatmapTile* tile = NULL;
+    HeatmapTile* oldest = &heatmap_tiles[0];
+    for (int i = 0; i < HEATMAP_CACHE_TILES && !tile; i++) {
+        if (heatmap_tiles[i].year == year && heatmap_tiles[i].month == month) tile = &heatmap_tiles[i];
+        else if (heatmap_tiles[i].used < oldest->used) oldest = &heatmap_tiles[i];
+    }
+    EnterCriticalSection(&state_lock);
+    heatmap_month_values(&day_counts, year, month, values);
+    if (!tile || tile->today != today || memcmp(tile->values, values, sizeof(values)) != 0) {
+        if (!tile) {
+            tile = oldest;
+            tile->year = year;
+            tile->month = month;
+        }
+        if (!tile->bitmap) {
+            BITMAPINFO bmi = {0};
+            bmi.bmiHeader.biSize = sizeof(BITMAPINFOHEADER);
+            bmi.bmiHeader.biWidth = HEATMAP_TILE_WIDTH;
+            bmi.bmiHeader.biHeight = -HEATMAP_TILE_HEIGHT; // top-down
+            bmi.bmiHeader.biPlanes = 1;
+            bmi.bmiHeader.biBitCount = 32;
+            bmi.bmiHeader.biCompression = BI_RGB;
+            tile->bitmap = CreateDIBSection(NULL, &bmi, DIB_RGB_COLORS, (void**)&tile->bits, NULL, 0);
+        }
+        if (tile->bitmap) {
+            HeatmapImage img = {tile->bits, HEATMAP_TILE_WIDTH, HEATMAP_TILE_HEIGHT, HEATMAP_TILE_WIDTH};
+            heatmap_render_month(&day_counts, year, month, today, &img);
+            GdiFlush();
+        }
+        tile->today = today;
+        memcpy(tile->values, values, sizeof(values));
+    }
+    LeaveCriticalSection(&state_lock);
+    tile->used = ++heatmap_tick;
+    return tile->bitmap;
+}
+
+void heatmap_free_tiles(void) {
+    for (int i = 0; i < HEATMAP_CACHE_TILES; i++) {
+        if (heatmap_tiles[i].bitmap) DeleteObject(heatmap_tiles[i].bitmap);
+    }
+    memset(heatmap_tiles, 0, sizeof(heatmap_tiles));
+}
+
+void paint_heatmap(HWND hwnd, HDC hdc) {
+    RECT rect;
+    GetClientRect(hwnd, &rect);
+    HBRUSH background = CreateSolidBrush(RGB(139, 0, 0));
+    FillRect(hdc, &rect, background);
+    DeleteObject(background);
+
+    SetBkMode(hdc, TRANSPARENT);
+    SetTextColor(hdc, RGB(255, 255, 255));
+    if (!g_hHeatmapFont) {
+        g_hHeatmapFont = CreateFontW(20, 0, 0, 0, FW_SEMIBOLD, FALSE, FALSE, FALSE, DEFAULT_CHARSET, OUT_DEFAULT_PRECIS,
+                                     CLIP_DEFAULT_PRECIS, DEFAULT_QUALITY, DEFAULT_PITCH, L"Segoe UI");
+    }
+    HFONT old_font = (HFONT)SelectObject(hdc, g_hHeatmapFont);
+
+    // Year and its total
+    int total = 0;
+    EnterCriticalSection(&state_lock);
+    int32_t first = heatmap_day_number(heatmap_year, 1, 1), last = heatmap_day_number(heatmap_year + 1, 1, 1);
+    for (int32_t day = first; day < last; day++) total += heatmap_days_get(&day_counts, day);
+    LeaveCriticalSection(&state_lock);
+    wchar_t title[64];
+    swprintf(title, 64, L"%d  \u2013  %d", heatmap_year, total);
+    RECT title_rect = {HEATMAP_MARGIN, HEATMAP_MARGIN, rect.right - HEATMAP_MARGIN, HEATMAP_MARGIN + HEATMAP_TITLE_HEIGHT};
+    DrawTextW(hdc, title, -1, &title_rect, DT_LEFT | DT_TOP | DT_SINGLELINE);
+
+    HDC tile_dc = CreateCompatibleDC(hdc);
+    HBITMAP old_bitmap = NULL;
+    for (int month = 1; month <= 12; month++) {
+        int x = HEATMAP_MARGIN + ((month - 1) % 4) * (HEATMAP_TILE_WIDTH + HEATMAP_GAP);
+        int y = HEATMAP_MARGIN + HEATMAP_TITLE_HEIGHT + ((month - 1) / 4) * (HEATMAP_LABEL_HEIGHT + HEATMAP_TILE_HEIGHT + HEATMAP_GAP);
+        SYSTEMTIME st = {0};
+        st.wYear = (WORD)heatmap_year;
+        st.wMonth = (WORD)month;
+        st.wDay = 1;
+        wchar_t name[32];
+        if (GetDateFormatW(LOCALE_USER_DEFAULT, 0, &st, L"MMMM", name, 32)) {
+            RECT label_rect = {x, y, x + HEATMAP_TILE_WIDTH, y + HEATMAP_LABEL_HEIGHT};
+            DrawTextW(hdc, name, -1, &label_rect, DT_LEFT | DT_TOP | DT_SINGLELINE);
+        }
+        HBITMAP tile = heatmap_tile(heatmap_year, month);
+        if (!tile) continue;
+        HBITMAP previous = (HBITMAP)SelectObject(tile_dc, tile);
+        if (!old_bitmap) old_bitmap = previous;
+        BitBlt(hdc, x, y + HEATMAP_LABEL_HEIGHT, HEATMAP_TILE_WIDTH, HEATMAP_TILE_HEIGHT, tile_dc, 0, 0, SRCCOPY);
+    }
+    if (old_bitmap) SelectObject(tile_dc, old_bitmap);
+    DeleteDC(tile_dc);
+    SelectObject(hdc, old_font);
+}
+
+void heatmap_show_year(HWND hwnd, int year) {
+    if (year < 1601 || year > 9999) return;
+    heatmap_year = year;
+    InvalidateRect(hwnd, NULL, FALSE);
+}
+
+LRESULT CALLBACK HeatmapWndProc(HWND hwnd, UINT msg, WPARAM wParam, LPARAM lParam) {
+    switch (msg) {
+        case WM_PAINT: {
+            PAINTSTRUCT ps;
+            HDC hdc = BeginPaint(hwnd, &ps);
+            paint_heatmap(hwnd, hdc);
+            EndPaint(hwnd, &ps);
+            return 0;
+        }
+        case WM_ERASEBKGND:
+            return 1; // painted in WM_PAINT
+        case WM_MOUSEWHEEL:
+            heatmap_show_year(hwnd, heatmap_year + (GET_WHEEL_DELTA_WPARAM(wParam) > 0 ? -1 : 1));
+            return 0;
+        case WM_KEYDOWN: {
+            SYSTEMTIME now;
+            switch (wParam) {
+                case VK_LEFT:
+                case VK_PRIOR: heatmap_show_year(hwnd, heatmap_year - 1); break;
+                case VK_RIGHT:
+                case VK_NEXT: heatmap_show_year(hwnd, heatmap_year + 1); break;
+                case VK_HOME: GetLocalTime(&now); heatmap_show_year(hwnd, now.wYear); break;
+                case VK_ESCAPE: DestroyWindow(hwnd); break;
+            }
+            return 0;
+        }
+        case WM_DESTROY:
+            // Released with the window; a reopened heatmap renders 12 tiles again
+            heatmap_free_tiles();
+            if (g_hHeatmapFont) {
+                DeleteObject(g_hHeatmapFont);
+                g_hHeatmapFont = NULL;
+            }
+            g_hHeatmap = NULL;
+            return 0;
+        default:
+            return DefWindowProcW(hwnd, msg, wParam, lParam);
+    }
+}
+
+void ShowHeatmap(HWND hwnd) {
+    if (g_hHeatmap) {
+        SetForegroundWindow(g_hHeatmap);
+        return;
+    }
+    static BOOL registered = FALSE;
+    if (!registered) {
+        WNDCLASSW wc = {0};
+        wc.lpfnWndProc = HeatmapWndProc;
+        wc.hInstance = GetModuleHandle(NULL);
+        wc.lpszClassName = HEATMAP_WINDOW_CLASS;
+        wc.hCursor = LoadCursorW(NULL, IDC_ARROW);
+        wc.hIcon = LoadIconW(GetModuleHandle(NULL), L"IDI_ICON1");
+        RegisterClassW(&wc);
+        registered = TRUE;
+    }
+
+    SYSTEMTIME now;
+    GetLocalTime(&now);
+    heatmap_year = now.wYear;
+    DWORD style = WS_OVERLAPPED | WS_CAPTION | WS_SYSMENU | WS_MINIMIZEBOX;
+    RECT rect = {0, 0, HEATMAP_CLIENT_WIDTH, HEATMAP_CLIENT_HEIGHT};
+    AdjustWindowRect(&rect, style, FALSE);
+    int width = rect.right - rect.left, height = rect.bottom - rect.top;
+    g_hHeatmap = CreateWindowExW(0, HEATMAP_WINDOW_CLASS, g_lang->menu_statistics, style,
+                                 (GetSystemMetrics(SM_CXSCREEN) - width) / 2, (GetSystemMetrics(SM_CYSCREEN) - height) / 2,
+                                 width, height, hwnd, NULL, GetModuleHandle(NULL), NULL);
+    if (!g_hHeatmap) return;
+    ShowWindow(g_hHeatmap, SW_SHOW);
+    SetForegroundWindow(g_hHeatmap);
+}
+
+// Run a command of the tray menu
+void execute_menu_command(HWND hwnd, int cmd) {
+    switch (cmd) {
+        case 1: // Start Pomodoro
+            start_pomodoro(hwnd);
+            break;
+        case 2: // Start Break
+            start_break(hwnd, 0);
+            break;
+        case 3: // Start Long Break
+            start_break(hwnd, 1);
+            break;
+        case 4: { // Toggle Clock Sound
+            TimerSettings updated = settings;
+            updated.enable_clock_sound = !settings.enable_clock_sound;
+            apply_settings(hwnd, &updated);
+            save_settings();
+            break;
+        }
+        case 5: // Toggle Autostart
+            autostart_enabled = !autostart_enabled;
+            set_autostart(autostart_enabled);
+            break;
+        case 9: // Toggle Completion Dialog
+            settings.show_completion_dialog = !settings.show_completion_dialog;
+            save_settings();
+            break;
+        case ID_MENU_PROGRESS_RING: { // Toggle Progress Ring
+            TimerSettings updated = settings;
+            updated.progress_ring = !settings.progress_ring;
+            apply_settings(hwnd, &updated);
+            save_settings();
+            break;
+        }
+        case 6: // Settings
+            ShowSettingsDialog(hwnd);
+            break;
+        case 7: // About
+            ShowAboutDialog(hwnd);
+            break;
+        case ID_MENU_RESET_COUNT:
+            reset_pomodoro_count(hwnd);
+            break;
+        case ID_MENU_LABEL_PICK:
+            ShowLabelPicker(hwnd);
+            break;
+        case ID_MENU_STATISTICS:
+            ShowHeatmap(hwnd);
+            break;
+        case 8: // Exit
+            // WM_DESTROY stops the timer, removes the icon and writes the trace
+            DestroyWindow(hwnd);
+            break;
+        case ID_MENU_LANG_EN:
+            SetLanguage(&lang_en);
+            SaveLanguageSelectionToRegistry();
+            break;
+        case ID_MENU_LANG_HU:
+            SetLanguage(&lang_hu);
+            SaveLanguageSelectionToRegistry();
+            break;
+        case ID_MENU_LANG_DE:
+            SetLanguage(&lang_de);
+            SaveLanguageSelectionToRegistry();
+            break;
+        case ID_MENU_LANG_IT:
+            SetLanguage(&lang_it);
+            SaveLanguageSelectionToRegistry();
+            break;
+        case ID_MENU_LANG_ES:
+            SetLanguage(&lang_es);
+            SaveLanguageSelectionToRegistry();
+            break;
+        case ID_MENU_LANG_FR:
+            SetLanguage(&lang_fr);
+            SaveLanguageSelectionToRegistry();
+            break;
+        case ID_MENU_LANG_RU:
+            SetLanguage(&lang_ru);
+            SaveLanguageSelectionToRegistry();
+            break;
+    }
+}
+
+// Main window procedure
+LRESULT CALLBACK WndProc(HWND hwnd, UINT msg, WPARAM wParam, LPARAM lParam) {
+    switch (msg) {
         case WM_USER + 1: // Tray icon message
+            deferred_init(hwnd);
             if (LOWORD(lParam) == WM_LBUTTONUP) {
                 // Left click: toggle timer
-                if (is_running) {
-                    is_running = 0;
-                    update_tray_icon(hwnd, L"\u25BA", pomodoro_count, 0);
-                } else {
-                    if (is_in_pomodoro) {
-                        is_in_pomodoro = 0;
-                        if (pomodoro_count == 4) {
-                            // do not reset here; keep pomodoro_count=4 to show 4th dot until a new pomodoro starts
-                             start_timer(hwnd, settings.long_break_duration);
-                        } else {
-                            start_timer(hwnd, settings.short_break_duration);
-                        }
-                    } else {
-                        is_in_pomodoro = 1;
-                        // starting a new pomodoro -> reset completed counter only if cycle complete
-                        if (pomodoro_count >= 4) pomodoro_count = 0;
-                        start_timer(hwnd, settings.pomodoro_duration);
-                    }
-                }
+                record_event(REPLAY_TRAY, WM_LBUTTONUP);
+                toggle_timer(hwnd);
             } else if (LOWORD(lParam) == WM_RBUTTONUP) {
                 // Right click: show context menu
                 HMENU hMenu = CreatePopupMenu();
@@ -1115,10 +2848,13 @@ LRESULT CALLBACK WndProc(HWND hwnd, UINT msg, WPARAM wParam, LPARAM lParam) {
                 AppendMenu(hMenu, MF_STRING, 1, g_lang->menu_start_pomodoro);
                 AppendMenu(hMenu, MF_STRING, 2, g_lang->menu_start_break);
                 AppendMenu(hMenu, MF_STRING, 3, g_lang->menu_start_long_break);
+                AppendMenu(hMenu, MF_STRING | (current_label ? MF_CHECKED : 0), ID_MENU_LABEL_PICK, g_lang->menu_choose_task);
+                AppendMenu(hMenu, MF_STRING, ID_MENU_STATISTICS, g_lang->menu_statistics);
                 AppendMenu(hMenu, MF_SEPARATOR, 0, NULL);
                 AppendMenu(hMenu, MF_STRING | (settings.enable_clock_sound ? MF_CHECKED : 0), 4, g_lang->menu_clock_sound);
                 AppendMenu(hMenu, MF_STRING | (autostart_enabled ? MF_CHECKED : 0), 5, g_lang->menu_autostart);
                 AppendMenu(hMenu, MF_STRING | (settings.show_completion_dialog ? MF_CHECKED : 0), 9, g_lang->menu_show_dialog);
+                AppendMenu(hMenu, MF_STRING | (settings.progress_ring ? MF_CHECKED : 0), ID_MENU_PROGRESS_RING, g_lang->menu_progress_ring);
                 AppendMenu(hMenu, MF_SEPARATOR, 0, NULL);
                 AppendMenu(hMenu, MF_STRING, 6, g_lang->menu_settings);
 
@@ -1153,159 +2889,1316 @@ LRESULT CALLBACK WndProc(HWND hwnd, UINT msg, WPARAM wParam, LPARAM lParam) {
                 SetForegroundWindow(hwnd);
                 int cmd = TrackPopupMenu(hMenu, TPM_RETURNCMD, pt.x, pt.y, 0, hwnd, NULL);
 
-                // Handle menu commands
-                switch (cmd) {
-                    case 1: // Start Pomodoro
-                        is_in_pomodoro = 1;
-                        // user started a new pomodoro manually -> reset completed counter only if cycle complete
-                        if (pomodoro_count >= 4) pomodoro_count = 0;
-                        start_timer(hwnd, settings.pomodoro_duration);
-                        break;
-                    case 2: // Start Break
-                        is_in_pomodoro = 0;
-                        start_timer(hwnd, settings.short_break_duration);
-                        break;
-                    case 3: // Start Long Break
-                        is_in_pomodoro = 0;
-                        start_timer(hwnd, settings.long_break_duration);
-                        break;
-                    case 4: // Toggle Clock Sound
-                        settings.enable_clock_sound = !settings.enable_clock_sound;
-                        save_settings();
-                        break;
-                    case 5: // Toggle Autostart
-                        autostart_enabled = !autostart_enabled;
-                        set_autostart(autostart_enabled);
-                        break;
-                    case 9: // Toggle Completion Dialog
-                        settings.show_completion_dialog = !settings.show_completion_dialog;
-                        save_settings();
-                        break;
-                    case 6: // Settings
-                        ShowSettingsDialog(hwnd);
-                        break;
-                    case 7: // About
-                        ShowAboutDialog(hwnd);
-                        break;
-                    case ID_MENU_RESET_COUNT:
-                        pomodoro_count = 0;
-                        if (is_running) {
-                             wchar_t display_text[16];
-                             if (remaining_seconds < 60) {
-                                 _itow(remaining_seconds, display_text, 10);
-                             } else {
-                                 _itow(remaining_seconds / 60, display_text, 10);
-                             }
-                             update_tray_icon(hwnd, display_text, pomodoro_count, remaining_seconds);
-                        } else {
-                             update_tray_icon(hwnd, L"\u25BA", pomodoro_count, 0);
-                        }
-                        break;
-                    case 8: // Exit
-                        Shell_NotifyIcon(NIM_DELETE, &nid);
-                        PostQuitMessage(0);
-                        break;
-                    case ID_MENU_LANG_EN:
-                        SetLanguage(&lang_en);
-                        SaveLanguageSelectionToRegistry();
-                        break;
-                    case ID_MENU_LANG_HU:
-                        SetLanguage(&lang_hu);
-                        SaveLanguageSelectionToRegistry();
-                        break;
-                    case ID_MENU_LANG_DE:
-                        SetLanguage(&lang_de);
-                        SaveLanguageSelectionToRegistry();
-                        break;
-                    case ID_MENU_LANG_IT:
-                        SetLanguage(&lang_it);
-                        SaveLanguageSelectionToRegistry();
-                        break;
-                    case ID_MENU_LANG_ES:
-                        SetLanguage(&lang_es);
-                        SaveLanguageSelectionToRegistry();
-                        break;
-                    case ID_MENU_LANG_FR:
-                        SetLanguage(&lang_fr);
-                        SaveLanguageSelectionToRegistry();
-                        break;
-                    case ID_MENU_LANG_RU:
-                        SetLanguage(&lang_ru);
-                        SaveLanguageSelectionToRegistry();
-                        break;
-                }
+                if (cmd) record_event(REPLAY_MENU, cmd);
+                execute_menu_command(hwnd, cmd);
                 DestroyMenu(hMenu);
             }
             break;
         case WM_DESTROY:
             // Clean up before exit
-            is_running = 0;
-            if (timer_thread_handle != NULL) {
-                WaitForSingleObject(timer_thread_handle, INFINITE);
-                CloseHandle(timer_thread_handle);
-                timer_thread_handle = NULL;
-            }
+            join_timer_thread();
+            if (team_stop) SetEvent(team_stop);
             Shell_NotifyIcon(NIM_DELETE, &nid);
+            trace_dump(TRACE_FILE);
+            if (record_out) {
+                EnterCriticalSection(&record_lock);
+                fclose(record_out);
+                record_out = NULL;
+                LeaveCriticalSection(&record_lock);
+            }
             PostQuitMessage(0);
             break;
         case WM_TOAST_NOTIFY:
             // wParam = was_pomodoro (0/1), lParam = is_long_break (0/1)
             ShowCompletionNotification(hwnd, (int)wParam, (int)lParam);
             return 0;
+        case WM_SETTINGS_CHANGED: {
+            // Parsed by the watcher thread; lParam is a heap copy owned by us
+            TimerSettings* updated = (TimerSettings*)lParam;
+            apply_settings(hwnd, updated);
+            free(updated);
+            return 0;
+        }
+        case WM_TEAM_STATE: {
+            // Pushed by the team thread; lParam is a heap copy owned by us
+            TeamState* pushed = (TeamState*)lParam;
+            team_update(hwnd, pushed);
+            free(pushed);
+            return 0;
+        }
+        case WM_DEFERRED_INIT:
+            deferred_init(hwnd);
+            return 0;
+        case WM_REPLAY_MENU:
+            execute_menu_command(hwnd, (int)wParam);
+            return 0;
+        case WM_HOTKEY: {
+            // Straight to the command, without building the menu; the icon changes before this returns
+            int id = (int)wParam - HOTKEY_ID_BASE;
+            if (id < 0 || id >= HOTKEY_COUNT) return 0;
+            LARGE_INTEGER freq, begin, end;
+            QueryPerformanceFrequency(&freq);
+            QueryPerformanceCounter(&begin);
+            DWORD queued_ms = GetTickCount() - (DWORD)GetMessageTime();
+            TRACE_BEGIN("hotkey");
+            record_event(REPLAY_REMOTE, hotkey_commands[id]); // replayed through the same command path
+            execute_remote_command(hwnd, hotkey_commands[id]);
+            refresh_tray_icon(hwnd);
+            TRACE_END("hotkey");
+            QueryPerformanceCounter(&end);
+            int64_t us = (int64_t)queued_ms * 1000 + (end.QuadPart - begin.QuadPart) * 1000000 / freq.QuadPart;
+            metrics_add(&metrics.hotkey_presses, 1);
+            metrics_add(&metrics.hotkey_microseconds, us);
+            metrics_max(&metrics.hotkey_max_microseconds, us);
+            return 0;
+        }
+        case WM_COPYDATA: {
+            // Command forwarded from a second instance
+            PCOPYDATASTRUCT cds = (PCOPYDATASTRUCT)lParam;
+            if (cds == NULL || HIWORD(cds->dwData) != REMOTE_COMMAND_MAGIC) return 0;
+            // Sent messages are dispatched before the posted WM_DEFERRED_INIT
+            deferred_init(hwnd);
+            // An optional task label applies to the command that comes with it
+            if (cds->lpData && cds->cbData >= sizeof(wchar_t)) {
+                wchar_t name[LABEL_MAX_BYTES];
+                size_t len = cds->cbData / sizeof(wchar_t);
+                if (len > LABEL_MAX_BYTES - 1) len = LABEL_MAX_BYTES - 1;
+                memcpy(name, cds->lpData, len * sizeof(wchar_t));
+                name[len] = L'\0';
+                set_current_label(hwnd, name);
+            }
+            record_event(REPLAY_REMOTE, LOWORD(cds->dwData));
+            LRESULT result = execute_remote_command(hwnd, LOWORD(cds->dwData));
+            LARGE_INTEGER done;
+            QueryPerformanceCounter(&done);
+            last_remote_command_time = done.QuadPart;
+            return result;
+        }
         default:
             return DefWindowProc(hwnd, msg, wParam, lParam);
     }
     return 0;
 }
 
-// Load settings from file
+// Load settings from file; missing fields (older files) keep their defaults
 void load_settings() {
-    FILE* fp = fopen("pomodoro_settings.json", "r");
-    if (fp) {
-        char buf[256] = {0};
-        if (fread(buf, 1, sizeof(buf) - 1, fp) > 0) {
-            if (sscanf(buf, "{\"pomodoro_duration\":%d,\"short_break_duration\":%d,\"long_break_duration\":%d,\"enable_clock_sound\":%d,\"show_completion_dialog\":%d}",
-                       &settings.pomodoro_duration, &settings.short_break_duration, &settings.long_break_duration, &settings.enable_clock_sound, &settings.show_completion_dialog) != 5) {
-                // Try old format
-                if (sscanf(buf, "{\"pomodoro_duration\":%d,\"short_break_duration\":%d,\"long_break_duration\":%d,\"enable_clock_sound\":%d}",
-                           &settings.pomodoro_duration, &settings.short_break_duration, &settings.long_break_duration, &settings.enable_clock_sound) == 4) {
-                    settings.show_completion_dialog = 1; // Default for old format
-                } else {
-                    // Use default values if parsing fails
-                    settings.pomodoro_duration = 25;
-                    settings.short_break_duration = 5;
-                    settings.long_break_duration = 15;
-                    settings.enable_clock_sound = 1;
-                    settings.show_completion_dialog = 1;
-                }
+    settings_read_file(SETTINGS_FILE, &settings);
+}
+
+// Apply changed settings; only the subsystems whose fields changed react
+void apply_settings(HWND hwnd, const TimerSettings* updated) {
+    int diff = settings_diff(&settings, updated);
+    // Durations and the countdown settings only affect future sessions and ticks
+    settings = *updated;
+
+    if (diff & SETTINGS_DIFF_CLOCK_SOUND) {
+        if (!updated->enable_clock_sound) {
+            // The clock sound is not in use any more
+            stop_clock_sound();
+            evict_sound("CLOCK_WAV");
+        } else if (is_running) {
+            start_clock_sound();
+        }
+    }
+    if (diff & SETTINGS_DIFF_RING) {
+        refresh_tray_icon(hwnd);
+    }
+    if (diff & SETTINGS_DIFF_MENU) {
+        RefreshMenuText();
+    }
+}
+
+// Watch the settings file for external edits; changes are debounced and parsed on this thread
+DWORD WINAPI settings_watch_thread(LPVOID lpParam) {
+    HWND hwnd = (HWND)lpParam;
+    HANDLE hDir = CreateFileW(L".", FILE_LIST_DIRECTORY, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+                              NULL, OPEN_EXISTING, FILE_FLAG_BACKUP_SEMANTICS, NULL);
+    if (hDir == INVALID_HANDLE_VALUE) return 0;
+
+    DWORD buffer[1024];
+    DWORD bytes;
+    while (ReadDirectoryChangesW(hDir, buffer, sizeof(buffer), FALSE,
+                                 FILE_NOTIFY_CHANGE_LAST_WRITE | FILE_NOTIFY_CHANGE_FILE_NAME | FILE_NOTIFY_CHANGE_SIZE,
+                                 &bytes, NULL, NULL)) {
+        int matched = bytes == 0; // buffer overflow: changes were lost, check anyway
+        for (BYTE* p = (BYTE*)buffer; bytes > 0 && !matched; ) {
+            FILE_NOTIFY_INFORMATION* info = (FILE_NOTIFY_INFORMATION*)p;
+            int len = (int)(info->FileNameLength / sizeof(WCHAR));
+            if (len == (int)wcslen(SETTINGS_FILE_W) && _wcsnicmp(info->FileName, SETTINGS_FILE_W, len) == 0) {
+                matched = 1;
             }
+            if (info->NextEntryOffset == 0) break;
+            p += info->NextEntryOffset;
+        }
+        if (!matched) continue;
+
+        // Editors write in several steps; let them finish
+        Sleep(SETTINGS_DEBOUNCE_MS);
+        TimerSettings* updated = (TimerSettings*)malloc(sizeof(TimerSettings));
+        if (!updated) continue;
+        *updated = settings;
+        // A file still being written is refused; its last write brings another notification
+        if (!settings_read_file(SETTINGS_FILE, updated) || !settings_diff(&settings, updated) ||
+            !PostMessage(hwnd, WM_SETTINGS_CHANGED, 0, (LPARAM)updated)) {
+            free(updated); // unreadable, unchanged (e.g. our own save) or not posted
         }
-        fclose(fp);
     }
+    CloseHandle(hDir);
+    return 0;
 }
 
 // Save settings to file
 void save_settings() {
-    FILE* fp = fopen("pomodoro_settings.json", "w");
-    if (fp) {
-        fprintf(fp, "{\"pomodoro_duration\":%d,\"short_break_duration\":%d,\"long_break_duration\":%d,\"enable_clock_sound\":%d,\"show_completion_dialog\":%d}",
-                settings.pomodoro_duration, settings.short_break_duration, settings.long_break_duration, settings.enable_clock_sound, settings.show_completion_dialog);
-        fclose(fp);
+    TRACE_BEGIN("save settings");
+    settings_save(&settings, SETTINGS_FILE);
+    TRACE_END("save settings");
+}
+
+// Write text to the console of the launching process, if there is one
+void console_print(const char* text) {
+    HANDLE out = GetStdHandle(STD_OUTPUT_HANDLE);
+    if ((out == NULL || out == INVALID_HANDLE_VALUE) && AttachConsole(ATTACH_PARENT_PROCESS)) {
+        out = GetStdHandle(STD_OUTPUT_HANDLE);
+    }
+    if (out != NULL && out != INVALID_HANDLE_VALUE) {
+        DWORD written;
+        WriteFile(out, text, (DWORD)strlen(text), &written, NULL);
     }
 }
 
-// Main entry point
-int WINAPI WinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, LPSTR lpCmdLine, int nCmdShow) {
-    HANDLE hEvent = CreateEventW(NULL, TRUE, FALSE, L"PomodoroTimerEvent");
-    if (GetLastError() == ERROR_ALREADY_EXISTS) {
-        MessageBoxW(NULL, L"The program is already running. Exiting.", L"Warning", MB_OK | MB_ICONWARNING);
+// Map a command line switch to a remote command (0 if unknown)
+int parse_remote_command(const wchar_t* arg) {
+    if (wcscmp(arg, L"--start-pomodoro") == 0) return REMOTE_CMD_START_POMODORO;
+    if (wcscmp(arg, L"--start-break") == 0) return REMOTE_CMD_START_BREAK;
+    if (wcscmp(arg, L"--start-long-break") == 0) return REMOTE_CMD_START_LONG_BREAK;
+    if (wcscmp(arg, L"--stop") == 0) return REMOTE_CMD_STOP;
+    if (wcscmp(arg, L"--toggle") == 0) return REMOTE_CMD_TOGGLE;
+    if (wcscmp(arg, L"--reset-count") == 0) return REMOTE_CMD_RESET_COUNT;
+    if (wcscmp(arg, L"--status") == 0) return REMOTE_CMD_STATUS;
+    if (wcscmp(arg, L"--trace-dump") == 0) return REMOTE_CMD_TRACE_DUMP;
+    return 0;
+}
+
+// Print a packed status value returned by the running instance
+void print_status(LRESULT status) {
+    char buf[128];
+    int running = (int)(status & 1);
+    int in_pomodoro = (int)((status >> 1) & 1);
+    int count = (int)((status >> 2) & 7);
+    int seconds = (int)((status >> 8) & 0xFFFF);
+    if (running) {
+        snprintf(buf, sizeof(buf), "%s running %02d:%02d, %d completed\n",
+                 in_pomodoro ? "Pomodoro" : "Break", seconds / 60, seconds % 60, count);
+    } else {
+        snprintf(buf, sizeof(buf), "Stopped, %d completed\n", count);
+    }
+    console_print(buf);
+}
+
+// Forward a command to the running instance; returns the process exit code
+int forward_remote_command(int cmd) {
+    // The primary instance may still be creating its window
+    HWND target = NULL;
+    for (int i = 0; i < 50 && target == NULL; i++) {
+        target = FindWindowW(L"Pomodoro", L"Pomodoro");
+        if (!target) Sleep(10);
+    }
+    if (!target) {
+        console_print("Pomodoro Timer is not responding\n");
+        return 1;
+    }
+
+    COPYDATASTRUCT cds = {0};
+    cds.dwData = MAKELONG(cmd, REMOTE_COMMAND_MAGIC);
+    if (g_startup_label[0]) {
+        cds.cbData = (DWORD)((wcslen(g_startup_label) + 1) * sizeof(wchar_t));
+        cds.lpData = g_startup_label;
+    }
+    DWORD_PTR result = 0;
+    if (!SendMessageTimeoutW(target, WM_COPYDATA, 0, (LPARAM)&cds, SMTO_ABORTIFHUNG, 2000, &result)) {
+        console_print("Pomodoro Timer is not responding\n");
+        return 1;
+    }
+    if (cmd == REMOTE_CMD_STATUS) {
+        print_status((LRESULT)result);
+    } else if (cmd == REMOTE_CMD_TRACE_DUMP) {
+        char buf[128];
+        snprintf(buf, sizeof(buf), result ? "%lu events written to " TRACE_FILE "\n" : "Tracing is off; start with --trace\n",
+                 (unsigned long)result);
+        console_print(buf);
+        return result ? 0 : 1;
+    }
+    return 0;
+}
+
+// Team mode: a headless daemon (--team-host) owns the shared schedule and pushes
+// every change to its subscribers over a named pipe (see pomodoro-team.h). A
+// subscriber derives the current phase from the schedule and its own clock, so
+// between changes it needs nothing from the daemon.
+static TeamState team_state = {0};
+static LONGLONG team_paused_phase = -1; // phase start the user opted out of
+static LONGLONG team_deadline = 0;      // deadline of the local session the team drives
+
+// Pipe of a team name; a full pipe path such as \\host\pipe\name is used as it is
+void team_pipe_name(const wchar_t* name, wchar_t* pipe) {
+    if (wcsncmp(name, L"\\\\", 2) == 0) {
+        wcsncpy(pipe, name, MAX_PATH - 1);
+    } else {
+        swprintf(pipe, MAX_PATH, TEAM_PIPE_PREFIX L"%ls", name);
+    }
+    pipe[MAX_PATH - 1] = L'\0';
+}
+
+// --team-start and friends: the command they send to the daemon, or 0
+int parse_team_command(const wchar_t* arg) {
+    if (wcscmp(arg, L"--team-start") == 0) return TEAM_CMD_START;
+    if (wcscmp(arg, L"--team-pause") == 0) return TEAM_CMD_PAUSE;
+    if (wcscmp(arg, L"--team-resume") == 0) return TEAM_CMD_RESUME;
+    if (wcscmp(arg, L"--team-stop") == 0) return TEAM_CMD_STOP;
+    if (wcscmp(arg, L"--team-shutdown") == 0) return TEAM_CMD_SHUTDOWN;
+    return 0;
+}
+
+static TeamServer team_server;
+static HANDLE team_daemon_done = NULL; // set once the daemon has closed its pipes
+
+// Ctrl+C, Ctrl+Break, closing the console, logoff or shutdown: stop the daemon and let it close its pipes
+BOOL WINAPI team_daemon_ctrl(DWORD type) {
+    (void)type;
+    team_server_stop(&team_server);
+    WaitForSingleObject(team_daemon_done, 5000);
+    return TRUE;
+}
+
+// Headless: serve the team schedule until Ctrl+C, the console is closed, or --team-shutdown;
+// the daemon sleeps until a client connects or sends a command
+int run_team_daemon(const wchar_t* pipe) {
+    if (!team_server_open(&team_server, pipe)) {
+        console_print("Cannot serve the team, or its daemon is already running\n");
+        return 1;
+    }
+    team_daemon_done = CreateEventW(NULL, TRUE, FALSE, NULL);
+    SetConsoleCtrlHandler(team_daemon_ctrl, TRUE);
+    console_print("Team daemon started\n");
+    while (team_server_poll(&team_server, -1) >= 0) {
+    }
+    team_server_close(&team_server);
+    console_print("Team daemon stopped\n");
+    if (team_daemon_done) SetEvent(team_daemon_done);
+    return 0;
+}
+
+// Send a command to the daemon and wait until it publishes the change; a start
+// uses the local durations. Returns the process exit code.
+int send_team_command(const wchar_t* pipe, int command) {
+    HANDLE h = team_connect(pipe);
+    if (h == INVALID_HANDLE_VALUE) {
+        console_print("The team daemon is not running\n");
+        return 1;
+    }
+    TeamCommand c = {TEAM_COMMAND_MAGIC, (uint32_t)command, (uint16_t)settings.pomodoro_duration,
+                     (uint16_t)settings.short_break_duration, (uint16_t)settings.long_break_duration, 4};
+    TeamState current, next;
+    int ok = team_wait_readable(h, 3000) && team_receive(h, &current);
+    next = current;
+    if (command == TEAM_CMD_SHUTDOWN) {
+        // The daemon closes every connection as it stops, this one included
+        ok = ok && team_send(h, &c);
+        while (ok && team_wait_readable(h, 3000) && team_receive(h, &next)) {
+        }
+        ok = ok && !PeekNamedPipe(h, NULL, 0, NULL, NULL, NULL);
+        CloseHandle(h);
+        console_print(ok ? "Team daemon stopped\n" : "The team daemon did not answer\n");
+        return ok ? 0 : 1;
+    }
+    if (ok && !team_state_apply(&next, &c, unix_time_now())) {
+        CloseHandle(h);
+        console_print("Nothing to change\n");
         return 0;
     }
+    ok = ok && team_send(h, &c);
+    // The change is published to every subscriber, this connection included
+    while (ok && next.seq <= current.seq) {
+        ok = team_wait_readable(h, 3000) && team_receive(h, &next);
+    }
+    CloseHandle(h);
+    console_print(ok ? "Team schedule updated\n" : "The team daemon did not answer\n");
+    return ok ? 0 : 1;
+}
+
+// Subscriber thread: waits on the pipe and hands every state the daemon pushes to
+// the GUI thread, and wakes up on its own only when a phase of the schedule ends,
+// to hand it the same state again. Reconnects when the daemon goes away; the last
+// schedule stays in use meanwhile. Ends when team_stop is set.
+DWORD WINAPI team_thread(LPVOID param) {
+    HWND hwnd = (HWND)param;
+    TRACE_THREAD_NAME("team");
+    do {
+        TeamReader r;
+        if (!team_reader_open(&r, g_team_path)) continue;
+        TeamState st;
+        int have = 0, got;
+        for (;;) {
+            DWORD wait = INFINITE;
+            int64_t next = have ? team_next_change(&st, team_now_us() / 1000000) : 0;
+            if (next) {
+                // A second late, so the local session of the phase that ends completes on its own first
+                int64_t ms = (next + 1) * 1000 - team_now_us() / 1000;
+                wait = ms > 0 ? (DWORD)ms : 0;
+            }
+            got = team_reader_wait(&r, team_stop, wait, &st);
+            if (got < 0) break;
+            have |= got;
+            TeamState* copy = (TeamState*)malloc(sizeof(TeamState));
+            if (!copy) continue;
+            *copy = st;
+            if (!PostMessage(hwnd, WM_TEAM_STATE, 0, (LPARAM)copy)) free(copy);
+        }
+        team_reader_close(&r);
+    } while (WaitForSingleObject(team_stop, 5000) == WAIT_TIMEOUT);
+    return 0;
+}
+
+// A manual start or stop opts out of the team phase that is currently running
+void team_pause_current_phase(void) {
+    int kind, phase_seconds, completed;
+    int64_t phase_start;
+    if (g_team_path[0] && team_phase_at(&team_state, unix_time_now(), &kind, &phase_start, &phase_seconds, &completed)) {
+        team_paused_phase = phase_start;
+    }
+}
+
+// Drive the local timer from the team schedule; runs on the GUI thread at the end
+// of every phase and right after every change the daemon pushes
+void team_follow(HWND hwnd) {
+    int kind, phase_seconds, completed;
+    int64_t phase_start;
+    LONGLONG now = unix_time_now();
+    LONGLONG local_deadline = session_start_time + session_planned_seconds;
+    if (!team_phase_at(&team_state, now, &kind, &phase_start, &phase_seconds, &completed)) {
+        // Stopped or paused by the team: end the session the team started, not one of the user's
+        if (is_running && team_deadline && local_deadline == team_deadline) {
+            interrupt_session();
+            save_session_state();
+            update_tray_icon(hwnd, L"\u25BA", pomodoro_count, 0);
+        }
+        team_deadline = 0;
+        return;
+    }
+    if (phase_start == team_paused_phase) return;
+
+    LONGLONG deadline = phase_start + phase_seconds;
+    if (is_running && session_kind == kind && local_deadline >= deadline - 2 && local_deadline <= deadline + 2) {
+        team_deadline = local_deadline;
+        return;
+    }
+    if (!is_running && local_deadline == deadline) return; // this phase already finished locally
+
+    interrupt_session();
+    session_kind = kind;
+    is_in_pomodoro = kind == SESSION_POMODORO;
+    pomodoro_count = completed;
+    run_timer(hwnd, phase_start, phase_seconds, (int)(deadline - now));
+    team_deadline = deadline;
+    save_session_state();
+    refresh_tray_icon(hwnd);
+}
+
+// Take a state the daemon pushed and act on it at once
+void team_update(HWND hwnd, const TeamState* pushed) {
+    team_state = *pushed;
+    team_follow(hwnd);
+}
+
+// History sync: every machine appends its finished sessions to its own segment
+// <folder>\<machine>.pomodoro.log, and a background thread exports new lines of
+// the local history and reads only the unread tail of each peer segment. The
+// records are merged through the journal of pomodoro-sync.h, so a crash at any
+// point neither drops nor repeats one. The seq of a local line is where it
+// starts in the whole history (archive included), so an export that is repeated
+// after a crash writes the same seqs and peers skip it.
+#define SYNC_STATE_FORMAT 2 // peer cursors come from the journal
+
+static wchar_t sync_folder[MAX_PATH] = L"";
+static wchar_t sync_machine[64] = L"";
+static LONGLONG sync_local_offset = 0; // bytes of the local history already exported
+static LONGLONG sync_next_seq = 1;   // above every seq exported so far
+static SyncJournal sync_journal;     // the peers, with their segment offsets
+static SyncTotals sync_totals = {&labels, &day_counts, &adapt_model, &today_pomodoros, &today_focus_seconds, &today_synced};
+
+// Load the export position and the peer segment offsets; returns the file format, 0 if there is no file
+int sync_load_state(void) {
+    FILE* fp = fopen(SYNC_STATE_FILE, "r");
+    if (!fp) return 0;
+    int format = 1;
+    char line[256];
+    while (fgets(line, sizeof(line), fp)) {
+        char name[SYNC_NAME_BYTES];
+        long long offset, seq;
+        if (sscanf(line, "format %d", &format) == 1) continue;
+        if (sscanf(line, "local %lld %lld", &offset, &seq) == 2) {
+            sync_local_offset = offset;
+            sync_next_seq = seq;
+        } else if (sscanf(line, "peer %63s %lld", name, &offset) == 2) {
+            // Format 1 has the last seq too; the journal's is the one that counts
+            SyncPeer* peer = sync_peer(&sync_journal, name);
+            if (peer) peer->offset = offset;
+        }
+    }
+    fclose(fp);
+    return format;
+}
+
+void sync_save_state(void) {
+    FILE* fp = fopen(SYNC_STATE_FILE ".tmp", "w");
+    if (!fp) return;
+    fprintf(fp, "format %d\n", SYNC_STATE_FORMAT);
+    fprintf(fp, "local %lld %lld\n", sync_local_offset, sync_next_seq);
+    for (int i = 0; i < sync_journal.peer_count; i++) {
+        fprintf(fp, "peer %s %lld\n", sync_journal.peers[i].name, (long long)sync_journal.peers[i].offset);
+    }
+    fclose(fp);
+    MoveFileExA(SYNC_STATE_FILE ".tmp", SYNC_STATE_FILE, MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH);
+}
+
+// Read the complete lines of a file from an offset; returns a malloc'd buffer or NULL
+char* sync_read_tail(const wchar_t* path, LONGLONG* offset, DWORD* size) {
+    HANDLE file = CreateFileW(path, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, NULL,
+                              OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (file == INVALID_HANDLE_VALUE) return NULL;
+    LARGE_INTEGER file_size;
+    char* buf = NULL;
+    *size = 0;
+    if (GetFileSizeEx(file, &file_size)) {
+        if (file_size.QuadPart < *offset) *offset = 0; // recreated; seq numbers still prevent duplicates
+        LONGLONG avail = file_size.QuadPart - *offset;
+        if (avail > 16 * 1024 * 1024) avail = 16 * 1024 * 1024;
+        LARGE_INTEGER pos;
+        pos.QuadPart = *offset;
+        if (avail > 0 && SetFilePointerEx(file, pos, NULL, FILE_BEGIN) && (buf = (char*)malloc((size_t)avail + 1))) {
+            DWORD read = 0;
+            ReadFile(file, buf, (DWORD)avail, &read, NULL);
+            // Only whole lines; a peer may be in the middle of an append
+            while (read > 0 && buf[read - 1] != '\n') read--;
+            buf[read] = '\0';
+            *size = read;
+            *offset += read;
+        }
+    }
+    CloseHandle(file);
+    if (buf && *size == 0) {
+        free(buf);
+        buf = NULL;
+    }
+    return buf;
+}
+
+// Export new local history lines to our own segment
+void sync_export_local(void) {
+    // sync_local_offset counts the archived bytes too, so compaction does not move it
+    LONGLONG offset = sync_local_offset > history_archived_bytes ? sync_local_offset - history_archived_bytes : 0;
+    DWORD size;
+    char* buf = sync_read_tail(L"" HISTORY_FILE, &offset, &size);
+    if (!buf) return;
+    LONGLONG base = history_archived_bytes + offset - size; // where buf starts in the whole history
+    wchar_t path[MAX_PATH];
+    swprintf(path, MAX_PATH, L"%ls\\%ls%ls", sync_folder, sync_machine, SYNC_SEGMENT_SUFFIX);
+    FILE* fp = _wfopen(path, L"ab");
+    if (fp) {
+        LONGLONG seq = sync_next_seq;
+        for (char* line = strtok(buf, "\n"); line; line = strtok(NULL, "\n")) {
+            // Only a log that was deleted and started over goes below the seqs already exported
+            LONGLONG line_seq = base + (line - buf) + 1;
+            if (line_seq > seq) seq = line_seq;
+            long long start;
+            char kind[16], outcome[16], focus[8] = "";
+            int planned, actual, label = 0, used = 0;
+            if (sscanf(line, "%lld,%15[a-z_],%d,%d,%15[a-z]%n", &start, kind, &planned, &actual, outcome, &used) < 5) continue;
+            const char* rest = line + used;
+            if (*rest == ',') {
+                rest++;
+                int n = 0;
+                while (rest[n] >= '0' && rest[n] <= '9' && n < 7) { focus[n] = rest[n]; n++; }
+                focus[n] = '\0';
+                rest += n;
+                if (*rest == ',') label = atoi(rest + 1);
+            }
+            EnterCriticalSection(&state_lock);
+            fprintf(fp, "%lld,%lld,%s,%d,%d,%s,%s,%s\n", seq++, start, kind, planned, actual, outcome, focus, label_name(&labels, label));
+            LeaveCriticalSection(&state_lock);
+        }
+        if (fclose(fp) == 0) {
+            sync_next_seq = seq;
+            sync_local_offset = offset + history_archived_bytes;
+        }
+    }
+    free(buf);
+}
+
+// Add a journal record to the totals that miss it; the caller holds state_lock
+void sync_apply_record(const SyncRecord* r, uint32_t number, void* context) {
+    (void)context;
+    roll_today_totals();
+    sync_totals_add(&sync_totals, r, number, local_day_of(r->row.start), local_hour_of(r->row.start), today_day);
+}
+
+void sync_replay_record(const SyncRecord* r, uint32_t number, void* context) {
+    EnterCriticalSection(&state_lock);
+    sync_apply_record(r, number, context);
+    LeaveCriticalSection(&state_lock);
+}
+
+// Load the journal and add the records that a saved total does not include yet. Runs once the
+// history caches are loaded, before the sync thread starts.
+void sync_replay_journal(void) {
+    int format = sync_load_state();
+    uint32_t days_synced = day_counts.synced, model_synced = adapt_model.synced;
+    sync_journal_load(&sync_journal, SYNC_PEERS_HISTORY_FILE, format == 1 ? NULL : sync_replay_record, NULL);
+    EnterCriticalSection(&state_lock);
+    if (format == 1) {
+        // The totals of the format before the journal numbering have the whole journal in them;
+        // the day counts and the model are rebuilt from it, since their files changed format too
+        for (int id = 1; id <= labels.count; id++) {
+            labels.totals[id - 1].synced = sync_journal.count;
+            label_save_totals(&labels, id);
+        }
+        today_synced = sync_journal.count;
+        sync_save_state();
+    }
+    if (day_counts.synced != days_synced) heatmap_days_save(&day_counts, DAY_COUNTS_FILE);
+    if (adapt_model.synced != model_synced) adapt_save(&adapt_model, ADAPT_FILE);
+    LeaveCriticalSection(&state_lock);
+}
+
+// Read the new tail of every peer segment
+int sync_merge_peers(void) {
+    wchar_t pattern[MAX_PATH];
+    swprintf(pattern, MAX_PATH, L"%ls\\*%ls", sync_folder, SYNC_SEGMENT_SUFFIX);
+    WIN32_FIND_DATAW fd;
+    HANDLE find = FindFirstFileW(pattern, &fd);
+    if (find == INVALID_HANDLE_VALUE) return 0;
+    int applied = 0;
+    do {
+        wchar_t machine[64];
+        char name[SYNC_NAME_BYTES];
+        size_t len = wcslen(fd.cFileName) - wcslen(SYNC_SEGMENT_SUFFIX);
+        if (len == 0 || len >= 64) continue;
+        wcsncpy(machine, fd.cFileName, len);
+        machine[len] = L'\0';
+        if (_wcsicmp(machine, sync_machine) == 0) continue;
+        if (!WideCharToMultiByte(CP_UTF8, 0, machine, -1, name, sizeof(name), NULL, NULL)) continue;
+        SyncPeer* peer = sync_peer(&sync_journal, name);
+        if (!peer) continue;
+        // Nothing new if the size did not grow past what we read
+        LONGLONG size = ((LONGLONG)fd.nFileSizeHigh << 32) | fd.nFileSizeLow;
+        if (size == peer->offset) continue;
+
+        wchar_t path[MAX_PATH];
+        swprintf(path, MAX_PATH, L"%ls\\%ls", sync_folder, fd.cFileName);
+        LONGLONG offset = peer->offset;
+        DWORD read;
+        char* buf = sync_read_tail(path, &offset, &read);
+        if (!buf) continue;
+        // The records reach the journal first, then the totals, which are saved with their numbers
+        EnterCriticalSection(&state_lock);
+        int merged = sync_merge_tail(&sync_journal, peer, buf, sync_apply_record, NULL);
+        if (merged > 0) {
+            heatmap_days_save(&day_counts, DAY_COUNTS_FILE);
+            adapt_save(&adapt_model, ADAPT_FILE);
+        }
+        LeaveCriticalSection(&state_lock);
+        if (merged >= 0) {
+            peer->offset = offset;
+            applied += merged;
+        }
+        free(buf);
+    } while (FindNextFileW(find, &fd));
+    FindClose(find);
+    return applied;
+}
+
+// Background sync loop: publish local sessions and merge peers every minute
+DWORD WINAPI sync_thread(LPVOID lpParam) {
+    (void)lpParam;
+    for (;;) {
+        sync_export_local();
+        // Also republishes the merged totals in the status segment
+        if (sync_merge_peers() > 0) save_session_state();
+        sync_save_state();
+        WaitForSingleObject(sync_wake, SYNC_INTERVAL_MS);
+    }
+    return 0;
+}
+
+// Read the [sync] section and start syncing if a folder is set
+void start_sync(void) {
+    const wchar_t* ini = config_ini_path();
+    GetPrivateProfileStringW(L"sync", L"folder", L"", sync_folder, MAX_PATH, ini);
+    if (!sync_folder[0]) return;
+    DWORD len = 64;
+    if (!GetPrivateProfileStringW(L"sync", L"machine", L"", sync_machine, 64, ini) && !GetComputerNameW(sync_machine, &len)) {
+        wcscpy(sync_machine, L"default");
+    }
+    sync_wake = CreateEventW(NULL, FALSE, FALSE, NULL);
+    HANDLE thread = CreateThread(NULL, 0, sync_thread, NULL, 0, NULL);
+    if (thread) {
+        SetThreadPriority(thread, THREAD_PRIORITY_BELOW_NORMAL);
+        CloseHandle(thread);
+    }
+}
+
+// --team-report: aggregate every <user>.pomodoro.log of a folder into TEAM_REPORT_FILE
+int write_team_report(const wchar_t* folder) {
+    char dir[MAX_PATH * 3];
+    if (!WideCharToMultiByte(CP_UTF8, 0, folder, -1, dir, sizeof(dir), NULL, NULL)) return 0;
+    LARGE_INTEGER freq, begin, end;
+    QueryPerformanceFrequency(&freq);
+    QueryPerformanceCounter(&begin);
+    TeamReport report;
+    int ok = team_report_run(&report, dir, 0);
+    FILE* fp = ok ? fopen(TEAM_REPORT_FILE, "w") : NULL;
+    ok = fp && team_report_write(&report, fp);
+    if (fp && fclose(fp) != 0) ok = 0;
+    QueryPerformanceCounter(&end);
+
+    char line[256];
+    if (ok) {
+        snprintf(line, sizeof(line), "Team report for %d users written to " TEAM_REPORT_FILE " (%d threads, %.0f ms)\n",
+                 report.user_count, report.thread_count, (double)(end.QuadPart - begin.QuadPart) * 1000.0 / freq.QuadPart);
+    } else {
+        snprintf(line, sizeof(line), "Cannot write the team report\n");
+    }
+    console_print(line);
+    team_report_free(&report);
+    return ok;
+}
+
+// Move old sessions from the history log into the columnar archive
+void compact_history(void) {
+    LONGLONG cutoff = unix_time_now() - HISTORY_ARCHIVE_AGE_DAYS * 86400LL;
+    EnterCriticalSection(&state_lock);
+    archive_compact(HISTORY_FILE, HISTORY_ARCHIVE_FILE, cutoff, HISTORY_ARCHIVE_SLACK_DAYS * 86400LL);
+    Archive archive;
+    if (archive_load(&archive, HISTORY_ARCHIVE_FILE)) history_archived_bytes = (LONGLONG)archive.archived_bytes;
+    archive_free(&archive);
+    LeaveCriticalSection(&state_lock);
+}
+
+// Parse a history log into a malloc'd array, skipping leading columns; returns the row count
+size_t read_history_log(const char* path, int skip_columns, ArchiveRow** rows) {
+    size_t size, count = 0;
+    char* log = archive_read_file(path, &size);
+    *rows = NULL;
+    if (!log) return 0;
+    size_t lines = 1;
+    for (size_t i = 0; i < size; i++) lines += log[i] == '\n';
+    *rows = (ArchiveRow*)malloc(lines * sizeof(ArchiveRow));
+    char* line = log;
+    while (*rows && *line) {
+        char* row = line;
+        for (int i = 0; i < skip_columns && row; i++) {
+            row = strchr(row, ',');
+            if (row) row++;
+        }
+        if (row && archive_parse_line(row, &(*rows)[count])) count++;
+        char* next = strchr(line, '\n');
+        if (!next) break;
+        line = next + 1;
+    }
+    free(log);
+    return count;
+}
+
+typedef struct {
+    void (*visit)(const ArchiveRow* row, void* context);
+    void* context;
+} HistoryVisit;
+
+void visit_journal_record(const SyncRecord* r, uint32_t number, void* context) {
+    (void)number;
+    HistoryVisit* v = (HistoryVisit*)context;
+    v->visit(&r->row, v->context);
+}
+
+// Call visit for every session in the history: the archive, the log, and the sessions synced from other
+// machines; returns the number of records in the sync journal
+uint32_t for_each_history_row(void (*visit)(const ArchiveRow* row, void* context), void* context) {
+    for (int f = 0; f < 2; f++) {
+        ArchiveRow* rows;
+        size_t count;
+        if (f == 0) {
+            Archive archive;
+            archive_load(&archive, HISTORY_ARCHIVE_FILE);
+            count = archive_read_rows(&archive, &rows);
+            archive_free(&archive);
+        } else {
+            count = read_history_log(HISTORY_FILE, 0, &rows);
+        }
+        for (size_t i = 0; i < count; i++) visit(&rows[i], context);
+        free(rows);
+    }
+    SyncJournal journal;
+    HistoryVisit v = {visit, context};
+    memset(&journal, 0, sizeof(journal));
+    return sync_journal_load(&journal, SYNC_PEERS_HISTORY_FILE, visit_journal_record, &v);
+}
+
+// The caches that are built from the whole history because their files are missing
+typedef struct {
+    HeatmapDays* days;  // NULL if it was loaded
+    AdaptModel* model;  // NULL if it was loaded
+} HistoryCaches;
+
+void count_history_row(const ArchiveRow* row, void* context) {
+    HistoryCaches* caches = (HistoryCaches*)context;
+    if (row->kind != SESSION_POMODORO) return;
+    if (caches->days && row->outcome != OUTCOME_STOPPED) heatmap_days_add(caches->days, local_day_of(row->start), 1);
+    if (caches->model) adapt_record(caches->model, local_hour_of(row->start), row->actual, row->outcome != OUTCOME_STOPPED);
+}
+
+// Compact the history, then load the heatmap's day counts and the per-hour Pomodoro statistics,
+// building the missing ones in one pass over the history. Runs off the GUI thread at startup; the
+// Pomodoros that end meanwhile are in history_pending until the loaded caches take them over.
+DWORD WINAPI history_load_thread(LPVOID lpParam) {
+    (void)lpParam;
+    LARGE_INTEGER freq, begin, end;
+    QueryPerformanceFrequency(&freq);
+    QueryPerformanceCounter(&begin);
+    compact_history();
+
+    HeatmapDays days;
+    AdaptModel model;
+    HistoryCaches build = {NULL, NULL};
+    if (!heatmap_days_load(&days, DAY_COUNTS_FILE)) build.days = &days;
+    if (!adapt_load(&model, ADAPT_FILE)) build.model = &model;
+    for (;;) {
+        // The pending Pomodoros before seen are in the log already; if more end during the pass, it may
+        // or may not have read them, so it starts over
+        EnterCriticalSection(&state_lock);
+        int seen = history_pending_count;
+        LeaveCriticalSection(&state_lock);
+        if (build.days) heatmap_days_free(&days);
+        if (build.model) memset(&model, 0, sizeof(model));
+        if (build.days || build.model) {
+            // The built caches include the whole journal
+            uint32_t synced = for_each_history_row(count_history_row, &build);
+            if (build.days) days.synced = synced;
+            if (build.model) model.synced = synced;
+        }
+        EnterCriticalSection(&state_lock);
+        if (history_pending_count == seen || (!build.days && !build.model)) break;
+        LeaveCriticalSection(&state_lock);
+    }
+
+    // The loaded files have none of the pending Pomodoros, the built caches all of them
+    HistoryCaches loaded = {build.days ? NULL : &days, build.model ? NULL : &model};
+    int pending = history_pending_count < HISTORY_PENDING_MAX ? history_pending_count : HISTORY_PENDING_MAX;
+    for (int i = 0; i < pending; i++) count_history_row(&history_pending[i], &loaded);
+    heatmap_days_free(&day_counts);
+    day_counts = days;
+    adapt_model = model;
+    if (build.days || (loaded.days && pending)) heatmap_days_save(&day_counts, DAY_COUNTS_FILE);
+    if (build.model || (loaded.model && pending)) adapt_save(&adapt_model, ADAPT_FILE);
+    history_loaded = 1;
+    LeaveCriticalSection(&state_lock);
+    if (g_hHeatmap) InvalidateRect(g_hHeatmap, NULL, FALSE);
+
+    QueryPerformanceCounter(&end);
+    if (g_startup_timing) {
+        char buf[128];
+        snprintf(buf, sizeof(buf), "%-24s %8.3f ms (background)\n", "history",
+                 (double)(end.QuadPart - begin.QuadPart) * 1000.0 / (double)freq.QuadPart);
+        console_print(buf);
+    }
+    sync_replay_journal();
+    // Sync reads the log at offsets that compaction moves, so it starts after it
+    start_sync();
+    return 0;
+}
+
+// Read the [adaptive] section
+void load_adapt_mode(void) {
+    wchar_t mode[16];
+    GetPrivateProfileStringW(L"adaptive", L"mode", L"suggest", mode, 16, config_ini_path());
+    if (_wcsicmp(mode, L"off") == 0) adapt_mode = ADAPT_MODE_OFF;
+    else if (_wcsicmp(mode, L"auto") == 0) adapt_mode = ADAPT_MODE_AUTO;
+    else adapt_mode = ADAPT_MODE_SUGGEST;
+}
+
+// Unix time of the local midnight that started today
+LONGLONG local_midnight(void) {
+    SYSTEMTIME st;
+    FILETIME local, utc;
+    GetLocalTime(&st);
+    st.wHour = st.wMinute = st.wSecond = st.wMilliseconds = 0;
+    SystemTimeToFileTime(&st, &local);
+    LocalFileTimeToFileTime(&local, &utc);
+    ULARGE_INTEGER t;
+    t.u.LowPart = utc.dwLowDateTime;
+    t.u.HighPart = utc.dwHighDateTime;
+    return (LONGLONG)(t.QuadPart / 10000000ULL) - 11644473600LL;
+}
+
+// --stats: Pomodoro totals for a few periods from the archive and the recent log
+int print_history_stats(void) {
+    Archive archive;
+    archive_load(&archive, HISTORY_ARCHIVE_FILE);
+    ArchiveRow* rows;
+    size_t row_count = read_history_log(HISTORY_FILE, 0, &rows);
+
+    static const char* names[] = {"Today", "Last 7 days", "Last 30 days", "Last 365 days", "All time"};
+    static const int days[] = {1, 7, 30, 365, 0};
+    LONGLONG midnight = local_midnight();
+    char out[1024];
+    int len = snprintf(out, sizeof(out), "%-14s %10s %8s %12s %12s\n", "", "Pomodoros", "Stopped", "Focus hours", "Focus score");
+    for (int p = 0; p < 5; p++) {
+        ArchiveFilter done = archive_filter_all();
+        if (days[p]) done.from = midnight - (days[p] - 1) * 86400LL;
+        done.codes = 1 << ARCHIVE_CODE(SESSION_POMODORO, OUTCOME_COMPLETED) | 1 << ARCHIVE_CODE(SESSION_POMODORO, OUTCOME_EXPIRED);
+        ArchiveFilter stopped = done;
+        stopped.codes = 1 << ARCHIVE_CODE(SESSION_POMODORO, OUTCOME_STOPPED);
+        ArchiveSum sum_done = {0}, sum_stopped = {0};
+        archive_scan(&archive, &done, &sum_done);
+        archive_scan(&archive, &stopped, &sum_stopped);
+        for (size_t i = 0; i < row_count; i++) {
+            if (archive_row_matches(&rows[i], &done)) archive_sum_row(&rows[i], &sum_done);
+            if (archive_row_matches(&rows[i], &stopped)) archive_sum_row(&rows[i], &sum_stopped);
+        }
+        unsigned long long focus_rows = sum_done.focus_rows + sum_stopped.focus_rows;
+        unsigned long long focus_sum = sum_done.focus_sum + sum_stopped.focus_sum;
+        char score[16] = "-";
+        if (focus_rows) snprintf(score, sizeof(score), "%llu%%", (focus_sum + focus_rows / 2) / focus_rows);
+        if (len < (int)sizeof(out)) {
+            len += snprintf(out + len, sizeof(out) - len, "%-14s %10llu %8llu %12.1f %12s\n", names[p],
+                            (unsigned long long)sum_done.rows, (unsigned long long)sum_stopped.rows,
+                            (sum_done.actual_seconds + sum_stopped.actual_seconds) / 3600.0, score);
+        }
+    }
+    console_print(out);
+    free(rows);
+    archive_free(&archive);
+    return 1;
+}
+
+// Record the end of a startup phase and report its cost in --startup-timing mode
+void startup_phase(const char* name) {
+    if (!g_startup_timing) return;
+    LARGE_INTEGER now, freq;
+    QueryPerformanceCounter(&now);
+    QueryPerformanceFrequency(&freq);
+    char buf[128];
+    snprintf(buf, sizeof(buf), "%-24s %8.3f ms (total %8.3f ms)\n", name,
+             (double)(now.QuadPart - g_startup_last.QuadPart) * 1000.0 / (double)freq.QuadPart,
+             (double)(now.QuadPart - g_startup_begin.QuadPart) * 1000.0 / (double)freq.QuadPart);
+    console_print(buf);
+    g_startup_last = now;
+}
+
+// Memory and GUI handles in use by the process
+typedef struct {
+    SIZE_T private_bytes;
+    SIZE_T working_set;
+    DWORD gdi_objects;
+    DWORD user_objects;
+} MemorySnapshot;
+
+void memory_snapshot(MemorySnapshot* snap) {
+    PROCESS_MEMORY_COUNTERS_EX pmc = {0};
+    pmc.cb = sizeof(pmc);
+    GetProcessMemoryInfo(GetCurrentProcess(), (PROCESS_MEMORY_COUNTERS*)&pmc, sizeof(pmc));
+    snap->private_bytes = pmc.PrivateUsage;
+    snap->working_set = pmc.WorkingSetSize;
+    snap->gdi_objects = GetGuiResources(GetCurrentProcess(), GR_GDIOBJECTS);
+    snap->user_objects = GetGuiResources(GetCurrentProcess(), GR_USEROBJECTS);
+}
+
+// Print the change between two snapshots
+void memory_line(const char* name, const MemorySnapshot* before, const MemorySnapshot* after) {
+    char buf[160];
+    snprintf(buf, sizeof(buf), "%-26s private %+7ld KB  working set %+7ld KB  GDI %+4ld  USER %+4ld\n", name,
+             ((long)after->private_bytes - (long)before->private_bytes) / 1024,
+             ((long)after->working_set - (long)before->working_set) / 1024,
+             (long)after->gdi_objects - (long)before->gdi_objects,
+             (long)after->user_objects - (long)before->user_objects);
+    console_print(buf);
+}
+
+// Background metrics loop: sample the gauges and rewrite the textfile every interval
+typedef struct {
+    char path[MAX_PATH * 3];
+    int interval_ms;
+    LONGLONG start_time;
+} MetricsExport;
+
+DWORD WINAPI metrics_thread(LPVOID lpParam) {
+    const MetricsExport* cfg = (const MetricsExport*)lpParam;
+    static char text[METRICS_TEXT_MAX];
+    for (;;) {
+        PomodoroGauges g = {0};
+        MemorySnapshot snap;
+        memory_snapshot(&snap);
+        g.running = is_running ? 1 : 0;
+        if (hooks_enabled) hook_queue_stats(&hook_queue, &g.hook_queue_depth, &g.hooks_dropped);
+        g.private_bytes = (int64_t)snap.private_bytes;
+        g.gdi_objects = snap.gdi_objects;
+        g.user_objects = snap.user_objects;
+        g.start_time = cfg->start_time;
+        int len = metrics_format(&metrics, &g, text, sizeof(text));
+        if (len > 0) metrics_write_textfile(cfg->path, text, (size_t)len);
+        Sleep(cfg->interval_ms);
+    }
+    return 0;
+}
+
+// Read the [metrics] section and start the exporter if a textfile is set
+void start_metrics(void) {
+    static MetricsExport cfg;
+    const wchar_t* ini = config_ini_path();
+    wchar_t path[MAX_PATH];
+    GetPrivateProfileStringW(L"metrics", L"textfile", L"", path, MAX_PATH, ini);
+    if (!path[0] || !WideCharToMultiByte(CP_ACP, 0, path, -1, cfg.path, sizeof(cfg.path), NULL, NULL)) return;
+    int interval = GetPrivateProfileIntW(L"metrics", L"interval_seconds", METRICS_INTERVAL_SECONDS, ini);
+    if (interval < 1) interval = METRICS_INTERVAL_SECONDS;
+    cfg.interval_ms = interval * 1000;
+    cfg.start_time = unix_time_now();
+    HANDLE thread = CreateThread(NULL, 0, metrics_thread, &cfg, 0, NULL);
+    if (thread) {
+        SetThreadPriority(thread, THREAD_PRIORITY_LOWEST);
+        CloseHandle(thread);
+    }
+}
+
+// --memory-report: load and release each lazily loaded subsystem and print what it costs
+void memory_report(HWND hwnd) {
+    MemorySnapshot base, loaded, released;
+    char buf[160];
+
+    memory_snapshot(&base);
+    snprintf(buf, sizeof(buf), "%-26s private %7lu KB  working set %7lu KB  GDI %4lu  USER %4lu\n", "after startup",
+             (unsigned long)(base.private_bytes / 1024), (unsigned long)(base.working_set / 1024),
+             (unsigned long)base.gdi_objects, (unsigned long)base.user_objects);
+    console_print(buf);
+
+    get_sound("CLOCK_WAV");
+    get_sound("DING_WAV");
+    memory_snapshot(&loaded);
+    memory_line("sounds decoded", &base, &loaded);
+    EnterCriticalSection(&sound_lock);
+    if (!clock_sound_playing) evict_sound("CLOCK_WAV");
+    evict_sound("DING_WAV");
+    LeaveCriticalSection(&sound_lock);
+    memory_snapshot(&released);
+    memory_line("sounds released", &base, &released);
+
+    if (!is_running) {
+        memory_snapshot(&base);
+        build_countdown_cache(pomodoro_count);
+        memory_snapshot(&loaded);
+        memory_line("countdown frames built", &base, &loaded);
+        free_countdown_cache();
+        memory_snapshot(&released);
+        memory_line("countdown frames freed", &base, &released);
+    }
+
+    if (!g_hToastWnd) {
+        memory_snapshot(&base);
+        ShowCompletionNotification(hwnd, 1, 0);
+        memory_snapshot(&loaded);
+        memory_line("toast shown", &base, &loaded);
+        if (g_hToastWnd) DestroyWindow(g_hToastWnd);
+        memory_snapshot(&released);
+        memory_line("toast closed", &base, &released);
+    }
+
+    memory_snapshot(&base);
+    trim_memory();
+    memory_snapshot(&released);
+    memory_line("working set trimmed", &base, &released);
+}
+
+// --tick-benchmark: time each stage of the once-per-second tray update in isolation and end to end,
+// and report how much the private bytes and GDI/USER handles grew per call. That is not a count of
+// allocations: a stage that frees what it allocates reads zero, one that leaks shows up.
+typedef void (*TickStage)(HWND hwnd, int i);
+
+static wchar_t tick_bench_text[2][16] = {L"24", L"23"};
+
+void tick_stage_display_text(HWND hwnd, int i) {
+    (void)hwnd;
+    wchar_t display_text[16];
+    int seconds = 1500 - i % 1500;
+    _itow(seconds < 60 ? seconds : seconds / 60, display_text, 10);
+}
+
+void tick_stage_tooltip(HWND hwnd, int i) {
+    (void)hwnd;
+    set_tray_tooltip(1500 - i % 1500);
+}
+
+void tick_stage_cache_hit(HWND hwnd, int i) {
+    (void)hwnd;
+    (void)i;
+    create_tray_icon(tick_bench_text[0], pomodoro_count);
+}
+
+void tick_stage_render(HWND hwnd, int i) {
+    (void)hwnd;
+    create_tray_icon(tick_bench_text[i & 1], pomodoro_count);
+}
+
+// The same, drawn with GDI as when there is no sprite for the text
+void tick_stage_render_gdi(HWND hwnd, int i) {
+    const SpriteSize* sprites = tray_sprite_size;
+    tray_sprite_size = NULL;
+    tick_stage_render(hwnd, i);
+    tray_sprite_size = sprites;
+}
+
+void tick_stage_ring(HWND hwnd, int i) {
+    (void)hwnd;
+    create_ring_icon(tick_bench_text[0], pomodoro_count, i % RING_STEPS);
+}
+
+void tick_stage_publish(HWND hwnd, int i) {
+    (void)hwnd;
+    (void)i;
+    publish_status();
+}
+
+// A 25 minute countdown as the timer thread shows it, including the Shell_NotifyIcon call
+void tick_stage_end_to_end(HWND hwnd, int i) {
+    wchar_t display_text[16];
+    int seconds = 1500 - i % 1500;
+    _itow(seconds < 60 ? seconds : seconds / 60, display_text, 10);
+    update_tray_icon(hwnd, display_text, pomodoro_count, seconds);
+}
+
+// Run a stage in growing batches until it has taken at least 200 ms, then print the per-call cost
+void tick_benchmark_stage(HWND hwnd, const char* name, TickStage stage) {
+    LARGE_INTEGER freq, begin, end;
+    QueryPerformanceFrequency(&freq);
+    for (int i = 0; i < 100; i++) stage(hwnd, i); // warm up caches and lazily created objects
+
+    MemorySnapshot before, after;
+    memory_snapshot(&before);
+    long long calls = 0;
+    double elapsed = 0;
+    for (int batch = 100; elapsed < 0.2; batch *= 2) {
+        QueryPerformanceCounter(&begin);
+        for (int i = 0; i < batch; i++) stage(hwnd, (int)(calls + i));
+        QueryPerformanceCounter(&end);
+        calls += batch;
+        elapsed += (double)(end.QuadPart - begin.QuadPart) / (double)freq.QuadPart;
+    }
+    memory_snapshot(&after);
+
+    char buf[160];
+    snprintf(buf, sizeof(buf), "%-18s %10lld calls %10.1f ns/op  private growth %+8.1f B/op  GDI growth %+6.3f/op  USER growth %+6.3f/op\n",
+             name, calls, elapsed * 1e9 / (double)calls,
+             ((double)after.private_bytes - (double)before.private_bytes) / (double)calls,
+             ((double)after.gdi_objects - (double)before.gdi_objects) / (double)calls,
+             ((double)after.user_objects - (double)before.user_objects) / (double)calls);
+    console_print(buf);
+}
+
+void tick_benchmark(HWND hwnd) {
+    // The stages share the tray caches with the timer thread
+    if (is_running) {
+        console_print("Tick benchmark skipped: a session is running\n");
+        return;
+    }
+    int planned = session_planned_seconds;
+    session_planned_seconds = 1500;
+
+    tick_benchmark_stage(hwnd, "display text", tick_stage_display_text);
+    tick_benchmark_stage(hwnd, "tooltip format", tick_stage_tooltip);
+    tick_benchmark_stage(hwnd, "icon cache hit", tick_stage_cache_hit);
+    tick_benchmark_stage(hwnd, "icon render", tick_stage_render);
+    tick_benchmark_stage(hwnd, "icon render GDI", tick_stage_render_gdi);
+    tick_benchmark_stage(hwnd, "ring step", tick_stage_ring);
+    tick_benchmark_stage(hwnd, "state publish", tick_stage_publish);
+    tick_benchmark_stage(hwnd, "end to end", tick_stage_end_to_end);
+
+    // Put the stopped icon back
+    session_planned_seconds = planned;
+    update_tray_icon(hwnd, L"\u25BA", pomodoro_count, 0);
+}
+
+// Replay one recorded event through the handlers it reached; returns 0 if it was skipped
+int replay_event(HWND hwnd, const ReplayEvent* e) {
+    switch (e->type) {
+        case REPLAY_TICK:
+            if (!is_running) return 0;
+            InterlockedExchangeAdd(&replay_pending_seconds, e->arg);
+            SetEvent(replay_tick_event);
+            return WaitForSingleObject(replay_tick_done, 1000) == WAIT_OBJECT_0;
+        case REPLAY_TRAY:
+            SendMessage(hwnd, WM_USER + 1, 0, e->arg);
+            return 1;
+        case REPLAY_MENU:
+            // Dialogs wait for the user, and autostart and language write to the registry
+            if (e->arg == 5 || e->arg == 6 || e->arg == 7 || e->arg == 8 ||
+                (e->arg >= ID_MENU_LANG_EN && e->arg <= ID_MENU_LANG_RU)) return 0;
+            SendMessage(hwnd, WM_REPLAY_MENU, e->arg, 0);
+            return 1;
+        case REPLAY_TOAST: {
+            for (int waited = 0; !g_hToastWnd && waited < REPLAY_TOAST_WAIT_MS; waited++) Sleep(1);
+            HWND toast = g_hToastWnd;
+            if (!toast) return 0;
+            if (e->arg) {
+                SendMessage(toast, WM_COMMAND, MAKEWPARAM(e->arg, BN_CLICKED), 0);
+            } else {
+                SendMessage(toast, WM_LBUTTONDOWN, 0, 0);
+            }
+            return 1;
+        }
+        case REPLAY_REMOTE: {
+            // The label of --label is not recorded
+            if (e->arg == REMOTE_CMD_SET_LABEL || e->arg == REMOTE_CMD_TRACE_DUMP) return 0;
+            COPYDATASTRUCT cds = {0};
+            cds.dwData = MAKELONG(e->arg, REMOTE_COMMAND_MAGIC);
+            SendMessage(hwnd, WM_COPYDATA, 0, (LPARAM)&cds);
+            return 1;
+        }
+    }
+    return 0;
+}
+
+// --replay: feed a recording to the handlers at the recorded pace divided by the speed, report and exit
+DWORD WINAPI replay_thread(LPVOID lpParam) {
+    HWND hwnd = (HWND)lpParam;
+    ReplayTrace trace;
+    if (!replay_load(&trace, g_replay_path)) {
+        console_print("Cannot read the recording\n");
+        PostMessage(hwnd, WM_CLOSE, 0, 0);
+        return 1;
+    }
+    ReplayLatency latency[REPLAY_TYPES] = {{0}};
+    int skipped = 0;
+    MemorySnapshot before, after;
+    memory_snapshot(&before);
+    int64_t renders = metrics_get(&metrics.icon_renders);
+    int64_t notify_calls = metrics_get(&metrics.notify_icon_calls);
+    int64_t wakeups = metrics_get(&metrics.timer_wakeups);
+    LARGE_INTEGER freq, begin, t0, t1;
+    QueryPerformanceFrequency(&freq);
+    QueryPerformanceCounter(&begin);
+    t1 = begin;
+
+    for (uint32_t i = 0; i < trace.count; i++) {
+        const ReplayEvent* e = &trace.events[i];
+        QueryPerformanceCounter(&t0);
+        double due_ms = e->ms / g_replay_speed;
+        double now_ms = (double)(t0.QuadPart - begin.QuadPart) * 1000.0 / (double)freq.QuadPart;
+        if (due_ms > now_ms) Sleep((DWORD)(due_ms - now_ms));
+        QueryPerformanceCounter(&t0);
+        int done = replay_event(hwnd, e);
+        QueryPerformanceCounter(&t1);
+        if (done) {
+            replay_latency_add(&latency[e->type], (double)(t1.QuadPart - t0.QuadPart) * 1e6 / (double)freq.QuadPart);
+        } else {
+            skipped++;
+        }
+    }
+    memory_snapshot(&after);
+
+    char buf[200];
+    double seconds = (double)(t1.QuadPart - begin.QuadPart) / (double)freq.QuadPart;
+    snprintf(buf, sizeof(buf), "Replayed %lu events in %.1f s (recorded %.1f s, speed %gx), %d skipped\n",
+             (unsigned long)trace.count, trace.count ? seconds : 0.0,
+             trace.count ? trace.events[trace.count - 1].ms / 1000.0 : 0.0, g_replay_speed, skipped);
+    console_print(buf);
+    console_print("event             count    mean us     p50 us     p99 us     max us\n");
+    for (int t = 0; t < REPLAY_TYPES; t++) {
+        ReplayLatency* l = &latency[t];
+        if (!l->count) continue;
+        double sum = 0;
+        for (uint32_t i = 0; i < l->count; i++) sum += l->samples[i];
+        snprintf(buf, sizeof(buf), "%-16s %6lu %10.1f %10.1f %10.1f %10.1f\n", replay_type_name(t),
+                 (unsigned long)l->count, sum / l->count, replay_percentile(l, 50), replay_percentile(l, 99),
+                 replay_percentile(l, 100));
+        console_print(buf);
+        replay_latency_free(l);
+    }
+    snprintf(buf, sizeof(buf), "icon renders %lld, Shell_NotifyIcon calls %lld, timer wakeups %lld\n",
+             (long long)(metrics_get(&metrics.icon_renders) - renders),
+             (long long)(metrics_get(&metrics.notify_icon_calls) - notify_calls),
+             (long long)(metrics_get(&metrics.timer_wakeups) - wakeups));
+    console_print(buf);
+    memory_line("after the replay", &before, &after);
+    replay_free(&trace);
+    PostMessage(hwnd, WM_CLOSE, 0, 0);
+    return 0;
+}
+
+// Replays run in a folder of their own, so they start from the default settings and leave the user's files alone
+int enter_replay_folder(void) {
+    wchar_t dir[MAX_PATH];
+    DWORD len = GetTempPathW(MAX_PATH, dir);
+    if (len == 0 || len > MAX_PATH - 32) return 0;
+    swprintf(dir + len, MAX_PATH - len, L"pomodoro-replay-%lu", (unsigned long)GetCurrentProcessId());
+    return CreateDirectoryW(dir, NULL) && SetCurrentDirectoryW(dir);
+}
+
+// --launch-benchmark: start second launches with --status, as hotkeys and launchers do, and time
+// them from CreateProcess to the command having run here and to the launch having exited
+#define LAUNCH_BENCHMARK_RUNS 50
+DWORD WINAPI launch_benchmark_thread(LPVOID lpParam) {
+    wchar_t exe[MAX_PATH], cmdline[MAX_PATH + 16];
+    if (!GetModuleFileNameW(NULL, exe, MAX_PATH)) return 0;
+    swprintf(cmdline, sizeof(cmdline)/sizeof(cmdline[0]), L"\"%ls\" --status", exe);
+    // The launches print their status; it goes nowhere
+    SECURITY_ATTRIBUTES sa = {sizeof(sa), NULL, TRUE};
+    HANDLE null_out = CreateFileW(L"NUL", GENERIC_WRITE, FILE_SHARE_READ | FILE_SHARE_WRITE, &sa, OPEN_EXISTING, 0, NULL);
+    LARGE_INTEGER freq;
+    QueryPerformanceFrequency(&freq);
+    ReplayLatency to_effect = {0}, to_exit = {0};
+    for (int i = 0; i < LAUNCH_BENCHMARK_RUNS; i++) {
+        STARTUPINFOW si = {0};
+        PROCESS_INFORMATION pi = {0};
+        si.cb = sizeof(si);
+        si.dwFlags = STARTF_USESTDHANDLES;
+        si.hStdOutput = si.hStdError = null_out;
+        LARGE_INTEGER begin, end;
+        last_remote_command_time = 0;
+        QueryPerformanceCounter(&begin);
+        if (!CreateProcessW(NULL, cmdline, NULL, NULL, TRUE, CREATE_NO_WINDOW, NULL, NULL, &si, &pi)) break;
+        WaitForSingleObject(pi.hProcess, 5000);
+        QueryPerformanceCounter(&end);
+        CloseHandle(pi.hThread);
+        CloseHandle(pi.hProcess);
+        if (last_remote_command_time) {
+            replay_latency_add(&to_effect, (double)(last_remote_command_time - begin.QuadPart) * 1e6 / (double)freq.QuadPart);
+        }
+        replay_latency_add(&to_exit, (double)(end.QuadPart - begin.QuadPart) * 1e6 / (double)freq.QuadPart);
+    }
+    if (null_out != INVALID_HANDLE_VALUE) CloseHandle(null_out);
+
+    char buf[256];
+    ReplayLatency* rows[2] = {&to_effect, &to_exit};
+    const char* names[2] = {"launch to effect", "launch to exit"};
+    console_print("Second launch with --status    median       p99       max  (ms)\n");
+    for (int r = 0; r < 2; r++) {
+        snprintf(buf, sizeof(buf), "%-24s %3u %9.3f %9.3f %9.3f\n", names[r], rows[r]->count,
+                 replay_percentile(rows[r], 50) / 1000.0, replay_percentile(rows[r], 99) / 1000.0,
+                 replay_percentile(rows[r], 100) / 1000.0);
+        console_print(buf);
+        replay_latency_free(rows[r]);
+    }
+    return 0;
+}
+
+// Work that is not needed to show the tray icon, run after the message loop starts
+void deferred_init(HWND hwnd) {
+    if (g_initialized) return;
+    g_initialized = 1;
 
-    // Initialize
     init_system_metrics();
     load_settings();
+    CloseHandle(CreateThread(NULL, 0, settings_watch_thread, hwnd, 0, NULL));
+    startup_phase("settings");
     autostart_enabled = is_autostart_enabled();
+    startup_phase("autostart registry");
 
     // Initialize language
     if (!LoadLanguageSelectionFromRegistry()) {
@@ -1322,6 +4215,181 @@ int WINAPI WinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, LPSTR lpCmdLine
         }
         SaveLanguageSelectionToRegistry();
     }
+    startup_phase("language");
+
+    label_table_load(&labels, LABELS_FILE, LABEL_TOTALS_FILE);
+    label_index_load(&labels, LABELS_INDEX_FILE);
+    load_hooks();
+    if (!replay_active) load_hotkeys(hwnd);
+    startup_phase("task labels");
+
+    load_adapt_mode();
+
+    // Resume the session of a previous run, or replace the pre-baked icon with the rendered one
+    if (!restore_session_state(hwnd)) {
+        update_tray_icon(hwnd, L"\u25BA", pomodoro_count, 0);
+    }
+    publish_status();
+    startup_phase("session restore and icon");
+
+    HANDLE history_thread = CreateThread(NULL, 0, history_load_thread, NULL, 0, NULL);
+    if (history_thread) {
+        SetThreadPriority(history_thread, THREAD_PRIORITY_BELOW_NORMAL);
+        CloseHandle(history_thread);
+    } else {
+        history_load_thread(NULL);
+    }
+
+    // Subscribe to a team daemon
+    if (g_team_path[0]) {
+        team_stop = CreateEventW(NULL, TRUE, FALSE, NULL);
+        if (team_stop) CloseHandle(CreateThread(NULL, 0, team_thread, hwnd, 0, NULL));
+    }
+
+    start_metrics();
+
+    if (g_memory_report) {
+        memory_report(hwnd);
+    }
+    if (g_tick_benchmark) {
+        tick_benchmark(hwnd);
+    }
+    if (g_launch_benchmark) {
+        // The launches wait for this thread to handle their commands
+        CloseHandle(CreateThread(NULL, 0, launch_benchmark_thread, NULL, 0, NULL));
+    }
+
+    // Apply a command given to the first instance
+    if (g_startup_label[0]) {
+        set_current_label(hwnd, g_startup_label);
+    }
+    if (g_startup_cmd == REMOTE_CMD_STATUS) {
+        print_status(pack_status());
+    } else if (g_startup_cmd) {
+        execute_remote_command(hwnd, g_startup_cmd);
+    }
+
+    if (replay_active) {
+        replay_tick_event = CreateEventW(NULL, FALSE, FALSE, NULL);
+        replay_tick_done = CreateEventW(NULL, FALSE, FALSE, NULL);
+        CloseHandle(CreateThread(NULL, 0, replay_thread, hwnd, 0, NULL));
+    }
+}
+
+// Main entry point
+int WINAPI WinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, LPSTR lpCmdLine, int nCmdShow) {
+    QueryPerformanceCounter(&g_startup_begin);
+    g_startup_last = g_startup_begin;
+
+    // Parse command line switches (e.g. --start-pomodoro, --stop, --status)
+    int argc = 0;
+    LPWSTR* argv = CommandLineToArgvW(GetCommandLineW(), &argc);
+    if (argv) {
+        for (int i = 1; i < argc; i++) {
+            int cmd = parse_remote_command(argv[i]);
+            int team_cmd = parse_team_command(argv[i]);
+            if (cmd) {
+                g_startup_cmd = cmd;
+            } else if (wcscmp(argv[i], L"--startup-timing") == 0) {
+                g_startup_timing = 1;
+            } else if (wcscmp(argv[i], L"--memory-report") == 0) {
+                g_memory_report = 1;
+            } else if (wcscmp(argv[i], L"--tick-benchmark") == 0) {
+                g_tick_benchmark = 1;
+            } else if (wcscmp(argv[i], L"--trace") == 0) {
+                g_trace = 1;
+            } else if (wcscmp(argv[i], L"--launch-benchmark") == 0) {
+                g_launch_benchmark = 1;
+            } else if (wcscmp(argv[i], L"--record") == 0 && i + 1 < argc) {
+                // Resolved now, as a replay changes the folder; created once this is the running instance
+                wchar_t full[MAX_PATH];
+                if (!GetFullPathNameW(argv[++i], MAX_PATH, full, NULL) ||
+                    !WideCharToMultiByte(CP_ACP, 0, full, -1, g_record_path, sizeof(g_record_path), NULL, NULL)) {
+                    console_print("Cannot create the recording\n");
+                    LocalFree(argv);
+                    return 1;
+                }
+            } else if (wcscmp(argv[i], L"--replay") == 0 && i + 1 < argc) {
+                // Resolved now: the replay runs in a folder of its own
+                wchar_t full[MAX_PATH];
+                if (!GetFullPathNameW(argv[++i], MAX_PATH, full, NULL) ||
+                    !WideCharToMultiByte(CP_ACP, 0, full, -1, g_replay_path, sizeof(g_replay_path), NULL, NULL)) {
+                    console_print("Cannot read the recording\n");
+                    LocalFree(argv);
+                    return 1;
+                }
+                replay_active = 1;
+            } else if (wcscmp(argv[i], L"--replay-speed") == 0 && i + 1 < argc) {
+                g_replay_speed = _wtof(argv[++i]);
+                if (g_replay_speed <= 0) g_replay_speed = 1.0;
+            } else if (wcscmp(argv[i], L"--label") == 0 && i + 1 < argc) {
+                wcsncpy(g_startup_label, argv[++i], LABEL_MAX_BYTES - 1);
+                if (!g_startup_cmd) g_startup_cmd = REMOTE_CMD_SET_LABEL;
+            } else if (wcscmp(argv[i], L"--team") == 0 && i + 1 < argc) {
+                team_pipe_name(argv[++i], g_team_path);
+            } else if (wcscmp(argv[i], L"--team-host") == 0 && i + 1 < argc) {
+                wchar_t pipe[MAX_PATH];
+                team_pipe_name(argv[++i], pipe);
+                LocalFree(argv);
+                return run_team_daemon(pipe);
+            } else if (team_cmd && i + 1 < argc) {
+                // Headless: send the command to the team daemon and exit
+                wchar_t pipe[MAX_PATH];
+                team_pipe_name(argv[++i], pipe);
+                LocalFree(argv);
+                load_settings();
+                return send_team_command(pipe, team_cmd);
+            } else if (wcscmp(argv[i], L"--stats") == 0) {
+                int ok = print_history_stats();
+                LocalFree(argv);
+                return ok ? 0 : 1;
+            } else if (wcscmp(argv[i], L"--team-report") == 0 && i + 1 < argc) {
+                // Headless: aggregate a folder of synced session logs and exit
+                int ok = write_team_report(argv[++i]);
+                LocalFree(argv);
+                return ok ? 0 : 1;
+            } else {
+                console_print("Usage: pomodoro-timer [--start-pomodoro | --start-break | --start-long-break | --stop | --toggle | --reset-count | --status] [--label <task>] [--startup-timing] [--memory-report] [--tick-benchmark] [--launch-benchmark] [--trace | --trace-dump] [--record <file> | --replay <file> [--replay-speed <x>]] [--team <name>] [--team-host <name>] [--team-start | --team-pause | --team-resume | --team-stop | --team-shutdown <name>] [--team-report <folder>] [--stats]\n");
+                LocalFree(argv);
+                return 2;
+            }
+        }
+        LocalFree(argv);
+    }
+    startup_phase("command line");
+    if (g_trace && trace_start()) TRACE_THREAD_NAME("main");
+    if (replay_active && !enter_replay_folder()) {
+        console_print("Cannot create a folder for the replay\n");
+        return 1;
+    }
+
+    HANDLE hEvent = CreateEventW(NULL, TRUE, FALSE, L"PomodoroTimerEvent");
+    if (GetLastError() == ERROR_ALREADY_EXISTS) {
+        // Fast path: hand the command to the running instance without loading the UI
+        if (g_startup_cmd) {
+            int result = forward_remote_command(g_startup_cmd);
+            startup_phase("forward command");
+            return result;
+        }
+        MessageBoxW(NULL, L"The program is already running. Exiting.", L"Warning", MB_OK | MB_ICONWARNING);
+        return 0;
+    }
+    startup_phase("instance check");
+
+    if (g_record_path[0]) {
+        record_out = replay_record_open(g_record_path);
+        if (!record_out) {
+            console_print("Cannot create the recording\n");
+            return 1;
+        }
+        InitializeCriticalSection(&record_lock);
+        record_start = GetTickCount();
+    }
+
+    InitializeCriticalSection(&state_lock);
+    InitializeCriticalSection(&sound_lock);
+    create_status_segment();
+    load_tray_sprites();
 
     // Create window class
     WNDCLASSW wc = {0};
@@ -1333,20 +4401,32 @@ int WINAPI WinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, LPSTR lpCmdLine
     // Create invisible window
     HWND hwnd = CreateWindowW(L"Pomodoro", L"Pomodoro", 0, 0, 0, 0, 0, NULL, NULL, hInstance, NULL);
     g_main_hwnd = hwnd;
+    startup_phase("window");
 
-    // Setup tray icon
+    // Setup tray icon with the pre-baked play symbol from the sprites (the
+    // application icon if they are missing); settings, registry and language
+    // are loaded after the message loop starts
     nid.cbSize = sizeof(NOTIFYICONDATA);
     nid.hWnd = hwnd;
     nid.uID = 1;
     nid.uFlags = NIF_ICON | NIF_MESSAGE | NIF_TIP;
     nid.uCallbackMessage = WM_USER + 1;
-    nid.hIcon = LoadIcon(NULL, IDI_APPLICATION);
+    nid.hIcon = sprite_icon(L"\u25BA", 0, TRAY_BACKGROUND);
+    if (nid.hIcon) {
+        // Owned by the icon cache, which hands it out again while nothing changed
+        last_icon = nid.hIcon;
+        wcscpy(last_text, L"\u25BA");
+        last_dots = 0;
+    } else {
+        nid.hIcon = LoadIconW(hInstance, L"IDI_ICON1");
+    }
+    if (!nid.hIcon) nid.hIcon = LoadIcon(NULL, IDI_APPLICATION);
     wcsncpy(nid.szTip, g_lang->tooltip_pomodoro, sizeof(nid.szTip)/sizeof(nid.szTip[0]) - 1);
     nid.szTip[sizeof(nid.szTip)/sizeof(nid.szTip[0]) - 1] = L'\0';
     Shell_NotifyIcon(NIM_ADD, &nid);
+    startup_phase("tray icon");
 
-    // Show initial icon
-    update_tray_icon(hwnd, L"\u25BA", pomodoro_count, 0);
+    PostMessage(hwnd, WM_DEFERRED_INIT, 0, 0);
 
     // Main message loop
     MSG msg;
@@ -1360,6 +4440,13 @@ int WINAPI WinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, LPSTR lpCmdLine
         DestroyIcon(last_icon);
         last_icon = NULL;
     }
+    if (ring_icon) {
+        DestroyIcon(ring_icon);
+        ring_icon = NULL;
+    }
+    free_countdown_cache();
+    if (ring_bitmap) DeleteObject(ring_bitmap);
+    if (ring_mask) DeleteObject(ring_mask);
 
     return 0;
 }
@@ -0,0 +1,176 @@
+// Pomodoro Timer trace recording
+//
+// With tracing on, the hot paths record begin/end spans and instant events
+// into a ring buffer per thread, and the buffers are written out on demand in
+// the Chrome trace-event JSON format (chrome://tracing, ui.perfetto.dev) to
+// see when stalls on different threads line up.
+//
+// Only the owning thread writes a ring, so recording takes no lock: it fills
+// the next slot and then publishes the new head. A ring keeps the last
+// TRACE_RING events; the dump copies them while the threads keep running and
+// drops any the writer may have overwritten meanwhile. With tracing off, the
+// TRACE_* macros cost one load and a branch, and no buffers are allocated.
+#ifndef POMODORO_TRACE_H
+#define POMODORO_TRACE_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <time.h>
+#endif
+
+#define TRACE_THREADS 16
+#define TRACE_RING 8192 // events per thread, a power of two
+
+#if defined(_MSC_VER) && !defined(__clang__)
+#define TRACE_THREAD_LOCAL __declspec(thread)
+#define TRACE_FENCE() MemoryBarrier()
+#define TRACE_CLAIM(flag) (InterlockedCompareExchange((volatile LONG*)(flag), 1, 0) == 0)
+#else
+#define TRACE_THREAD_LOCAL __thread
+#define TRACE_FENCE() __atomic_thread_fence(__ATOMIC_SEQ_CST)
+#define TRACE_CLAIM(flag) __sync_bool_compare_and_swap(flag, 0, 1)
+#endif
+
+typedef struct {
+    int64_t ts;        // trace_now() ticks
+    const char* name;  // must be a string literal
+    char phase;        // 'B' begin, 'E' end, 'i' instant
+} TraceEvent;
+
+typedef struct {
+    volatile int32_t owned; // 1 while a thread records into it
+    volatile uint32_t head; // events written so far
+    const char* thread;     // thread name, or NULL
+    TraceEvent events[TRACE_RING];
+} TraceRing;
+
+static volatile int trace_enabled = 0;
+static TraceRing* trace_rings = NULL;
+static int64_t trace_begin_ticks, trace_ticks_per_second;
+static TRACE_THREAD_LOCAL TraceRing* trace_ring_self = NULL;
+
+#define TRACE_BEGIN(name) do { if (trace_enabled) trace_event('B', name); } while (0)
+#define TRACE_END(name) do { if (trace_enabled) trace_event('E', name); } while (0)
+#define TRACE_INSTANT(name) do { if (trace_enabled) trace_event('i', name); } while (0)
+#define TRACE_THREAD_NAME(name) do { if (trace_enabled) trace_thread_name(name); } while (0)
+#define TRACE_THREAD_EXIT() do { if (trace_enabled) trace_thread_exit(); } while (0)
+
+static inline int64_t trace_now(void) {
+#ifdef _WIN32
+    LARGE_INTEGER now;
+    QueryPerformanceCounter(&now);
+    return now.QuadPart;
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+#endif
+}
+
+// Allocate the rings and start recording; returns 0 if out of memory
+static inline int trace_start(void) {
+    if (trace_enabled) return 1;
+    trace_rings = (TraceRing*)calloc(TRACE_THREADS, sizeof(TraceRing));
+    if (!trace_rings) return 0;
+#ifdef _WIN32
+    LARGE_INTEGER freq;
+    QueryPerformanceFrequency(&freq);
+    trace_ticks_per_second = freq.QuadPart;
+#else
+    trace_ticks_per_second = 1000000000;
+#endif
+    trace_begin_ticks = trace_now();
+    TRACE_FENCE();
+    trace_enabled = 1;
+    return 1;
+}
+
+// The calling thread's ring, claimed on first use; NULL once all are taken
+static inline TraceRing* trace_ring(void) {
+    for (int i = 0; !trace_ring_self && i < TRACE_THREADS; i++) {
+        if (TRACE_CLAIM(&trace_rings[i].owned)) trace_ring_self = &trace_rings[i];
+    }
+    return trace_ring_self;
+}
+
+static inline void trace_event(char phase, const char* name) {
+    TraceRing* r = trace_ring();
+    if (!r) return;
+    uint32_t head = r->head;
+    TraceEvent* e = &r->events[head & (TRACE_RING - 1)];
+    e->ts = trace_now();
+    e->name = name;
+    e->phase = phase;
+    TRACE_FENCE();
+    r->head = head + 1;
+}
+
+static inline void trace_thread_name(const char* name) {
+    TraceRing* r = trace_ring();
+    if (r) r->thread = name;
+}
+
+// Hand the ring of an exiting thread to the next thread, which continues its timeline
+static inline void trace_thread_exit(void) {
+    if (!trace_ring_self) return;
+    TRACE_FENCE();
+    trace_ring_self->owned = 0;
+    trace_ring_self = NULL;
+}
+
+// Write every ring as Chrome trace-event JSON; returns the number of events written
+static inline long trace_dump(const char* path) {
+    if (!trace_enabled) return 0;
+    char tmp[1024];
+    if (snprintf(tmp, sizeof(tmp), "%s.tmp", path) >= (int)sizeof(tmp)) return 0;
+    FILE* fp = fopen(tmp, "wb");
+    if (!fp) return 0;
+    TraceEvent* copy = (TraceEvent*)malloc(TRACE_RING * sizeof(TraceEvent));
+    if (!copy) {
+        fclose(fp);
+        return 0;
+    }
+    long written = 0;
+    fputs("{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n", fp);
+    for (int t = 0; t < TRACE_THREADS; t++) {
+        TraceRing* r = &trace_rings[t];
+        uint32_t head = r->head;
+        TRACE_FENCE();
+        if (head == 0) continue;
+        uint32_t start = head > TRACE_RING ? head - TRACE_RING : 0;
+        for (uint32_t i = start; i < head; i++) copy[i - start] = r->events[i & (TRACE_RING - 1)];
+        // Slots the writer reused during the copy may hold newer events; drop them
+        TRACE_FENCE();
+        uint32_t now_head = r->head;
+        uint32_t first = now_head >= TRACE_RING && now_head - TRACE_RING + 1 > start ? now_head - TRACE_RING + 1 : start;
+        const char* thread = r->thread;
+        if (thread) {
+            fprintf(fp, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":\"%s\"}}",
+                    written ? ",\n" : "", t + 1, thread);
+            written++;
+        }
+        for (uint32_t i = first; i < head; i++) {
+            const TraceEvent* e = &copy[i - start];
+            double us = (double)(e->ts - trace_begin_ticks) * 1e6 / (double)trace_ticks_per_second;
+            fprintf(fp, "%s{\"name\":\"%s\",\"ph\":\"%c\",\"ts\":%.3f,\"pid\":1,\"tid\":%d%s}", written ? ",\n" : "",
+                    e->name, e->phase, us, t + 1, e->phase == 'i' ? ",\"s\":\"t\"" : "");
+            written++;
+        }
+    }
+    fputs("\n]}\n", fp);
+    free(copy);
+    int ok = fclose(fp) == 0;
+#ifdef _WIN32
+    ok = ok && MoveFileExA(tmp, path, MOVEFILE_REPLACE_EXISTING);
+#else
+    ok = ok && rename(tmp, path) == 0;
+#endif
+    return ok ? written : 0;
+}
+
+#endif
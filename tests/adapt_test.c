@@ -0,0 +1,135 @@
+// Adaptive durations: replay synthetic histories of different habits through the model and check
+// what it suggests for each hour, and time an update and a suggestion.
+#include <math.h>
+#include <unistd.h>
+#include "pomodoro-adapt.h"
+#include "test.h"
+
+static unsigned seed;
+
+static double uniform(void) {
+    return (test_rand(&seed) & 0xFFFFFF) / (double)0x1000000;
+}
+
+static double gauss(void) {
+    double u = uniform() + 1e-9, v = uniform();
+    return sqrt(-2 * log(u)) * cos(2 * M_PI * v);
+}
+
+// Sixty days of three habits: mornings finished, afternoons stopped around 18 minutes, evenings
+// stopped anywhere
+static void test_habits(void) {
+    AdaptModel m;
+    memset(&m, 0, sizeof(m));
+    seed = 1;
+    for (int day = 0; day < 60; day++) {
+        adapt_record(&m, 9, uniform() < 0.9 ? 1500 : (int)(uniform() * 1500), uniform() < 0.9);
+        if (uniform() < 0.8) adapt_record(&m, 15, (int)((18 + 2 * gauss()) * 60), 0);
+        else adapt_record(&m, 15, 1500, 1);
+        if (uniform() < 0.8) adapt_record(&m, 21, (int)(60 + uniform() * 1400), 0);
+        else adapt_record(&m, 21, 1500, 1);
+    }
+    int afternoon = adapt_suggest(&m, 15, 25);
+    printf("  afternoon stops at 18 +- 2 min: %d min suggested (mean %.1f, sd %.1f)\n", afternoon, m.hours[15].stop_mean,
+           sqrtf(m.hours[15].stop_var));
+    CHECK(adapt_suggest(&m, 9, 25) == 25);
+    CHECK(afternoon >= 18 && afternoon < 25 && afternoon % ADAPT_BIN_MINUTES == 0);
+    CHECK(adapt_suggest(&m, 21, 25) == 25);
+    CHECK(adapt_suggest(&m, 3, 25) == 25);
+    CHECK(adapt_suggest(&m, 15, 15) == 15); // never longer than configured
+    CHECK(adapt_suggest(&m, -1, 25) == 25 && adapt_suggest(&m, 24, 25) == 25);
+
+    // The habit changes: afternoons are finished again, and the suggestion goes away
+    for (int i = 0; i < 40; i++) adapt_record(&m, 15, 1500, 1);
+    CHECK(adapt_suggest(&m, 15, 25) == 25);
+
+    // Saved and loaded unchanged; a file that is not a model loads as empty
+    char path[160];
+    const char* dir = test_temp_dir();
+    snprintf(path, sizeof(path), "%s/adapt.dat", dir);
+    AdaptModel loaded;
+    CHECK(adapt_save(&m, path) && adapt_load(&loaded, path) && memcmp(&loaded, &m, sizeof(m)) == 0);
+    FILE* fp = fopen(path, "wb");
+    fputs("xx", fp);
+    fclose(fp);
+    CHECK(!adapt_load(&loaded, path) && loaded.hours[9].sessions == 0);
+    remove(path);
+    CHECK(!adapt_load(&loaded, path));
+    rmdir(dir);
+}
+
+static void test_edges(void) {
+    AdaptModel m;
+
+    // Nothing is suggested before ADAPT_MIN_SESSIONS
+    memset(&m, 0, sizeof(m));
+    for (int i = 0; i < ADAPT_MIN_SESSIONS - 1; i++) adapt_record(&m, 10, 600, 0);
+    CHECK(adapt_suggest(&m, 10, 25) == 25);
+    adapt_record(&m, 10, 600, 0);
+    CHECK(adapt_suggest(&m, 10, 25) == 10);
+
+    // Stops in the first minute are misclicks
+    memset(&m, 0, sizeof(m));
+    for (int i = 0; i < 50; i++) adapt_record(&m, 10, 20, 0);
+    CHECK(m.hours[10].sessions == 0 && adapt_suggest(&m, 10, 25) == 25);
+    adapt_record(&m, 99, 600, 0); // an hour out of range is ignored
+
+    // Very early stops suggest no less than ADAPT_MIN_MINUTES
+    for (int i = 0; i < 20; i++) adapt_record(&m, 11, 120, 0);
+    CHECK(adapt_suggest(&m, 11, 25) == ADAPT_MIN_MINUTES);
+
+    // A full histogram bin halves them all
+    memset(&m, 0, sizeof(m));
+    for (int i = 0; i < 1000; i++) adapt_record(&m, 5, 12 * 60, 0);
+    CHECK(m.hours[5].stop_bins[2] >= 128 && m.hours[5].stop_bins[2] <= 255);
+    CHECK(adapt_suggest(&m, 5, 25) == 10);
+
+    CHECK(sizeof(AdaptModel) + 4 <= 2048);
+}
+
+// A year in which the afternoon stop point drifts from 12 to 20 minutes: the suggestion follows
+static void test_drift(void) {
+    AdaptModel m;
+    memset(&m, 0, sizeof(m));
+    seed = 7;
+    int early = 0;
+    for (int day = 0; day < 365; day++) {
+        double stop = 12 + 8.0 * day / 364;
+        for (int k = 0; k < 2; k++) {
+            if (uniform() < 0.85) adapt_record(&m, 14, (int)((stop + gauss()) * 60), 0);
+            else adapt_record(&m, 14, 1500, 1);
+        }
+        if (day == 60) early = adapt_suggest(&m, 14, 25);
+    }
+    int late = adapt_suggest(&m, 14, 25);
+    printf("  stop point drifting from 12 to 20 min: %d min suggested early, %d late\n", early, late);
+    CHECK(early >= 10 && early <= 15);
+    CHECK(late >= 20 && late <= 25 && late > early);
+}
+
+static void bench(void) {
+    AdaptModel m;
+    memset(&m, 0, sizeof(m));
+    int n = 10000000;
+    double begin = test_now();
+    for (int i = 0; i < n; i++) adapt_record(&m, i % 24, (i * 37) % 1500 + 60, i & 1);
+    double elapsed = test_now() - begin;
+    printf("adapt record            %8.2f ns/op  (model %zu bytes on disk)\n", elapsed * 1e9 / n, sizeof(m) + 4);
+    volatile int sink = 0;
+    begin = test_now();
+    for (int i = 0; i < n; i++) sink += adapt_suggest(&m, i % 24, 25);
+    elapsed = test_now() - begin;
+    printf("adapt suggest           %8.2f ns/op\n", elapsed * 1e9 / n);
+    (void)sink;
+}
+
+int main(int argc, char** argv) {
+    if (test_bench_mode(argc, argv)) {
+        bench();
+        return 0;
+    }
+    test_habits();
+    test_edges();
+    test_drift();
+    return test_done("adapt_test");
+}
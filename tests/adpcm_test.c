@@ -0,0 +1,298 @@
+// IMA ADPCM: encode synthetic signals, decode them with ima-adpcm.h and compare with the
+// original, check the inputs it must refuse, and decode the sounds the timer ships.
+#include <malloc.h>
+#include <math.h>
+#include <stdint.h>
+#include "ima-adpcm.h"
+#include "test.h"
+
+#define RATE 22050
+#define BLOCK_ALIGN 256
+
+// The nibble that gets the predictor closest to a sample, as the usual encoders pick it
+static int encode_nibble(int sample, int* predictor, int* index) {
+    int diff = sample - *predictor, nibble = 0;
+    int step = ima_step_table[*index];
+    if (diff < 0) {
+        nibble = 8;
+        diff = -diff;
+    }
+    if (diff >= step) { nibble |= 4; diff -= step; }
+    step >>= 1;
+    if (diff >= step) { nibble |= 2; diff -= step; }
+    step >>= 1;
+    if (diff >= step) nibble |= 1;
+    ima_decode_nibble(nibble, predictor, index); // keeps the encoder in step with the decoder
+    return nibble;
+}
+
+// Build an IMA ADPCM WAV file of interleaved 16-bit frames; returns its size
+static size_t encode_wav(const int16_t* pcm, size_t frames, int channels, uint8_t** out) {
+    size_t per_block = (size_t)(BLOCK_ALIGN - 4 * channels) * 2 / channels + 1;
+    size_t blocks = (frames + per_block - 1) / per_block;
+    size_t size = 60 + blocks * BLOCK_ALIGN;
+    uint8_t* wav = (uint8_t*)calloc(1, size);
+    memcpy(wav, "RIFF", 4);
+    ima_wr32(wav + 4, (uint32_t)size - 8);
+    memcpy(wav + 8, "WAVEfmt ", 8);
+    ima_wr32(wav + 16, 20);
+    ima_wr16(wav + 20, WAVE_FORMAT_IMA_ADPCM_TAG);
+    ima_wr16(wav + 22, (uint32_t)channels);
+    ima_wr32(wav + 24, RATE);
+    ima_wr32(wav + 28, RATE * BLOCK_ALIGN / (uint32_t)per_block);
+    ima_wr16(wav + 32, BLOCK_ALIGN);
+    ima_wr16(wav + 34, 4);
+    ima_wr16(wav + 36, 2);
+    ima_wr16(wav + 38, (uint32_t)per_block);
+    memcpy(wav + 40, "fact", 4);
+    ima_wr32(wav + 44, 4);
+    ima_wr32(wav + 48, (uint32_t)frames);
+    memcpy(wav + 52, "data", 4);
+    ima_wr32(wav + 56, (uint32_t)(blocks * BLOCK_ALIGN));
+
+    int predictor[2] = {0, 0}, index[2] = {0, 0};
+    for (size_t b = 0; b < blocks; b++) {
+        uint8_t* block = wav + 60 + b * BLOCK_ALIGN;
+        size_t first = b * per_block;
+        // The sample past the end repeats the last one, as in a padded last block
+        #define SAMPLE(f, c) pcm[((f) < frames ? (f) : frames - 1) * channels + (c)]
+        for (int c = 0; c < channels; c++) {
+            predictor[c] = SAMPLE(first, c);
+            ima_wr16(block + 4 * c, (uint16_t)predictor[c]);
+            block[4 * c + 2] = (uint8_t)index[c];
+        }
+        uint8_t* p = block + 4 * channels;
+        for (size_t f = first + 1; f + 8 <= first + per_block; f += 8) {
+            for (int c = 0; c < channels; c++) {
+                for (int i = 0; i < 8; i++) {
+                    int nibble = encode_nibble(SAMPLE(f + i, c), &predictor[c], &index[c]);
+                    p[i >> 1] |= (uint8_t)(nibble << ((i & 1) * 4));
+                }
+                p += 4;
+            }
+        }
+        #undef SAMPLE
+    }
+    *out = wav;
+    return size;
+}
+
+// Signal to noise ratio of a decoded channel against the original, in dB
+static double snr(const int16_t* original, const int16_t* decoded, size_t frames, int channels, int c) {
+    double signal = 0, noise = 0;
+    for (size_t i = 0; i < frames; i++) {
+        double s = original[i * channels + c], d = s - decoded[i * channels + c];
+        signal += s * s;
+        noise += d * d;
+    }
+    return noise == 0 ? 999 : 10 * log10(signal / noise);
+}
+
+// Encode, decode and check the PCM header and the length; returns the decoded samples
+static int16_t* round_trip(const int16_t* pcm, size_t frames, int channels) {
+    uint8_t *wav, *out;
+    size_t size = encode_wav(pcm, frames, channels, &wav);
+    size_t out_size = ima_adpcm_decode_wav(wav, size, &out);
+    free(wav);
+    CHECK(out_size == 44 + frames * channels * 2);
+    if (out_size != 44 + frames * channels * 2) {
+        free(out);
+        return NULL;
+    }
+    CHECK(memcmp(out, "RIFF", 4) == 0 && memcmp(out + 8, "WAVEfmt ", 8) == 0 && memcmp(out + 36, "data", 4) == 0);
+    CHECK(ima_rd16(out + 20) == WAVE_FORMAT_PCM_TAG && ima_rd16(out + 22) == channels && ima_rd32(out + 24) == RATE);
+    CHECK(ima_rd16(out + 34) == 16 && ima_rd32(out + 40) == frames * channels * 2);
+    int16_t* decoded = (int16_t*)malloc(frames * channels * 2);
+    memcpy(decoded, out + 44, frames * channels * 2);
+    free(out);
+    return decoded;
+}
+
+static void test_mono_sine(void) {
+    size_t frames = RATE + 123; // not a whole number of blocks
+    int16_t* pcm = (int16_t*)malloc(frames * 2);
+    for (size_t i = 0; i < frames; i++) pcm[i] = (int16_t)(12000 * sin(2 * M_PI * 440 * i / RATE));
+    int16_t* decoded = round_trip(pcm, frames, 1);
+    if (decoded) {
+        double db = snr(pcm, decoded, frames, 1, 0);
+        printf("  mono 440 Hz sine: %.1f dB\n", db);
+        CHECK(db > 30);
+    }
+    free(pcm);
+    free(decoded);
+}
+
+static void test_stereo(void) {
+    size_t frames = RATE / 2;
+    int16_t* pcm = (int16_t*)malloc(frames * 4);
+    for (size_t i = 0; i < frames; i++) {
+        pcm[i * 2] = (int16_t)(10000 * sin(2 * M_PI * 330 * i / RATE));
+        pcm[i * 2 + 1] = (int16_t)(6000 * sin(2 * M_PI * 1200 * i / RATE));
+    }
+    int16_t* decoded = round_trip(pcm, frames, 2);
+    if (decoded) {
+        double left = snr(pcm, decoded, frames, 2, 0), right = snr(pcm, decoded, frames, 2, 1);
+        printf("  stereo sines: left %.1f dB, right %.1f dB\n", left, right);
+        CHECK(left > 30 && right > 20);
+    }
+    free(pcm);
+    free(decoded);
+}
+
+static void test_edges(void) {
+    // Silence stays exactly silent
+    size_t frames = 3000;
+    int16_t* pcm = (int16_t*)calloc(frames, 2);
+    int16_t* decoded = round_trip(pcm, frames, 1);
+    int silent = decoded != NULL;
+    for (size_t i = 0; decoded && i < frames; i++) silent &= decoded[i] == 0;
+    CHECK(silent);
+    free(decoded);
+
+    // A full-scale square wave saturates without wrapping around
+    for (size_t i = 0; i < frames; i++) pcm[i] = (i / 50) % 2 ? 32767 : -32768;
+    decoded = round_trip(pcm, frames, 1);
+    if (decoded) {
+        int wrapped = 0;
+        for (size_t i = 1; i < frames; i++) wrapped |= pcm[i] > 0 && decoded[i] < -30000 && decoded[i - 1] > 30000;
+        CHECK(!wrapped);
+        CHECK(snr(pcm, decoded, frames, 1, 0) > 3); // each full-scale jump takes a few samples to reach
+    }
+    free(decoded);
+
+    // Noise, the worst case for a predictor
+    unsigned seed = 1;
+    for (size_t i = 0; i < frames; i++) pcm[i] = (int16_t)((int)(test_rand(&seed) % 16001) - 8000);
+    decoded = round_trip(pcm, frames, 1);
+    if (decoded) CHECK(snr(pcm, decoded, frames, 1, 0) > 5);
+    free(decoded);
+    free(pcm);
+}
+
+static void test_refused(void) {
+    int16_t pcm[505 * 2] = {0};
+    uint8_t *wav, *out = (uint8_t*)1;
+    size_t size = encode_wav(pcm, 505 * 2, 1, &wav);
+    CHECK(ima_adpcm_decode_wav("RIFX", 4, &out) == 0 && out == NULL);
+    CHECK(ima_adpcm_decode_wav(wav, 12, &out) == 0);
+    CHECK(ima_adpcm_decode_wav(wav, 30, &out) == 0); // fmt chunk cut short
+    ima_wr16(wav + 20, 0x0055);                     // MP3
+    CHECK(ima_adpcm_decode_wav(wav, size, &out) == 0);
+    ima_wr16(wav + 20, WAVE_FORMAT_IMA_ADPCM_TAG);
+    ima_wr16(wav + 22, 3);
+    CHECK(ima_adpcm_decode_wav(wav, size, &out) == 0);
+    ima_wr16(wav + 22, 1);
+    ima_wr16(wav + 32, 4); // a block with only a header
+    CHECK(ima_adpcm_decode_wav(wav, size, &out) == 0);
+    ima_wr16(wav + 32, BLOCK_ALIGN);
+
+    // A file cut in the middle of a block decodes what is there, and no more
+    size_t frames_cut = ima_adpcm_decode_wav(wav, size - BLOCK_ALIGN / 2, &out);
+    CHECK(frames_cut > 44 && frames_cut < 44 + 505 * 2 * 2);
+    free(out);
+    free(wav);
+
+    // Plain PCM is copied unchanged
+    uint8_t plain[44 + 8] = "RIFF";
+    ima_wr32(plain + 4, sizeof(plain) - 8);
+    memcpy(plain + 8, "WAVEfmt ", 8);
+    ima_wr32(plain + 16, 16);
+    ima_wr16(plain + 20, WAVE_FORMAT_PCM_TAG);
+    ima_wr16(plain + 22, 1);
+    ima_wr32(plain + 24, RATE);
+    ima_wr32(plain + 28, RATE * 2);
+    ima_wr16(plain + 32, 2);
+    ima_wr16(plain + 34, 16);
+    memcpy(plain + 36, "data", 4);
+    ima_wr32(plain + 40, 8);
+    CHECK(ima_adpcm_decode_wav(plain, sizeof(plain), &out) == sizeof(plain) && memcmp(out, plain, sizeof(plain)) == 0);
+    free(out);
+}
+
+static uint8_t* read_file(const char* path, size_t* size) {
+    FILE* fp = fopen(path, "rb");
+    if (!fp) return NULL;
+    fseek(fp, 0, SEEK_END);
+    *size = (size_t)ftell(fp);
+    fseek(fp, 0, SEEK_SET);
+    uint8_t* data = (uint8_t*)malloc(*size);
+    if (fread(data, 1, *size, fp) != *size) *size = 0;
+    fclose(fp);
+    return data;
+}
+
+// The sounds linked into the timer are IMA ADPCM and decode to the length their fact chunk gives
+static void test_shipped_sounds(void) {
+    static const char* files[] = {"../clock.wav", "../ding.wav"};
+    for (int i = 0; i < 2; i++) {
+        size_t size = 0, out_size;
+        uint8_t *wav = read_file(files[i], &size), *out;
+        CHECK(wav != NULL && size > 0);
+        if (!wav) continue;
+        uint32_t fmt_size, fact_size;
+        const uint8_t* fmt = ima_find_chunk(wav, size, "fmt ", &fmt_size);
+        const uint8_t* fact = ima_find_chunk(wav, size, "fact", &fact_size);
+        CHECK(fmt && ima_rd16(fmt) == WAVE_FORMAT_IMA_ADPCM_TAG && fact);
+        out_size = ima_adpcm_decode_wav(wav, size, &out);
+        CHECK(fmt && fact && out_size == 44 + (size_t)ima_rd32(fact) * ima_rd16(fmt + 2) * 2);
+        printf("  %s: %zu bytes, %zu bytes of PCM\n", files[i] + 3, size, out_size);
+        free(out);
+        free(wav);
+    }
+}
+
+// What the timer's sound cache costs: the heap in use with both sounds decoded, and after they are
+// evicted as idle, which must give all of it back
+static void test_sound_cache(void) {
+    static const char* files[] = {"../clock.wav", "../ding.wav"};
+    uint8_t* wav[2];
+    size_t size[2] = {0, 0};
+    for (int i = 0; i < 2; i++) wav[i] = read_file(files[i], &size[i]);
+    CHECK(wav[0] && wav[1]);
+    if (!wav[0] || !wav[1]) return;
+
+    uint8_t* pcm[2];
+    size_t before = mallinfo2().uordblks;
+    for (int i = 0; i < 2; i++) ima_adpcm_decode_wav(wav[i], size[i], &pcm[i]);
+    size_t cached = mallinfo2().uordblks;
+    for (int i = 0; i < 2; i++) free(pcm[i]);
+    size_t evicted = mallinfo2().uordblks;
+    printf("  sound cache: %zu bytes of heap before, %zu with both sounds decoded, %zu after eviction\n", before,
+           cached, evicted);
+    CHECK(cached > before && evicted == before);
+    for (int i = 0; i < 2; i++) free(wav[i]);
+}
+
+static void bench(void) {
+    size_t size = 0;
+    uint8_t* wav = read_file("../ding.wav", &size);
+    if (!wav) {
+        fprintf(stderr, "Cannot read ../ding.wav\n");
+        return;
+    }
+    uint8_t* out;
+    size_t out_size = 0;
+    int n = 2000;
+    double begin = test_now();
+    for (int i = 0; i < n; i++) {
+        out_size = ima_adpcm_decode_wav(wav, size, &out);
+        free(out);
+    }
+    double elapsed = test_now() - begin;
+    printf("adpcm decode ding.wav %8.1f us/op  %7.1f MB/s of PCM\n", elapsed * 1e6 / n, out_size * (double)n / elapsed / 1e6);
+    free(wav);
+}
+
+int main(int argc, char** argv) {
+    if (test_bench_mode(argc, argv)) {
+        bench();
+        return 0;
+    }
+    test_mono_sine();
+    test_stereo();
+    test_edges();
+    test_refused();
+    test_shipped_sounds();
+    test_sound_cache();
+    return test_done("adpcm_test");
+}
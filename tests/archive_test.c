@@ -0,0 +1,300 @@
+// History archive: compact synthetic logs, compare the archived rows and filtered sums with the
+// rows of the log, take the failure and crash paths, and benchmark scans and size against the log.
+#include <sys/stat.h>
+#include <unistd.h>
+#include "pomodoro-archive.h"
+#include "test.h"
+
+static const char* kinds[] = {"pomodoro", "short_break", "long_break"};
+static const char* outcomes[] = {"completed", "stopped", "expired"};
+static char log_path[128], arc_path[128];
+
+// Write a time-ordered log of n sessions from start; rows gets what each line holds.
+// wide adds long sessions, many labels and a jump of more than 2^32 seconds. Returns the next start.
+static int64_t write_log(const char* path, ArchiveRow* rows, int n, int64_t start, unsigned seed, int wide) {
+    FILE* fp = fopen(path, "ab");
+    for (int i = 0; i < n; i++) {
+        unsigned r = test_rand(&seed);
+        ArchiveRow* row = &rows[i];
+        row->start = start;
+        row->kind = (uint8_t)(r % 3);
+        row->outcome = (uint8_t)(r % 10 < 8 ? 0 : (r >> 4) % 3);
+        row->planned = row->kind == 0 ? 1500 : 300;
+        if (wide && r % 97 == 0) row->planned = 100000;
+        row->actual = row->outcome == 1 ? (r >> 6) % row->planned : row->planned;
+        row->focus = row->kind == 0 && (r >> 3) % 5 ? (uint8_t)((r >> 9) % 101) : ARCHIVE_NO_FOCUS;
+        row->label = (r >> 12) % 4 ? (uint32_t)((r >> 14) % (wide ? 1000 : 40)) : 0;
+        fprintf(fp, "%lld,%s,%u,%u,%s", (long long)row->start, kinds[row->kind], row->planned, row->actual,
+                outcomes[row->outcome]);
+        // Old logs have no focus or label column, and a missing value is an empty field
+        if (row->focus != ARCHIVE_NO_FOCUS || row->label) fprintf(fp, ",");
+        if (row->focus != ARCHIVE_NO_FOCUS) fprintf(fp, "%u", row->focus);
+        if (row->label) fprintf(fp, ",%u", row->label);
+        fprintf(fp, i % 500 == 0 ? "\r\n" : "\n");
+        start += 600 + (r >> 5) % 5000;
+        if (wide && i == n / 2) start += 5000000000LL;
+    }
+    fclose(fp);
+    return start;
+}
+
+static int same_row(const ArchiveRow* a, const ArchiveRow* b) {
+    return a->start == b->start && a->kind == b->kind && a->outcome == b->outcome && a->planned == b->planned &&
+           a->actual == b->actual && a->focus == b->focus && a->label == b->label;
+}
+
+static ArchiveFilter random_filter(unsigned* seed, int64_t first, int64_t last) {
+    ArchiveFilter f = archive_filter_all();
+    unsigned r = test_rand(seed);
+    if (r % 2) {
+        f.from = first + (int64_t)(test_rand(seed) % 1000) * ((last - first) / 1000);
+        f.to = f.from + (int64_t)(test_rand(seed) % 1000) * ((last - first) / 2000);
+    }
+    if (r % 3 == 0) f.codes = (uint16_t)(test_rand(seed) & ARCHIVE_ALL_CODES);
+    if (r % 5 == 0) f.label = test_rand(seed) % 60;
+    if (r % 7 == 0) {
+        f.min_actual = test_rand(seed) % 1500;
+        f.max_actual = f.min_actual + test_rand(seed) % 2000;
+    }
+    return f;
+}
+
+// Everything in the archive is the rows the log had before cutoff, and scans agree with the rows
+static void check_archive(const ArchiveRow* rows, int archived, int64_t first, int64_t last) {
+    Archive a;
+    ArchiveRow* got;
+    CHECK(archive_load(&a, arc_path));
+    size_t n = archive_read_rows(&a, &got);
+    CHECK(n == (size_t)archived);
+    int same = n == (size_t)archived;
+    for (size_t i = 0; same && i < n; i++) same = same_row(&got[i], &rows[i]);
+    CHECK(same);
+    free(got);
+
+    unsigned seed = 5;
+    for (int q = 0; q < 300; q++) {
+        ArchiveFilter f = q == 0 ? archive_filter_all() : random_filter(&seed, first, last);
+        ArchiveSum scan = {0}, want = {0};
+        archive_scan(&a, &f, &scan);
+        for (int i = 0; i < archived; i++) {
+            if (archive_row_matches(&rows[i], &f)) archive_sum_row(&rows[i], &want);
+        }
+        if (memcmp(&scan, &want, sizeof(want)) != 0) {
+            fprintf(stderr, "  filter %d: %llu rows instead of %llu\n", q, (unsigned long long)scan.rows,
+                    (unsigned long long)want.rows);
+        }
+        CHECK(memcmp(&scan, &want, sizeof(want)) == 0);
+    }
+    archive_free(&a);
+}
+
+static void test_compact(int wide) {
+    int n = 20000;
+    ArchiveRow* rows = (ArchiveRow*)malloc(n * sizeof(ArchiveRow));
+    remove(log_path);
+    remove(arc_path);
+    int64_t first = 1300000000, last = write_log(log_path, rows, n, first, 1, wide);
+    ArchiveRow parsed;
+    size_t size, rest_size;
+    char* log = archive_read_file(log_path, &size);
+    CHECK(archive_parse_line(log, &parsed) && same_row(&parsed, &rows[0]));
+
+    // Nothing is due while the oldest row is within the slack
+    CHECK(archive_compact(log_path, arc_path, first + 100, 1000) == 0);
+
+    // Archive in two steps, the second appending blocks to the first
+    int64_t cut1 = rows[n / 3].start, cut2 = rows[n * 3 / 4].start;
+    CHECK(archive_compact(log_path, arc_path, cut1, 0) == n / 3);
+    CHECK(archive_compact(log_path, arc_path, cut2, 0) == n * 3 / 4 - n / 3);
+    CHECK(archive_compact(log_path, arc_path, cut2, 0) == 0);
+    char* rest = archive_read_file(log_path, &rest_size);
+    Archive a;
+    archive_load(&a, arc_path);
+    CHECK(a.archived_bytes + rest_size == size && memcmp(rest, log + a.archived_bytes, rest_size) == 0);
+    archive_free(&a);
+    check_archive(rows, n * 3 / 4, first, last);
+    free(rest);
+    free(log);
+    free(rows);
+}
+
+// Lines the archive cannot take, and a torn last line
+static void test_odd_lines(void) {
+    ArchiveRow rows[3];
+    remove(log_path);
+    remove(arc_path);
+    int64_t next = write_log(log_path, rows, 2, 1300000000, 2, 0);
+    FILE* fp = fopen(log_path, "ab");
+    fprintf(fp, "garbage\n%lld,pomodoro,1500,1500,completed,50,7\n%lld,pomodoro,15", (long long)next, (long long)next + 1);
+    fclose(fp);
+    rows[2].start = next;
+    rows[2].kind = 0;
+    rows[2].outcome = 0;
+    rows[2].planned = rows[2].actual = 1500;
+    rows[2].focus = 50;
+    rows[2].label = 7;
+    CHECK(archive_compact(log_path, arc_path, next + 1000, 0) == 3);
+    size_t size;
+    char* rest = archive_read_file(log_path, &size);
+    CHECK(rest && strchr(rest, '\n') == NULL && strstr(rest, "pomodoro,15") != NULL);
+    free(rest);
+    check_archive(rows, 3, 1300000000, next);
+}
+
+// A failed log rewrite leaves the prefix pending, and the next run finishes it without archiving
+// the rows twice; an archive that cannot be written leaves the log alone
+static void test_errors(void) {
+    int n = 1000;
+    ArchiveRow rows[1000];
+    char tmp[160];
+    size_t size, now_size;
+    remove(log_path);
+    remove(arc_path);
+    write_log(log_path, rows, n, 1300000000, 3, 0);
+    char* log = archive_read_file(log_path, &size);
+
+    CHECK(archive_compact(log_path, "/nonexistent-pomodoro-folder/history.arc", rows[500].start, 0) == -1);
+    char* now = archive_read_file(log_path, &now_size);
+    CHECK(now_size == size && memcmp(now, log, size) == 0);
+    free(now);
+
+    snprintf(tmp, sizeof(tmp), "%s.tmp", log_path);
+    mkdir(tmp, 0755); // the rewrite cannot create its temporary file
+    CHECK(archive_compact(log_path, arc_path, rows[500].start, 0) == 500);
+    now = archive_read_file(log_path, &now_size);
+    CHECK(now_size == size);
+    free(now);
+    FILE* fp = fopen(arc_path, "rb");
+    ArchiveHeader hdr;
+    CHECK(fp && fread(&hdr, sizeof(hdr), 1, fp) == 1 && hdr.pending_bytes > 0 && hdr.row_count == 500);
+    if (fp) fclose(fp);
+    size_t prefix = (size_t)hdr.pending_bytes;
+    rmdir(tmp);
+
+    CHECK(archive_compact(log_path, arc_path, rows[500].start, 0) == 0);
+    now = archive_read_file(log_path, &now_size);
+    CHECK(now_size == size - prefix && memcmp(now, log + prefix, now_size) == 0);
+    free(now);
+    check_archive(rows, 500, rows[0].start, rows[n - 1].start);
+
+    // A crash after the log was put back by hand (or restored from a backup) with the prefix
+    // still pending: the next run drops the prefix again, as it is the same bytes
+    fp = fopen(log_path, "wb");
+    fwrite(log, 1, size, fp);
+    fclose(fp);
+    fp = fopen(arc_path, "r+b");
+    CHECK(fp && fread(&hdr, sizeof(hdr), 1, fp) == 1);
+    hdr.pending_bytes = prefix;
+    hdr.pending_hash = archive_hash(log, prefix);
+    fseek(fp, 0, SEEK_SET);
+    fwrite(&hdr, sizeof(hdr), 1, fp);
+    fclose(fp);
+    CHECK(archive_compact(log_path, arc_path, rows[500].start, 0) == 0);
+    now = archive_read_file(log_path, &now_size);
+    CHECK(now_size == size - prefix);
+    free(now);
+    check_archive(rows, 500, rows[0].start, rows[n - 1].start);
+    free(log);
+
+    // An archive of another version is not touched
+    fp = fopen(arc_path, "r+b");
+    hdr.version = ARCHIVE_VERSION + 1;
+    hdr.pending_bytes = 0;
+    fwrite(&hdr, sizeof(hdr), 1, fp);
+    fclose(fp);
+    CHECK(archive_compact(log_path, arc_path, rows[900].start, 0) == -1);
+    Archive a;
+    CHECK(archive_load(&a, arc_path) == 0 && a.data == NULL);
+    now = archive_read_file(log_path, &now_size);
+    CHECK(now_size == size - prefix);
+    free(now);
+}
+
+// Years of history: scans of the archive against parsing the log and against an array of rows
+static void bench(void) {
+    const int n = 1000000;
+    ArchiveRow* rows = (ArchiveRow*)malloc(n * sizeof(ArchiveRow));
+    remove(log_path);
+    remove(arc_path);
+    int64_t first = 1300000000, last = write_log(log_path, rows, n, first, 1, 0);
+    size_t log_size, rest_size;
+    char* log = archive_read_file(log_path, &log_size);
+
+    double begin = test_now();
+    long archived = archive_compact(log_path, arc_path, last, 0);
+    double elapsed = test_now() - begin;
+    Archive a;
+    archive_load(&a, arc_path);
+    char* rest = archive_read_file(log_path, &rest_size);
+    printf("archive compact         %8.1f ms     (%ld rows, %zu bytes left in the log)\n", elapsed * 1e3, archived, rest_size);
+    printf("archive size            %8.2f MB     log %.2f MB, %.1f bytes/row against %.1f\n", a.size / 1e6,
+           log_size / 1e6, (double)a.size / n, (double)log_size / n);
+
+    static const char* names[] = {"all", "1 year", "completed pomodoros", "one label", "stopped 5-20 min"};
+    ArchiveFilter filters[5];
+    for (int q = 0; q < 5; q++) filters[q] = archive_filter_all();
+    filters[1].from = first + 365 * 86400LL * 3;
+    filters[1].to = filters[1].from + 365 * 86400LL;
+    filters[2].codes = 1 << ARCHIVE_CODE(0, 0);
+    filters[3].label = 7;
+    filters[4].codes = 1 << ARCHIVE_CODE(0, 1);
+    filters[4].min_actual = 300;
+    filters[4].max_actual = 1200;
+    for (int q = 0; q < 5; q++) {
+        ArchiveSum scan = {0}, parse = {0}, array = {0};
+        int reps = 20;
+        begin = test_now();
+        for (int r = 0; r < reps; r++) {
+            memset(&scan, 0, sizeof(scan));
+            archive_scan(&a, &filters[q], &scan);
+        }
+        double t_scan = (test_now() - begin) / reps;
+
+        begin = test_now();
+        for (int r = 0; r < 2; r++) {
+            memset(&parse, 0, sizeof(parse));
+            for (const char* p = log; *p;) {
+                ArchiveRow row;
+                if (archive_parse_line(p, &row) && archive_row_matches(&row, &filters[q])) archive_sum_row(&row, &parse);
+                p = strchr(p, '\n') + 1;
+            }
+        }
+        double t_parse = (test_now() - begin) / 2;
+
+        begin = test_now();
+        for (int r = 0; r < reps; r++) {
+            memset(&array, 0, sizeof(array));
+            for (int i = 0; i < n; i++) {
+                if (archive_row_matches(&rows[i], &filters[q])) archive_sum_row(&rows[i], &array);
+            }
+        }
+        double t_array = (test_now() - begin) / reps;
+        if (memcmp(&scan, &parse, sizeof(scan)) != 0 || memcmp(&scan, &array, sizeof(scan)) != 0) {
+            fprintf(stderr, "%s: the sums differ\n", names[q]);
+        }
+        printf("archive %-19s %7.2f ms scan  %8.2f ms log  %6.2f ms rows  (%llu rows)\n", names[q], t_scan * 1e3,
+               t_parse * 1e3, t_array * 1e3, (unsigned long long)scan.rows);
+    }
+    archive_free(&a);
+    free(rest);
+    free(log);
+    free(rows);
+}
+
+int main(int argc, char** argv) {
+    const char* dir = test_temp_dir();
+    snprintf(log_path, sizeof(log_path), "%s/history.csv", dir);
+    snprintf(arc_path, sizeof(arc_path), "%s/history.arc", dir);
+    if (test_bench_mode(argc, argv)) {
+        bench();
+    } else {
+        test_compact(0);
+        test_compact(1);
+        test_odd_lines();
+        test_errors();
+    }
+    remove(log_path);
+    remove(arc_path);
+    rmdir(dir);
+    return test_bench_mode(argc, argv) ? 0 : test_done("archive_test");
+}
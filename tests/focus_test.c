@@ -0,0 +1,114 @@
+// Focus sampler: compare the incremental score with one computed from the whole activity
+// trace, and time a sample.
+#include "pomodoro-focus.h"
+#include "test.h"
+
+// Feed a trace of activity bits through the sampler as the timer does, one-second ticks
+// with an input time that moves when there was input; returns the score
+static int run_trace(const unsigned char* active, int samples) {
+    FocusSampler f;
+    uint32_t input = 1000;
+    focus_sampler_reset(&f, input);
+    for (int i = 0; i < samples; i++) {
+        if (active[i]) input += 7;
+        for (int s = 0; s < FOCUS_SAMPLE_SECONDS; s++) {
+            if (focus_sampler_tick(&f, 1)) focus_sampler_add(&f, input);
+        }
+    }
+    CHECK(f.samples == samples);
+    return focus_sampler_score(&f);
+}
+
+// The same score, straight from the definition
+static int reference_score(const unsigned char* active, int samples) {
+    if (samples == 0) return -1;
+    int focused = 0;
+    for (int i = 0; i < samples; i++) {
+        int any = 0;
+        for (int j = i - FOCUS_WINDOW_SAMPLES + 1; j <= i; j++) any |= j >= 0 && active[j];
+        focused += any;
+    }
+    return focused * 100 / samples;
+}
+
+#define MAX_SAMPLES (120 * 60 / FOCUS_SAMPLE_SECONDS) // longest Pomodoro the settings allow
+
+static void test_scores(void) {
+    static unsigned char active[MAX_SAMPLES];
+    CHECK(run_trace(active, 0) == -1);
+
+    memset(active, 0, sizeof(active));
+    CHECK(run_trace(active, 300) == 0);
+    memset(active, 1, sizeof(active));
+    CHECK(run_trace(active, 300) == 100);
+
+    // One input covers itself and the rest of its window
+    memset(active, 0, sizeof(active));
+    active[10] = 1;
+    CHECK(run_trace(active, 100) == FOCUS_WINDOW_SAMPLES);
+
+    // Random traces of every density and length, many times around the ring
+    unsigned seed = 7;
+    for (int n = 0; n < 2000; n++) {
+        int samples = 1 + (int)(test_rand(&seed) % MAX_SAMPLES);
+        unsigned density = test_rand(&seed) % 101;
+        // Runs of activity and idleness, like real work
+        int on = 0;
+        for (int i = 0; i < samples; i++) {
+            if (test_rand(&seed) % 100 < 10) on = test_rand(&seed) % 100 < density;
+            active[i] = (unsigned char)on;
+        }
+        int got = run_trace(active, samples), want = reference_score(active, samples);
+        if (got != want) fprintf(stderr, "  %d samples at %u%%: %d instead of %d\n", samples, density, got, want);
+        CHECK(got == want);
+    }
+}
+
+static void test_ticks(void) {
+    // Ticks longer than a second (a late wakeup) still give one sample per period at most
+    FocusSampler f;
+    focus_sampler_reset(&f, 0);
+    int due = 0;
+    for (int i = 0; i < 10; i++) due += focus_sampler_tick(&f, 3);
+    CHECK(due == 30 / FOCUS_SAMPLE_SECONDS);
+    CHECK(focus_sampler_tick(&f, FOCUS_SAMPLE_SECONDS) == 1);
+}
+
+static void bench(void) {
+    FocusSampler f;
+    focus_sampler_reset(&f, 0);
+    unsigned seed = 1;
+    int n = 100000000;
+    double begin = test_now();
+    for (int i = 0; i < n; i++) {
+        focus_sampler_add(&f, test_rand(&seed) & 0x1000);
+        if (f.samples == MAX_SAMPLES) focus_sampler_reset(&f, f.last_input);
+    }
+    double elapsed = test_now() - begin;
+    printf("focus sample            %5.2f ns/op  (score %d)\n", elapsed * 1e9 / n, focus_sampler_score(&f));
+
+    // A whole 25 minute Pomodoro: 1500 ticks and 300 samples
+    n = 100000;
+    volatile int sink = 0;
+    begin = test_now();
+    for (int i = 0; i < n; i++) {
+        focus_sampler_reset(&f, 0);
+        for (int s = 0; s < 1500; s++) {
+            if (focus_sampler_tick(&f, 1)) focus_sampler_add(&f, (uint32_t)(s / 90));
+        }
+        sink += focus_sampler_score(&f);
+    }
+    elapsed = test_now() - begin;
+    printf("focus 25 min session    %5.2f us/op  (%d bytes of state)\n", elapsed * 1e6 / n, (int)sizeof(FocusSampler));
+    (void)sink;
+}
+
+int main(int argc, char** argv) {
+    if (test_bench_mode(argc, argv)) {
+        bench();
+        return 0;
+    }
+    test_scores();
+    test_ticks();
+    return test_done("focus_test");
+}
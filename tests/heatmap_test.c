@@ -0,0 +1,184 @@
+// Calendar heatmap: day numbers and the counters file, and month tiles compared pixel by pixel
+// with the golden images in golden/. Run with --update to rewrite them after a deliberate change
+// to the drawing, and look at the new images before committing them.
+#include <unistd.h>
+#include "pomodoro-heatmap.h"
+#include "test.h"
+
+#define TILE_PIXELS (HEATMAP_TILE_WIDTH * HEATMAP_TILE_HEIGHT)
+
+static void test_days(void) {
+    CHECK(heatmap_day_number(1601, 1, 1) == 0);
+    CHECK(heatmap_day_number(1970, 1, 1) == 134774);
+    CHECK(heatmap_day_number(2024, 1, 1) % 7 == 0); // a Monday
+    CHECK(heatmap_day_number(2024, 3, 1) - heatmap_day_number(2024, 2, 28) == 2);
+    CHECK(heatmap_day_number(2100, 3, 1) - heatmap_day_number(2100, 2, 28) == 1);
+    CHECK(heatmap_days_in_month(2000, 2) == 29 && heatmap_days_in_month(1900, 2) == 28 && heatmap_days_in_month(2023, 12) == 31);
+
+    HeatmapDays d = {0}, e;
+    int32_t march = heatmap_day_number(2024, 3, 1);
+    for (int i = 0; i < 31; i++) heatmap_days_add(&d, march + i, i % 10);
+    CHECK(heatmap_days_add(&d, heatmap_day_number(2014, 12, 25), 3)); // grows to the front
+    CHECK(heatmap_days_add(&d, heatmap_day_number(2034, 1, 1), 1));   // and to the back
+    CHECK(!heatmap_days_add(&d, -1, 1));
+    CHECK(heatmap_days_get(&d, march + 4) == 4 && heatmap_days_get(&d, heatmap_day_number(2014, 12, 25)) == 3);
+    CHECK(heatmap_days_get(&d, heatmap_day_number(2014, 12, 24)) == 0 && heatmap_days_get(&d, march + 400) == 0);
+    heatmap_days_add(&d, march, 70000);
+    heatmap_days_add(&d, march + 1, -5);
+    CHECK(heatmap_days_get(&d, march) == 0xFFFF && heatmap_days_get(&d, march + 1) == 0);
+
+    uint16_t values[31];
+    heatmap_month_values(&d, 2024, 2, values);
+    CHECK(values[28] == 0 && values[29] == 0); // no March days in February
+    heatmap_month_values(&d, 2024, 3, values);
+    CHECK(values[9] == 9 && values[30] == 0);
+
+    char path[128];
+    snprintf(path, sizeof(path), "%s/days.dat", test_temp_dir());
+    CHECK(heatmap_days_save(&d, path));
+    CHECK(heatmap_days_load(&e, path) && e.first_day == d.first_day && e.count == d.count &&
+          memcmp(e.values, d.values, d.count * sizeof(uint16_t)) == 0);
+    CHECK(e.count < 8000); // twenty years
+    heatmap_days_free(&e);
+    FILE* fp = fopen(path, "r+b");
+    fputc('X', fp);
+    fclose(fp);
+    CHECK(!heatmap_days_load(&e, path) && e.values == NULL);
+    remove(path);
+    CHECK(!heatmap_days_load(&e, path));
+    *strrchr(path, '/') = '\0';
+    rmdir(path);
+    heatmap_days_free(&d);
+}
+
+static int read_ppm(const char* path, uint32_t* pixels) {
+    FILE* fp = fopen(path, "rb");
+    int w, h, max, ok = 0;
+    if (!fp) return 0;
+    if (fscanf(fp, "P6 %d %d %d", &w, &h, &max) == 3 && w == HEATMAP_TILE_WIDTH && h == HEATMAP_TILE_HEIGHT && max == 255 &&
+        fgetc(fp) == '\n') {
+        ok = 1;
+        for (int i = 0; i < TILE_PIXELS && ok; i++) {
+            uint8_t c[3];
+            ok = fread(c, 3, 1, fp) == 1;
+            pixels[i] = (uint32_t)c[0] << 16 | (uint32_t)c[1] << 8 | c[2];
+        }
+    }
+    fclose(fp);
+    return ok;
+}
+
+static void write_ppm(const char* path, const uint32_t* pixels) {
+    FILE* fp = fopen(path, "wb");
+    fprintf(fp, "P6\n%d %d\n255\n", HEATMAP_TILE_WIDTH, HEATMAP_TILE_HEIGHT);
+    for (int i = 0; i < TILE_PIXELS; i++) {
+        uint8_t c[3] = {(uint8_t)(pixels[i] >> 16), (uint8_t)(pixels[i] >> 8), (uint8_t)pixels[i]};
+        fwrite(c, 3, 1, fp);
+    }
+    fclose(fp);
+}
+
+// Render a month and compare it with golden/<name>.ppm; a mismatch is written next to the test
+static void check_golden(const char* name, const HeatmapDays* d, int year, int month, int32_t today, int update) {
+    static uint32_t pixels[TILE_PIXELS], golden[TILE_PIXELS];
+    HeatmapImage img = {pixels, HEATMAP_TILE_WIDTH, HEATMAP_TILE_HEIGHT, HEATMAP_TILE_WIDTH};
+    char path[128];
+    snprintf(path, sizeof(path), "golden/%s.ppm", name);
+    heatmap_render_month(d, year, month, today, &img);
+    if (update) {
+        write_ppm(path, pixels);
+        printf("  wrote %s\n", path);
+        return;
+    }
+    if (!read_ppm(path, golden)) {
+        fprintf(stderr, "  cannot read %s\n", path);
+        CHECK(!"golden image");
+        return;
+    }
+    int differ = 0;
+    for (int i = 0; i < TILE_PIXELS; i++) differ += pixels[i] != golden[i];
+    if (differ) {
+        snprintf(path, sizeof(path), "%s.actual.ppm", name);
+        write_ppm(path, pixels);
+        fprintf(stderr, "  %s: %d pixels differ, see %s\n", name, differ, path);
+    }
+    CHECK(differ == 0);
+}
+
+static void test_golden(int update) {
+    HeatmapDays d = {0};
+    // Every shade, and a month that starts on a Friday and needs six rows
+    int32_t march = heatmap_day_number(2024, 3, 1);
+    for (int i = 0; i < 31; i++) heatmap_days_add(&d, march + i, i % 10);
+    check_golden("2024-03", &d, 2024, 3, march + 13, update);
+    // A February that fills exactly four weeks, without data or today
+    check_golden("2021-02", &d, 2021, 2, -1, update);
+    // Starts on a Sunday, today on the first, a saturated counter
+    int32_t september = heatmap_day_number(2024, 9, 1);
+    heatmap_days_add(&d, september, 0xFFFF);
+    heatmap_days_add(&d, september + 29, 1);
+    check_golden("2024-09", &d, 2024, 9, september, update);
+
+    // A tile drawn into a larger image stays inside its rectangle
+    int width = HEATMAP_TILE_WIDTH + 10, height = HEATMAP_TILE_HEIGHT + 10;
+    uint32_t* big = (uint32_t*)malloc(width * height * sizeof(uint32_t));
+    for (int i = 0; i < width * height; i++) big[i] = 0x123456;
+    HeatmapImage img = {big + 5 * width + 5, HEATMAP_TILE_WIDTH, HEATMAP_TILE_HEIGHT, width};
+    heatmap_render_month(&d, 2024, 3, march + 13, &img);
+    int outside = 0;
+    for (int y = 0; y < height; y++) {
+        for (int x = 0; x < width; x++) {
+            int inside = x >= 5 && x < 5 + HEATMAP_TILE_WIDTH && y >= 5 && y < 5 + HEATMAP_TILE_HEIGHT;
+            outside += !inside && big[y * width + x] != 0x123456;
+        }
+    }
+    CHECK(outside == 0);
+    free(big);
+    heatmap_days_free(&d);
+}
+
+static void bench(void) {
+    HeatmapDays d = {0};
+    unsigned seed = 1;
+    int32_t first = heatmap_day_number(2015, 1, 1), last = heatmap_day_number(2025, 1, 1);
+    int n = 1000000;
+    double begin = test_now();
+    for (int i = 0; i < n; i++) heatmap_days_add(&d, first + (int32_t)(test_rand(&seed) % (uint32_t)(last - first)), 1);
+    double elapsed = test_now() - begin;
+    printf("heatmap add             %8.2f ns/op  (%u days)\n", elapsed * 1e9 / n, d.count);
+
+    // The stale check of every cached tile of a decade, as when scrolling
+    uint16_t values[31];
+    volatile uint32_t sink = 0;
+    n = 2000;
+    begin = test_now();
+    for (int i = 0; i < n; i++) {
+        for (int m = 0; m < 120; m++) {
+            heatmap_month_values(&d, 2015 + m / 12, 1 + m % 12, values);
+            sink += values[i % 31];
+        }
+    }
+    elapsed = test_now() - begin;
+    printf("heatmap decade stale    %8.2f us/op  (120 month checks)\n", elapsed * 1e6 / n);
+
+    static uint32_t pixels[TILE_PIXELS];
+    HeatmapImage img = {pixels, HEATMAP_TILE_WIDTH, HEATMAP_TILE_HEIGHT, HEATMAP_TILE_WIDTH};
+    n = 2000;
+    begin = test_now();
+    for (int i = 0; i < n; i++) heatmap_render_month(&d, 2015 + i % 10, 1 + i % 12, -1, &img);
+    elapsed = test_now() - begin;
+    printf("heatmap render month    %8.2f us/op  (a year of tiles %.2f ms)\n", elapsed * 1e6 / n, elapsed * 12e3 / n);
+    (void)sink;
+    heatmap_days_free(&d);
+}
+
+int main(int argc, char** argv) {
+    if (test_bench_mode(argc, argv)) {
+        bench();
+        return 0;
+    }
+    int update = argc > 1 && strcmp(argv[1], "--update") == 0;
+    if (!update) test_days();
+    test_golden(update);
+    return test_done("heatmap_test");
+}
@@ -0,0 +1,172 @@
+// Hook queue: order, depth and drops, and a timer firing a hook on every tick while the
+// hooks hang, which must keep every tick on time; and benchmarks of queueing a job.
+#include <pthread.h>
+#include <stdio.h>
+#include <unistd.h>
+#include "pomodoro-hooks.h"
+#include "test.h"
+
+#define WORKERS 2
+#define TICKS 1000
+#define TICK_NS 2000000 // 2 ms, 500 times faster than the timer
+
+static HookQueue queue;
+static pthread_mutex_t gate_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t gate_open = PTHREAD_COND_INITIALIZER;
+static int gate = 0;           // 0 while the hooks hang
+static int started = 0;        // jobs a worker took
+static int runs[TICKS];        // times each tick's job was run
+
+static void make_job(HookJob* job, int event, int n) {
+    job->event = event;
+    job->queued_at = (uint32_t)n;
+    snprintf(job->payload, sizeof(job->payload), "{\"tick\":%d}\n", n);
+}
+
+// A worker whose hook does not return until the gate opens; event -1 ends it
+static void* worker(void* arg) {
+    (void)arg;
+    for (;;) {
+        HookJob job;
+        int64_t dropped;
+        hook_queue_pop(&queue, &job, &dropped);
+        if (job.event < 0) return NULL;
+        pthread_mutex_lock(&gate_lock);
+        started++;
+        while (!gate) pthread_cond_wait(&gate_open, &gate_lock);
+        runs[job.queued_at]++;
+        pthread_mutex_unlock(&gate_lock);
+    }
+}
+
+static void test_queue(void) {
+    HookQueue q;
+    HookJob job;
+    int64_t dropped;
+    int depth;
+    CHECK(hook_queue_init(&q));
+
+    // Full at HOOK_QUEUE_MAX, then every push is dropped and counted
+    for (int i = 0; i < HOOK_QUEUE_MAX + 6; i++) {
+        make_job(&job, 0, i);
+        int queued = hook_queue_push(&q, &job);
+        CHECK(queued == (i < HOOK_QUEUE_MAX));
+        if (queued) CHECK(job.depth == i + 1);
+    }
+    hook_queue_stats(&q, &depth, &dropped);
+    CHECK(depth == HOOK_QUEUE_MAX && dropped == 6);
+
+    // Oldest first
+    for (int i = 0; i < HOOK_QUEUE_MAX; i++) {
+        hook_queue_pop(&q, &job, &dropped);
+        CHECK(job.queued_at == (uint32_t)i && job.depth == i + 1 && dropped == 6);
+    }
+
+    // Around the ring many times
+    int next = 0, order_kept = 1;
+    for (int i = 0; i < 10000; i++) {
+        make_job(&job, 1, i);
+        CHECK(hook_queue_push(&q, &job));
+        if (i % 3 == 2) {
+            for (int k = 0; k < 3; k++) {
+                hook_queue_pop(&q, &job, &dropped);
+                order_kept &= job.queued_at == (uint32_t)next++;
+            }
+        }
+    }
+    CHECK(order_kept && next == 9999);
+    hook_queue_stats(&q, &depth, &dropped);
+    CHECK(depth == 1 && dropped == 6);
+}
+
+// The timer fires a hook on every tick while both workers are stuck in hooks that never
+// return on their own. The queue fills and the rest are dropped, but no tick is held up.
+static void test_slow_hooks(void) {
+    pthread_t threads[WORKERS];
+    CHECK(hook_queue_init(&queue));
+    for (int i = 0; i < WORKERS; i++) pthread_create(&threads[i], NULL, worker, NULL);
+
+    struct timespec next;
+    clock_gettime(CLOCK_MONOTONIC, &next);
+    double max_push = 0, max_late = 0, begin = test_now();
+    int queued = 0;
+    for (int tick = 0; tick < TICKS; tick++) {
+        next.tv_nsec += TICK_NS;
+        if (next.tv_nsec >= 1000000000) {
+            next.tv_sec++;
+            next.tv_nsec -= 1000000000;
+        }
+        clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next, NULL);
+        double woke = test_now();
+        double late = woke - ((double)next.tv_sec + (double)next.tv_nsec / 1e9);
+        if (late > max_late) max_late = late;
+
+        HookJob job;
+        make_job(&job, 2, tick);
+        queued += hook_queue_push(&queue, &job);
+        double push = test_now() - woke;
+        if (push > max_push) max_push = push;
+    }
+    double elapsed = test_now() - begin;
+
+    int depth;
+    int64_t dropped;
+    hook_queue_stats(&queue, &depth, &dropped);
+    pthread_mutex_lock(&gate_lock);
+    int stuck = started;
+    pthread_mutex_unlock(&gate_lock);
+    printf("  %d ticks with %d hooks hanging: %d queued, %lld dropped, longest push %.1f us, "
+           "latest tick %.2f ms, %.3f s for %.3f s of ticks\n",
+           TICKS, stuck, queued, (long long)dropped, max_push * 1e6, max_late * 1e3, elapsed,
+           TICKS * TICK_NS / 1e9);
+    CHECK(stuck == WORKERS && depth == HOOK_QUEUE_MAX && queued == HOOK_QUEUE_MAX + WORKERS);
+    CHECK(queued + dropped == TICKS);
+    // Generous bounds for a loaded machine; a blocking push would take the whole test
+    CHECK(max_push < 0.005 && elapsed < TICKS * TICK_NS / 1e9 + 0.5);
+
+    // Released, the workers run every queued job once and nothing else
+    pthread_mutex_lock(&gate_lock);
+    gate = 1;
+    pthread_cond_broadcast(&gate_open);
+    pthread_mutex_unlock(&gate_lock);
+    for (int i = 0; i < WORKERS; i++) {
+        HookJob quit;
+        make_job(&quit, -1, 0);
+        while (!hook_queue_push(&queue, &quit)) usleep(1000);
+    }
+    for (int i = 0; i < WORKERS; i++) pthread_join(threads[i], NULL);
+    int once = 1;
+    for (int tick = 0; tick < TICKS; tick++) once &= runs[tick] == (tick < queued);
+    CHECK(once && started == queued);
+}
+
+static void bench(void) {
+    HookQueue q;
+    HookJob job;
+    int64_t dropped;
+    hook_queue_init(&q);
+    make_job(&job, 0, 1);
+    int n = 10000000;
+    double t0 = test_now();
+    for (int i = 0; i < n; i++) {
+        hook_queue_push(&q, &job);
+        hook_queue_pop(&q, &job, &dropped);
+    }
+    double t1 = test_now();
+    for (int i = 0; i < HOOK_QUEUE_MAX; i++) hook_queue_push(&q, &job);
+    double t2 = test_now();
+    for (int i = 0; i < n; i++) hook_queue_push(&q, &job);
+    double t3 = test_now();
+    printf("hook push and pop       %8.1f ns/op\n", (t1 - t0) * 1e9 / n);
+    printf("hook push, queue full   %8.1f ns/op\n", (t3 - t2) * 1e9 / n);
+}
+
+int main(int argc, char** argv) {
+    if (test_bench_mode(argc, argv)) {
+        bench();
+        return 0;
+    }
+    test_queue();
+    test_slow_hooks();
+    return test_done("hooks_test");
+}
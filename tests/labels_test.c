@@ -0,0 +1,331 @@
+// Task labels: interning, totals and their files, the word index and its searches, and
+// benchmarks of a large history and of typing into the picker.
+#include "pomodoro-labels.h"
+#include "test.h"
+
+static char names_path[128], totals_path[128], index_path[128];
+
+static void test_intern(void) {
+    LabelTable t;
+    remove(names_path);
+    remove(totals_path);
+    label_table_load(&t, names_path, totals_path);
+    CHECK(t.count == 0 && label_find(&t, "anything") == 0 && label_name(&t, 1)[0] == '\0');
+
+    int a = label_intern(&t, "  Write report \n");
+    int b = label_intern(&t, "Email");
+    CHECK(a == 1 && b == 2);
+    CHECK(label_intern(&t, "Write report") == a && label_intern(&t, "Email   ") == b);
+    CHECK(strcmp(label_name(&t, a), "Write report") == 0);
+    CHECK(label_intern(&t, "   ") == 0 && label_intern(&t, "") == 0);
+    CHECK(label_intern(&t, "two\nlines") == 3 && strcmp(label_name(&t, 3), "two lines") == 0);
+
+    // A long name is cut, and not in the middle of a UTF-8 sequence
+    char longname[300];
+    size_t n = 0;
+    while (n + 2 < sizeof(longname) - 1) {
+        longname[n++] = (char)0xC3; // "é"
+        longname[n++] = (char)0xA9;
+    }
+    longname[n] = '\0';
+    int c = label_intern(&t, longname);
+    size_t len = strlen(label_name(&t, c));
+    CHECK(c == 4 && len < LABEL_MAX_BYTES && len % 2 == 0);
+    CHECK(label_intern(&t, longname) == c);
+
+    // Ids are stable across a reload
+    label_table_free(&t);
+    label_table_load(&t, names_path, totals_path);
+    CHECK(t.count == 4 && label_find(&t, "Write report") == 1 && label_find(&t, "Email") == 2 && label_find(&t, "two lines") == 3);
+    label_table_free(&t);
+
+    // A torn append (no line break at the end) is not a label
+    FILE* fp = fopen(names_path, "ab");
+    fputs("half written", fp);
+    fclose(fp);
+    label_table_load(&t, names_path, totals_path);
+    CHECK(t.count == 4 && label_find(&t, "half written") == 0);
+    label_table_free(&t);
+}
+
+static void test_totals(void) {
+    LabelTable t;
+    remove(names_path);
+    remove(totals_path);
+    label_table_load(&t, names_path, totals_path);
+    int a = label_intern(&t, "Write report"), b = label_intern(&t, "Email"), c = label_intern(&t, "Review");
+    label_record(&t, b, 1500, 100, 7);
+    label_record(&t, b, 600, 200, 7);
+    label_record(&t, b, 60, 300, 8);
+    label_record(&t, b, 900, 50, 6); // a late session from another machine
+    label_record(&t, 0, 1500, 100, 7);
+    label_record(&t, 99, 1500, 100, 7);
+    label_record(&t, c, 1500, 400, 8);
+    CHECK(label_week_seconds(&t, b, 8) == 60 && label_week_seconds(&t, b, 7) == 0 && label_week_seconds(&t, a, 8) == 0);
+    label_table_free(&t);
+
+    // Records of labels without sessions are filled in, and all survive a reload
+    label_table_load(&t, names_path, totals_path);
+    CHECK(t.count == 3);
+    CHECK(t.totals[a - 1].count == 0 && t.totals[a - 1].total_seconds == 0);
+    CHECK(t.totals[b - 1].count == 4 && t.totals[b - 1].total_seconds == 3060 && t.totals[b - 1].last_used == 300);
+    CHECK(label_week_seconds(&t, b, 8) == 60 && label_week_seconds(&t, c, 8) == 1500);
+    label_table_free(&t);
+
+    // The totals do not depend on the order of the sessions
+    LabelTotals forward, backward;
+    for (int order = 0; order < 2; order++) {
+        remove(totals_path);
+        label_table_load(&t, names_path, totals_path);
+        unsigned seed = 3;
+        int when[200], week[200], seconds[200];
+        for (int i = 0; i < 200; i++) {
+            when[i] = (int)(test_rand(&seed) % 100000);
+            week[i] = when[i] / 10000;
+            seconds[i] = 60 + (int)(test_rand(&seed) % 1500);
+        }
+        for (int k = 0; k < 200; k++) {
+            int i = order ? 199 - k : k;
+            label_record(&t, a, seconds[i], when[i], week[i]);
+        }
+        if (order) backward = t.totals[a - 1];
+        else forward = t.totals[a - 1];
+        label_table_free(&t);
+    }
+    CHECK(memcmp(&forward, &backward, sizeof(LabelTotals)) == 0);
+}
+
+static const char* words[] = {"design", "review", "email", "meeting", "bugfix", "report", "planning", "Research",
+                              "q3-budget", "(draft)", "Über", "api/v2"};
+
+// Does a word of the name start with the prefix, ignoring ASCII case?
+static int reference_match(const char* name, const char* prefix) {
+    size_t n = strlen(prefix);
+    for (size_t i = 0; name[i]; i++) {
+        if (!label_is_word_start(name, i)) continue;
+        size_t k = 0;
+        while (k < n && name[i + k] && label_fold((uint8_t)name[i + k]) == label_fold((uint8_t)prefix[k])) k++;
+        if (k == n) return 1;
+    }
+    return 0;
+}
+
+// The search answer from the definition: matching labels, most recently used first
+static int reference_search(const LabelTable* t, const char* prefix, int* ids, int max) {
+    int count = 0;
+    for (int id = 1; id <= t->count; id++) {
+        if (!reference_match(label_name(t, id), prefix)) continue;
+        int pos = count < max ? count : max;
+        while (pos > 0 && t->totals[ids[pos - 1] - 1].last_used < t->totals[id - 1].last_used) pos--;
+        if (pos == max) continue;
+        memmove(ids + pos + 1, ids + pos, (size_t)((count < max ? count : max - 1) - pos) * sizeof(int));
+        ids[pos] = id;
+        if (count < max) count++;
+    }
+    return count;
+}
+
+static void test_search_small(void) {
+    LabelTable t;
+    int ids[20];
+    remove(names_path);
+    remove(totals_path);
+    remove(index_path);
+    label_table_load(&t, names_path, totals_path);
+    label_index_load(&t, index_path);
+    CHECK(label_search(&t, "", ids, 20) == 0 && label_search(&t, "a", ids, 20) == 0);
+    int a = label_intern(&t, "Write report"), b = label_intern(&t, "Email triage"), c = label_intern(&t, "report-review");
+    label_record(&t, c, 1500, 50, 0);
+    label_record(&t, a, 1500, 10, 0);
+    CHECK(label_search(&t, "rep", ids, 20) == 2 && ids[0] == c && ids[1] == a);
+    CHECK(label_search(&t, "REV", ids, 20) == 1 && ids[0] == c);
+    CHECK(label_search(&t, "em", ids, 20) == 1 && ids[0] == b);
+    CHECK(label_search(&t, "port", ids, 20) == 0); // inside a word
+    CHECK(label_search(&t, "", ids, 20) == 3);
+    CHECK(label_search(&t, "rep", ids, 1) == 1 && ids[0] == c);
+    CHECK(label_search(&t, "report-r", ids, 20) == 1 && ids[0] == c);
+    CHECK(label_search(&t, "x", ids, 20) == 0);
+    label_table_free(&t);
+}
+
+// Random labels against the reference, through both search paths, with the index built at
+// load, updated as labels are added, and mapped from the file
+static void test_search_random(void) {
+    LabelTable t;
+    char name[LABEL_MAX_BYTES];
+    int ids[20], want[20];
+    unsigned seed = 11;
+    remove(names_path);
+    remove(totals_path);
+    remove(index_path);
+    label_table_load(&t, names_path, totals_path);
+    for (int i = 0; i < 3000; i++) {
+        snprintf(name, sizeof(name), "%s %s task %d", words[test_rand(&seed) % 12], words[test_rand(&seed) % 12], i);
+        label_intern(&t, name);
+    }
+    label_index_load(&t, index_path);
+    for (int i = 3000; i < 3300; i++) {
+        snprintf(name, sizeof(name), "%s:%s #%d", words[test_rand(&seed) % 12], words[test_rand(&seed) % 12], i);
+        label_intern(&t, name);
+    }
+    // Every label used once, at distinct times, so the order is defined
+    for (int id = 1; id <= t.count; id++) label_record(&t, id, 60, 1000 + (test_rand(&seed) % 1000) * 4000 + id, 0);
+
+    static const char* prefixes[] = {"", "t", "ta", "task", "task 1", "task 29", "task 2999", "#3", "#32", "d", "de",
+                                     "DESIGN", "design r", "r", "re", "rev", "q", "q3-b", "b", "budget", "(", "draft",
+                                     "\xc3\x9c", "\xc3\x9c" "ber", "\xc3\xbc", "api", "v2", "api/v", "x", "zzz"};
+    for (int pass = 0; pass < 2; pass++) {
+        for (size_t p = 0; p < sizeof(prefixes) / sizeof(prefixes[0]); p++) {
+            for (int max = 1; max <= 20; max += 19) {
+                int got = label_search(&t, prefixes[p], ids, max), n = reference_search(&t, prefixes[p], want, max);
+                int same = got == n && memcmp(ids, want, (size_t)n * sizeof(int)) == 0;
+                if (!same) fprintf(stderr, "  pass %d \"%s\" max %d: %d results instead of %d\n", pass, prefixes[p], max, got, n);
+                CHECK(same);
+            }
+        }
+        if (pass == 0) {
+            // The index updated label by label is the one a rebuild gives, and it is reused from the file
+            uint32_t count = t.index_count;
+            uint32_t* entries = (uint32_t*)malloc(count * sizeof(uint32_t));
+            memcpy(entries, t.index, count * sizeof(uint32_t));
+            label_table_free(&t);
+            label_table_load(&t, names_path, totals_path);
+            label_index_load(&t, index_path);
+            CHECK(t.index_map != NULL && t.index_count == count && memcmp(t.index, entries, count * sizeof(uint32_t)) == 0);
+            label_table_free(&t);
+            remove(index_path);
+            label_table_load(&t, names_path, totals_path);
+            label_index_load(&t, index_path);
+            CHECK(t.index_map == NULL && t.index_count == count && memcmp(t.index, entries, count * sizeof(uint32_t)) == 0);
+            free(entries);
+        }
+    }
+    label_table_free(&t);
+
+    // A label added while the index file was not looked at makes it stale
+    label_table_load(&t, names_path, totals_path);
+    int id = label_intern(&t, "added without the index");
+    label_table_free(&t);
+    label_table_load(&t, names_path, totals_path);
+    label_index_load(&t, index_path);
+    CHECK(t.index_map == NULL && label_search(&t, "without", ids, 20) == 1 && ids[0] == id);
+    label_table_free(&t);
+}
+
+static void bench(void) {
+    LabelTable t;
+    char name[64];
+    const int labels = 50000, sessions = 1000000;
+    remove(names_path);
+    remove(totals_path);
+    label_table_load(&t, names_path, totals_path);
+
+    double begin = test_now();
+    for (int i = 0; i < labels; i++) {
+        snprintf(name, sizeof(name), "project %d task %d", i / 100, i);
+        label_intern(&t, name);
+    }
+    double elapsed = test_now() - begin;
+    printf("labels intern new       %8.2f us/op  (%d labels)\n", elapsed * 1e6 / labels, labels);
+
+    unsigned seed = 1;
+    begin = test_now();
+    for (int i = 0; i < sessions; i++) {
+        snprintf(name, sizeof(name), "project %d task %d", 0, (int)(test_rand(&seed) % 100));
+        if (!label_intern(&t, name)) abort();
+    }
+    elapsed = test_now() - begin;
+    printf("labels intern existing  %8.2f ns/op\n", elapsed * 1e9 / sessions);
+
+    // A session per 1500 seconds over about three years, with a skewed choice of label
+    begin = test_now();
+    for (int i = 0; i < sessions; i++) {
+        unsigned r = test_rand(&seed);
+        int id = 1 + (int)((r % labels) * (r % 1000) / 1000);
+        int64_t when = 1700000000 + (int64_t)i * 90;
+        label_record(&t, id, 1500, when, (int32_t)(when / 604800));
+    }
+    elapsed = test_now() - begin;
+    printf("labels record session   %8.2f us/op  (%d sessions, writes its record)\n", elapsed * 1e6 / sessions, sessions);
+
+    int32_t week = (int32_t)((1700000000 + (int64_t)(sessions - 1) * 90) / 604800);
+    volatile uint32_t sink = 0;
+    begin = test_now();
+    for (int i = 0; i < sessions; i++) sink += label_week_seconds(&t, 1 + i % labels, week);
+    elapsed = test_now() - begin;
+    printf("labels week seconds     %8.2f ns/op\n", elapsed * 1e9 / sessions);
+    label_table_free(&t);
+
+    int n = 20;
+    begin = test_now();
+    for (int i = 0; i < n; i++) {
+        label_table_load(&t, names_path, totals_path);
+        if (i < n - 1) label_table_free(&t);
+    }
+    elapsed = test_now() - begin;
+    printf("labels load             %8.2f ms/op  (%d labels, %zu KB of names, %zu KB of totals)\n", elapsed * 1e3 / n,
+           t.count, t.names_size / 1024, (size_t)t.count * sizeof(LabelTotals) / 1024);
+    (void)sink;
+
+    // The picker: build the word index, then map it on later starts
+    remove(index_path);
+    begin = test_now();
+    label_index_load(&t, index_path);
+    elapsed = test_now() - begin;
+    printf("labels build index      %8.2f ms     (%u words, %zu KB)\n", elapsed * 1e3, t.index_count,
+           (size_t)t.index_count * sizeof(uint32_t) / 1024);
+    label_table_free(&t);
+    begin = test_now();
+    label_table_load(&t, names_path, totals_path);
+    label_index_load(&t, index_path);
+    elapsed = test_now() - begin;
+    printf("labels load with index  %8.2f ms     (mapped %d)\n", elapsed * 1e3, t.index_map != NULL);
+
+    // Keystroke to result: every prefix of what a user types, including one letter
+    static const char* typed[] = {"project 12 task 1234", "task 4999", "project 4", "p", "t", "zzz"};
+    int ids[20];
+    for (size_t k = 0; k < sizeof(typed) / sizeof(typed[0]); k++) {
+        char prefix[64];
+        size_t len = strlen(typed[k]);
+        double worst = 0, sum = 0;
+        int found = 0;
+        for (size_t i = 1; i <= len; i++) {
+            memcpy(prefix, typed[k], i);
+            prefix[i] = '\0';
+            int reps = 200;
+            begin = test_now();
+            for (int r = 0; r < reps; r++) found = label_search(&t, prefix, ids, 20);
+            elapsed = (test_now() - begin) / reps;
+            sum += elapsed;
+            if (elapsed > worst) worst = elapsed;
+        }
+        printf("labels keystroke %-22s %6.2f us avg  %6.2f us worst  (%d results)\n", typed[k], sum * 1e6 / len,
+               worst * 1e6, found);
+    }
+
+    begin = test_now();
+    int id = label_intern(&t, "a brand new task");
+    elapsed = test_now() - begin;
+    printf("labels intern indexed   %8.2f ms     (adds the words and rewrites the index, id %d)\n", elapsed * 1e3, id);
+    label_table_free(&t);
+}
+
+int main(int argc, char** argv) {
+    const char* dir = test_temp_dir();
+    snprintf(names_path, sizeof(names_path), "%s/names.txt", dir);
+    snprintf(totals_path, sizeof(totals_path), "%s/totals.dat", dir);
+    snprintf(index_path, sizeof(index_path), "%s/names.idx", dir);
+    if (test_bench_mode(argc, argv)) {
+        bench();
+    } else {
+        test_intern();
+        test_totals();
+        test_search_small();
+        test_search_random();
+    }
+    remove(names_path);
+    remove(totals_path);
+    remove(index_path);
+    rmdir(dir);
+    return test_bench_mode(argc, argv) ? 0 : test_done("labels_test");
+}
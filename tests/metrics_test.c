@@ -0,0 +1,267 @@
+// Metrics: the exported text checked against the Prometheus text format, values read back from
+// it, truncation, the atomic counters under threads and the textfile write.
+#include <ctype.h>
+#include <pthread.h>
+#include <unistd.h>
+#include "pomodoro-metrics.h"
+#include "test.h"
+
+#define MAX_FAMILIES 64
+
+static int quiet = 0; // set while feeding the validator bad text on purpose
+
+static int is_name_start(int c) {
+    return isalpha(c) || c == '_' || c == ':';
+}
+
+static int is_name_char(int c) {
+    return isalnum(c) || c == '_' || c == ':';
+}
+
+// Step over a metric or label name; returns NULL if there is none
+static const char* scan_name(const char* s, int label) {
+    if (!is_name_start((unsigned char)*s) || (label && *s == ':')) return NULL;
+    while (is_name_char((unsigned char)*s) && !(label && *s == ':')) s++;
+    return s;
+}
+
+// Check a whole exposition: every line a comment or a sample, one TYPE and HELP per family
+// before its samples, families not split, counters named *_total and not negative, no
+// repeated series. Returns the number of problems, printing each.
+static int validate(const char* text) {
+    char families[MAX_FAMILIES][128], types[MAX_FAMILIES][16], series[256][256];
+    int family_count = 0, series_count = 0, problems = 0, line_no = 0;
+    char current[128] = "";
+    const char* s = text;
+    size_t len = strlen(text);
+    if (len == 0 || text[len - 1] != '\n') {
+        if (!quiet) fprintf(stderr, "  the text does not end with a line break\n");
+        problems++;
+    }
+    while (*s) {
+        const char* nl = strchr(s, '\n');
+        if (!nl) break;
+        char line[512];
+        size_t n = (size_t)(nl - s) < sizeof(line) - 1 ? (size_t)(nl - s) : sizeof(line) - 1;
+        memcpy(line, s, n);
+        line[n] = '\0';
+        s = nl + 1;
+        line_no++;
+        #define PROBLEM(why) do { if (!quiet) fprintf(stderr, "  line %d: %s: %s\n", line_no, why, line); problems++; } while (0)
+
+        if (strncmp(line, "# HELP ", 7) == 0 || strncmp(line, "# TYPE ", 7) == 0) {
+            const char* name = line + 7;
+            const char* end = scan_name(name, 0);
+            if (!end || *end != ' ') {
+                PROBLEM("bad metric name");
+                continue;
+            }
+            char family[128];
+            snprintf(family, sizeof(family), "%.*s", (int)(end - name), name);
+            int f = 0;
+            while (f < family_count && strcmp(families[f], family) != 0) f++;
+            if (f == family_count) {
+                if (family_count == MAX_FAMILIES) continue;
+                strcpy(families[family_count], family);
+                types[family_count++][0] = '\0';
+            } else if (strcmp(current, family) != 0) {
+                PROBLEM("family continued after another one");
+            }
+            strcpy(current, family);
+            if (line[2] == 'T') {
+                const char* type = end + 1;
+                if (types[f][0]) PROBLEM("second TYPE");
+                if (strcmp(type, "counter") && strcmp(type, "gauge") && strcmp(type, "histogram") &&
+                    strcmp(type, "summary") && strcmp(type, "untyped")) PROBLEM("unknown type");
+                snprintf(types[f], sizeof(types[f]), "%s", type);
+                if (strcmp(type, "counter") == 0 && (strlen(family) < 6 || strcmp(family + strlen(family) - 6, "_total") != 0)) {
+                    PROBLEM("counter not named *_total");
+                }
+            } else if (end[1] == '\0') {
+                PROBLEM("empty HELP");
+            }
+            continue;
+        }
+        if (line[0] == '#') continue;
+
+        // name{label="value",...} value
+        const char* p = scan_name(line, 0);
+        if (!p) {
+            PROBLEM("bad sample name");
+            continue;
+        }
+        char name[128];
+        snprintf(name, sizeof(name), "%.*s", (int)(p - line), line);
+        if (*p == '{') {
+            p++;
+            while (*p != '}') {
+                const char* label_end = scan_name(p, 1);
+                if (!label_end || label_end[0] != '=' || label_end[1] != '"') break;
+                p = label_end + 2;
+                while (*p && *p != '"') {
+                    if (*p == '\\') {
+                        if (p[1] != '\\' && p[1] != '"' && p[1] != 'n') break;
+                        p++;
+                    }
+                    p++;
+                }
+                if (*p != '"') break;
+                p++;
+                if (*p == ',') p++;
+            }
+            if (*p != '}') {
+                PROBLEM("bad labels");
+                continue;
+            }
+            p++;
+        }
+        char* value_end;
+        double value = *p == ' ' ? strtod(p + 1, &value_end) : 0;
+        if (*p != ' ' || value_end == p + 1 || (*value_end != '\0' && *value_end != ' ')) {
+            PROBLEM("bad value");
+            continue;
+        }
+        int f = 0;
+        while (f < family_count && strcmp(families[f], name) != 0) f++;
+        if (f == family_count || !types[f][0]) PROBLEM("sample without TYPE");
+        else if (strcmp(current, name) != 0) PROBLEM("sample outside its family");
+        else if (strcmp(types[f], "counter") == 0 && value < 0) PROBLEM("negative counter");
+        int repeated = 0;
+        for (int i = 0; i < series_count; i++) repeated |= strncmp(series[i], line, (size_t)(p - line)) == 0 && series[i][p - line] == '\0';
+        if (repeated) PROBLEM("repeated series");
+        else if (series_count < 256) snprintf(series[series_count++], sizeof(series[0]), "%.*s", (int)(p - line), line);
+        #undef PROBLEM
+    }
+    return problems;
+}
+
+// The value of a series in the text, or -1
+static long long value_of(const char* text, const char* series) {
+    size_t n = strlen(series);
+    for (const char* s = text; (s = strstr(s, series)) != NULL; s += n) {
+        if ((s == text || s[-1] == '\n') && s[n] == ' ') return atoll(s + n + 1);
+    }
+    return -1;
+}
+
+static void test_format(void) {
+    static PomodoroMetrics m;
+    PomodoroGauges g = {1, 2, 3, 4567890, 42, 17, 1760000000};
+    char text[8192];
+    memset(&m, 0, sizeof(m));
+    int empty = metrics_format(&m, &g, text, sizeof(text));
+    CHECK(empty > 0 && validate(text) == 0);
+
+    metrics_add(&m.sessions[0][0], 5);
+    metrics_add(&m.sessions[2][1], 1);
+    metrics_add(&m.focus_seconds, 7500);
+    metrics_add(&m.timer_wakeups, 30000);
+    metrics_add(&m.notify_icon_calls, 1500);
+    metrics_add(&m.hotkey_presses, 3);
+    metrics_max(&m.hotkey_max_microseconds, 900);
+    metrics_max(&m.hotkey_max_microseconds, 400);
+    int n = metrics_format(&m, &g, text, sizeof(text));
+    CHECK(n > 0 && (size_t)n == strlen(text) && validate(text) == 0);
+    CHECK(value_of(text, "pomodoro_sessions_total{kind=\"pomodoro\",outcome=\"completed\"}") == 5);
+    CHECK(value_of(text, "pomodoro_sessions_total{kind=\"long_break\",outcome=\"stopped\"}") == 1);
+    CHECK(value_of(text, "pomodoro_sessions_total{kind=\"short_break\",outcome=\"expired\"}") == 0);
+    CHECK(value_of(text, "pomodoro_focus_seconds_total") == 7500 && value_of(text, "pomodoro_running") == 1);
+    CHECK(value_of(text, "pomodoro_hotkey_latency_max_microseconds") == 900);
+    CHECK(value_of(text, "pomodoro_private_bytes") == 4567890 && value_of(text, "pomodoro_start_time_seconds") == 1760000000);
+    CHECK(value_of(text, "pomodoro_hooks_dropped_total") == 3 && value_of(text, "pomodoro_hook_queue_depth") == 2);
+
+    // The validator catches what it should
+    quiet = 1;
+    CHECK(validate("# TYPE a counter\na 1\n") == 1);
+    CHECK(validate("# TYPE a_total counter\na_total{x=\"1\"} 1\na_total{x=\"1\"} 2\n") == 1);
+    CHECK(validate("# TYPE a gauge\na{x=1} 1\n") == 1);
+    CHECK(validate("# TYPE a gauge\n# TYPE b gauge\nb 1\na 1\n") == 1);
+    CHECK(validate("b 1\n") == 1);
+    CHECK(validate("# TYPE a gauge\na 1") == 1);
+    quiet = 0;
+
+    // Every buffer too small fails, without writing past its end
+    char small[8192];
+    for (int size = 0; size <= n; size++) {
+        memset(small, 'x', sizeof(small));
+        CHECK(metrics_format(&m, &g, small, (size_t)size) == -1);
+        CHECK(small[size] == 'x');
+    }
+    CHECK(metrics_format(&m, &g, small, (size_t)n + 1) == n && strcmp(small, text) == 0);
+}
+
+static PomodoroMetrics shared;
+
+static void* add_worker(void* arg) {
+    int64_t id = (int64_t)(intptr_t)arg;
+    for (int i = 0; i < 1000000; i++) {
+        metrics_add(&shared.timer_wakeups, 1);
+        metrics_max(&shared.hotkey_max_microseconds, id * 1000000 + i);
+    }
+    return NULL;
+}
+
+static void test_counters(void) {
+    pthread_t threads[4];
+    for (int t = 0; t < 4; t++) pthread_create(&threads[t], NULL, add_worker, (void*)(intptr_t)t);
+    for (int t = 0; t < 4; t++) pthread_join(threads[t], NULL);
+    CHECK(metrics_get(&shared.timer_wakeups) == 4000000);
+    CHECK(metrics_get(&shared.hotkey_max_microseconds) == 3999999);
+}
+
+static void test_textfile(void) {
+    const char* dir = test_temp_dir();
+    char path[160], tmp[170];
+    snprintf(path, sizeof(path), "%s/pomodoro.prom", dir);
+    snprintf(tmp, sizeof(tmp), "%s.tmp", path);
+    CHECK(metrics_write_textfile(path, "a 1\n", 4));
+    CHECK(metrics_write_textfile(path, "b 2\n", 4));
+    FILE* fp = fopen(path, "rb");
+    char buf[16] = "";
+    CHECK(fp && fread(buf, 1, sizeof(buf), fp) == 4 && strcmp(buf, "b 2\n") == 0);
+    if (fp) fclose(fp);
+    CHECK(access(tmp, F_OK) != 0);
+    CHECK(!metrics_write_textfile("/nonexistent-pomodoro-folder/pomodoro.prom", "a 1\n", 4));
+    remove(path);
+    rmdir(dir);
+}
+
+static void bench(void) {
+    static PomodoroMetrics m;
+    PomodoroGauges g = {1, 2, 3, 4567890, 42, 17, 1760000000};
+    int n = 100000000;
+    double begin = test_now();
+    for (int i = 0; i < n; i++) metrics_add(&m.timer_wakeups, 1);
+    double elapsed = test_now() - begin;
+    printf("metrics add             %8.2f ns/op\n", elapsed * 1e9 / n);
+
+    char text[8192];
+    int len = 0;
+    n = 100000;
+    begin = test_now();
+    for (int i = 0; i < n; i++) len = metrics_format(&m, &g, text, sizeof(text));
+    elapsed = test_now() - begin;
+    printf("metrics format          %8.2f us/op  (%d bytes)\n", elapsed * 1e6 / n, len);
+
+    const char* dir = test_temp_dir();
+    char path[160];
+    snprintf(path, sizeof(path), "%s/pomodoro.prom", dir);
+    n = 2000;
+    begin = test_now();
+    for (int i = 0; i < n; i++) metrics_write_textfile(path, text, (size_t)len);
+    elapsed = test_now() - begin;
+    printf("metrics write textfile  %8.2f us/op\n", elapsed * 1e6 / n);
+    remove(path);
+    rmdir(dir);
+}
+
+int main(int argc, char** argv) {
+    if (test_bench_mode(argc, argv)) {
+        bench();
+        return 0;
+    }
+    test_format();
+    test_counters();
+    test_textfile();
+    return test_done("metrics_test");
+}
@@ -0,0 +1,123 @@
+// Replay recordings: the file written by --record read back, recordings cut short by a crash,
+// foreign files, and the latency percentiles of the replay report; and benchmarks of recording an
+// event and loading a long recording. Replaying itself needs the Win32 handlers and is not tested
+// here.
+#include <unistd.h>
+#include "pomodoro-replay.h"
+#include "test.h"
+
+static char path[128];
+
+// A recording of n events; every field follows from the event's position
+static void write_recording(int n) {
+    FILE* fp = replay_record_open(path);
+    CHECK(fp != NULL);
+    for (int i = 0; i < n; i++) replay_record(fp, (uint32_t)i * 250, i % REPLAY_TYPES, (i * 7) & 0xFFFF);
+    fclose(fp);
+}
+
+static int check_events(const ReplayTrace* t, uint32_t n) {
+    int same = t->count == n;
+    for (uint32_t i = 0; same && i < n; i++) {
+        const ReplayEvent* e = &t->events[i];
+        same = e->ms == i * 250 && e->type == i % REPLAY_TYPES && e->arg == ((i * 7) & 0xFFFF);
+    }
+    return same;
+}
+
+static void test_file(void) {
+    ReplayTrace t;
+    CHECK(sizeof(ReplayEvent) == 8);
+    remove(path);
+    CHECK(!replay_load(&t, path) && t.events == NULL && t.count == 0);
+
+    // Read back across the buffer growth
+    write_recording(5000);
+    CHECK(replay_load(&t, path) && check_events(&t, 5000));
+    replay_free(&t);
+    write_recording(0);
+    CHECK(replay_load(&t, path) && t.count == 0);
+    replay_free(&t);
+
+    // Killed in the middle of an event: the whole events before it are kept
+    write_recording(100);
+    CHECK(truncate(path, 4 + 37 * 8 + 5) == 0);
+    CHECK(replay_load(&t, path) && check_events(&t, 37));
+    replay_free(&t);
+
+    // Events of an unknown type are skipped
+    FILE* fp = replay_record_open(path);
+    replay_record(fp, 1, REPLAY_TICK, 1);
+    replay_record(fp, 2, REPLAY_TYPES, 9);
+    replay_record(fp, 3, REPLAY_MENU, 8);
+    fclose(fp);
+    CHECK(replay_load(&t, path) && t.count == 2 && t.events[1].type == REPLAY_MENU && t.events[1].arg == 8);
+    replay_free(&t);
+
+    // Not a recording, or too short for the magic
+    fp = fopen(path, "wb");
+    fputs("PRP2 and then some", fp);
+    fclose(fp);
+    CHECK(!replay_load(&t, path) && t.events == NULL);
+    CHECK(truncate(path, 3) == 0);
+    CHECK(!replay_load(&t, path));
+    remove(path);
+
+    CHECK(strcmp(replay_type_name(REPLAY_TOAST), "toast button") == 0);
+    CHECK(strcmp(replay_type_name(REPLAY_TYPES), "unknown") == 0 && strcmp(replay_type_name(-1), "unknown") == 0);
+}
+
+static void test_percentiles(void) {
+    ReplayLatency l = {0};
+    CHECK(replay_percentile(&l, 50) == 0);
+    unsigned seed = 9;
+    // 1 to 1001 us in a random order
+    for (int i = 0; i <= 1000; i++) replay_latency_add(&l, 1 + i);
+    for (uint32_t i = l.count - 1; i > 0; i--) {
+        uint32_t j = test_rand(&seed) % (i + 1);
+        double x = l.samples[i];
+        l.samples[i] = l.samples[j];
+        l.samples[j] = x;
+    }
+    CHECK(l.count == 1001);
+    CHECK(replay_percentile(&l, 0) == 1 && replay_percentile(&l, 50) == 501);
+    CHECK(replay_percentile(&l, 99) == 991 && replay_percentile(&l, 100) == 1001);
+    replay_latency_free(&l);
+    CHECK(l.samples == NULL && l.count == 0);
+
+    replay_latency_add(&l, 42);
+    CHECK(replay_percentile(&l, 0) == 42 && replay_percentile(&l, 99) == 42);
+    replay_latency_free(&l);
+}
+
+static void bench(void) {
+    int n = 1000000;
+    FILE* fp = replay_record_open(path);
+    double begin = test_now();
+    for (int i = 0; i < n; i++) replay_record(fp, (uint32_t)i, REPLAY_TICK, 1);
+    fclose(fp);
+    double elapsed = test_now() - begin;
+    printf("replay record event     %8.2f ns/op\n", elapsed * 1e9 / n);
+
+    // A million events is about 11 days of ticks
+    ReplayTrace t;
+    begin = test_now();
+    replay_load(&t, path);
+    elapsed = test_now() - begin;
+    printf("replay load             %8.2f ms     (%u events)\n", elapsed * 1e3, t.count);
+    replay_free(&t);
+    remove(path);
+}
+
+int main(int argc, char** argv) {
+    const char* dir = test_temp_dir();
+    snprintf(path, sizeof(path), "%s/trace.prp", dir);
+    if (test_bench_mode(argc, argv)) {
+        bench();
+    } else {
+        test_file();
+        test_percentiles();
+    }
+    rmdir(dir);
+    return test_bench_mode(argc, argv) ? 0 : test_done("replay_test");
+}
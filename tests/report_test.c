@@ -0,0 +1,158 @@
+// Team report: aggregate a folder of synthetic user logs with any number of threads, check the
+// totals against the ones the logs were made from and that the report is the same every time.
+#include "pomodoro-report.h"
+#include "test.h"
+
+typedef struct {
+    uint64_t sessions, pomodoros, focus_seconds, bad_lines;
+    uint64_t label_sessions; // of the label "Write report, draft"
+    uint64_t length_hist[TEAM_LENGTH_BINS];
+} Expected;
+
+static const char* labels[] = {"", "Email", "Write report, draft", "Review", "Über planning"};
+
+// Write one user's log of sessions from start, one every step seconds, and count what it holds
+static void write_log(const char* dir, const char* user, int sessions, int64_t start, int step, unsigned seed,
+                      Expected* e, int with_noise) {
+    char path[256];
+    snprintf(path, sizeof(path), "%s/%s" TEAM_REPORT_SUFFIX, dir, user);
+    FILE* fp = fopen(path, "wb");
+    for (int i = 0; i < sessions; i++) {
+        unsigned r = test_rand(&seed);
+        int pomodoro = r % 5 != 0, stopped = pomodoro && r % 7 == 0;
+        int planned = pomodoro ? 1500 : 300, actual = stopped ? (int)(r % 1400) : planned - 10 + (int)(r % 21);
+        const char* label = pomodoro ? labels[(r >> 4) % 5] : "";
+        char focus[8] = "";
+        if (pomodoro && (r >> 8) % 4) snprintf(focus, sizeof(focus), "%u", (r >> 10) % 101);
+        fprintf(fp, "%d,%lld,%s,%d,%d,%s,%s,%s%s\n", i + 1, (long long)(start + (int64_t)i * step),
+                pomodoro ? "pomodoro" : "short_break", planned, actual, stopped ? "stopped" : "completed", focus, label,
+                with_noise && i % 1000 == 0 ? "\r" : "");
+        e->sessions++;
+        if (!pomodoro) continue;
+        e->focus_seconds += (uint64_t)actual;
+        e->label_sessions += label == labels[2];
+        if (!stopped) {
+            e->pomodoros++;
+            e->length_hist[actual]++;
+        }
+    }
+    if (with_noise) {
+        fprintf(fp, "not a session\n\n7,1700000000,pomodoro,1500\n");
+        e->bad_lines += 2;
+        // The last line has no line break
+        fprintf(fp, "%d,%lld,pomodoro,1500,1500,completed,50,Review", sessions + 1, (long long)(start + (int64_t)sessions * step));
+        e->sessions++;
+        e->pomodoros++;
+        e->focus_seconds += 1500;
+        e->length_hist[1500]++;
+    }
+    fclose(fp);
+}
+
+static char* report_text(TeamReport* r) {
+    char* text = NULL;
+    size_t size = 0;
+    FILE* out = open_memstream(&text, &size);
+    team_report_write(r, out);
+    fclose(out);
+    return text;
+}
+
+static void test_threads(void) {
+    const char* dir = test_temp_dir();
+    static Expected e;
+    char user[32];
+    memset(&e, 0, sizeof(e));
+    for (int u = 0; u < 12; u++) {
+        snprintf(user, sizeof(user), "user%02d", u);
+        write_log(dir, user, 200 + u * 50, 1600000000 + u * 3600, 1800, (unsigned)u + 1, &e, u == 3);
+    }
+    // One user with more than a range of history, so lines cross the range ends
+    write_log(dir, "heavy", 150000, 1500000000, 900, 99, &e, 1);
+    // Files that are not user logs are left alone
+    char path[256];
+    snprintf(path, sizeof(path), "%s/notes.txt", dir);
+    FILE* fp = fopen(path, "wb");
+    fputs("1,2,pomodoro,3,4,completed,5,x\n", fp);
+    fclose(fp);
+
+    char* first = NULL;
+    for (int threads = 1; threads <= 16; threads = threads < 4 ? threads + 1 : threads * 2) {
+        TeamReport r;
+        CHECK(team_report_run(&r, dir, threads));
+        CHECK(r.user_count == 13 && strcmp(r.users[0], "heavy") == 0 && r.item_count > 13);
+        TeamPartial* p = &r.partials[0];
+        TeamTotals all = {0, 0, 0};
+        for (int u = 0; u < r.user_count; u++) team_add_totals(&all, &p->users[u]);
+        CHECK(all.sessions == e.sessions && all.pomodoros == e.pomodoros && all.focus_seconds == e.focus_seconds);
+        CHECK(p->bad_lines == e.bad_lines);
+        TeamTotals* label = team_label_slot(p, labels[2], strlen(labels[2]));
+        CHECK(label && label->sessions == e.label_sessions);
+        int same_hist = 1;
+        for (int i = 0; i < TEAM_LENGTH_BINS; i++) same_hist &= p->length_hist[i] == e.length_hist[i];
+        CHECK(same_hist);
+        uint64_t day_sessions = 0;
+        for (int32_t d = 0; d < p->day_cap; d++) day_sessions += p->days[d].sessions;
+        CHECK(day_sessions == e.sessions);
+
+        char* text = report_text(&r);
+        if (!first) first = text;
+        else {
+            CHECK(strcmp(text, first) == 0);
+            free(text);
+        }
+        team_report_free(&r);
+    }
+    free(first);
+
+    TeamReport r;
+    CHECK(team_report_run(&r, "/nonexistent-pomodoro-folder", 2) == 0);
+    team_report_free(&r);
+
+    char cmd[300];
+    snprintf(cmd, sizeof(cmd), "rm -rf %s", dir);
+    CHECK(system(cmd) == 0);
+}
+
+// 1,000 users with 5 years of eight Pomodoros a working day
+static void bench(void) {
+    const char* dir = test_temp_dir();
+    static Expected e;
+    const int users = 1000, sessions = 5 * 250 * 8;
+    char user[32];
+    double begin = test_now();
+    for (int u = 0; u < users; u++) {
+        snprintf(user, sizeof(user), "user%04d", u);
+        write_log(dir, user, sessions, 1600000000, 5 * 365 * 86400 / sessions, (unsigned)u + 1, &e, 0);
+    }
+    printf("report generated %d users x %d sessions in %.1f s\n", users, sessions, test_now() - begin);
+
+    int cores = team_cpu_count();
+    double one = 0;
+    TeamReport warm; // reads the logs into the file cache, so every run below finds them there
+    team_report_run(&warm, dir, 0);
+    team_report_free(&warm);
+    for (int threads = 1; threads <= cores * 2 && threads <= TEAM_REPORT_MAX_THREADS; threads *= 2) {
+        TeamReport r;
+        begin = test_now();
+        team_report_run(&r, dir, threads);
+        double elapsed = test_now() - begin;
+        if (threads == 1) one = elapsed;
+        printf("report %2d threads       %8.1f ms  %6.1f M lines/s  speedup %.2f  (%d items, %d cores)\n", threads,
+               elapsed * 1e3, (double)e.sessions / elapsed / 1e6, one / elapsed, r.item_count, cores);
+        team_report_free(&r);
+    }
+
+    char cmd[300];
+    snprintf(cmd, sizeof(cmd), "rm -rf %s", dir);
+    if (system(cmd) != 0) fprintf(stderr, "Cannot remove %s\n", dir);
+}
+
+int main(int argc, char** argv) {
+    if (test_bench_mode(argc, argv)) {
+        bench();
+        return 0;
+    }
+    test_threads();
+    return test_done("report_test");
+}
@@ -0,0 +1,262 @@
+// Progress ring: the step table, the icon mask, frames moved step by step against frames drawn
+// from scratch, and icons compared pixel by pixel with the golden images in golden/. Run with
+// --update to rewrite them after a deliberate change to the drawing, and look at the new images
+// before committing them.
+#include "pomodoro-ring.h"
+#include "pomodoro-sprites.h"
+#include "test.h"
+
+#define BACKGROUND 0x8B0000 // the tray icon's
+#define TRACK 0x640000
+#define FILL 0x90EE90
+#define ICON_PIXELS (RING_ICON_SIZE * RING_ICON_SIZE)
+#define MASK_BYTES (RING_ICON_SIZE * RING_MASK_STRIDE)
+#define STRIP_ICONS 6
+#define STRIP_WIDTH (STRIP_ICONS * RING_ICON_SIZE)
+#define STRIP_HEIGHT (2 * RING_ICON_SIZE) // the icons above their masks
+
+static const int strip_steps[STRIP_ICONS] = {0, 1, 30, 61, 119, RING_STEPS};
+
+static RingTable table;
+static SpriteSet sprites;
+static const SpriteSize* sprite32;
+static uint32_t palette[256];
+
+static int load_sprites(void) {
+    static uint8_t data[1 << 20];
+    FILE* fp = fopen("../pomodoro-sprites.bin", "rb");
+    if (!fp) return 0;
+    size_t size = fread(data, 1, sizeof(data), fp);
+    fclose(fp);
+    if (!sprites_open(&sprites, data, size) || !(sprite32 = sprite_size(&sprites, 32))) return 0;
+    sprite_palette(palette, BACKGROUND);
+    return 1;
+}
+
+static int mask_bit(const uint8_t* mask, int p) {
+    return mask[p / RING_ICON_SIZE * RING_MASK_STRIDE + p % RING_ICON_SIZE / 8] >> (7 - p % 8) & 1;
+}
+
+// The face with the track, as the timer draws it when the text or the dots change
+static void draw_base(const wchar_t* text, int dots, uint32_t* base, uint8_t* mask) {
+    CHECK(sprite_draw(&sprites, sprite32, sprite_face(text), dots, palette, base, mask, RING_MASK_STRIDE));
+    ring_draw_track(&table, base, TRACK, mask, RING_MASK_STRIDE);
+}
+
+// A frame drawn from scratch
+static void draw_icon(const uint32_t* base, int steps, uint32_t* pixels) {
+    memcpy(pixels, base, ICON_PIXELS * sizeof(uint32_t));
+    ring_set_steps(&table, pixels, base, 0, steps, FILL);
+}
+
+static void test_table(void) {
+    // Every pixel at most once, inside the icon, covered, and in angle order around the clock
+    static int seen[ICON_PIXELS];
+    int once = 1, covered = 1, empty_steps = 0, clockwise = 1;
+    for (int i = 0; i < table.count; i++) {
+        once &= table.pixel[i] >= 0 && table.pixel[i] < ICON_PIXELS && !seen[table.pixel[i]]++;
+        covered &= table.coverage[i] > 0;
+    }
+    for (int s = 0; s < RING_STEPS; s++) {
+        empty_steps += table.step_start[s + 1] == table.step_start[s];
+        for (int i = table.step_start[s]; i < table.step_start[s + 1]; i++) {
+            int p = table.pixel[i];
+            double a = atan2(p % RING_ICON_SIZE + 0.5 - 16, 16 - (p / RING_ICON_SIZE + 0.5));
+            if (a < 0) a += 2 * M_PI;
+            clockwise &= (int)(a / (2 * M_PI) * RING_STEPS) == s;
+        }
+    }
+    CHECK(once && covered && clockwise && empty_steps == 0);
+    CHECK(table.step_start[0] == 0 && table.step_start[RING_STEPS] == table.count);
+    // 2.5 pixels wide around a radius of 14.25 is 224 pixels of area; the pixels along both
+    // edges are partly covered
+    CHECK(table.count > 224 && table.count < 360);
+    // The centre and the corners are not part of it
+    CHECK(!seen[16 * RING_ICON_SIZE + 16] && !seen[0] && !seen[ICON_PIXELS - 1]);
+
+    CHECK(ring_blend_pixel(0x123456, 0xABCDEF, 0) == 0x123456);
+    CHECK(ring_blend_pixel(0x123456, 0xABCDEF, 255) == 0xABCDEF);
+    CHECK(ring_blend_pixel(0x000000, 0xFEFEFE, 128) == 0x7F7F7F);
+}
+
+static void test_mask(void) {
+    static uint32_t base[ICON_PIXELS], face[ICON_PIXELS];
+    uint8_t mask[MASK_BYTES], face_mask[MASK_BYTES], pixel_mask[MASK_BYTES];
+    draw_base(L"25", 2, base, mask);
+
+    // The background around the face is transparent, the face and the whole ring are not
+    sprite_draw(&sprites, sprite32, sprite_face(L"25"), 2, palette, face, face_mask, RING_MASK_STRIDE);
+    int ring_opaque = 1, rest_kept = 1, transparent = 0;
+    for (int p = 0; p < ICON_PIXELS; p++) {
+        int on_ring = 0;
+        for (int i = 0; i < table.count; i++) on_ring |= table.pixel[i] == p;
+        if (on_ring) ring_opaque &= !mask_bit(mask, p);
+        else rest_kept &= mask_bit(mask, p) == mask_bit(face_mask, p);
+        transparent += mask_bit(mask, p);
+    }
+    CHECK(ring_opaque && rest_kept);
+    CHECK(mask_bit(mask, 0) && mask_bit(mask, ICON_PIXELS - 1));
+    CHECK(transparent > 100 && transparent < ICON_PIXELS - table.count);
+
+    // The mask of a face drawn without sprites, from its pixels, is the sprite's mask
+    ring_background_mask(face, RING_ICON_SIZE, BACKGROUND, pixel_mask, RING_MASK_STRIDE);
+    CHECK(memcmp(pixel_mask, face_mask, MASK_BYTES) == 0);
+}
+
+// The timer moves the ring by the steps that changed; after any sequence of moves, forwards and
+// back, the frame is the one drawn from scratch
+static void test_steps(void) {
+    static uint32_t base[ICON_PIXELS], pixels[ICON_PIXELS], fresh[ICON_PIXELS];
+    uint8_t mask[MASK_BYTES];
+    draw_base(L"7", 4, base, mask);
+    memcpy(pixels, base, sizeof(pixels));
+    unsigned seed = 3;
+    int steps = 0, same = 1;
+    for (int i = 0; i < 5000; i++) {
+        int to = i % 5 == 0 ? (int)(test_rand(&seed) % (RING_STEPS + 1)) : steps + (steps < RING_STEPS);
+        ring_set_steps(&table, pixels, base, steps, to, FILL);
+        steps = to;
+        draw_icon(base, steps, fresh);
+        same &= memcmp(pixels, fresh, sizeof(pixels)) == 0;
+    }
+    CHECK(same);
+
+    // Nothing but the ring changes, and no step leaves it unchanged
+    draw_icon(base, RING_STEPS, fresh);
+    int outside = 0;
+    for (int p = 0; p < ICON_PIXELS; p++) outside += fresh[p] != base[p];
+    CHECK(outside == table.count);
+}
+
+static int read_ppm(const char* path, uint32_t* pixels) {
+    FILE* fp = fopen(path, "rb");
+    int w, h, max, ok = 0;
+    if (!fp) return 0;
+    if (fscanf(fp, "P6 %d %d %d", &w, &h, &max) == 3 && w == STRIP_WIDTH && h == STRIP_HEIGHT && max == 255 &&
+        fgetc(fp) == '\n') {
+        ok = 1;
+        for (int i = 0; i < STRIP_WIDTH * STRIP_HEIGHT && ok; i++) {
+            uint8_t c[3];
+            ok = fread(c, 3, 1, fp) == 1;
+            pixels[i] = (uint32_t)c[0] << 16 | (uint32_t)c[1] << 8 | c[2];
+        }
+    }
+    fclose(fp);
+    return ok;
+}
+
+static void write_ppm(const char* path, const uint32_t* pixels) {
+    FILE* fp = fopen(path, "wb");
+    fprintf(fp, "P6\n%d %d\n255\n", STRIP_WIDTH, STRIP_HEIGHT);
+    for (int i = 0; i < STRIP_WIDTH * STRIP_HEIGHT; i++) {
+        uint8_t c[3] = {(uint8_t)(pixels[i] >> 16), (uint8_t)(pixels[i] >> 8), (uint8_t)pixels[i]};
+        fwrite(c, 3, 1, fp);
+    }
+    fclose(fp);
+}
+
+// Draw a strip of icons at strip_steps with their masks below them (white where transparent)
+// and compare it with golden/<name>.ppm; a mismatch is written next to the test
+static void check_golden(const char* name, const wchar_t* text, int dots, int update) {
+    static uint32_t strip[STRIP_WIDTH * STRIP_HEIGHT], golden[STRIP_WIDTH * STRIP_HEIGHT];
+    static uint32_t base[ICON_PIXELS], pixels[ICON_PIXELS];
+    uint8_t mask[MASK_BYTES];
+    draw_base(text, dots, base, mask);
+    for (int k = 0; k < STRIP_ICONS; k++) {
+        draw_icon(base, strip_steps[k], pixels);
+        for (int p = 0; p < ICON_PIXELS; p++) {
+            int x = k * RING_ICON_SIZE + p % RING_ICON_SIZE, y = p / RING_ICON_SIZE;
+            strip[y * STRIP_WIDTH + x] = pixels[p];
+            strip[(y + RING_ICON_SIZE) * STRIP_WIDTH + x] = mask_bit(mask, p) ? 0xFFFFFF : 0x000000;
+        }
+    }
+
+    char path[128];
+    snprintf(path, sizeof(path), "golden/%s.ppm", name);
+    if (update) {
+        write_ppm(path, strip);
+        printf("  wrote %s\n", path);
+        return;
+    }
+    if (!read_ppm(path, golden)) {
+        fprintf(stderr, "  cannot read %s\n", path);
+        CHECK(!"golden image");
+        return;
+    }
+    int differ = 0;
+    for (int i = 0; i < STRIP_WIDTH * STRIP_HEIGHT; i++) differ += strip[i] != golden[i];
+    if (differ) {
+        snprintf(path, sizeof(path), "%s.actual.ppm", name);
+        write_ppm(path, strip);
+        fprintf(stderr, "  %s: %d pixels differ, see %s\n", name, differ, path);
+    }
+    CHECK(differ == 0);
+}
+
+static void test_golden(int update) {
+    check_golden("ring-25", L"25", 2, update);
+    check_golden("ring-play", L"\u25BA", 4, update);
+}
+
+static void bench(void) {
+    static RingTable t;
+    static uint32_t base[ICON_PIXELS], pixels[ICON_PIXELS];
+    uint8_t mask[MASK_BYTES];
+    int n = 2000;
+    double begin = test_now();
+    for (int i = 0; i < n; i++) ring_build_table(&t, RING_ICON_SIZE);
+    double elapsed = test_now() - begin;
+    printf("ring table              %8.2f us/op  (once per run)\n", elapsed * 1e6 / n);
+
+    n = 200000;
+    begin = test_now();
+    for (int i = 0; i < n; i++) draw_base(i % 2 ? L"24" : L"25", 2, base, mask);
+    elapsed = test_now() - begin;
+    printf("ring face and track     %8.2f ns/op  (text or dots changed)\n", elapsed * 1e9 / n);
+
+    // One step forwards, as on a tick that crosses a step, and a whole 25 minute session
+    memcpy(pixels, base, sizeof(pixels));
+    n = 10000000;
+    begin = test_now();
+    for (int i = 0; i < n; i++) {
+        int from = i % RING_STEPS;
+        ring_set_steps(&table, pixels, base, from, from + 1, FILL);
+        if (from + 1 == RING_STEPS) ring_set_steps(&table, pixels, base, RING_STEPS, 0, FILL);
+    }
+    elapsed = test_now() - begin;
+    printf("ring one step           %8.2f ns/op\n", elapsed * 1e9 / n);
+
+    n = 20000;
+    begin = test_now();
+    for (int i = 0; i < n; i++) {
+        int steps = 0;
+        for (int second = 1; second <= 1500; second++) {
+            int to = second * RING_STEPS / 1500;
+            if (to != steps) ring_set_steps(&table, pixels, base, steps, to, FILL);
+            steps = to;
+        }
+        ring_set_steps(&table, pixels, base, steps, 0, FILL);
+    }
+    elapsed = test_now() - begin;
+    printf("ring 25 minute session  %8.2f us/op  (1500 ticks)\n", elapsed * 1e6 / n);
+}
+
+int main(int argc, char** argv) {
+    if (!load_sprites()) {
+        fprintf(stderr, "Cannot load ../pomodoro-sprites.bin\n");
+        return 1;
+    }
+    ring_build_table(&table, RING_ICON_SIZE);
+    if (test_bench_mode(argc, argv)) {
+        bench();
+        return 0;
+    }
+    int update = argc > 1 && strcmp(argv[1], "--update") == 0;
+    if (!update) {
+        test_table();
+        test_mask();
+        test_steps();
+    }
+    test_golden(update);
+    return test_done("ring_test");
+}
@@ -0,0 +1,176 @@
+// Session state file: the layout, damaged and foreign files, a writer killed at arbitrary points
+// (which must leave a whole record every time), and what a start does with the record it finds;
+// and benchmarks of a save and a load.
+#include <signal.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include "pomodoro-session.h"
+#include "test.h"
+
+static char path[128], tmp_path[160];
+
+// Every field follows from n, so a record mixed from two saves does not pass check_record
+static void make_record(SessionState* st, uint32_t n) {
+    memset(st, 0, sizeof(*st));
+    st->running = n % 2;
+    st->kind = n % 3;
+    st->is_in_pomodoro = st->kind == 0;
+    st->pomodoro_count = n % 5;
+    st->planned_seconds = 1500;
+    st->start_time = 1700000000 + (int64_t)n * 60;
+    st->deadline = st->start_time + 1500;
+    st->today_pomodoros = n;
+    st->today_focus_seconds = n * 7;
+    st->today = 19675 + (int32_t)(n / 100);
+    st->label = n % 11;
+    st->today_synced = n * 3;
+}
+
+static int check_record(const SessionState* st, uint32_t* n) {
+    SessionState want;
+    make_record(&want, st->today_pomodoros);
+    want.magic = st->magic;
+    want.checksum = st->checksum;
+    *n = st->today_pomodoros;
+    return memcmp(&want, st, sizeof(want)) == 0;
+}
+
+static void write_bytes(const char* p, const void* data, size_t size) {
+    FILE* fp = fopen(p, "wb");
+    fwrite(data, 1, size, fp);
+    fclose(fp);
+}
+
+static void test_layout(void) {
+    // The file is the struct as it is in memory, the same on Windows and Linux
+    CHECK(sizeof(SessionState) == 64);
+    CHECK(offsetof(SessionState, start_time) == 24 && offsetof(SessionState, today) == 48);
+    CHECK(offsetof(SessionState, checksum) == 60);
+
+    SessionState st, loaded;
+    uint32_t n;
+    make_record(&st, 42);
+    remove(path);
+    CHECK(!session_state_load(&loaded, path));
+    CHECK(session_state_save(&st, path) && session_state_load(&loaded, path) && check_record(&loaded, &n) && n == 42);
+    CHECK(access(tmp_path, F_OK) != 0);
+
+    // Short files, every flipped bit, another magic or an unknown kind are refused
+    for (size_t size = 0; size < sizeof(st); size++) {
+        write_bytes(path, &st, size);
+        CHECK(!session_state_load(&loaded, path));
+    }
+    int flips_found = 1;
+    for (size_t bit = 0; bit < offsetof(SessionState, checksum) * 8; bit++) {
+        SessionState bad = st;
+        ((uint8_t*)&bad)[bit / 8] ^= (uint8_t)(1 << bit % 8);
+        write_bytes(path, &bad, sizeof(bad));
+        flips_found &= !session_state_load(&loaded, path);
+    }
+    CHECK(flips_found);
+    SessionState bad = st;
+    bad.kind = SESSION_STATE_KINDS;
+    bad.checksum = session_state_checksum(&bad);
+    write_bytes(path, &bad, sizeof(bad));
+    CHECK(!session_state_load(&loaded, path));
+    bad = st;
+    bad.magic = 0x33534D50; // the layout before the sync journal
+    bad.checksum = session_state_checksum(&bad);
+    write_bytes(path, &bad, sizeof(bad));
+    CHECK(!session_state_load(&loaded, path));
+
+    // A save that dies before the rename leaves the previous record
+    CHECK(session_state_save(&st, path));
+    SessionState next;
+    make_record(&next, 43);
+    write_bytes(tmp_path, &next, sizeof(next) / 2);
+    CHECK(session_state_load(&loaded, path) && check_record(&loaded, &n) && n == 42);
+    CHECK(session_state_save(&next, path) && session_state_load(&loaded, path) && check_record(&loaded, &n) && n == 43);
+}
+
+// A child saves records 1, 2, 3, ... as fast as it can and is killed after a random delay. Whatever
+// the point of the kill, the file holds one whole record, never one before the last one found.
+static void test_kill(void) {
+    unsigned seed = 5;
+    uint32_t last = 0, kills = 0, advanced = 0;
+    remove(path);
+    for (int round = 0; round < 300; round++) {
+        pid_t pid = fork();
+        if (pid == 0) {
+            SessionState st;
+            for (uint32_t n = last + 1;; n++) {
+                make_record(&st, n);
+                if (!session_state_save(&st, path)) _exit(1);
+            }
+        }
+        usleep(test_rand(&seed) % 3000);
+        kill(pid, SIGKILL);
+        int status;
+        waitpid(pid, &status, 0);
+        kills += WIFSIGNALED(status);
+
+        SessionState loaded;
+        uint32_t n = 0;
+        if (!session_state_load(&loaded, path)) {
+            CHECK(last == 0); // only before the first save got through
+            continue;
+        }
+        CHECK(check_record(&loaded, &n) && n >= last);
+        advanced += n > last;
+        last = n;
+    }
+    printf("  300 writers killed at random points: %u killed, %u records saved, %u kills after a new record\n", kills, last,
+           advanced);
+    CHECK(kills == 300 && advanced > 100);
+    remove(tmp_path);
+}
+
+// What the timer does at start with the record of a session that was killed
+static void test_restore(void) {
+    SessionState st, loaded;
+    int left;
+    make_record(&st, 1); // running, planned 1500 s
+    CHECK(st.running && session_state_save(&st, path) && session_state_load(&loaded, path));
+    CHECK(session_state_resume(&loaded, st.start_time, &left) == SESSION_STATE_RESUME && left == 1500);
+    CHECK(session_state_resume(&loaded, st.start_time + 600, &left) == SESSION_STATE_RESUME && left == 900);
+    CHECK(session_state_resume(&loaded, st.deadline - 1, &left) == SESSION_STATE_RESUME && left == 1);
+    CHECK(session_state_resume(&loaded, st.deadline, &left) == SESSION_STATE_EXPIRED && left == 0);
+    CHECK(session_state_resume(&loaded, st.deadline + 86400, &left) == SESSION_STATE_EXPIRED);
+    // The clock went back past the start
+    CHECK(session_state_resume(&loaded, st.start_time - 60, &left) == SESSION_STATE_EXPIRED);
+
+    make_record(&st, 2); // stopped
+    CHECK(!st.running && session_state_save(&st, path) && session_state_load(&loaded, path));
+    CHECK(session_state_resume(&loaded, st.start_time + 600, &left) == SESSION_STATE_IDLE && left == 0);
+    remove(path);
+}
+
+static void bench(void) {
+    SessionState st, loaded;
+    make_record(&st, 7);
+    int n = 200;
+    double t0 = test_now();
+    for (int i = 0; i < n; i++) session_state_save(&st, path);
+    double t1 = test_now();
+    for (int i = 0; i < n * 50; i++) session_state_load(&loaded, path);
+    double t2 = test_now();
+    printf("save (write, fsync, rename): %.1f us\n", (t1 - t0) * 1e6 / n);
+    printf("load and check: %.2f us\n", (t2 - t1) * 1e6 / (n * 50));
+    remove(path);
+}
+
+int main(int argc, char** argv) {
+    const char* dir = test_temp_dir();
+    snprintf(path, sizeof(path), "%s/pomodoro_state.dat", dir);
+    snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", path);
+    if (test_bench_mode(argc, argv)) {
+        bench();
+    } else {
+        test_layout();
+        test_kill();
+        test_restore();
+    }
+    remove(tmp_path);
+    rmdir(dir);
+    return test_bench_mode(argc, argv) ? 0 : test_done("session_test");
+}
@@ -0,0 +1,243 @@
+// Settings reload: parsing, limits and files cut short, the difference a change makes, and a
+// stress test of a watcher (inotify, like the timer's ReadDirectoryChangesW thread) applying a
+// file that a writer rewrites as fast as it can, in pieces and in place; and benchmarks of a parse
+// and a reload.
+#include <poll.h>
+#include <pthread.h>
+#include <stddef.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+#include "pomodoro-settings.h"
+#include "test.h"
+
+#define DEFAULTS {25, 5, 15, 1, 1, 0, 0, 10}
+#define WRITES 3000
+#define PERIOD 240 // make_settings repeats after this many
+
+static char dir[64], path[128];
+
+// Settings whose every field follows from n, so a file mixed from two writes is not one of them
+static TimerSettings make_settings(int n) {
+    TimerSettings s = {n % 120 + 1, n * 7 % 60 + 1, n * 13 % 120 + 1, n & 1, n >> 1 & 1, n >> 2 & 1, n >> 3 & 1, n % 10 + 1};
+    return s;
+}
+
+static int same(const TimerSettings* a, const TimerSettings* b) {
+    return memcmp(a, b, sizeof(*a)) == 0;
+}
+
+static void test_parse(void) {
+    TimerSettings s = DEFAULTS, want = DEFAULTS, t;
+    char text[SETTINGS_TEXT_MAX];
+    CHECK(settings_parse("{}", &s) && same(&s, &want));
+    CHECK(settings_parse(" {\"pomodoro_duration\":50, \"progress_ring\":1}\r\n", &s));
+    want.pomodoro_duration = 50;
+    want.progress_ring = 1;
+    CHECK(same(&s, &want));
+
+    // Outside the dialog's limits: kept; switches are 0 or 1
+    CHECK(settings_parse("{\"pomodoro_duration\":0,\"short_break_duration\":61,\"long_break_duration\":-5,"
+                         "\"countdown_seconds\":11,\"enable_clock_sound\":7}", &s));
+    CHECK(same(&s, &want));
+    CHECK(settings_parse("{\"pomodoro_duration\":120,\"short_break_duration\":60,\"countdown_seconds\":1}", &s));
+    CHECK(s.pomodoro_duration == 120 && s.short_break_duration == 60 && s.countdown_seconds == 1);
+
+    // Round trip through the file the timer writes, with nothing left behind
+    for (int n = 0; n < PERIOD; n++) {
+        TimerSettings w = make_settings(n);
+        t = (TimerSettings)DEFAULTS;
+        CHECK(settings_save(&w, path) && settings_read_file(path, &t) && same(&t, &w));
+    }
+    char tmp[160];
+    snprintf(tmp, sizeof(tmp), "%s.tmp", path);
+    CHECK(access(tmp, F_OK) != 0);
+
+    // Every text cut short is refused and changes nothing, e.g. "25" read as "2"
+    TimerSettings w = make_settings(24);
+    int len = settings_format(&w, text, sizeof(text)), refused = 1;
+    for (int cut = 0; cut < len; cut++) {
+        char part[SETTINGS_TEXT_MAX];
+        memcpy(part, text, (size_t)cut);
+        part[cut] = '\0';
+        t = (TimerSettings)DEFAULTS;
+        refused &= !settings_parse(part, &t) && same(&t, &(TimerSettings)DEFAULTS);
+    }
+    CHECK(refused);
+    CHECK(!settings_parse("", &t) && !settings_parse("not json}", &t) && !settings_parse("{\"a\":1} x", &t));
+    remove(path);
+    CHECK(!settings_read_file(path, &t));
+    fclose(fopen(path, "wb"));
+    CHECK(!settings_read_file(path, &t));
+    remove(path);
+}
+
+static void test_diff(void) {
+    TimerSettings a = DEFAULTS, b;
+    CHECK(settings_diff(&a, &a) == 0);
+    static const struct {
+        size_t offset;
+        int diff;
+    } fields[] = {
+        {offsetof(TimerSettings, pomodoro_duration), SETTINGS_DIFF_DURATIONS},
+        {offsetof(TimerSettings, short_break_duration), SETTINGS_DIFF_DURATIONS},
+        {offsetof(TimerSettings, long_break_duration), SETTINGS_DIFF_DURATIONS},
+        {offsetof(TimerSettings, enable_clock_sound), SETTINGS_DIFF_CLOCK_SOUND},
+        {offsetof(TimerSettings, show_completion_dialog), SETTINGS_DIFF_DIALOG},
+        {offsetof(TimerSettings, progress_ring), SETTINGS_DIFF_RING},
+        {offsetof(TimerSettings, countdown_animation), SETTINGS_DIFF_COUNTDOWN},
+        {offsetof(TimerSettings, countdown_seconds), SETTINGS_DIFF_COUNTDOWN},
+    };
+    CHECK(sizeof(fields) / sizeof(fields[0]) == sizeof(TimerSettings) / sizeof(int));
+    // Each field affects its own part only, and changes add up
+    int all = 0;
+    b = a;
+    for (size_t i = 0; i < sizeof(fields) / sizeof(fields[0]); i++) {
+        TimerSettings one = a;
+        *(int*)((char*)&one + fields[i].offset) ^= 1;
+        *(int*)((char*)&b + fields[i].offset) ^= 1;
+        all |= fields[i].diff;
+        CHECK(settings_diff(&a, &one) == fields[i].diff && settings_diff(&one, &a) == fields[i].diff);
+        CHECK(settings_diff(&a, &b) == all);
+    }
+    CHECK((SETTINGS_DIFF_MENU & (SETTINGS_DIFF_DURATIONS | SETTINGS_DIFF_COUNTDOWN)) == 0);
+}
+
+// The writer rewrites the file WRITES times, mostly in place in two pieces with a pause between
+// them (as an editor or a configuration tool may), sometimes as the timer does (renamed over it).
+static volatile int writes_done = 0;
+
+static void* writer(void* arg) {
+    (void)arg;
+    unsigned seed = 11;
+    char text[SETTINGS_TEXT_MAX];
+    for (int n = 1; n <= WRITES; n++) {
+        TimerSettings s = make_settings(n);
+        if (n % 8 == 0) {
+            settings_save(&s, path);
+        } else {
+            int len = settings_format(&s, text, sizeof(text)), split = (int)(test_rand(&seed) % (unsigned)len);
+            FILE* fp = fopen(path, "wb");
+            fwrite(text, 1, (size_t)split, fp);
+            fflush(fp);
+            if (n % 3 == 0) usleep(test_rand(&seed) % 200);
+            fwrite(text + split, 1, (size_t)(len - split), fp);
+            fclose(fp);
+        }
+        __atomic_store_n(&writes_done, n, __ATOMIC_RELEASE);
+        if (n % 5 == 0) usleep(test_rand(&seed) % 300);
+    }
+    return NULL;
+}
+
+// The watcher, as settings_watch_thread: a change to the file, a short debounce, a read and a
+// parse on this thread, and the difference applied. Every applied file must be one that was
+// written whole, never older than one applied before, and the last one written must be applied.
+static void test_watcher(void) {
+    int fd = inotify_init1(IN_NONBLOCK);
+    CHECK(fd >= 0 && inotify_add_watch(fd, dir, IN_CLOSE_WRITE | IN_MODIFY | IN_MOVED_TO | IN_CREATE) >= 0);
+    TimerSettings applied = make_settings(0);
+    CHECK(settings_save(&applied, path));
+
+    pthread_t thread;
+    pthread_create(&thread, NULL, writer, NULL);
+    int last_n = 0, valid = 1, in_order = 1, events = 0, reads = 0, refused = 0, applies = 0, quiet = 0;
+    int reactions[5] = {0};
+    double begin = test_now(), max_apply = 0;
+    while (quiet < 50) {
+        struct pollfd p = {fd, POLLIN, 0};
+        if (poll(&p, 1, 10) <= 0) {
+            // Nothing for 10 ms; stop once the writer is done and the last file was handled
+            quiet += __atomic_load_n(&writes_done, __ATOMIC_ACQUIRE) == WRITES;
+            continue;
+        }
+        char buf[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+        int matched = 0;
+        ssize_t len;
+        while ((len = read(fd, buf, sizeof(buf))) > 0) {
+            for (char* e = buf; e < buf + len; e += sizeof(struct inotify_event) + ((struct inotify_event*)e)->len) {
+                const struct inotify_event* ev = (const struct inotify_event*)e;
+                matched |= ev->len && strcmp(ev->name, "pomodoro_settings.json") == 0;
+                events++;
+            }
+        }
+        if (!matched) continue;
+        quiet = 0;
+        usleep(1000); // the timer waits SETTINGS_DEBOUNCE_MS
+
+        double t0 = test_now();
+        TimerSettings updated = applied;
+        reads++;
+        if (!settings_read_file(path, &updated)) {
+            refused++;
+            continue;
+        }
+        int diff = settings_diff(&applied, &updated);
+        if (!diff) continue;
+        // Which write is this? The first match from the last one applied on
+        int n;
+        for (n = last_n; n <= WRITES; n++) {
+            TimerSettings w = make_settings(n);
+            if (same(&updated, &w)) break;
+        }
+        valid &= n <= WRITES;
+        in_order &= n >= last_n && n - last_n < PERIOD;
+        if (n <= WRITES) last_n = n;
+        for (int bit = 0; bit < 5; bit++) reactions[bit] += diff >> bit & 1;
+        applied = updated;
+        applies++;
+        double t = test_now() - t0;
+        if (t > max_apply) max_apply = t;
+    }
+    pthread_join(thread, NULL);
+    double elapsed = test_now() - begin;
+    TimerSettings last = make_settings(WRITES);
+    printf("  %d writes in %.2f s: %d events, %d reads, %d refused as cut short, %d applied "
+           "(durations %d, sound %d, toast %d, ring %d, countdown %d), slowest read and apply %.0f us\n",
+           WRITES, elapsed, events, reads, refused, applies, reactions[0], reactions[1], reactions[2], reactions[3],
+           reactions[4], max_apply * 1e6);
+    CHECK(valid && in_order && same(&applied, &last));
+    CHECK(refused > 0 && applies > 10);
+    close(fd);
+    remove(path);
+}
+
+static void bench(void) {
+    char text[SETTINGS_TEXT_MAX];
+    TimerSettings s = make_settings(77), t;
+    settings_format(&s, text, sizeof(text));
+    int n = 1000000;
+    double begin = test_now();
+    for (int i = 0; i < n; i++) {
+        t = (TimerSettings)DEFAULTS;
+        settings_parse(text, &t);
+    }
+    double elapsed = test_now() - begin;
+    printf("settings parse          %8.2f ns/op\n", elapsed * 1e9 / n);
+
+    settings_save(&s, path);
+    n = 100000;
+    begin = test_now();
+    volatile int diff = 0;
+    for (int i = 0; i < n; i++) {
+        t = (TimerSettings)DEFAULTS;
+        settings_read_file(path, &t);
+        diff += settings_diff(&s, &t);
+    }
+    elapsed = test_now() - begin;
+    printf("settings reload         %8.2f us/op  (read, parse and diff)\n", elapsed * 1e6 / n);
+    remove(path);
+}
+
+int main(int argc, char** argv) {
+    snprintf(dir, sizeof(dir), "%s", test_temp_dir());
+    snprintf(path, sizeof(path), "%s/pomodoro_settings.json", dir);
+    if (test_bench_mode(argc, argv)) {
+        bench();
+    } else {
+        test_parse();
+        test_diff();
+        test_watcher();
+    }
+    rmdir(dir);
+    return test_bench_mode(argc, argv) ? 0 : test_done("settings_test");
+}
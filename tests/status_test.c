@@ -0,0 +1,166 @@
+// Status segment: publish and read back, and a seqlock stress test with reader processes
+// hammering the segment while the writer publishes; no reader may see a torn snapshot.
+#include <signal.h>
+#include <sys/wait.h>
+
+static char status_test_name[64];
+#define POMODORO_STATUS_NAME_POSIX status_test_name // a name of our own, not the running timer's
+#include "pomodoro-status.h"
+#include "test.h"
+
+#define STRESS_READERS 3
+#define STRESS_SECONDS 1.0
+
+// Every field is derived from n, so a snapshot mixing two updates is caught
+static void status_for(uint32_t n, PomodoroStatus* s) {
+    memset(s, 0, sizeof(*s));
+    s->kind = n % 3;
+    s->running = n & 1;
+    s->pomodoro_count = n % 5;
+    s->planned_seconds = n % 7200 + 1;
+    s->deadline = (int64_t)n * 7 + 1700000000;
+    s->start_time = s->deadline - s->planned_seconds;
+    s->today_pomodoros = n;
+    s->today_focus_seconds = n * 3;
+    s->today = (int32_t)(n ^ 0x5A5A);
+}
+
+static int status_consistent(const PomodoroStatus* s) {
+    PomodoroStatus expected;
+    status_for(s->today_pomodoros, &expected);
+    return s->kind == expected.kind && s->running == expected.running && s->pomodoro_count == expected.pomodoro_count &&
+           s->planned_seconds == expected.planned_seconds && s->deadline == expected.deadline &&
+           s->start_time == expected.start_time && s->today_focus_seconds == expected.today_focus_seconds &&
+           s->today == expected.today;
+}
+
+typedef struct {
+    volatile int stop;
+    long long reads[STRESS_READERS];
+    long long torn[STRESS_READERS];
+    long long backwards[STRESS_READERS];
+} StressShared;
+
+static void stress_reader(StressShared* shared, int id) {
+    const volatile PomodoroStatus* seg = pomodoro_status_open();
+    if (!seg) _exit(3);
+    uint32_t last = 0;
+    while (!shared->stop) {
+        PomodoroStatus s;
+        if (!pomodoro_status_read(seg, &s)) continue; // the writer kept it busy for 10000 tries
+        shared->reads[id]++;
+        if (!status_consistent(&s)) shared->torn[id]++;
+        if (s.today_pomodoros < last) shared->backwards[id]++;
+        last = s.today_pomodoros;
+    }
+    pomodoro_status_close(seg);
+    _exit(0);
+}
+
+static void test_publish_and_read(void) {
+    CHECK(pomodoro_status_open() == NULL);
+    volatile PomodoroStatus* seg = pomodoro_status_create();
+    CHECK(seg != NULL);
+    if (!seg) return;
+    PomodoroStatus s, out;
+    status_for(42, &s);
+    pomodoro_status_publish(seg, &s);
+    const volatile PomodoroStatus* reader = pomodoro_status_open();
+    CHECK(reader != NULL);
+    CHECK(pomodoro_status_read(reader, &out));
+    CHECK(out.seq == 2 && out.magic == POMODORO_STATUS_MAGIC && out.version == POMODORO_STATUS_VERSION);
+    CHECK(out.today_pomodoros == 42 && status_consistent(&out));
+
+    // A second writer (a restarted timer) opens the same segment and continues the sequence
+    volatile PomodoroStatus* again = pomodoro_status_create();
+    CHECK(again != NULL);
+    status_for(43, &s);
+    pomodoro_status_publish(again, &s);
+    CHECK(pomodoro_status_read(reader, &out) && out.seq == 4 && out.today_pomodoros == 43);
+
+    // Readers see nothing valid in a segment no writer has filled in
+    pomodoro_status_remove();
+    seg = pomodoro_status_create();
+    CHECK(seg != NULL && !pomodoro_status_read(pomodoro_status_open(), &out));
+    pomodoro_status_remove();
+    CHECK(pomodoro_status_open() == NULL);
+}
+
+static void test_stress(void) {
+    volatile PomodoroStatus* seg = pomodoro_status_create();
+    CHECK(seg != NULL);
+    if (!seg) return;
+    PomodoroStatus s;
+    status_for(0, &s);
+    pomodoro_status_publish(seg, &s);
+    StressShared* shared = (StressShared*)mmap(NULL, sizeof(StressShared), PROT_READ | PROT_WRITE,
+                                               MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    memset(shared, 0, sizeof(*shared));
+    pid_t readers[STRESS_READERS];
+    for (int i = 0; i < STRESS_READERS; i++) {
+        readers[i] = fork();
+        if (readers[i] == 0) stress_reader(shared, i);
+    }
+
+    uint32_t n = 0;
+    double end = test_now() + STRESS_SECONDS;
+    while (test_now() < end) {
+        for (int i = 0; i < 1000; i++) {
+            status_for(++n, &s);
+            pomodoro_status_publish(seg, &s);
+        }
+    }
+    shared->stop = 1;
+    long long reads = 0, torn = 0;
+    for (int i = 0; i < STRESS_READERS; i++) {
+        int status = 0;
+        waitpid(readers[i], &status, 0);
+        CHECK(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+        CHECK(shared->torn[i] == 0);
+        CHECK(shared->backwards[i] == 0);
+        reads += shared->reads[i];
+        torn += shared->torn[i];
+    }
+    CHECK(reads > 0);
+    printf("  %u updates, %lld snapshots by %d readers, %lld torn\n", n, reads, STRESS_READERS, torn);
+    munmap(shared, sizeof(*shared));
+    pomodoro_status_remove();
+}
+
+static void bench(void) {
+    volatile PomodoroStatus* seg = pomodoro_status_create();
+    const volatile PomodoroStatus* reader = pomodoro_status_open();
+    if (!seg || !reader) {
+        fprintf(stderr, "Cannot create the status segment\n");
+        return;
+    }
+    PomodoroStatus s, out = {0};
+    const int n = 10000000;
+    double begin = test_now();
+    for (int i = 0; i < n; i++) {
+        status_for((uint32_t)i, &s);
+        pomodoro_status_publish(seg, &s);
+    }
+    double publish = test_now() - begin;
+    begin = test_now();
+    uint64_t sink = 0;
+    for (int i = 0; i < n; i++) {
+        pomodoro_status_read(reader, &out);
+        sink += out.today_pomodoros;
+    }
+    double read = test_now() - begin;
+    printf("status publish      %8.1f ns/op\n", publish * 1e9 / n);
+    printf("status read         %8.1f ns/op  (%llu)\n", read * 1e9 / n, (unsigned long long)(sink & 1));
+    pomodoro_status_remove();
+}
+
+int main(int argc, char** argv) {
+    snprintf(status_test_name, sizeof(status_test_name), "/pomodoro-status-test-%d", (int)getpid());
+    if (test_bench_mode(argc, argv)) {
+        bench();
+        return 0;
+    }
+    test_publish_and_read();
+    test_stress();
+    return test_done("status_test");
+}
@@ -0,0 +1,459 @@
+// History sync: parsing of segment and journal lines, the journal as merge cursor, and many
+// machines merged in random order with crashes at arbitrary points, which must give every record
+// exactly once in every total; and benchmarks of a merge and of a replay at start.
+#include <sys/stat.h>
+#include <unistd.h>
+#include "pomodoro-sync.h"
+#include "test.h"
+
+#define TODAY 20380 // day number of the today counters, days since 1970 here
+#define MACHINES 12
+#define RECORDS 300 // per machine
+
+static const char* const kinds[] = {"pomodoro", "short_break", "long_break"};
+static const char* const outcomes[] = {"completed", "stopped", "expired"};
+static const char* const names[] = {"Write report", "Email", "Review, part 2", "", "Ops", "Design"};
+
+static int32_t day_of(int64_t t) { return (int32_t)(t / 86400); }
+static int hour_of(int64_t t) { return (int)(t / 3600 % 24); }
+
+static long file_size(const char* path) {
+    struct stat st;
+    return stat(path, &st) == 0 ? (long)st.st_size : -1;
+}
+
+static void test_parse(void) {
+    char line[200];
+    SyncRecord r;
+    strcpy(line, "12,1700000000,pomodoro,1500,1500,completed,80,Write, report\r");
+    CHECK(sync_parse_segment_line(line, &r) && r.seq == 12 && r.row.start == 1700000000 && r.row.kind == SYNC_POMODORO &&
+          r.row.outcome == 0 && r.row.focus == 80 && r.machine == NULL && strcmp(r.label, "Write, report") == 0);
+    strcpy(line, "5,1700000000,short_break,300,300,completed,,");
+    CHECK(sync_parse_segment_line(line, &r) && r.row.kind == 1 && r.row.focus == ARCHIVE_NO_FOCUS && r.label[0] == '\0');
+    strcpy(line, "7,1700000000,pomodoro,1500,900,stopped");
+    CHECK(sync_parse_segment_line(line, &r) && r.row.outcome == SYNC_STOPPED && r.row.actual == 900 && r.label[0] == '\0');
+    // A label that looks like a number is still a name
+    strcpy(line, "7,1700000000,pomodoro,1500,900,stopped,,42");
+    CHECK(sync_parse_segment_line(line, &r) && r.row.label == 0 && strcmp(r.label, "42") == 0);
+    const char* bad[] = {"", "x,1700000000,pomodoro,1,1,completed", "0,1700000000,pomodoro,1,1,completed",
+                         "3,1700000000,nap,1,1,completed", "3,1700000000,pomodoro,1,1"};
+    for (size_t i = 0; i < sizeof(bad) / sizeof(bad[0]); i++) {
+        strcpy(line, bad[i]);
+        CHECK(!sync_parse_segment_line(line, &r));
+    }
+
+    strcpy(line, "laptop,9,1700000000,long_break,900,900,expired,,Ops");
+    CHECK(sync_parse_journal_line(line, &r) && strcmp(r.machine, "laptop") == 0 && r.seq == 9 && r.row.kind == 2 &&
+          r.row.outcome == 2 && strcmp(r.label, "Ops") == 0);
+    strcpy(line, ",9,1700000000,long_break,900,900,expired,,Ops");
+    CHECK(!sync_parse_journal_line(line, &r));
+
+    SyncJournal j;
+    memset(&j, 0, sizeof(j));
+    SyncPeer* p = sync_peer(&j, "Laptop");
+    CHECK(p && sync_peer(&j, "LAPTOP") == p && j.peer_count == 1);
+    CHECK(!sync_peer(&j, "a,b") && !sync_peer(&j, "") && j.peer_count == 1);
+    char name[16];
+    for (int i = 1; i < SYNC_MAX_PEERS; i++) {
+        snprintf(name, sizeof(name), "pc%d", i);
+        CHECK(sync_peer(&j, name) != NULL);
+    }
+    CHECK(!sync_peer(&j, "one-too-many") && sync_peer(&j, "pc7") != NULL);
+}
+
+static void count_visit(const SyncRecord* r, uint32_t number, void* context) {
+    (void)r;
+    uint32_t* last = (uint32_t*)context;
+    CHECK(number == *last + 1);
+    *last = number;
+}
+
+// The journal is the cursor: seqs at or below the last one are skipped, also after a reload,
+// and a line cut short by a crash is dropped before the next append
+static void test_journal(void) {
+    const char* dir = test_temp_dir();
+    char path[160];
+    snprintf(path, sizeof(path), "%s/peers.csv", dir);
+    SyncJournal j;
+    memset(&j, 0, sizeof(j));
+    CHECK(sync_journal_load(&j, path, NULL, NULL) == 0);
+    SyncPeer* p = sync_peer(&j, "desk");
+
+    char tail[512] = "1,1700000000,pomodoro,1500,1500,completed,,A\n"
+                     "3,1700001800,pomodoro,1500,1500,completed,,B\n"
+                     "garbage\n"
+                     "2,1700003600,pomodoro,1500,1500,completed,,C\n"
+                     "4,1700005400,short_break,300,300,completed,,\n";
+    uint32_t last = 0;
+    CHECK(sync_merge_tail(&j, p, tail, count_visit, &last) == 3 && last == 3 && j.count == 3 && p->last_seq == 4);
+    strcpy(tail, "3,1700001800,pomodoro,1500,1500,completed,,B\n4,1700005400,short_break,300,300,completed,,\n");
+    CHECK(sync_merge_tail(&j, p, tail, count_visit, &last) == 0 && j.count == 3);
+
+    // A crash in the middle of an append leaves part of a line
+    long whole = file_size(path);
+    FILE* fp = fopen(path, "ab");
+    fputs("desk,5,1700007200,pomo", fp);
+    fclose(fp);
+    memset(&j, 0, sizeof(j));
+    last = 0;
+    CHECK(sync_journal_load(&j, path, count_visit, &last) == 3 && last == 3 && file_size(path) == whole);
+    p = sync_peer(&j, "DESK");
+    CHECK(p && p->last_seq == 4);
+    strcpy(tail, "5,1700007200,pomodoro,1500,1500,completed,,A\n");
+    CHECK(sync_merge_tail(&j, p, tail, count_visit, &last) == 1 && last == 4);
+    memset(&j, 0, sizeof(j));
+    last = 0;
+    CHECK(sync_journal_load(&j, path, count_visit, &last) == 4 && j.peer_count == 1 && j.peers[0].last_seq == 5);
+
+    // Nothing is taken if the journal cannot be written
+    snprintf(j.path, sizeof(j.path), "%s/missing/peers.csv", dir);
+    strcpy(tail, "6,1700009000,pomodoro,1500,1500,completed,,A\n");
+    CHECK(sync_merge_tail(&j, &j.peers[0], tail, count_visit, &last) == -1 && j.count == 4 && j.peers[0].last_seq == 5);
+    remove(path);
+    rmdir(dir);
+}
+
+// Every machine's segment, written in pieces as the test goes
+typedef struct {
+    char name[16];
+    char* text;
+    size_t size, written;
+} Segment;
+
+static Segment segments[MACHINES];
+static unsigned seed;
+
+// What the totals must come to, from the records themselves
+static uint32_t ref_days[16];    // days TODAY - 8 .. TODAY + 7
+static uint32_t ref_label_count[6];
+static int64_t ref_label_seconds[6];
+static int ref_today_pomodoros, ref_today_focus;
+static uint32_t ref_records;
+
+static void make_segments(void) {
+    memset(ref_days, 0, sizeof(ref_days));
+    memset(ref_label_count, 0, sizeof(ref_label_count));
+    memset(ref_label_seconds, 0, sizeof(ref_label_seconds));
+    ref_today_pomodoros = ref_today_focus = 0;
+    ref_records = 0;
+    seed = 7;
+    for (int m = 0; m < MACHINES; m++) {
+        Segment* s = &segments[m];
+        snprintf(s->name, sizeof(s->name), "pc-%02d", m);
+        s->text = (char*)malloc(RECORDS * 96);
+        s->size = s->written = 0;
+        long long seq = 0;
+        for (int i = 0; i < RECORDS; i++) {
+            seq += 1 + test_rand(&seed) % 80; // byte offsets in the real segments
+            int day = TODAY - 8 + (int)(test_rand(&seed) % 16);
+            long long start = (long long)day * 86400 + test_rand(&seed) % 86400;
+            int kind = test_rand(&seed) % 10 < 7 ? 0 : 1 + (int)(test_rand(&seed) % 2);
+            int outcome = (int)(test_rand(&seed) % 10);
+            outcome = outcome < 6 ? 0 : outcome < 9 ? 1 : 2;
+            int actual = outcome == 1 ? (int)(test_rand(&seed) % 1500) : 1500;
+            int label = (int)(test_rand(&seed) % 6);
+            char focus[8] = "";
+            if (test_rand(&seed) % 2) snprintf(focus, sizeof(focus), "%u", test_rand(&seed) % 101);
+            s->size += (size_t)sprintf(s->text + s->size, "%lld,%lld,%s,1500,%d,%s,%s,%s\n", seq, start, kinds[kind], actual,
+                                       outcomes[outcome], focus, names[label]);
+            ref_records++;
+            if (kind != 0) continue;
+            if (outcome != 1) ref_days[day - (TODAY - 8)]++;
+            if (day == TODAY) {
+                ref_today_pomodoros += outcome != 1;
+                ref_today_focus += actual;
+            }
+            if (names[label][0] && actual > 0) {
+                ref_label_count[label]++;
+                ref_label_seconds[label] += actual;
+            }
+        }
+    }
+}
+
+// One machine that merges the segments: its files, what it has in memory, and when it dies
+typedef struct {
+    char dir[64], names_path[128], totals_path[128], days_path[128], model_path[128], journal_path[128];
+    LabelTable labels;
+    HeatmapDays days;
+    AdaptModel model;
+    int today_pomodoros, today_focus;
+    uint32_t today_synced;
+    int saved_pomodoros, saved_focus;   // the session state file
+    uint32_t saved_synced;
+    int64_t saved_offsets[MACHINES];    // the sync state file
+    SyncJournal journal;
+    SyncTotals totals;
+    int crash_in;                       // records to add before it dies, -1 for never
+    int crashes;
+} Replica;
+
+static void add_record(const SyncRecord* r, uint32_t number, void* context) {
+    Replica* rp = (Replica*)context;
+    if (rp->crash_in == 0) return; // dead, nothing more happens
+    if (rp->crash_in > 0) rp->crash_in--;
+    sync_totals_add(&rp->totals, r, number, day_of(r->row.start), hour_of(r->row.start), TODAY);
+}
+
+static void rebuild_record(const SyncRecord* r, uint32_t number, void* context) {
+    (void)number;
+    Replica* rp = (Replica*)context;
+    if (r->row.kind != SYNC_POMODORO) return;
+    if (r->row.outcome != SYNC_STOPPED) heatmap_days_add(&rp->days, day_of(r->row.start), 1);
+    adapt_record(&rp->model, hour_of(r->row.start), (int)r->row.actual, r->row.outcome != SYNC_STOPPED);
+}
+
+// What the timer does at start: load the files, rebuild missing caches from the journal, replay the rest
+static void replica_start(Replica* rp) {
+    label_table_load(&rp->labels, rp->names_path, rp->totals_path);
+    int have_days = heatmap_days_load(&rp->days, rp->days_path), have_model = adapt_load(&rp->model, rp->model_path);
+    if (!have_days || !have_model) {
+        SyncJournal all;
+        memset(&all, 0, sizeof(all));
+        heatmap_days_free(&rp->days);
+        memset(&rp->model, 0, sizeof(rp->model));
+        uint32_t count = sync_journal_load(&all, rp->journal_path, rebuild_record, rp);
+        rp->days.synced = rp->model.synced = count;
+    }
+    rp->today_pomodoros = rp->saved_pomodoros;
+    rp->today_focus = rp->saved_focus;
+    rp->today_synced = rp->saved_synced;
+    rp->totals = (SyncTotals){&rp->labels, &rp->days, &rp->model, &rp->today_pomodoros, &rp->today_focus, &rp->today_synced};
+
+    memset(&rp->journal, 0, sizeof(rp->journal));
+    for (int m = 0; m < MACHINES; m++) {
+        if (rp->saved_offsets[m]) sync_peer(&rp->journal, segments[m].name)->offset = rp->saved_offsets[m];
+    }
+    uint32_t days_synced = rp->days.synced, model_synced = rp->model.synced;
+    rp->crash_in = -1;
+    sync_journal_load(&rp->journal, rp->journal_path, add_record, rp);
+    if (rp->days.synced != days_synced) heatmap_days_save(&rp->days, rp->days_path);
+    if (rp->model.synced != model_synced) adapt_save(&rp->model, rp->model_path);
+}
+
+static void replica_stop(Replica* rp) {
+    label_table_free(&rp->labels);
+    heatmap_days_free(&rp->days);
+}
+
+static void replica_init(Replica* rp) {
+    memset(rp, 0, sizeof(*rp));
+    snprintf(rp->dir, sizeof(rp->dir), "%s", test_temp_dir());
+    snprintf(rp->names_path, sizeof(rp->names_path), "%s/labels.txt", rp->dir);
+    snprintf(rp->totals_path, sizeof(rp->totals_path), "%s/totals.dat", rp->dir);
+    snprintf(rp->days_path, sizeof(rp->days_path), "%s/days.dat", rp->dir);
+    snprintf(rp->model_path, sizeof(rp->model_path), "%s/adapt.dat", rp->dir);
+    snprintf(rp->journal_path, sizeof(rp->journal_path), "%s/peers.csv", rp->dir);
+    replica_start(rp);
+}
+
+static void replica_remove(Replica* rp) {
+    replica_stop(rp);
+    remove(rp->names_path);
+    remove(rp->totals_path);
+    remove(rp->days_path);
+    remove(rp->model_path);
+    remove(rp->journal_path);
+    rmdir(rp->dir);
+}
+
+// One pass of the sync thread over the segments in a random order. With crash_odds, the replica
+// may die at any point of a merge and start over from its files.
+static void replica_sync(Replica* rp, unsigned* rng, unsigned crash_odds) {
+    int order[MACHINES];
+    for (int i = 0; i < MACHINES; i++) order[i] = i;
+    for (int i = MACHINES - 1; i > 0; i--) {
+        int k = (int)(test_rand(rng) % (unsigned)(i + 1)), t = order[i];
+        order[i] = order[k];
+        order[k] = t;
+    }
+    for (int i = 0; i < MACHINES; i++) {
+        Segment* s = &segments[order[i]];
+        SyncPeer* peer = sync_peer(&rp->journal, s->name);
+        // A stale offset only means lines that are read again
+        if (crash_odds && test_rand(rng) % 16 == 0) peer->offset = 0;
+        size_t offset = (size_t)peer->offset, end = s->written;
+        while (end > offset && s->text[end - 1] != '\n') end--;
+        if (end <= offset) continue;
+        char* buf = (char*)malloc(end - offset + 1);
+        memcpy(buf, s->text + offset, end - offset);
+        buf[end - offset] = '\0';
+
+        // Where it dies: 1 while adding the records, 2 before saving the day counts, 3 before saving
+        // the model, 4 before the sync state is saved, 5 in the middle of the journal append
+        int stage = crash_odds && test_rand(rng) % crash_odds == 0 ? 1 + (int)(test_rand(rng) % 5) : 0;
+        rp->crash_in = stage == 1 ? 1 + (int)(test_rand(rng) % 8) : stage == 5 ? 0 : -1;
+        long before = file_size(rp->journal_path);
+        int merged = sync_merge_tail(&rp->journal, peer, buf, add_record, rp);
+        free(buf);
+        CHECK(merged >= 0);
+        if (stage == 5) {
+            long after = file_size(rp->journal_path);
+            if (after > before && truncate(rp->journal_path, before + (long)(test_rand(rng) % (unsigned)(after - before)))) {
+                CHECK(0);
+            }
+        } else if (stage == 1 && rp->crash_in == 0) {
+            // Died after some of the records
+        } else {
+            rp->crash_in = -1;
+            if (stage == 1) stage = 0;
+            if (merged > 0 && stage != 2) heatmap_days_save(&rp->days, rp->days_path);
+            if (merged > 0 && stage != 2 && stage != 3) adapt_save(&rp->model, rp->model_path);
+            if (stage == 0 || stage == 4) peer->offset = (int64_t)end;
+        }
+        if (stage) {
+            rp->crashes++;
+            replica_stop(rp);
+            replica_start(rp);
+            return;
+        }
+    }
+    // The session state and the sync state are saved after the pass
+    rp->saved_pomodoros = rp->today_pomodoros;
+    rp->saved_focus = rp->today_focus;
+    rp->saved_synced = rp->today_synced;
+    for (int m = 0; m < MACHINES; m++) {
+        SyncPeer* peer = sync_peer(&rp->journal, segments[m].name);
+        rp->saved_offsets[m] = peer->offset;
+    }
+}
+
+static void check_seq_order(const SyncRecord* r, uint32_t number, void* context) {
+    (void)number;
+    int64_t* last = (int64_t*)context;
+    int m = atoi(r->machine + 3);
+    CHECK(m >= 0 && m < MACHINES && r->seq > last[m]);
+    if (m >= 0 && m < MACHINES) last[m] = r->seq;
+}
+
+static void model_record(const SyncRecord* r, uint32_t number, void* context) {
+    (void)number;
+    if (r->row.kind == SYNC_POMODORO) {
+        adapt_record((AdaptModel*)context, hour_of(r->row.start), (int)r->row.actual, r->row.outcome != SYNC_STOPPED);
+    }
+}
+
+// Every record is in every total once, and the model is the one a rebuild from the journal gives
+static void check_replica(Replica* rp) {
+    SyncJournal j;
+    int64_t last[MACHINES] = {0};
+    memset(&j, 0, sizeof(j));
+    CHECK(sync_journal_load(&j, rp->journal_path, check_seq_order, last) == ref_records);
+    for (int m = 0; m < MACHINES; m++) {
+        CHECK(sync_peer(&j, segments[m].name)->last_seq == sync_peer(&rp->journal, segments[m].name)->last_seq);
+    }
+
+    int days_ok = 1;
+    for (int d = 0; d < 16; d++) days_ok &= heatmap_days_get(&rp->days, TODAY - 8 + d) == ref_days[d];
+    CHECK(days_ok);
+    for (int l = 0; l < 6; l++) {
+        if (!names[l][0]) continue;
+        int id = label_find(&rp->labels, names[l]);
+        CHECK(id > 0 && rp->labels.totals[id - 1].count == ref_label_count[l] &&
+              rp->labels.totals[id - 1].total_seconds == ref_label_seconds[l]);
+    }
+    CHECK(rp->today_pomodoros == ref_today_pomodoros && rp->today_focus == ref_today_focus);
+
+    AdaptModel rebuilt;
+    memset(&rebuilt, 0, sizeof(rebuilt));
+    memset(&j, 0, sizeof(j));
+    sync_journal_load(&j, rp->journal_path, model_record, &rebuilt);
+    CHECK(memcmp(rebuilt.hours, rp->model.hours, sizeof(rebuilt.hours)) == 0);
+}
+
+static void test_random_merges(void) {
+    make_segments();
+    // Replicas see the same segments through different orders, read sizes and crashes
+    for (int run = 0; run < 4; run++) {
+        Replica* rp = (Replica*)malloc(sizeof(Replica));
+        unsigned rng = 100 + (unsigned)run;
+        unsigned crash_odds = run == 0 ? 0 : 3;
+        for (int m = 0; m < MACHINES; m++) segments[m].written = 0;
+        replica_init(rp);
+        for (int done = 0; !done;) {
+            done = 1;
+            for (int m = 0; m < MACHINES; m++) {
+                Segment* s = &segments[m];
+                s->written += test_rand(&rng) % 700; // cuts lines anywhere
+                if (s->written >= s->size) s->written = s->size;
+                else done = 0;
+            }
+            replica_sync(rp, &rng, crash_odds);
+        }
+        // Sync passes without crashes take the rest
+        for (int i = 0; i < 3; i++) replica_sync(rp, &rng, 0);
+        check_replica(rp);
+        printf("  %d machines, %u records, order %d: %d crashes\n", MACHINES, ref_records, run, rp->crashes);
+        if (crash_odds) CHECK(rp->crashes > 10);
+        // A start with everything merged adds nothing
+        replica_stop(rp);
+        replica_start(rp);
+        check_replica(rp);
+        // A lost day counts file is rebuilt from the journal
+        remove(rp->days_path);
+        replica_stop(rp);
+        replica_start(rp);
+        check_replica(rp);
+        replica_remove(rp);
+        free(rp);
+    }
+    for (int m = 0; m < MACHINES; m++) free(segments[m].text);
+}
+
+static void bench(void) {
+    // 32 machines with 2000 sessions each, merged in one pass, then the replay of a start
+    Replica* rp = (Replica*)malloc(sizeof(Replica));
+    replica_init(rp);
+    char name[16];
+    unsigned rng = 1;
+    size_t size = 2000 * 96;
+    char* text = (char*)malloc(size);
+    double merge = 0;
+    for (int m = 0; m < SYNC_MAX_PEERS; m++) {
+        size_t used = 0;
+        for (int i = 1; i <= 2000; i++) {
+            long long start = (long long)(TODAY - 300 + (int)(test_rand(&rng) % 301)) * 86400 + test_rand(&rng) % 86400;
+            used += (size_t)sprintf(text + used, "%d,%lld,pomodoro,1500,%d,%s,,%s\n", i * 50, start, 1500,
+                                    test_rand(&rng) % 4 ? "completed" : "stopped", names[test_rand(&rng) % 6]);
+        }
+        snprintf(name, sizeof(name), "bench-%02d", m);
+        SyncPeer* peer = sync_peer(&rp->journal, name);
+        double t0 = test_now();
+        int merged = sync_merge_tail(&rp->journal, peer, text, add_record, rp);
+        heatmap_days_save(&rp->days, rp->days_path);
+        adapt_save(&rp->model, rp->model_path);
+        merge += test_now() - t0;
+        CHECK(merged == 2000);
+    }
+    uint32_t records = rp->journal.count;
+    printf("merge: %u records from %d machines in %.1f ms (%.2f us per record, journal %ld KB)\n", records, SYNC_MAX_PEERS,
+           merge * 1e3, merge * 1e6 / records, file_size(rp->journal_path) / 1024);
+
+    replica_stop(rp);
+    double t0 = test_now();
+    replica_start(rp);
+    double t1 = test_now();
+    printf("start: journal of %u records read and checked against the totals in %.1f ms\n", rp->journal.count, (t1 - t0) * 1e3);
+    rp->saved_synced = 0;
+    replica_stop(rp);
+    remove(rp->days_path);
+    t0 = test_now();
+    replica_start(rp);
+    t1 = test_now();
+    printf("start: day counts and model rebuilt and today replayed from %u records in %.1f ms\n", rp->journal.count,
+           (t1 - t0) * 1e3);
+    free(text);
+    replica_remove(rp);
+    free(rp);
+}
+
+int main(int argc, char** argv) {
+    if (test_bench_mode(argc, argv)) {
+        bench();
+        return 0;
+    }
+    test_parse();
+    test_journal();
+    test_random_merges();
+    return test_done("sync_test");
+}
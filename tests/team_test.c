@@ -0,0 +1,459 @@
+// Team channel: commands and phases, the epoll daemon with real unix socket subscribers, coalescing
+// and backpressure for a subscriber that does not read, stopping the daemon, and a load generator
+// that measures the fan-out latency of a change at 1k and 10k subscribers.
+#include <fcntl.h>
+#include <pthread.h>
+#include <signal.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include "pomodoro-team.h"
+#include "test.h"
+
+static char sock_path[96];
+
+static TeamCommand command(uint32_t what) {
+    TeamCommand c = {TEAM_COMMAND_MAGIC, what, 25, 5, 15, 4};
+    return c;
+}
+
+static void test_commands(void) {
+    TeamHub hub;
+    team_hub_init(&hub);
+    TeamState s = hub.state;
+    int kind, seconds, completed;
+    int64_t phase_start;
+    TeamCommand c = command(TEAM_CMD_PAUSE);
+    CHECK(!team_state_apply(&s, &c, 1000)); // nothing to pause while stopped
+    CHECK(!team_phase_at(&s, 1000, &kind, &phase_start, &seconds, &completed));
+
+    c = command(TEAM_CMD_START);
+    CHECK(team_state_apply(&s, &c, 1000) && s.start == 1000 && s.paused_at == 0);
+    CHECK(team_phase_at(&s, 1000, &kind, &phase_start, &seconds, &completed));
+    CHECK(kind == TEAM_POMODORO && phase_start == 1000 && seconds == 25 * 60 && completed == 0);
+    // Fourth Pomodoro, then the long break; the next cycle starts after 4 * 25 + 3 * 5 + 15 minutes
+    CHECK(team_phase_at(&s, 1000 + 3 * 30 * 60, &kind, &phase_start, &seconds, &completed));
+    CHECK(kind == TEAM_POMODORO && completed == 3);
+    CHECK(team_phase_at(&s, 1000 + (4 * 25 + 3 * 5) * 60, &kind, &phase_start, &seconds, &completed));
+    CHECK(kind == TEAM_LONG_BREAK && seconds == 15 * 60 && completed == 4);
+    CHECK(team_phase_at(&s, 1000 + 130 * 60 + 26 * 60, &kind, &phase_start, &seconds, &completed));
+    CHECK(kind == TEAM_SHORT_BREAK && phase_start == 1000 + 130 * 60 + 25 * 60 && completed == 1);
+    // A subscriber wakes up at the end of each phase and at no other time
+    CHECK(team_next_change(&s, 999) == 1000 && team_next_change(&s, 1000) == 1000 + 25 * 60);
+    CHECK(team_next_change(&s, 1000 + 25 * 60) == 1000 + 30 * 60);
+    CHECK(team_next_change(&s, 1000 + (4 * 25 + 3 * 5) * 60) == 1000 + 130 * 60);
+    int64_t t = 1000, changes = 0;
+    while (t < 1000 + 2 * 130 * 60) {
+        int64_t next = team_next_change(&s, t);
+        CHECK(next > t && team_phase_at(&s, next - 1, &kind, &phase_start, &seconds, &completed));
+        CHECK(phase_start + seconds == next);
+        t = next;
+        changes++;
+    }
+    CHECK(changes == 16);
+
+    c = command(TEAM_CMD_PAUSE);
+    CHECK(team_state_apply(&s, &c, 1600) && s.paused_at == 1600);
+    CHECK(!team_state_apply(&s, &c, 1700));
+    CHECK(!team_phase_at(&s, 1700, &kind, &phase_start, &seconds, &completed));
+    CHECK(team_next_change(&s, 1700) == 0);
+    // Resuming shifts the schedule by the pause, so the Pomodoro continues with 15 minutes left
+    c = command(TEAM_CMD_RESUME);
+    CHECK(team_state_apply(&s, &c, 2600) && s.start == 2000 && s.paused_at == 0);
+    CHECK(!team_state_apply(&s, &c, 2700));
+    CHECK(team_phase_at(&s, 2600, &kind, &phase_start, &seconds, &completed));
+    CHECK(kind == TEAM_POMODORO && phase_start + seconds - 2600 == 15 * 60);
+
+    c = command(TEAM_CMD_STOP);
+    CHECK(team_state_apply(&s, &c, 3000) && s.start == 0);
+    CHECK(!team_state_apply(&s, &c, 3000));
+    CHECK(team_next_change(&s, 3000) == 0);
+
+    // Commands that are not valid change nothing
+    TeamState before = s;
+    c = command(TEAM_CMD_START);
+    c.pomodoro_duration = 0;
+    CHECK(!team_state_apply(&s, &c, 4000));
+    c = command(TEAM_CMD_START);
+    c.long_break_every = 5;
+    CHECK(!team_state_apply(&s, &c, 4000));
+    c = command(TEAM_CMD_START);
+    c.magic = 0;
+    CHECK(!team_state_apply(&s, &c, 4000));
+    c = command(99);
+    CHECK(!team_state_apply(&s, &c, 4000));
+    CHECK(memcmp(&before, &s, sizeof(s)) == 0);
+    CHECK(team_state_valid(&s));
+    s.long_break_every = 0;
+    CHECK(!team_state_valid(&s));
+}
+
+// Poll the daemon until a client has a whole state to read, then read it
+static int receive(TeamServer* srv, int fd, TeamState* out) {
+    for (int i = 0; i < 100 && !team_wait_readable(fd, 0); i++) team_server_poll(srv, 10);
+    return team_wait_readable(fd, 0) && team_receive(fd, out);
+}
+
+static void test_daemon(void) {
+    TeamServer srv;
+    CHECK(team_server_open(&srv, sock_path));
+    TeamServer other;
+    CHECK(!team_server_open(&other, sock_path)); // the path is served
+    team_hub_free(&other.hub);
+
+    // A new subscriber gets the current state at once
+    int fds[3];
+    TeamState st;
+    for (int i = 0; i < 3; i++) {
+        fds[i] = team_connect(sock_path);
+        CHECK(fds[i] >= 0);
+        CHECK(receive(&srv, fds[i], &st) && st.seq == 1 && st.start == 0);
+    }
+    CHECK(srv.hub.count == 3);
+
+    // A command from one is pushed to all, the sender included
+    TeamCommand c = command(TEAM_CMD_START);
+    CHECK(team_send(fds[1], &c));
+    for (int i = 0; i < 3; i++) {
+        CHECK(receive(&srv, fds[i], &st) && st.seq == 2 && st.start > 0 && st.paused_at == 0);
+    }
+    // A command that changes nothing is not published
+    c = command(TEAM_CMD_PAUSE);
+    CHECK(team_send(fds[0], &c) && team_send(fds[0], &c));
+    for (int i = 0; i < 3; i++) CHECK(receive(&srv, fds[i], &st) && st.seq == 3 && st.paused_at > 0);
+    team_server_poll(&srv, 10);
+    CHECK(!team_wait_readable(fds[0], 20));
+
+    // A command split across writes still counts
+    c = command(TEAM_CMD_RESUME);
+    CHECK(send(fds[2], &c, 5, 0) == 5);
+    team_server_poll(&srv, 10);
+    CHECK(!team_wait_readable(fds[0], 0));
+    CHECK(send(fds[2], (char*)&c + 5, sizeof(c) - 5, 0) == (ssize_t)(sizeof(c) - 5));
+    for (int i = 0; i < 3; i++) CHECK(receive(&srv, fds[i], &st) && st.seq == 4 && st.start > 0 && st.paused_at == 0);
+
+    // Hang-ups and garbage drop the subscriber, and the others are not affected
+    close(fds[0]);
+    uint32_t garbage[4] = {0x12345678, 1, 2, 3};
+    CHECK(send(fds[2], garbage, sizeof(garbage), 0) == sizeof(garbage));
+    for (int i = 0; i < 10 && srv.hub.count > 1; i++) team_server_poll(&srv, 10);
+    CHECK(srv.hub.count == 1);
+    CHECK(recv(fds[2], &st, sizeof(st), 0) == 0);
+    close(fds[2]);
+    c = command(TEAM_CMD_STOP);
+    CHECK(team_send(fds[1], &c));
+    CHECK(receive(&srv, fds[1], &st) && st.seq == 5 && st.start == 0);
+    close(fds[1]);
+    team_server_close(&srv);
+
+    // A socket left behind by a daemon that is gone is replaced
+    int stale = socket(AF_UNIX, SOCK_STREAM, 0);
+    struct sockaddr_un addr = {0};
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, sock_path);
+    CHECK(bind(stale, (struct sockaddr*)&addr, sizeof(addr)) == 0);
+    close(stale);
+    CHECK(team_server_open(&srv, sock_path));
+    int fd = team_connect(sock_path);
+    CHECK(fd >= 0 && receive(&srv, fd, &st) && st.seq == 1);
+    close(fd);
+    team_server_close(&srv);
+    CHECK(team_connect(sock_path) < 0);
+}
+
+static void* stop_later(void* arg) {
+    usleep(100000);
+    team_server_stop((TeamServer*)arg);
+    return NULL;
+}
+
+// The daemon sleeps until there is something to do, and stops when told to from another thread or
+// by a TEAM_CMD_SHUTDOWN from any connection; subscribers see the connection close
+static void test_stop(void) {
+    TeamServer srv;
+    CHECK(team_server_open(&srv, sock_path));
+    int fd = team_connect(sock_path);
+    TeamState st;
+    CHECK(fd >= 0 && receive(&srv, fd, &st));
+    while (team_server_poll(&srv, 0) > 0) {
+    }
+
+    pthread_t thread;
+    pthread_create(&thread, NULL, stop_later, &srv);
+    int polls = 0, r;
+    double begin = test_now();
+    while ((r = team_server_poll(&srv, -1)) >= 0) polls++;
+    double elapsed = test_now() - begin;
+    pthread_join(thread, NULL);
+    CHECK(polls == 0 && elapsed >= 0.09 && elapsed < 2); // one wait, no wakeups before the stop
+    CHECK(team_server_poll(&srv, -1) < 0);
+    team_server_close(&srv);
+    CHECK(recv(fd, &st, sizeof(st), 0) == 0);
+    close(fd);
+
+    CHECK(team_server_open(&srv, sock_path));
+    int fds[2];
+    for (int i = 0; i < 2; i++) {
+        fds[i] = team_connect(sock_path);
+        CHECK(fds[i] >= 0 && receive(&srv, fds[i], &st) && st.seq == 1);
+    }
+    TeamCommand c = command(TEAM_CMD_SHUTDOWN);
+    CHECK(team_send(fds[0], &c));
+    polls = 0;
+    while (polls < 100 && team_server_poll(&srv, 1000) >= 0) polls++;
+    CHECK(polls < 100 && srv.hub.shutdown && srv.hub.state.seq == 1);
+    // The other one was waiting for a change, or a stop, and sees the daemon go
+    TeamReader reader = {fds[1], 0, {0}};
+    CHECK(team_reader_wait(&reader, -1, 0, &st) == 0);
+    team_server_close(&srv);
+    CHECK(recv(fds[0], &st, sizeof(st), 0) == 0 && team_reader_wait(&reader, -1, 1000, &st) < 0);
+    close(fds[0]);
+    team_reader_close(&reader);
+    CHECK(team_connect(sock_path) < 0);
+
+    // A subscriber's reader: the state on connect, nothing until a change, then the change, and a stop
+    CHECK(team_server_open(&srv, sock_path));
+    int stop = eventfd(0, EFD_CLOEXEC);
+    CHECK(team_reader_open(&reader, sock_path));
+    for (int i = 0; i < 100 && team_reader_wait(&reader, stop, 0, &st) == 0; i++) team_server_poll(&srv, 10);
+    CHECK(st.seq == 1);
+    CHECK(team_reader_wait(&reader, stop, 20, &st) == 0);
+    c = command(TEAM_CMD_START);
+    CHECK(team_state_apply(&srv.hub.state, &c, 1000));
+    team_hub_publish(&srv.hub);
+    CHECK(team_reader_wait(&reader, stop, 1000, &st) == 1 && st.seq == 2 && st.start == 1000);
+    uint64_t one = 1;
+    CHECK(write(stop, &one, sizeof(one)) == sizeof(one));
+    CHECK(team_reader_wait(&reader, stop, -1, &st) < 0);
+    team_reader_close(&reader);
+    close(stop);
+    team_server_close(&srv);
+}
+
+// A subscriber that stops reading: publishing never blocks, its backlog is bounded by its socket
+// buffer, and when it reads again it catches up to the latest state with the rest coalesced away
+static void test_slow_subscriber(void) {
+    TeamServer srv;
+    CHECK(team_server_open(&srv, sock_path));
+    int slow = team_connect(sock_path), fast = team_connect(sock_path);
+    int buf = 4096;
+    setsockopt(slow, SOL_SOCKET, SO_RCVBUF, &buf, sizeof(buf));
+    TeamState st;
+    CHECK(receive(&srv, slow, &st) && receive(&srv, fast, &st));
+    CHECK(srv.hub.count == 2);
+    setsockopt(srv.hub.subs[0]->handle, SOL_SOCKET, SO_SNDBUF, &buf, sizeof(buf));
+
+    const int changes = 100000;
+    int fast_seen = 0;
+    double begin = test_now();
+    for (int i = 0; i < changes; i++) {
+        TeamCommand c = command(i % 2 ? TEAM_CMD_STOP : TEAM_CMD_START);
+        team_state_apply(&srv.hub.state, &c, 1000 + i);
+        team_hub_publish(&srv.hub);
+        if (i % 64 == 63) {
+            team_server_poll(&srv, 0);
+            while (team_wait_readable(fast, 0) && team_receive(fast, &st)) fast_seen++;
+        }
+    }
+    double elapsed = test_now() - begin;
+    CHECK(elapsed < 5); // not held up by the slow one
+    CHECK(srv.hub.subs[0]->blocked && srv.hub.blocked > 0);
+
+    // The fast one saw everything but what was published while it was full
+    uint32_t latest = srv.hub.state.seq;
+    for (int i = 0; i < 100; i++) {
+        team_server_poll(&srv, 0);
+        while (team_wait_readable(fast, 0) && team_receive(fast, &st)) fast_seen++;
+        if (st.seq == latest) break;
+    }
+    CHECK(st.seq == latest);
+    CHECK(fast_seen > changes / 2);
+
+    int slow_seen = 0;
+    st.seq = 0;
+    for (int i = 0; i < 1000 && st.seq != latest; i++) {
+        while (team_wait_readable(slow, 0) && team_receive(slow, &st)) slow_seen++;
+        team_server_poll(&srv, 1);
+    }
+    CHECK(st.seq == latest && st.start == 0);
+    CHECK(slow_seen < changes / 10);
+    CHECK(srv.hub.coalesced > (uint64_t)changes / 2);
+    CHECK(!srv.hub.subs[0]->blocked);
+    close(slow);
+    close(fast);
+    team_server_close(&srv);
+}
+
+// Load generator: N subscribers in a child process; one of them sends a command and the rest wait
+// for the change. Latency is from the send to the time each subscriber has read the new state.
+typedef struct {
+    int fd;
+    uint32_t seq;
+    uint8_t len;
+    uint8_t buf[sizeof(TeamState)];
+} Client;
+
+static int compare_double(const void* a, const void* b) {
+    double x = *(const double*)a, y = *(const double*)b;
+    return x < y ? -1 : x > y;
+}
+
+// Read what arrived for a client; returns 1 once it has a state newer than seq
+static int client_read(Client* c, uint32_t seq) {
+    for (;;) {
+        ssize_t n = recv(c->fd, c->buf + c->len, sizeof(c->buf) - c->len, 0);
+        if (n <= 0) break;
+        c->len += (uint8_t)n;
+        if (c->len == sizeof(c->buf)) {
+            TeamState st;
+            memcpy(&st, c->buf, sizeof(st));
+            c->seq = st.seq;
+            c->len = 0;
+        }
+    }
+    return c->seq > seq;
+}
+
+static int load_generator(int n, int rounds) {
+    Client* clients = (Client*)calloc(n, sizeof(Client));
+    int ep = epoll_create1(0);
+    for (int i = 0; i < n; i++) {
+        clients[i].fd = team_connect(sock_path);
+        if (clients[i].fd < 0) {
+            fprintf(stderr, "cannot connect subscriber %d\n", i);
+            return 1;
+        }
+        fcntl(clients[i].fd, F_SETFL, O_NONBLOCK);
+        struct epoll_event ev = {EPOLLIN, {.ptr = &clients[i]}};
+        epoll_ctl(ep, EPOLL_CTL_ADD, clients[i].fd, &ev);
+    }
+    double* latency = (double*)malloc(sizeof(double) * n * rounds);
+    double* last = (double*)malloc(sizeof(double) * rounds);
+    struct epoll_event* events = (struct epoll_event*)malloc(sizeof(struct epoll_event) * n);
+    int samples = 0;
+    for (int r = -1; r < rounds; r++) {
+        // Round -1 waits for the state every subscriber gets when it connects
+        uint32_t seq = clients[0].seq;
+        double begin = test_now();
+        if (r >= 0) {
+            TeamCommand c = command(r == 0 ? TEAM_CMD_START : r % 2 ? TEAM_CMD_PAUSE : TEAM_CMD_RESUME);
+            fcntl(clients[0].fd, F_SETFL, 0);
+            team_send(clients[0].fd, &c);
+            fcntl(clients[0].fd, F_SETFL, O_NONBLOCK);
+        }
+        int waiting = n;
+        while (waiting) {
+            int k = epoll_wait(ep, events, n, 5000);
+            if (k <= 0) {
+                fprintf(stderr, "%d subscribers did not get the change\n", waiting);
+                return 1;
+            }
+            double now = test_now();
+            for (int i = 0; i < k; i++) {
+                Client* c = (Client*)events[i].data.ptr;
+                uint32_t had = c->seq;
+                if (had > seq) continue;
+                if (client_read(c, seq)) {
+                    if (r >= 0) latency[samples++] = now - begin;
+                    waiting--;
+                }
+            }
+        }
+        if (r >= 0) last[r] = test_now() - begin;
+    }
+    qsort(latency, samples, sizeof(double), compare_double);
+    qsort(last, rounds, sizeof(double), compare_double);
+    printf("team fan-out %5d subscribers  p50 %7.2f ms  p99 %7.2f ms  all %7.2f ms median, %7.2f ms worst  (%d changes)\n", n,
+           latency[samples / 2] * 1e3, latency[samples * 99 / 100] * 1e3, last[rounds / 2] * 1e3, last[rounds - 1] * 1e3, rounds);
+    for (int i = 0; i < n; i++) close(clients[i].fd);
+    free(events);
+    free(last);
+    free(latency);
+    free(clients);
+    return 0;
+}
+
+static void bench_fan_out(int n, int rounds) {
+    TeamServer srv;
+    if (!team_server_open(&srv, sock_path)) {
+        fprintf(stderr, "cannot serve %s\n", sock_path);
+        return;
+    }
+    fflush(stdout);
+    pid_t child = fork();
+    if (child == 0) {
+        close(srv.listener);
+        close(srv.epoll);
+        int result = load_generator(n, rounds);
+        fflush(stdout);
+        _exit(result);
+    }
+    int status = 0;
+    uint64_t polls = 0;
+    while (waitpid(child, &status, WNOHANG) == 0) {
+        team_server_poll(&srv, 100);
+        polls++;
+    }
+    if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) fprintf(stderr, "the load generator failed\n");
+    printf("team daemon  %5d subscribers  %llu published, %llu sent, %llu coalesced, %llu blocked writes, %zu bytes per subscriber\n", n,
+           (unsigned long long)srv.hub.published, (unsigned long long)srv.hub.sent, (unsigned long long)srv.hub.coalesced,
+           (unsigned long long)srv.hub.blocked, sizeof(TeamSubscriber) + sizeof(TeamSubscriber*));
+    team_server_close(&srv);
+}
+
+// Publishing alone, to subscribers that read nothing: the cost of one change in the daemon.
+// The subscribers are held by a child that waits until the pipe to it is closed.
+static void bench_publish(int n) {
+    TeamServer srv;
+    team_server_open(&srv, sock_path);
+    int done[2];
+    if (pipe(done) != 0) return;
+    fflush(stdout);
+    pid_t child = fork();
+    if (child == 0) {
+        close(done[1]);
+        for (int i = 0; i < n; i++) {
+            if (team_connect(sock_path) < 0) _exit(1);
+        }
+        char c;
+        _exit(read(done[0], &c, 1) == 0 ? 0 : 1);
+    }
+    close(done[0]);
+    while (srv.hub.count < (uint32_t)n) team_server_poll(&srv, 10);
+    int rounds = 20;
+    double begin = test_now();
+    for (int r = 0; r < rounds; r++) {
+        TeamCommand c = command(r % 2 ? TEAM_CMD_STOP : TEAM_CMD_START);
+        team_state_apply(&srv.hub.state, &c, 1000 + r);
+        team_hub_publish(&srv.hub);
+    }
+    double elapsed = (test_now() - begin) / rounds;
+    printf("team publish %5d subscribers  %7.2f ms per change, %.2f us per subscriber\n", n, elapsed * 1e3, elapsed * 1e6 / n);
+    close(done[1]);
+    waitpid(child, NULL, 0);
+    team_server_close(&srv);
+}
+
+int main(int argc, char** argv) {
+    const char* dir = test_temp_dir();
+    snprintf(sock_path, sizeof(sock_path), "%s/team.sock", dir);
+    signal(SIGPIPE, SIG_IGN);
+    if (test_bench_mode(argc, argv)) {
+        // The daemon and the load generator each hold one end of every connection
+        struct rlimit lim;
+        getrlimit(RLIMIT_NOFILE, &lim);
+        lim.rlim_cur = lim.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &lim);
+        bench_fan_out(1000, 50);
+        bench_fan_out(10000, 20);
+        bench_publish(1000);
+        bench_publish(10000);
+    } else {
+        test_commands();
+        test_daemon();
+        test_stop();
+        test_slow_subscriber();
+    }
+    unlink(sock_path);
+    rmdir(dir);
+    return test_bench_mode(argc, argv) ? 0 : test_done("team_test");
+}
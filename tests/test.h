@@ -0,0 +1,59 @@
+// Shared helpers of the Linux tests and benchmarks
+//
+// Each program runs its tests and exits non-zero if any check failed; with
+// --bench it runs its benchmarks instead and prints one line per measurement.
+#ifndef POMODORO_TEST_H
+#define POMODORO_TEST_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+static int test_failures = 0;
+
+#define CHECK(cond)                                                          \
+    do {                                                                     \
+        if (!(cond)) {                                                       \
+            fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+            test_failures++;                                                 \
+        }                                                                    \
+    } while (0)
+
+static inline double test_now(void) {
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return (double)t.tv_sec + (double)t.tv_nsec / 1e9;
+}
+
+static inline int test_bench_mode(int argc, char** argv) {
+    return argc > 1 && strcmp(argv[1], "--bench") == 0;
+}
+
+// Deterministic pseudo-random numbers, so runs are comparable
+static inline unsigned test_rand(unsigned* state) {
+    *state = *state * 1103515245u + 12345u;
+    return *state >> 8;
+}
+
+// Make a fresh temporary folder and return its path
+static inline const char* test_temp_dir(void) {
+    static char dir[64];
+    snprintf(dir, sizeof(dir), "/tmp/pomodoro-test-XXXXXX");
+    if (!mkdtemp(dir)) {
+        perror("mkdtemp");
+        exit(2);
+    }
+    return dir;
+}
+
+static inline int test_done(const char* name) {
+    if (test_failures) {
+        fprintf(stderr, "%s: %d checks failed\n", name, test_failures);
+        return 1;
+    }
+    printf("%s: ok\n", name);
+    return 0;
+}
+
+#endif
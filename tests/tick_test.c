@@ -0,0 +1,192 @@
+// The portable parts of the once-per-second tray update, as --tick-benchmark runs them on
+// Windows: formatting the display text and tooltip, the icon cache check, drawing an icon from
+// the sprites and publishing the status. The C library calls stand in for the Windows ones
+// (swprintf for _itow), and wchar_t is 4 bytes here instead of 2. Allocations are counted by
+// wrapping malloc, so the allocs/op column counts calls, not memory growth.
+#include <sys/mman.h>
+#include <wchar.h>
+#include "pomodoro-sprites.h"
+#include "pomodoro-status.h"
+#include "test.h"
+
+static long allocations = 0;
+
+extern void* __libc_malloc(size_t size);
+extern void* __libc_calloc(size_t count, size_t size);
+extern void* __libc_realloc(void* p, size_t size);
+
+void* malloc(size_t size) {
+    allocations++;
+    return __libc_malloc(size);
+}
+
+void* calloc(size_t count, size_t size) {
+    allocations++;
+    return __libc_calloc(count, size);
+}
+
+void* realloc(void* p, size_t size) {
+    allocations++;
+    return __libc_realloc(p, size);
+}
+
+#define TIP_CHARS 128 // NOTIFYICONDATAW.szTip
+
+static SpriteSet sprites;
+static const SpriteSize* sprite32;
+static uint32_t palette[256];
+static uint32_t pixels[SPRITE_MAX_SIZE * SPRITE_MAX_SIZE];
+static uint8_t mask[SPRITE_MAX_SIZE * SPRITE_MAX_SIZE / 8];
+static wchar_t tip[TIP_CHARS], last_text[16] = L"24";
+static int last_dots = 2;
+static volatile PomodoroStatus* segment;
+
+static void display_text(int seconds, wchar_t text[16]) {
+    swprintf(text, 16, L"%d", seconds < 60 ? seconds : seconds / 60);
+}
+
+static void tooltip(int seconds) {
+    wchar_t buf[128];
+    swprintf(buf, 128, L"%02d:%02d", seconds / 60, seconds % 60);
+    wcsncpy(tip, buf, TIP_CHARS - 1);
+    tip[TIP_CHARS - 1] = L'\0';
+}
+
+static int cache_hit(const wchar_t* text, int dots) {
+    return wcscmp(text, last_text) == 0 && dots == last_dots;
+}
+
+static int render(const wchar_t* text, int dots) {
+    return sprite_draw(&sprites, sprite32, sprite_face(text), dots, palette, pixels, mask, 4);
+}
+
+static void publish(int seconds) {
+    PomodoroStatus s = {0};
+    s.running = 1;
+    s.pomodoro_count = 2;
+    s.planned_seconds = 1500;
+    s.deadline = 1700000000 + seconds;
+    s.start_time = 1700000000 - (1500 - seconds);
+    pomodoro_status_publish(segment, &s);
+}
+
+// A 25 minute countdown: the icon changes once a minute and every second of the last one
+static void end_to_end(int seconds) {
+    wchar_t text[16];
+    display_text(seconds, text);
+    tooltip(seconds);
+    if (!cache_hit(text, 2)) {
+        render(text, 2);
+        wcscpy(last_text, text);
+        last_dots = 2;
+    }
+    publish(seconds);
+}
+
+static int load_sprites(void) {
+    static uint8_t data[1 << 20];
+    FILE* fp = fopen("../pomodoro-sprites.bin", "rb");
+    if (!fp) return 0;
+    size_t size = fread(data, 1, sizeof(data), fp);
+    fclose(fp);
+    if (!sprites_open(&sprites, data, size) || !(sprite32 = sprite_size(&sprites, 32))) return 0;
+    sprite_palette(palette, 0x8B0000);
+    segment = (volatile PomodoroStatus*)mmap(NULL, sizeof(PomodoroStatus), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    return segment != MAP_FAILED;
+}
+
+static void test_stages(void) {
+    wchar_t text[16];
+    display_text(1499, text);
+    CHECK(wcscmp(text, L"24") == 0);
+    display_text(42, text);
+    CHECK(wcscmp(text, L"42") == 0);
+    tooltip(1499);
+    CHECK(wcscmp(tip, L"24:59") == 0);
+    CHECK(cache_hit(L"24", 2) && !cache_hit(L"24", 3) && !cache_hit(L"23", 2));
+
+    // Every pixel of a drawn icon is background exactly where the mask says so
+    CHECK(render(L"24", 2));
+    int mismatched = 0;
+    for (int y = 0; y < 32; y++) {
+        for (int x = 0; x < 32; x++) {
+            int masked = mask[y * 4 + x / 8] >> (7 - x % 8) & 1;
+            mismatched += masked && pixels[y * 32 + x] != 0x8B0000;
+        }
+    }
+    CHECK(mismatched == 0);
+    CHECK(!render(L"121", 2) && !render(L"24", 5));
+
+    allocations = 0;
+    free(malloc(16)); // the counter works
+    CHECK(allocations == 1);
+    allocations = 0;
+    for (int s = 1500; s > 0; s--) end_to_end(s);
+    CHECK(allocations == 0);
+    PomodoroStatus read;
+    CHECK(pomodoro_status_read(segment, &read) && read.deadline == 1700000001 && read.seq == 3000);
+}
+
+typedef void (*Stage)(int i);
+
+static void stage_display_text(int i) {
+    wchar_t text[16];
+    display_text(1500 - i % 1500, text);
+}
+
+static void stage_tooltip(int i) {
+    tooltip(1500 - i % 1500);
+}
+
+static volatile int sink;
+
+static void stage_cache_hit(int i) {
+    (void)i;
+    sink += cache_hit(L"24", 2);
+}
+
+static void stage_render(int i) {
+    render(i & 1 ? L"24" : L"23", 2);
+}
+
+static void stage_publish(int i) {
+    publish(1500 - i % 1500);
+}
+
+static void stage_end_to_end(int i) {
+    end_to_end(1500 - i % 1500);
+}
+
+// Run a stage in growing batches until it has taken at least 200 ms
+static void bench_stage(const char* name, Stage stage) {
+    for (int i = 0; i < 100; i++) stage(i);
+    long long calls = 0;
+    double elapsed = 0;
+    allocations = 0;
+    for (int batch = 100; elapsed < 0.2; batch *= 2) {
+        double begin = test_now();
+        for (int i = 0; i < batch; i++) stage((int)(calls + i));
+        elapsed += test_now() - begin;
+        calls += batch;
+    }
+    printf("tick %-16s %10lld calls %8.1f ns/op  %6.3f allocs/op\n", name, calls, elapsed * 1e9 / calls,
+           (double)allocations / calls);
+}
+
+int main(int argc, char** argv) {
+    if (!load_sprites()) {
+        fprintf(stderr, "Cannot load ../pomodoro-sprites.bin\n");
+        return 1;
+    }
+    if (test_bench_mode(argc, argv)) {
+        bench_stage("display text", stage_display_text);
+        bench_stage("tooltip format", stage_tooltip);
+        bench_stage("icon cache hit", stage_cache_hit);
+        bench_stage("icon render", stage_render);
+        bench_stage("state publish", stage_publish);
+        bench_stage("end to end", stage_end_to_end);
+        return 0;
+    }
+    test_stages();
+    return test_done("tick_test");
+}